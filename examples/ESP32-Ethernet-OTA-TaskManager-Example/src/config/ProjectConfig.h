@@ -61,7 +61,7 @@
 #define PRIORITY_SENSOR_TASK 3
 
 // Task Intervals
-#define OTA_TASK_INTERVAL_MS 250
+#define OTA_TASK_INTERVAL_MS 250  // Longest OTA task wait; shorter when handleUpdates() asks
 #define MONITORING_TASK_INTERVAL_MS 5000
 #define SENSOR_TASK_INTERVAL_MS 1000
 
@@ -1,6 +1,7 @@
 // MonitoringTask.cpp
 #include "../tasks/MonitoringTask.h"
 
+#include <OTAManager.h>
 #include <SemaphoreGuard.h>
 #include <TaskManager.h>
 #include <esp_system.h>
@@ -108,6 +109,13 @@ void MonitoringTask::logSystemHealth() {
     LOG_INFO(LOG_TAG_MONITORING, "  Min Free Heap: %lu bytes", minFreeHeap);
     LOG_INFO(LOG_TAG_MONITORING, "  Chip: ID=0x%08lX, Rev=%u", chipId, chipRev);
 
+    // OTA counters are relaxed atomics: reading them never waits for a running update
+    OTAStats ota = OTAManager::getStats();
+    LOG_INFO(LOG_TAG_MONITORING, "  OTA: %lu sessions (%lu ok, %lu failed)%s, last %lu B/s, peak %lu B/s",
+             (unsigned long)ota.sessionsStarted, (unsigned long)ota.sessionsCompleted,
+             (unsigned long)ota.sessionsFailed, ota.sessionActive ? ", one running" : "",
+             (unsigned long)ota.lastThroughput, (unsigned long)ota.peakThroughput);
+
 #ifdef CONFIG_FREERTOS_USE_STATS_FORMATTING_FUNCTIONS
     char* taskStatusBuffer = (char*)malloc(2048);
     if (taskStatusBuffer) {
@@ -47,6 +47,9 @@ bool OTATask::init() {
     OTAManager::setProgressCallback(onOTAProgress);
     OTAManager::setErrorCallback(onOTAError);
 
+    // Sensor readings pause for every update session and resume however it ends
+    SensorTask::registerForOTA();
+
     LOG_INFO(LOG_TAG_OTA, "OTA task initialized successfully");
     return true;
 }
@@ -97,7 +100,7 @@ void OTATask::taskFunction(void* pvParameters) {
 
         // Always try to handle OTA updates - OTAManager will check network internally
         // This ensures OTA can recover if network reconnects
-        OTAManager::handleUpdates();
+        uint32_t recommendedDelayMs = OTAManager::handleUpdates();
         
         // Check network status for LED indication
         bool currentNetworkState = isNetworkConnected();
@@ -154,8 +157,15 @@ void OTATask::taskFunction(void* pvParameters) {
 #endif
         }
 
-        // Use configured interval for consistent timing
-        vTaskDelay(pdMS_TO_TICKS(OTA_TASK_INTERVAL_MS));
+        // Follow OTAManager's recommendation (short during an update, longer while
+        // idle), but keep the LED and status checks at least this frequent
+        uint32_t delayMs = recommendedDelayMs < OTA_TASK_INTERVAL_MS ? recommendedDelayMs
+                                                                     : OTA_TASK_INTERVAL_MS;
+        if (delayMs == 0) {
+            taskYIELD();
+        } else {
+            vTaskDelay(pdMS_TO_TICKS(delayMs));
+        }
         esp_task_wdt_reset();
     }
 }
@@ -177,9 +187,6 @@ void OTATask::onOTAStart() {
     // Set LED to fast blink during update
     StatusLed::setBlink(100);
 #endif
-
-    // Notify the sensor task to suspend operations during update
-    SensorTask::suspend();
 }
 
 void OTATask::onOTAEnd() {
@@ -245,9 +252,6 @@ void OTATask::onOTAError(ota_error_t error) {
         otaUpdateInProgress = false;
     }
 
-    // Resume any suspended operations
-    SensorTask::resume();
-
 #ifdef ENABLE_STATUS_LED
     // Indicate error with LED pattern - 5 quick blinks
     StatusLed::setPattern(5, 100, 1500);
@@ -1,6 +1,7 @@
 // SensorTask.cpp
 #include "../tasks/SensorTask.h"
 
+#include <OTAManager.h>
 #include <SemaphoreGuard.h>
 #include <TaskManager.h>  // Add this include
 
@@ -12,6 +13,8 @@ SemaphoreHandle_t SensorTask::dataMutex = nullptr;
 float SensorTask::temperature = 0.0f;
 float SensorTask::humidity = 0.0f;
 bool SensorTask::suspended = false;  // Initialize the suspended flag
+bool SensorTask::reading = false;
+int SensorTask::otaQuiesceId = -1;
 static bool wdtRegistered = false;
 
 bool SensorTask::init() {
@@ -73,6 +76,7 @@ void SensorTask::taskFunction(void* pvParameters) {
         // Check if we're suspended using mutex for thread safety
         if (xSemaphoreTake(dataMutex, pdMS_TO_TICKS(100)) == pdTRUE) {
             isSuspended = suspended;
+            reading = !suspended;
             xSemaphoreGive(dataMutex);
         }
 
@@ -83,6 +87,17 @@ void SensorTask::taskFunction(void* pvParameters) {
             // Log sensor readings
             LOG_INFO(LOG_TAG_SENSOR, "Temperature: %.1f°C, Humidity: %.1f%%", temperature,
                      humidity);
+
+            // An OTA session asked to pause during the reading: it is done now
+            bool pauseRequested = false;
+            if (xSemaphoreTake(dataMutex, pdMS_TO_TICKS(100)) == pdTRUE) {
+                reading = false;
+                pauseRequested = suspended;
+                xSemaphoreGive(dataMutex);
+            }
+            if (pauseRequested && otaQuiesceId >= 0) {
+                OTAManager::acknowledgeQuiesce(otaQuiesceId);
+            }
         } else {
             LOG_DEBUG(LOG_TAG_SENSOR, "Sensor readings suspended");
         }
@@ -171,3 +186,28 @@ void SensorTask::readSensors() {
     // Feed watchdog after operation
     if (wdtRegistered) esp_task_wdt_reset();
 }
+
+void SensorTask::registerForOTA() {
+    if (otaQuiesceId >= 0) {
+        return;  // OTATask::init() runs again after a network reconnect
+    }
+    otaQuiesceId = OTAManager::addQuiesceParticipant({"SensorTask", pauseForOTA, resumeAfterOTA, nullptr});
+    if (otaQuiesceId < 0) {
+        LOG_WARN(LOG_TAG_SENSOR, "Could not register with OTAManager; readings continue during updates");
+    }
+}
+
+bool SensorTask::pauseForOTA(void* context) {
+    bool pausedNow = false;
+    if (xSemaphoreTake(dataMutex, pdMS_TO_TICKS(100)) == pdTRUE) {
+        suspended = true;
+        pausedNow = !reading;  // Otherwise the task acknowledges after the reading
+        xSemaphoreGive(dataMutex);
+    }
+    LOG_INFO(LOG_TAG_SENSOR, "Sensor readings suspended for OTA update");
+    return pausedNow;
+}
+
+void SensorTask::resumeAfterOTA(void* context) {
+    resume();
+}
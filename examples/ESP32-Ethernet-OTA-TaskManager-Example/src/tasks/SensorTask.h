@@ -56,12 +56,25 @@ class SensorTask {
      */
     static void resume();
 
+    /**
+     * @brief Have OTAManager pause sensor readings for every update session
+     *
+     * Call after OTAManager::initialize(). A reading in progress finishes first.
+     */
+    static void registerForOTA();
+
     // Task handle exposed for watchdog monitoring
     static TaskHandle_t taskHandle;
 
    private:
     static SemaphoreHandle_t dataMutex;
     static bool suspended;
+    static bool reading;     // A reading is in progress
+    static int otaQuiesceId; // Participant id from OTAManager, -1 if not registered
+
+    // OTAManager quiesce handlers
+    static bool pauseForOTA(void* context);
+    static void resumeAfterOTA(void* context);
 
     // Sensor data
     static float temperature;
@@ -24,17 +24,22 @@ volatile bool updateInProgress = false;
 /**
  * @brief Task dedicated to handling OTA updates
  * 
- * This task runs on Core 0 and continuously checks for OTA updates
+ * This task runs on Core 0 and checks for OTA updates as often as
+ * handleUpdates() recommends: rarely while idle, at once during an update.
+ * OTAManager::startPollTask() runs the same loop for you.
  */
 void otaTask(void *pvParameters) {
     Serial.println("OTA Task started on Core 0");
     
     while (true) {
         // Handle OTA updates - thread-safe due to internal mutex
-        OTAManager::handleUpdates();
+        uint32_t delayMs = OTAManager::handleUpdates();
         
-        // Small delay to prevent watchdog issues
-        vTaskDelay(pdMS_TO_TICKS(10));
+        if (delayMs == 0) {
+            taskYIELD();  // The next step of an update is due
+        } else {
+            vTaskDelay(pdMS_TO_TICKS(delayMs));
+        }
     }
 }
 
@@ -99,23 +104,12 @@ void setup() {
     OTAManager::setStartCallback([]() {
         Serial.println("\n=== OTA Update Starting ===");
         updateInProgress = true;
-        
-        // Optional: Suspend other tasks
-        if (appTaskHandle != NULL) {
-            Serial.println("Suspending application task...");
-            vTaskSuspend(appTaskHandle);
-        }
     });
     
     OTAManager::setEndCallback([]() {
         Serial.println("=== OTA Update Complete ===");
         updateInProgress = false;
         
-        // Resume suspended tasks before restart
-        if (appTaskHandle != NULL) {
-            vTaskResume(appTaskHandle);
-        }
-        
         Serial.println("Restarting in 2 seconds...");
         delay(2000);
         ESP.restart();
@@ -136,11 +130,6 @@ void setup() {
         Serial.printf("OTA Error [%u]: ", error);
         updateInProgress = false;
         
-        // Resume tasks on error
-        if (appTaskHandle != NULL) {
-            vTaskResume(appTaskHandle);
-        }
-        
         switch (error) {
             case OTA_AUTH_ERROR:
                 Serial.println("Auth Failed");
@@ -185,6 +174,19 @@ void setup() {
         1                     // Core 1
     );
     
+    // Suspend the application task for the length of every update session;
+    // OTAManager resumes it when the session ends or fails
+    OTAManager::addQuiesceParticipant({
+        "App_Task",
+        [](void*) -> bool {
+            Serial.println("Suspending application task...");
+            vTaskSuspend(appTaskHandle);
+            return true;  // Paused on return
+        },
+        [](void*) { vTaskResume(appTaskHandle); },
+        nullptr
+    });
+    
     Serial.println("\nSetup complete!");
     Serial.printf("Upload firmware to: %s.local or %s\n", 
                   "esp32-threaded", WiFi.localIP().toString().c_str());
@@ -0,0 +1,103 @@
+// OTACallbackQueue.cpp
+#include "OTACallbackQueue.h"
+
+struct OTAProgressReport {
+    uint32_t progress;
+    uint32_t total;
+};
+
+bool OTACallbackQueue::begin(size_t length) {
+    end();
+    queue = xQueueCreate(length, sizeof(OTACallbackMessage));
+    mailbox = xQueueCreate(1, sizeof(OTAProgressReport));
+    if (!queue || !mailbox) {
+        end();
+        return false;
+    }
+    progressQueued = false;
+    nextSeq = 0;
+    handledSeq = 0;
+    eventsQueued = 0;
+    eventsDropped = 0;
+    progressReports = 0;
+    progressDelivered = 0;
+    return true;
+}
+
+void OTACallbackQueue::end() {
+    if (queue) {
+        vQueueDelete(queue);
+        queue = nullptr;
+    }
+    if (mailbox) {
+        vQueueDelete(mailbox);
+        mailbox = nullptr;
+    }
+}
+
+uint32_t OTACallbackQueue::post(OTACallbackEvent event, uint32_t arg, TickType_t ticks) {
+    OTACallbackMessage message = {event, nextSeq + 1, arg, 0};
+    if (xQueueSend(queue, &message, ticks) != pdTRUE) {
+        eventsDropped.fetch_add(1, std::memory_order_relaxed);
+        return 0;
+    }
+    nextSeq++;
+    if (event != OTA_CALLBACK_STOP) {
+        eventsQueued.fetch_add(1, std::memory_order_relaxed);
+    }
+    return message.seq;
+}
+
+void OTACallbackQueue::postProgress(uint32_t progress, uint32_t total) {
+    progressReports.fetch_add(1, std::memory_order_relaxed);
+    OTAProgressReport report = {progress, total};
+    xQueueOverwrite(mailbox, &report);
+    // Only the first report since the callback task took the token queues one; the
+    // token resolves to whatever the mailbox holds when it is taken
+    if (!progressQueued.exchange(true, std::memory_order_acq_rel)) {
+        OTACallbackMessage token = {OTA_CALLBACK_PROGRESS, 0, 0, 0};
+        if (xQueueSend(queue, &token, 0) != pdTRUE) {
+            progressQueued = false;  // The next report tries again
+        }
+    }
+}
+
+bool OTACallbackQueue::receive(OTACallbackMessage* message, TickType_t ticks) {
+    if (xQueueReceive(queue, message, ticks) != pdTRUE) {
+        return false;
+    }
+    if (message->event != OTA_CALLBACK_PROGRESS) {
+        return true;
+    }
+    // Clear the flag before reading the mailbox: a report that lands after the read
+    // queues a new token, one that lands before it is read now
+    progressQueued.store(false, std::memory_order_release);
+    OTAProgressReport report;
+    if (xQueueReceive(mailbox, &report, 0) != pdTRUE) {
+        return false;
+    }
+    message->arg = report.progress;
+    message->total = report.total;
+    progressDelivered.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool OTACallbackQueue::waitHandled(uint32_t seq, uint32_t timeoutMs) const {
+    uint32_t start = millis();
+    while ((int32_t)(handledSeq.load(std::memory_order_acquire) - seq) < 0) {
+        if (millis() - start >= timeoutMs) {
+            return false;
+        }
+        vTaskDelay(1);
+    }
+    return true;
+}
+
+OTACallbackStats OTACallbackQueue::getStats() const {
+    OTACallbackStats s;
+    s.eventsQueued = eventsQueued.load(std::memory_order_relaxed);
+    s.eventsDropped = eventsDropped.load(std::memory_order_relaxed);
+    s.progressReports = progressReports.load(std::memory_order_relaxed);
+    s.progressDelivered = progressDelivered.load(std::memory_order_relaxed);
+    return s;
+}
@@ -0,0 +1,110 @@
+/**
+ * @file OTACallbackQueue.h
+ * @brief Session events on their way from the OTA data path to the callback task
+ *
+ * @details Start, end and error events are queued in order. Progress is
+ * coalesced: each report overwrites a one-entry mailbox, and a single progress
+ * token in the queue stands for all reports since the callback task last took
+ * one. The data path therefore never waits, however slow the application's
+ * callbacks are, and the callbacks still see every event in session order with
+ * the latest progress before the end.
+ *
+ * One producer (the session hooks, under the OTA mutex) and one consumer (the
+ * callback task).
+ */
+#pragma once
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+
+#include <atomic>
+
+#include "OTAManagerConfig.h"
+
+enum OTACallbackEvent : uint8_t {
+    OTA_CALLBACK_START = 1,
+    OTA_CALLBACK_PROGRESS,
+    OTA_CALLBACK_END,
+    OTA_CALLBACK_ERROR,
+    OTA_CALLBACK_STOP  // Ends the callback task once the events before it are handled
+};
+
+struct OTACallbackMessage {
+    OTACallbackEvent event;
+    uint32_t seq;   // Order of start/end/error/stop events, from 1
+    uint32_t arg;   // Progress bytes, or the ota_error_t
+    uint32_t total; // Progress only
+};
+
+/**
+ * @brief Event counts since the callback task started
+ */
+struct OTACallbackStats {
+    uint32_t eventsQueued;      // Start, end and error events
+    uint32_t eventsDropped;     // ... not queued because the queue was full
+    uint32_t progressReports;   // Progress reports from the session
+    uint32_t progressDelivered; // ... passed to the callback, the rest coalesced
+};
+
+class OTACallbackQueue {
+   public:
+    ~OTACallbackQueue() { end(); }
+
+    /**
+     * @brief Create the queue (length entries) and the progress mailbox
+     */
+    bool begin(size_t length);
+
+    /**
+     * @brief Free the queue; messages still in it are discarded
+     */
+    void end();
+
+    bool isOpen() const { return queue != nullptr; }
+
+    /**
+     * @brief Queue a start, end, error or stop event, waiting at most ticks for room
+     *
+     * @return its sequence number for waitHandled(), or 0 if the queue was full
+     */
+    uint32_t post(OTACallbackEvent event, uint32_t arg = 0, TickType_t ticks = 0);
+
+    /**
+     * @brief Publish a progress report; never waits
+     */
+    void postProgress(uint32_t progress, uint32_t total);
+
+    /**
+     * @brief Take the next event for the callback task
+     *
+     * A progress token resolves to the latest report. Returns false on timeout,
+     * and for a token whose report an earlier token already delivered.
+     */
+    bool receive(OTACallbackMessage* message, TickType_t ticks);
+
+    /**
+     * @brief Mark the event with this sequence number (and all before it) as handled
+     */
+    void handled(uint32_t seq) { handledSeq.store(seq, std::memory_order_release); }
+
+    /**
+     * @brief Wait until the callback task has handled event seq
+     *
+     * @return false on timeout
+     */
+    bool waitHandled(uint32_t seq, uint32_t timeoutMs) const;
+
+    OTACallbackStats getStats() const;
+
+   private:
+    QueueHandle_t queue = nullptr;
+    QueueHandle_t mailbox = nullptr;  // Latest progress, length 1
+    std::atomic<bool> progressQueued{false};
+    std::atomic<uint32_t> handledSeq{0};
+    uint32_t nextSeq = 0;
+    std::atomic<uint32_t> eventsQueued{0};
+    std::atomic<uint32_t> eventsDropped{0};
+    std::atomic<uint32_t> progressReports{0};
+    std::atomic<uint32_t> progressDelivered{0};
+};
@@ -0,0 +1,114 @@
+// OTAEventBus.cpp
+#include "OTAEventBus.h"
+
+#include <algorithm>
+
+int OTAEventBus::subscribe(const OTASubscriber& subscriber) {
+    for (int i = 0; i < CAPACITY; i++) {
+        if (!slots[i].used) {
+            slots[i] = {subscriber, true, false, 0, 0};
+            updateGate();
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool OTAEventBus::unsubscribe(int id) {
+    if (id < 0 || id >= CAPACITY || !slots[id].used) {
+        return false;
+    }
+    slots[id].used = false;
+    updateGate();
+    return true;
+}
+
+int OTAEventBus::count() const {
+    int n = 0;
+    for (const Slot& slot : slots) {
+        n += slot.used ? 1 : 0;
+    }
+    return n;
+}
+
+void OTAEventBus::start() {
+    for (Slot& slot : slots) {
+        slot.reported = false;
+    }
+    updateGate();
+    for (const Slot& slot : slots) {
+        if (slot.used && slot.subscriber.onStart) {
+            slot.subscriber.onStart(slot.subscriber.context);
+        }
+    }
+}
+
+void OTAEventBus::progress(uint32_t progress, uint32_t total, uint32_t nowMs) {
+    bool last = progress >= total;
+    if (!firstPending && !last) {
+        if (progress < dueBytes || (timeGate && (int32_t)(nowMs - dueMs) < 0)) {
+            return;
+        }
+    }
+    for (Slot& slot : slots) {
+        const OTASubscriber& s = slot.subscriber;
+        if (!slot.used || !s.onProgress) {
+            continue;
+        }
+        bool due = !slot.reported || last ||
+                   (progress - slot.lastBytes >= s.minProgressBytes && nowMs - slot.lastMs >= s.minProgressMs);
+        if (!due) {
+            continue;
+        }
+        slot.reported = true;
+        slot.lastBytes = progress;
+        slot.lastMs = nowMs;
+        calls++;
+        s.onProgress(progress, total, s.context);
+    }
+    updateGate();
+}
+
+void OTAEventBus::end() {
+    for (const Slot& slot : slots) {
+        if (slot.used && slot.subscriber.onEnd) {
+            slot.subscriber.onEnd(slot.subscriber.context);
+        }
+    }
+}
+
+void OTAEventBus::error(ota_error_t error) {
+    for (const Slot& slot : slots) {
+        if (slot.used && slot.subscriber.onError) {
+            slot.subscriber.onError(error, slot.subscriber.context);
+        }
+    }
+}
+
+void OTAEventBus::updateGate() {
+    // A report is due for some subscriber only if it reaches that subscriber's
+    // next byte count and next time, so it must reach the smallest of each
+    firstPending = false;
+    dueBytes = UINT32_MAX;
+    timeGate = false;
+    for (const Slot& slot : slots) {
+        const OTASubscriber& s = slot.subscriber;
+        if (!slot.used || !s.onProgress) {
+            continue;
+        }
+        if (!slot.reported) {
+            firstPending = true;
+            return;
+        }
+        uint32_t nextBytes = slot.lastBytes + s.minProgressBytes;
+        if (nextBytes < slot.lastBytes) {
+            nextBytes = UINT32_MAX;
+        }
+        dueBytes = std::min(dueBytes, nextBytes);
+        uint32_t nextMs = slot.lastMs + s.minProgressMs;
+        if (!timeGate || (int32_t)(nextMs - dueMs) < 0) {
+            dueMs = nextMs;
+            timeGate = true;
+        }
+    }
+}
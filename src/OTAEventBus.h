@@ -0,0 +1,96 @@
+/**
+ * @file OTAEventBus.h
+ * @brief Fixed-capacity table of session event subscribers
+ *
+ * @details Every subscriber gets every start, end and error event, and the
+ * progress reports its own minimum interval lets through: at least
+ * minProgressBytes more than the last report it got, and at least
+ * minProgressMs after it. The first report of a session (0, or the resume
+ * offset) and the last one (progress == total) always go out.
+ *
+ * The earliest byte count and time at which any subscriber is due are kept, so
+ * a report that is due for none costs two comparisons however many subscribers
+ * there are; otherwise only the subscribers that are due are called.
+ *
+ * Not thread-safe: OTAManager calls it under its mutex.
+ */
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoOTA.h>
+
+#include "OTAManagerConfig.h"
+
+/**
+ * @brief A subscriber to session events
+ *
+ * Handlers left nullptr are skipped. They run inside the session, like the
+ * callbacks set with setProgressCallback(), so they should return quickly.
+ */
+struct OTASubscriber {
+    void (*onStart)(void* context);
+    void (*onProgress)(unsigned int progress, unsigned int total, void* context);
+    void (*onEnd)(void* context);
+    void (*onError)(ota_error_t error, void* context);
+    void* context;
+    uint32_t minProgressBytes;  // 0 = no byte interval
+    uint32_t minProgressMs;     // 0 = no time interval
+};
+
+class OTAEventBus {
+   public:
+    static const int CAPACITY = OTA_SUBSCRIBERS_MAX;
+
+    /**
+     * @brief Add a subscriber
+     *
+     * @return its id for unsubscribe(), or -1 if the table is full
+     */
+    int subscribe(const OTASubscriber& subscriber);
+
+    /**
+     * @brief Remove a subscriber; false if id is not subscribed
+     */
+    bool unsubscribe(int id);
+
+    int count() const;
+
+    void start();
+
+    /**
+     * @brief Whether progress() could call anyone, from the byte counts alone
+     *
+     * Lets the caller skip reading the clock for a report due for no subscriber.
+     */
+    bool mayBeDue(uint32_t progress, uint32_t total) const {
+        return firstPending || progress >= total || progress >= dueBytes;
+    }
+
+    void progress(uint32_t progress, uint32_t total, uint32_t nowMs);
+    void end();
+    void error(ota_error_t error);
+
+    /**
+     * @brief Progress handler calls made, over all subscribers
+     */
+    uint32_t progressCalls() const { return calls; }
+
+   private:
+    struct Slot {
+        OTASubscriber subscriber;
+        bool used;
+        bool reported;  // Got a progress report this session
+        uint32_t lastBytes;
+        uint32_t lastMs;
+    };
+
+    // Recompute the earliest point at which any subscriber is due
+    void updateGate();
+
+    Slot slots[CAPACITY] = {};
+    bool firstPending = false;       // A progress subscriber has had no report yet
+    uint32_t dueBytes = UINT32_MAX;  // No subscriber is due below this byte count
+    uint32_t dueMs = 0;              // ... or before this time (valid if timeGate)
+    bool timeGate = false;
+    uint32_t calls = 0;
+};
@@ -0,0 +1,43 @@
+/**
+ * @file OTAFec.h
+ * @brief Reed-Solomon erasure code for multicast image groups
+ *
+ * @details Systematic code over GF(2^8): a group of k data blocks is sent as is,
+ * followed by up to MAX_PARITY parity blocks. Parity row r is the sum of the
+ * data blocks weighted by a Cauchy matrix, so any k of the k + p blocks give the
+ * group back. Blocks shorter than the group's block length count as zero padded.
+ */
+#pragma once
+
+#include <Arduino.h>
+
+class OTAFec {
+   public:
+    static const uint8_t MAX_DATA = 64;
+    static const uint8_t MAX_PARITY = 16;
+
+    /**
+     * @brief Compute parity row `row` of a group
+     *
+     * @param data k data blocks of len bytes each
+     * @param out Receives the parity block (len bytes)
+     */
+    static void encode(const uint8_t* const* data, uint8_t k, uint8_t row, uint8_t* out, size_t len);
+
+    /**
+     * @brief Rebuild the missing data blocks of a group
+     *
+     * @param data k block buffers; missing ones are filled in
+     * @param present Which data blocks arrived
+     * @param parity Received parity blocks; used as scratch and overwritten
+     * @param rows Parity row of each entry in parity
+     * @param parityCount Entries in parity; at least the number of missing blocks
+     * @return false if too few parity blocks arrived
+     */
+    static bool decode(uint8_t* const* data, const bool* present, uint8_t k, uint8_t* const* parity,
+                       const uint8_t* rows, uint8_t parityCount, size_t len);
+
+   private:
+    static uint8_t coefficient(uint8_t row, uint8_t column);
+    static void multiplyAdd(uint8_t* dst, const uint8_t* src, uint8_t factor, size_t len);
+};
@@ -0,0 +1,48 @@
+// OTAHistogram.cpp
+#include "OTAHistogram.h"
+
+#include <string.h>
+
+uint32_t OTAHistogramSnapshot::percentileUs(float fraction) const {
+    uint32_t total = 0;
+    for (int i = 0; i < OTA_LATENCY_BUCKETS; i++) {
+        total += buckets[i];
+    }
+    if (!total) {
+        return 0;
+    }
+    uint32_t rank = (uint32_t)(fraction * total + 0.5f);
+    rank = rank < 1 ? 1 : rank;
+    uint32_t seen = 0;
+    for (int i = 0; i < OTA_LATENCY_BUCKETS - 1; i++) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            uint32_t bound = (2UL << i) - 1;
+            return bound < maxUs ? bound : maxUs;
+        }
+    }
+    return maxUs;
+}
+
+OTAHistogramSnapshot OTAHistogram::snapshot() const {
+    OTAHistogramSnapshot s;
+    memset(&s, 0, sizeof(s));
+#if OTA_LATENCY_HISTOGRAMS_ENABLED
+    for (int i = 0; i < OTA_LATENCY_BUCKETS; i++) {
+        s.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+    }
+    s.count = count.load(std::memory_order_relaxed);
+    s.maxUs = maxUs.load(std::memory_order_relaxed);
+#endif
+    return s;
+}
+
+void OTAHistogram::reset() {
+#if OTA_LATENCY_HISTOGRAMS_ENABLED
+    for (int i = 0; i < OTA_LATENCY_BUCKETS; i++) {
+        buckets[i].store(0, std::memory_order_relaxed);
+    }
+    count.store(0, std::memory_order_relaxed);
+    maxUs.store(0, std::memory_order_relaxed);
+#endif
+}
@@ -0,0 +1,81 @@
+/**
+ * @file OTAHistogram.h
+ * @brief Fixed-size log2 latency histogram
+ *
+ * @details Averages hide the occasional long stall (a sector erase, a lock held
+ * by another task), so durations are counted in power-of-two buckets of
+ * microseconds instead. Recording is a few relaxed atomic increments from
+ * whichever task measured the duration; reading and resetting never lock.
+ * The size is fixed at compile time by OTA_LATENCY_BUCKETS, and with
+ * OTA_LATENCY_HISTOGRAMS_ENABLED set to 0 the histogram holds nothing and
+ * record() compiles away.
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include <atomic>
+
+#include "OTAManagerConfig.h"
+
+// What a histogram measures (OTAManager::getLatencyHistogram())
+enum OTALatencySource : uint8_t {
+    OTA_LATENCY_SOCKET_READ,     // Listener and pull mode: waiting for and reading one chunk
+    OTA_LATENCY_FLASH_WRITE,     // Writing one chunk to flash, including any erase it triggers
+    OTA_LATENCY_HANDLE_UPDATES,  // handleUpdates() calls that poll ArduinoOTA, lock wait included
+    OTA_LATENCY_SOURCES
+};
+
+struct OTAHistogramSnapshot {
+    uint32_t buckets[OTA_LATENCY_BUCKETS];
+    uint32_t count;
+    uint32_t maxUs;
+
+    /**
+     * @brief Upper bound of the bucket holding the given fraction of samples
+     *
+     * @param fraction 0.5 for the median, 0.99 for the 99th percentile
+     * @return Bound in microseconds (maxUs for the last bucket), 0 if empty
+     */
+    uint32_t percentileUs(float fraction) const;
+
+    // Smallest duration counted in bucket i
+    static uint32_t bucketLowUs(int i) { return i == 0 ? 0 : 1UL << i; }
+};
+
+class OTAHistogram {
+   public:
+    static int bucketOf(uint32_t us) {
+        int b = us < 2 ? 0 : 31 - __builtin_clz(us);
+        return b < OTA_LATENCY_BUCKETS ? b : OTA_LATENCY_BUCKETS - 1;
+    }
+
+#if OTA_LATENCY_HISTOGRAMS_ENABLED
+    void record(uint32_t us) {
+        buckets[bucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        uint32_t seen = maxUs.load(std::memory_order_relaxed);
+        while (us > seen && !maxUs.compare_exchange_weak(seen, us, std::memory_order_relaxed)) {
+        }
+    }
+#else
+    void record(uint32_t) {}
+#endif
+
+    /**
+     * @brief Copy of the counts; all zero when histograms are compiled out
+     *
+     * Taken bucket by bucket while others may record, so count and the sum of
+     * the buckets can differ by the samples recorded meanwhile.
+     */
+    OTAHistogramSnapshot snapshot() const;
+
+    void reset();
+
+#if OTA_LATENCY_HISTOGRAMS_ENABLED
+   private:
+    std::atomic<uint32_t> buckets[OTA_LATENCY_BUCKETS] = {};
+    std::atomic<uint32_t> count{0};
+    std::atomic<uint32_t> maxUs{0};
+#endif
+};
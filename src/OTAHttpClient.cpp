@@ -0,0 +1,372 @@
+// OTAHttpClient.cpp
+#include "OTAHttpClient.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <strings.h>
+
+#if defined(ESP32)
+    #include <lwip/netdb.h>
+    #include <lwip/sockets.h>
+#else
+    #include <netdb.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <sys/select.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+#endif
+
+#if OTA_PULL_TLS_ENABLED
+    #include <esp_crt_bundle.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static int waitFor(int sock, bool write, uint32_t timeoutMs) {
+    fd_set set;
+    FD_ZERO(&set);
+    FD_SET(sock, &set);
+    struct timeval tv;
+    tv.tv_sec = timeoutMs / 1000;
+    tv.tv_usec = (timeoutMs % 1000) * 1000;
+    return select(sock + 1, write ? nullptr : &set, write ? &set : nullptr, nullptr, &tv);
+}
+
+bool OTAHttpClient::fail(const char* msg) {
+    error = msg;
+    close();
+    return false;
+}
+
+bool OTAHttpClient::setUrl(const char* url) {
+    error = nullptr;
+    if (!url) {
+        return fail("no URL");
+    }
+    const char* rest;
+    if (strncmp(url, "http://", 7) == 0) {
+        tls = false;
+        port = 80;
+        rest = url + 7;
+    } else if (strncmp(url, "https://", 8) == 0) {
+#if OTA_PULL_TLS_ENABLED
+        tls = true;
+        port = 443;
+        rest = url + 8;
+#else
+        return fail("https is not available (OTA_PULL_TLS_ENABLED)");
+#endif
+    } else {
+        return fail("URL must start with http:// or https://");
+    }
+
+    const char* slash = strchr(rest, '/');
+    const char* hostEnd = slash ? slash : rest + strlen(rest);
+    const char* colon = (const char*)memchr(rest, ':', hostEnd - rest);
+    size_t hostLen = (colon ? colon : hostEnd) - rest;
+    if (hostLen == 0 || hostLen >= sizeof(host)) {
+        return fail("bad host in URL");
+    }
+    memcpy(host, rest, hostLen);
+    host[hostLen] = '\0';
+    if (colon) {
+        unsigned long p = strtoul(colon + 1, nullptr, 10);
+        if (p == 0 || p > 65535) {
+            return fail("bad port in URL");
+        }
+        port = (uint16_t)p;
+    }
+    const char* target = slash ? slash : "/";
+    if (strlen(target) >= sizeof(path)) {
+        return fail("URL too long (OTA_PULL_URL_MAX)");
+    }
+    strcpy(path, target);
+    return true;
+}
+
+bool OTAHttpClient::connectTo(uint32_t timeoutMs) {
+#if OTA_PULL_TLS_ENABLED
+    if (tls) {
+        esp_tls_cfg_t cfg = {};
+        if (caCert) {
+            cfg.cacert_buf = (const unsigned char*)caCert;
+            cfg.cacert_bytes = strlen(caCert) + 1;
+        } else {
+            cfg.crt_bundle_attach = esp_crt_bundle_attach;
+        }
+        cfg.timeout_ms = (int)timeoutMs;
+        tlsConn = esp_tls_init();
+        if (!tlsConn || esp_tls_conn_new_sync(host, strlen(host), port, &cfg, tlsConn) != 1) {
+            return fail("TLS connection failed");
+        }
+        return true;
+    }
+#endif
+    struct addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* res = nullptr;
+    char service[6];
+    snprintf(service, sizeof(service), "%u", port);
+    if (getaddrinfo(host, service, &hints, &res) != 0 || !res) {
+        return fail("host not found");
+    }
+    sock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (sock < 0) {
+        freeaddrinfo(res);
+        return fail("socket failed");
+    }
+    // Non-blocking connect so an unreachable server costs timeoutMs, not the stack default
+    int flags = fcntl(sock, F_GETFL, 0);
+    fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+    int rc = connect(sock, res->ai_addr, res->ai_addrlen);
+    freeaddrinfo(res);
+    if (rc != 0 && errno != EINPROGRESS) {
+        return fail("connect failed");
+    }
+    if (rc != 0) {
+        int soError = 0;
+        socklen_t soLen = sizeof(soError);
+        if (waitFor(sock, true, timeoutMs) <= 0 ||
+            getsockopt(sock, SOL_SOCKET, SO_ERROR, &soError, &soLen) != 0 || soError != 0) {
+            return fail("connect failed");
+        }
+    }
+    fcntl(sock, F_SETFL, flags);
+    int yes = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    return true;
+}
+
+bool OTAHttpClient::sendAll(const char* data, size_t len) {
+    while (len > 0) {
+        int n;
+#if OTA_PULL_TLS_ENABLED
+        if (tlsConn) {
+            n = esp_tls_conn_write(tlsConn, data, len);
+            if (n == ESP_TLS_ERR_SSL_WANT_READ || n == ESP_TLS_ERR_SSL_WANT_WRITE) {
+                continue;
+            }
+        } else
+#endif
+        {
+            n = send(sock, data, len, MSG_NOSIGNAL);
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+int OTAHttpClient::receive(uint8_t* dst, size_t len, uint32_t timeoutMs) {
+#if OTA_PULL_TLS_ENABLED
+    if (tlsConn) {
+        for (;;) {
+            // Decrypted bytes may already be waiting inside the TLS layer
+            if (esp_tls_get_bytes_avail(tlsConn) <= 0) {
+                int fd = -1;
+                if (esp_tls_get_conn_sockfd(tlsConn, &fd) != ESP_OK || waitFor(fd, false, timeoutMs) <= 0) {
+                    return -1;
+                }
+            }
+            int n = esp_tls_conn_read(tlsConn, dst, len);
+            if (n == ESP_TLS_ERR_SSL_WANT_READ || n == ESP_TLS_ERR_SSL_WANT_WRITE) {
+                continue;
+            }
+            return n > 0 ? n : (n == 0 ? 0 : -1);
+        }
+    }
+#endif
+    if (sock < 0 || waitFor(sock, false, timeoutMs) <= 0) {
+        return -1;
+    }
+    int n = recv(sock, dst, len, 0);
+    return n > 0 ? n : (n == 0 ? 0 : -1);
+}
+
+bool OTAHttpClient::readLine(char* line, size_t max, uint32_t timeoutMs) {
+    size_t len = 0;
+    for (;;) {
+        if (bufferPos == bufferLen) {
+            int n = receive(buffer, sizeof(buffer), timeoutMs);
+            if (n <= 0) {
+                return false;
+            }
+            bufferPos = 0;
+            bufferLen = n;
+        }
+        char c = (char)buffer[bufferPos++];
+        if (c == '\n') {
+            if (len > 0 && line[len - 1] == '\r') {
+                len--;
+            }
+            line[len] = '\0';
+            return true;
+        }
+        if (len < max - 1) {
+            line[len++] = c;  // Longer lines are cut; none of the ones used can be
+        }
+    }
+}
+
+int OTAHttpClient::request(size_t offset, uint32_t timeoutMs) {
+    close();
+    bufferPos = bufferLen = 0;
+    length = start = total = remaining = 0;
+    if (!connectTo(timeoutMs)) {
+        return -1;
+    }
+
+    char head[OTA_PULL_URL_MAX + 160];
+    int headLen = snprintf(head, sizeof(head),
+                           "GET %s HTTP/1.1\r\nHost: %s:%u\r\nUser-Agent: OTAManager\r\n"
+                           "Connection: close\r\n",
+                           path, host, port);
+    if (offset > 0) {
+        headLen += snprintf(head + headLen, sizeof(head) - headLen, "Range: bytes=%u-\r\n",
+                            (unsigned)offset);
+    }
+    headLen += snprintf(head + headLen, sizeof(head) - headLen, "\r\n");
+    if (!sendAll(head, headLen)) {
+        fail("request not sent");
+        return -1;
+    }
+
+    char line[OTA_PULL_URL_MAX + 16];
+    int status = 0;
+    if (!readLine(line, sizeof(line), timeoutMs) || sscanf(line, "HTTP/%*d.%*d %d", &status) != 1) {
+        fail("no HTTP response");
+        return -1;
+    }
+    bool haveLength = false;
+    bool chunked = false;
+    for (;;) {
+        if (!readLine(line, sizeof(line), timeoutMs)) {
+            fail("response head cut off");
+            return -1;
+        }
+        if (line[0] == '\0') {
+            break;
+        }
+        if (strncasecmp(line, "Content-Length:", 15) == 0) {
+            length = strtoul(line + 15, nullptr, 10);
+            haveLength = true;
+        } else if (strncasecmp(line, "Content-Range:", 14) == 0) {
+            unsigned long first = 0, last = 0, size = 0;
+            if (sscanf(line + 14, " bytes %lu-%lu/%lu", &first, &last, &size) == 3) {
+                start = first;
+                total = size;
+            }
+        } else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0 && strstr(line, "chunked")) {
+            chunked = true;
+        } else if (strncasecmp(line, "Location:", 9) == 0 && status >= 300 && status < 400) {
+            const char* location = line + 9;
+            while (*location == ' ') {
+                location++;
+            }
+            if (location[0] == '/') {
+                if (strlen(location) >= sizeof(path)) {
+                    fail("redirect URL too long");
+                    return -1;
+                }
+                strcpy(path, location);
+            } else if (!setUrl(location)) {
+                return -1;
+            }
+        }
+    }
+    if (status >= 300 && status < 400) {
+        return status;  // get() follows it
+    }
+    if (status != 200 && status != 206) {
+        fail("server refused the request");
+        return status;
+    }
+    if (chunked || !haveLength) {
+        fail("response has no Content-Length");
+        return -1;
+    }
+    if (status == 200) {
+        start = 0;
+        total = length;
+    }
+    remaining = length;
+    return status;
+}
+
+int OTAHttpClient::get(size_t offset, uint32_t timeoutMs) {
+    error = nullptr;
+    for (int hops = 0; hops <= OTA_PULL_MAX_REDIRECTS; hops++) {
+        int status = request(offset, timeoutMs);
+        if (status < 300 || status >= 400) {
+            return status;
+        }
+        OTAM_LOG_D("Pull: redirected (%d) to %s%s", status, host, path);
+    }
+    fail("too many redirects");
+    return -1;
+}
+
+int OTAHttpClient::read(uint8_t* dst, size_t len, uint32_t timeoutMs) {
+    if (remaining == 0) {
+        return 0;
+    }
+    if (len > remaining) {
+        len = remaining;
+    }
+    int n;
+    if (bufferPos < bufferLen) {
+        n = bufferLen - bufferPos < len ? bufferLen - bufferPos : len;
+        memcpy(dst, buffer + bufferPos, n);
+        bufferPos += n;
+    } else {
+        n = receive(dst, len, timeoutMs);  // Straight into the caller's buffer
+    }
+    if (n > 0) {
+        remaining -= n;
+    }
+    return n;
+}
+
+int OTAHttpClient::peek(uint8_t* dst, size_t len, uint32_t timeoutMs) {
+    if (len > remaining) {
+        len = remaining;
+    }
+    if (bufferPos > 0) {
+        memmove(buffer, buffer + bufferPos, bufferLen - bufferPos);
+        bufferLen -= bufferPos;
+        bufferPos = 0;
+    }
+    while (bufferLen < len) {
+        int n = receive(buffer + bufferLen, sizeof(buffer) - bufferLen, timeoutMs);
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            len = bufferLen;  // Closed early; read() reports it
+            break;
+        }
+        bufferLen += n;
+    }
+    memcpy(dst, buffer, len);
+    return (int)len;
+}
+
+void OTAHttpClient::close() {
+#if OTA_PULL_TLS_ENABLED
+    if (tlsConn) {
+        esp_tls_conn_destroy(tlsConn);
+        tlsConn = nullptr;
+    }
+#endif
+    if (sock >= 0) {
+        ::close(sock);
+        sock = -1;
+    }
+}
@@ -0,0 +1,112 @@
+/**
+ * @file OTAHttpClient.h
+ * @brief Minimal HTTP/1.1 GET client for pull-mode updates
+ *
+ * @details One request per connection ("Connection: close"), with an optional
+ * Range header so a dropped download continues where it stopped. The body is
+ * read straight into the caller's buffer; only the response head passes through
+ * a small internal buffer. Redirects are followed. Bodies must carry a
+ * Content-Length (static file servers and object stores do); chunked responses
+ * are refused. https:// goes through ESP-TLS when OTA_PULL_TLS_ENABLED is set.
+ *
+ * @note Not thread-safe; used by OTAReceiver under OTAManager's mutex.
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include "OTAManagerConfig.h"
+
+#if OTA_PULL_TLS_ENABLED
+    #include <esp_tls.h>
+#endif
+
+class OTAHttpClient {
+   public:
+    ~OTAHttpClient() { close(); }
+
+    /**
+     * @brief Set the URL to fetch
+     *
+     * @return false if it is not an http:// (or, with TLS, https://) URL that fits
+     * OTA_PULL_URL_MAX
+     */
+    bool setUrl(const char* url);
+
+    /**
+     * @brief CA certificate (PEM) for https://; nullptr uses the certificate bundle
+     */
+    void setCACert(const char* pem) { caCert = pem; }
+
+    /**
+     * @brief Request the file from offset on, following redirects
+     *
+     * @return Status of the final response (200, or 206 for a range), or -1 if
+     * none arrived; errorString() has the reason
+     */
+    int get(size_t offset, uint32_t timeoutMs);
+
+    /**
+     * @brief Body bytes of the current response
+     */
+    size_t contentLength() const { return length; }
+
+    /**
+     * @brief File offset of the first body byte (non-zero only for a 206 response)
+     */
+    size_t rangeStart() const { return start; }
+
+    /**
+     * @brief Size of the whole file (from Content-Range, or the Content-Length of a 200)
+     */
+    size_t totalSize() const { return total; }
+
+    /**
+     * @brief Read body bytes into dst
+     *
+     * @return Bytes read, 0 at the end of the body or if the server closed early,
+     * -1 on timeout or a connection error
+     */
+    int read(uint8_t* dst, size_t len, uint32_t timeoutMs);
+
+    /**
+     * @brief Copy the next body bytes without consuming them
+     *
+     * @return Bytes copied (less than len only if the body is shorter), -1 on timeout
+     */
+    int peek(uint8_t* dst, size_t len, uint32_t timeoutMs);
+
+    void close();
+
+    const char* errorString() const { return error; }
+
+   private:
+    int request(size_t offset, uint32_t timeoutMs);
+    bool connectTo(uint32_t timeoutMs);
+    bool sendAll(const char* data, size_t len);
+    int receive(uint8_t* dst, size_t len, uint32_t timeoutMs);
+    bool readLine(char* line, size_t max, uint32_t timeoutMs);
+    bool fail(const char* msg);
+
+    bool tls = false;
+    char host[64] = {0};
+    uint16_t port = 80;
+    char path[OTA_PULL_URL_MAX] = {0};
+    const char* caCert = nullptr;
+
+    int sock = -1;
+#if OTA_PULL_TLS_ENABLED
+    esp_tls_t* tlsConn = nullptr;
+#endif
+
+    // Response head, and any body bytes that arrived with it
+    uint8_t buffer[512];
+    size_t bufferPos = 0;
+    size_t bufferLen = 0;
+
+    size_t length = 0;
+    size_t start = 0;
+    size_t total = 0;
+    size_t remaining = 0;
+    const char* error = nullptr;
+};
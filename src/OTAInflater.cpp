@@ -0,0 +1,640 @@
+// OTAInflater.cpp
+#include "OTAInflater.h"
+
+#include "OTAManagerConfig.h"
+
+#define INFLATE_WINDOW_SIZE 32768
+#define INFLATE_WINDOW_MASK (INFLATE_WINDOW_SIZE - 1)
+#define INFLATE_MAX_BITS 15
+#define INFLATE_FAST_BITS 9
+
+// gzip header flags (RFC 1952)
+#define GZIP_FHCRC 0x02
+#define GZIP_FEXTRA 0x04
+#define GZIP_FNAME 0x08
+#define GZIP_FCOMMENT 0x10
+
+struct OTAInflater::Huffman {
+    uint16_t count[INFLATE_MAX_BITS + 1];  // Number of codes of each length
+    uint16_t symbol[288];                  // Symbols ordered by code
+    uint16_t fast[1 << INFLATE_FAST_BITS];  // (symbol << 4) | length for short codes, 0 = slow path
+};
+
+struct OTAInflater::Workspace {
+    uint8_t window[INFLATE_WINDOW_SIZE];
+    Huffman lit;
+    Huffman dist;  // Also holds the code length code while a dynamic table is read
+    uint8_t lengths[286 + 30];
+    uint32_t crcTable[256];
+};
+
+static const uint16_t lengthBase[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                        31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t lengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                        2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t distBase[30] = {1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+                                      33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+                                      1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t distExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                      6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+static const uint8_t codeLengthOrder[19] = {16, 17, 18, 0, 8,  7, 9,  6, 10, 5,
+                                            11, 4,  12, 3, 13, 2, 14, 1, 15};
+
+// Build canonical decoding tables; incomplete codes are allowed, over-subscribed ones are not
+bool OTAInflater::buildHuffman(Huffman& h, const uint8_t* lengths, uint16_t n) {
+    memset(h.count, 0, sizeof(h.count));
+    memset(h.fast, 0, sizeof(h.fast));
+    for (uint16_t i = 0; i < n; i++) {
+        h.count[lengths[i]]++;
+    }
+    h.count[0] = 0;
+
+    int left = 1;
+    for (uint8_t len = 1; len <= INFLATE_MAX_BITS; len++) {
+        left = (left << 1) - h.count[len];
+        if (left < 0) {
+            return false;
+        }
+    }
+
+    uint16_t offset[INFLATE_MAX_BITS + 1];
+    offset[1] = 0;
+    for (uint8_t len = 1; len < INFLATE_MAX_BITS; len++) {
+        offset[len + 1] = offset[len] + h.count[len];
+    }
+    for (uint16_t i = 0; i < n; i++) {
+        if (lengths[i]) {
+            h.symbol[offset[lengths[i]]++] = i;
+        }
+    }
+
+    // Codes are sent MSB first but read LSB first, so index the table by the reversed code
+    uint16_t code = 0;
+    uint16_t index = 0;
+    for (uint8_t len = 1; len <= INFLATE_FAST_BITS; len++) {
+        for (uint16_t k = 0; k < h.count[len]; k++, code++) {
+            uint16_t reversed = 0;
+            for (uint8_t b = 0; b < len; b++) {
+                reversed |= ((code >> b) & 1) << (len - 1 - b);
+            }
+            uint16_t entry = (h.symbol[index++] << 4) | len;
+            for (uint16_t r = reversed; r < (1 << INFLATE_FAST_BITS); r += (1 << len)) {
+                h.fast[r] = entry;
+            }
+        }
+        code <<= 1;
+    }
+    return true;
+}
+
+bool OTAInflater::isCompressed(const uint8_t* data, size_t len) {
+    if (len < 2) {
+        return false;
+    }
+    if (data[0] == 0x1f && data[1] == 0x8b) {
+        return true;  // gzip
+    }
+    // zlib: deflate method, window <= 32 KB, header check bits
+    return (data[0] & 0x0f) == 8 && (data[0] >> 4) <= 7 && ((data[0] << 8) | data[1]) % 31 == 0;
+}
+
+size_t OTAInflater::memoryRequired() {
+    return sizeof(Workspace);
+}
+
+bool OTAInflater::begin(OutputFunction output, void* context) {
+    end();
+    ws = (Workspace*)malloc(sizeof(Workspace));
+    if (!ws) {
+        OTAM_LOG_E("Inflate: allocation of %u bytes failed", (unsigned)sizeof(Workspace));
+        return false;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (uint8_t k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        ws->crcTable[i] = c;
+    }
+
+    outputFn = output;
+    outputContext = context;
+    state = HEADER;
+    error = nullptr;
+    bitBuf = 0;
+    bitCount = 0;
+    headerStage = 0;
+    lastBlock = false;
+    windowPos = 0;
+    flushedPos = 0;
+    inBytes = 0;
+    outBytes = 0;
+    return true;
+}
+
+void OTAInflater::end() {
+    free(ws);
+    ws = nullptr;
+    if (state != DONE) {
+        state = FAILED;
+    }
+}
+
+bool OTAInflater::write(const uint8_t* data, size_t len) {
+    if (state == FAILED) {
+        return false;
+    }
+    inBytes += len;
+    if (state == DONE) {
+        return true;  // Padding after the stream is ignored
+    }
+
+    inPos = data;
+    inEnd = data + len;
+    while (state != DONE) {
+        uint64_t savedBuf = bitBuf;
+        uint8_t savedCount = bitCount;
+        const uint8_t* savedPos = inPos;
+
+        Step result = step();
+        if (result == STEP_OK) {
+            continue;
+        }
+        if (result == STEP_ERROR) {
+            state = FAILED;
+            break;
+        }
+        // Not enough input for a whole step: rewind it and keep the unread bytes as bits
+        // (a step needs at most 48 bits, so they always fit)
+        bitBuf = savedBuf;
+        bitCount = savedCount;
+        for (const uint8_t* p = savedPos; p < inEnd; p++) {
+            bitBuf |= (uint64_t)*p << bitCount;
+            bitCount += 8;
+        }
+        break;
+    }
+    inPos = inEnd = nullptr;
+
+    if (state != FAILED && !flush()) {
+        state = FAILED;
+    }
+    return state != FAILED;
+}
+
+OTAInflater::Step OTAInflater::step() {
+    switch (state) {
+        case HEADER: return readHeader();
+        case BLOCK_HEADER: return readBlockHeader();
+        case STORED_LEN: return readStoredLength();
+        case STORED_COPY: return copyStored();
+        case TABLE_COUNTS: return readTableCounts();
+        case TABLE_CODE_LENGTHS: return readCodeLengthCode();
+        case TABLE_LENGTHS: return readLengths();
+        case CODES: return decodeCodes();
+        case TRAILER: return readTrailer();
+        default: return STEP_ERROR;
+    }
+}
+
+OTAInflater::Step OTAInflater::fail(const char* msg) {
+    if (!error) {
+        error = msg;
+    }
+    return STEP_ERROR;
+}
+
+bool OTAInflater::need(uint8_t n) {
+    while (bitCount < n) {
+        if (inPos == inEnd) {
+            return false;
+        }
+        bitBuf |= (uint64_t)*inPos++ << bitCount;
+        bitCount += 8;
+    }
+    return true;
+}
+
+uint32_t OTAInflater::bits(uint8_t n) {
+    uint32_t value = (uint32_t)(bitBuf & ((1ULL << n) - 1));
+    bitBuf >>= n;
+    bitCount -= n;
+    return value;
+}
+
+int OTAInflater::decode(const Huffman& h) {
+    if (need(INFLATE_FAST_BITS)) {
+        uint16_t entry = h.fast[bitBuf & ((1 << INFLATE_FAST_BITS) - 1)];
+        if (entry) {
+            bits(entry & 15);
+            return entry >> 4;
+        }
+    }
+
+    // Longer codes (and the end of the input) are decoded one bit at a time
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    for (uint8_t len = 1; len <= INFLATE_MAX_BITS; len++) {
+        if (!need(len)) {
+            return -2;
+        }
+        code |= (bitBuf >> (len - 1)) & 1;
+        int count = h.count[len];
+        if (code - count < first) {
+            bits(len);
+            return h.symbol[index + (code - first)];
+        }
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+bool OTAInflater::flush() {
+    uint32_t n = windowPos - flushedPos;
+    if (n == 0) {
+        return true;
+    }
+    uint8_t* data = ws->window + (flushedPos & INFLATE_WINDOW_MASK);
+    if (gzip) {
+        uint32_t c = checksum;
+        for (uint32_t i = 0; i < n; i++) {
+            c = ws->crcTable[(c ^ data[i]) & 0xff] ^ (c >> 8);
+        }
+        checksum = c;
+    } else {
+        uint32_t a = checksum & 0xffff;
+        uint32_t b = checksum >> 16;
+        for (uint32_t i = 0; i < n;) {
+            uint32_t run = n - i < 5552 ? n - i : 5552;  // Largest run without overflow
+            for (uint32_t end = i + run; i < end; i++) {
+                a += data[i];
+                b += a;
+            }
+            a %= 65521;
+            b %= 65521;
+        }
+        checksum = (b << 16) | a;
+    }
+    flushedPos = windowPos;
+    outBytes += n;
+    if (!outputFn(outputContext, data, n)) {
+        fail("output rejected");
+        return false;
+    }
+    return true;
+}
+
+void OTAInflater::put(uint8_t b) {
+    ws->window[windowPos & INFLATE_WINDOW_MASK] = b;
+    windowPos++;
+}
+
+OTAInflater::Step OTAInflater::readHeader() {
+    switch (headerStage) {
+        case 0: {
+            if (!need(16)) {
+                return STEP_NEED_INPUT;
+            }
+            uint8_t b0 = bits(8);
+            uint8_t b1 = bits(8);
+            if (b0 == 0x1f && b1 == 0x8b) {
+                gzip = true;
+                checksum = 0xffffffff;
+                headerStage = 1;
+                return STEP_OK;
+            }
+            const uint8_t magic[2] = {b0, b1};
+            if (!isCompressed(magic, 2)) {
+                return fail("not a gzip or zlib stream");
+            }
+            if (b1 & 0x20) {
+                return fail("zlib preset dictionary not supported");
+            }
+            gzip = false;
+            checksum = 1;
+            state = BLOCK_HEADER;
+            return STEP_OK;
+        }
+        case 1:
+            // CM, FLG, MTIME, XFL, OS
+            if (!need(64)) {
+                return STEP_NEED_INPUT;
+            }
+            if (bits(8) != 8) {
+                return fail("unknown gzip compression method");
+            }
+            headerFlags = bits(8);
+            bits(32);
+            bits(16);
+            if (headerFlags & 0xe0) {
+                return fail("reserved gzip flags set");
+            }
+            headerStage = 2;
+            return STEP_OK;
+        case 2:
+            if (headerFlags & GZIP_FEXTRA) {
+                if (!need(16)) {
+                    return STEP_NEED_INPUT;
+                }
+                headerSkip = bits(16);
+            } else {
+                headerSkip = 0;
+            }
+            headerStage = 3;
+            return STEP_OK;
+        case 3:
+            if (headerSkip) {
+                if (!need(8)) {
+                    return STEP_NEED_INPUT;
+                }
+                bits(8);
+                headerSkip--;
+                return STEP_OK;
+            }
+            headerStage = 4;
+            return STEP_OK;
+        case 4:  // File name
+        case 5:  // Comment
+            if (headerFlags & (headerStage == 4 ? GZIP_FNAME : GZIP_FCOMMENT)) {
+                if (!need(8)) {
+                    return STEP_NEED_INPUT;
+                }
+                if (bits(8) != 0) {
+                    return STEP_OK;
+                }
+            }
+            headerStage++;
+            return STEP_OK;
+        default:
+            if (headerFlags & GZIP_FHCRC) {
+                if (!need(16)) {
+                    return STEP_NEED_INPUT;
+                }
+                bits(16);
+            }
+            state = BLOCK_HEADER;
+            return STEP_OK;
+    }
+}
+
+OTAInflater::Step OTAInflater::readBlockHeader() {
+    if (!need(3)) {
+        return STEP_NEED_INPUT;
+    }
+    lastBlock = bits(1);
+    switch (bits(2)) {
+        case 0:
+            state = STORED_LEN;
+            return STEP_OK;
+        case 1: {
+            uint8_t* l = ws->lengths;
+            memset(l, 8, 144);
+            memset(l + 144, 9, 112);
+            memset(l + 256, 7, 24);
+            memset(l + 280, 8, 8);
+            buildHuffman(ws->lit, l, 288);
+            memset(l, 5, 30);
+            buildHuffman(ws->dist, l, 30);
+            state = CODES;
+            return STEP_OK;
+        }
+        case 2:
+            state = TABLE_COUNTS;
+            return STEP_OK;
+        default:
+            return fail("invalid block type");
+    }
+}
+
+OTAInflater::Step OTAInflater::readStoredLength() {
+    bits(bitCount & 7);  // Stored blocks start on a byte boundary
+    if (!need(32)) {
+        return STEP_NEED_INPUT;
+    }
+    uint16_t len = bits(16);
+    uint16_t nlen = bits(16);
+    if (len != (uint16_t)~nlen) {
+        return fail("stored block length mismatch");
+    }
+    storedRemaining = len;
+    if (len) {
+        state = STORED_COPY;
+    } else {
+        state = lastBlock ? TRAILER : BLOCK_HEADER;
+    }
+    return STEP_OK;
+}
+
+OTAInflater::Step OTAInflater::copyStored() {
+    bool progressed = false;
+    while (storedRemaining) {
+        size_t n;
+        if (bitCount >= 8) {
+            put(bits(8));
+            n = 1;
+        } else if (inPos < inEnd) {
+            // Bulk copy up to the end of the input or the window
+            n = inEnd - inPos;
+            size_t room = INFLATE_WINDOW_SIZE - (windowPos & INFLATE_WINDOW_MASK);
+            if (n > room) {
+                n = room;
+            }
+            if (n > storedRemaining) {
+                n = storedRemaining;
+            }
+            memcpy(ws->window + (windowPos & INFLATE_WINDOW_MASK), inPos, n);
+            inPos += n;
+            windowPos += n;
+        } else {
+            break;
+        }
+        storedRemaining -= n;
+        progressed = true;
+        if ((windowPos & INFLATE_WINDOW_MASK) == 0 && !flush()) {
+            return STEP_ERROR;
+        }
+    }
+    if (!storedRemaining) {
+        state = lastBlock ? TRAILER : BLOCK_HEADER;
+        return STEP_OK;
+    }
+    return progressed ? STEP_OK : STEP_NEED_INPUT;
+}
+
+OTAInflater::Step OTAInflater::readTableCounts() {
+    if (!need(14)) {
+        return STEP_NEED_INPUT;
+    }
+    litCount = bits(5) + 257;
+    distCount = bits(5) + 1;
+    codeLengthCount = bits(4) + 4;
+    if (litCount > 286 || distCount > 30) {
+        return fail("too many length or distance codes");
+    }
+    memset(ws->lengths, 0, 19);
+    lengthIndex = 0;
+    state = TABLE_CODE_LENGTHS;
+    return STEP_OK;
+}
+
+OTAInflater::Step OTAInflater::readCodeLengthCode() {
+    if (!need(3)) {
+        return STEP_NEED_INPUT;
+    }
+    ws->lengths[codeLengthOrder[lengthIndex++]] = bits(3);
+    if (lengthIndex == codeLengthCount) {
+        if (!buildHuffman(ws->dist, ws->lengths, 19)) {
+            return fail("invalid code length code");
+        }
+        memset(ws->lengths, 0, sizeof(ws->lengths));
+        lengthIndex = 0;
+        state = TABLE_LENGTHS;
+    }
+    return STEP_OK;
+}
+
+OTAInflater::Step OTAInflater::readLengths() {
+    int sym = decode(ws->dist);
+    if (sym == -2) {
+        return STEP_NEED_INPUT;
+    }
+    if (sym < 0) {
+        return fail("invalid code length");
+    }
+
+    uint16_t total = litCount + distCount;
+    if (sym < 16) {
+        ws->lengths[lengthIndex++] = sym;
+    } else {
+        uint8_t len = 0;
+        uint8_t repeat;
+        if (sym == 16) {
+            if (lengthIndex == 0) {
+                return fail("repeat with no previous length");
+            }
+            if (!need(2)) {
+                return STEP_NEED_INPUT;
+            }
+            len = ws->lengths[lengthIndex - 1];
+            repeat = 3 + bits(2);
+        } else if (sym == 17) {
+            if (!need(3)) {
+                return STEP_NEED_INPUT;
+            }
+            repeat = 3 + bits(3);
+        } else {
+            if (!need(7)) {
+                return STEP_NEED_INPUT;
+            }
+            repeat = 11 + bits(7);
+        }
+        if (lengthIndex + repeat > total) {
+            return fail("too many code lengths");
+        }
+        memset(ws->lengths + lengthIndex, len, repeat);
+        lengthIndex += repeat;
+    }
+
+    if (lengthIndex == total) {
+        if (ws->lengths[256] == 0) {
+            return fail("missing end-of-block code");
+        }
+        if (!buildHuffman(ws->lit, ws->lengths, litCount) ||
+            !buildHuffman(ws->dist, ws->lengths + litCount, distCount)) {
+            return fail("invalid literal/length or distance code");
+        }
+        state = CODES;
+    }
+    return STEP_OK;
+}
+
+OTAInflater::Step OTAInflater::decodeCodes() {
+    int sym = decode(ws->lit);
+    if (sym == -2) {
+        return STEP_NEED_INPUT;
+    }
+    if (sym < 0) {
+        return fail("invalid literal/length code");
+    }
+    if (sym < 256) {
+        put(sym);
+        if ((windowPos & INFLATE_WINDOW_MASK) == 0 && !flush()) {
+            return STEP_ERROR;
+        }
+        return STEP_OK;
+    }
+    if (sym == 256) {
+        state = lastBlock ? TRAILER : BLOCK_HEADER;
+        return STEP_OK;
+    }
+
+    sym -= 257;
+    if (sym >= 29) {
+        return fail("invalid length code");
+    }
+    if (!need(lengthExtra[sym])) {
+        return STEP_NEED_INPUT;
+    }
+    uint16_t len = lengthBase[sym] + bits(lengthExtra[sym]);
+
+    int d = decode(ws->dist);
+    if (d == -2) {
+        return STEP_NEED_INPUT;
+    }
+    if (d < 0 || d >= 30) {
+        return fail("invalid distance code");
+    }
+    if (!need(distExtra[d])) {
+        return STEP_NEED_INPUT;
+    }
+    uint32_t dist = distBase[d] + bits(distExtra[d]);
+    if (dist > windowPos) {
+        return fail("distance too far back");
+    }
+
+    while (len--) {
+        put(ws->window[(windowPos - dist) & INFLATE_WINDOW_MASK]);
+        if ((windowPos & INFLATE_WINDOW_MASK) == 0 && !flush()) {
+            return STEP_ERROR;
+        }
+    }
+    return STEP_OK;
+}
+
+OTAInflater::Step OTAInflater::readTrailer() {
+    if (!flush()) {
+        return STEP_ERROR;
+    }
+    bits(bitCount & 7);
+    if (gzip) {
+        // CRC-32 and length of the decoded data, little endian
+        if (!need(64)) {
+            return STEP_NEED_INPUT;
+        }
+        uint32_t crc = bits(32);
+        uint32_t size = bits(32);
+        if (crc != ~checksum) {
+            return fail("CRC-32 mismatch");
+        }
+        if (size != (uint32_t)outBytes) {
+            return fail("length mismatch");
+        }
+    } else {
+        // Adler-32, big endian
+        if (!need(32)) {
+            return STEP_NEED_INPUT;
+        }
+        uint32_t adler = 0;
+        for (uint8_t i = 0; i < 4; i++) {
+            adler = (adler << 8) | bits(8);
+        }
+        if (adler != checksum) {
+            return fail("Adler-32 mismatch");
+        }
+    }
+    state = DONE;
+    return STEP_OK;
+}
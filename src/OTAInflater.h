@@ -0,0 +1,144 @@
+/**
+ * @file OTAInflater.h
+ * @brief Streaming gzip/zlib decoder for compressed OTA images
+ *
+ * @details Decodes RFC 1951 deflate data wrapped in a gzip (RFC 1952) or zlib
+ * (RFC 1950) container as it arrives, in whatever pieces the socket delivers.
+ * Memory is bounded: the 32 KB history window plus ~3.5 KB of Huffman tables,
+ * allocated in begin() and released in end(). Decoded data is handed to an
+ * output function in window-sized pieces at most, and the container checksum
+ * (CRC-32 or Adler-32) and length are verified at the end of the stream.
+ */
+#pragma once
+
+#include <Arduino.h>
+
+class OTAInflater {
+   public:
+    /**
+     * @brief Receives decoded data; returns false to abort decoding
+     */
+    typedef bool (*OutputFunction)(void* context, uint8_t* data, size_t len);
+
+    ~OTAInflater() { end(); }
+
+    /**
+     * @brief Check whether the first bytes of an image are a gzip or zlib header
+     *
+     * @param data At least two bytes from the start of the image
+     */
+    static bool isCompressed(const uint8_t* data, size_t len);
+
+    /**
+     * @brief Allocate the window and tables and reset the decoder
+     *
+     * @return false if memory could not be allocated
+     */
+    bool begin(OutputFunction output, void* context);
+
+    /**
+     * @brief Release the window and tables
+     */
+    void end();
+
+    /**
+     * @brief Decode the next piece of the compressed stream
+     *
+     * @return false if the stream is corrupt or the output function failed
+     */
+    bool write(const uint8_t* data, size_t len);
+
+    /**
+     * @brief True once the whole stream, including its checksum, has been verified
+     */
+    bool isFinished() const { return state == DONE; }
+    bool hasFailed() const { return state == FAILED; }
+
+    size_t totalIn() const { return inBytes; }
+    size_t totalOut() const { return outBytes; }
+
+    /**
+     * @brief Description of the first decoding error, or nullptr
+     */
+    const char* errorString() const { return error; }
+
+    /**
+     * @brief Heap allocated by begin()
+     */
+    static size_t memoryRequired();
+
+   private:
+    enum State {
+        HEADER,
+        BLOCK_HEADER,
+        STORED_LEN,
+        STORED_COPY,
+        TABLE_COUNTS,
+        TABLE_CODE_LENGTHS,
+        TABLE_LENGTHS,
+        CODES,
+        TRAILER,
+        DONE,
+        FAILED
+    };
+    enum Step { STEP_OK, STEP_NEED_INPUT, STEP_ERROR };
+
+    struct Huffman;
+    struct Workspace;
+
+    static bool buildHuffman(Huffman& h, const uint8_t* lengths, uint16_t n);
+
+    Step step();
+    Step readHeader();
+    Step readBlockHeader();
+    Step readStoredLength();
+    Step copyStored();
+    Step readTableCounts();
+    Step readCodeLengthCode();
+    Step readLengths();
+    Step decodeCodes();
+    Step readTrailer();
+
+    bool need(uint8_t n);
+    uint32_t bits(uint8_t n);
+    int decode(const Huffman& h);
+    Step fail(const char* msg);
+
+    void put(uint8_t b);
+    bool flush();
+
+    Workspace* ws = nullptr;
+    OutputFunction outputFn = nullptr;
+    void* outputContext = nullptr;
+
+    State state = FAILED;
+    const char* error = nullptr;
+
+    // Bit reader over the current input piece
+    const uint8_t* inPos = nullptr;
+    const uint8_t* inEnd = nullptr;
+    uint64_t bitBuf = 0;
+    uint8_t bitCount = 0;
+
+    // Container
+    bool gzip = false;
+    uint8_t headerFlags = 0;
+    uint8_t headerStage = 0;
+    uint16_t headerSkip = 0;
+    uint32_t checksum = 0;
+
+    // Block decoding
+    bool lastBlock = false;
+    uint16_t storedRemaining = 0;
+    uint16_t litCount = 0;
+    uint16_t distCount = 0;
+    uint16_t codeLengthCount = 0;
+    uint16_t lengthIndex = 0;
+
+    // Output window
+    uint32_t windowPos = 0;   // Total bytes decoded (window index = windowPos & mask)
+    uint32_t flushedPos = 0;  // Bytes already handed to the output function
+
+    size_t inBytes = 0;
+    size_t outBytes = 0;
+};
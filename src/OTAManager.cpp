@@ -1,20 +1,148 @@
 // OTAManager.cpp
 #include "OTAManager.h"
+#include "OTANetworkState.h"
+#include "OTAReceiver.h"
+#include "OTAStats.h"
+#include "OTAUdpProbe.h"
 
 #ifdef ESP32
+    #include <esp_arduino_version.h>
     #if CONFIG_WIFI_ENABLED == 1
         #include <WiFi.h>
     #endif
+    #if OTA_NETWORK_EVENTS_ENABLED
+        #if ESP_ARDUINO_VERSION_MAJOR >= 3
+            #include <Network.h>
+            #define OTA_NETWORK_EVENT_SOURCE Network
+        #elif CONFIG_WIFI_ENABLED == 1
+            // Core 2.x delivers Ethernet events through WiFiGeneric as well
+            #define OTA_NETWORK_EVENT_SOURCE WiFi
+        #endif
+    #endif
 #endif
 
 // Initialize static members
-bool OTAManager::initialized = false;
+std::atomic<bool> OTAManager::initialized{false};
+std::atomic<bool> OTAManager::pollingActive{false};
+std::atomic<bool> OTAManager::networkEvents{false};
+unsigned long OTAManager::lastWaitLog = 0;
+unsigned long OTAManager::lastNetworkErrorLog = 0;
 OTAManager::NetworkCheckCallback OTAManager::networkCheckCallback = nullptr;
 SemaphoreHandle_t OTAManager::mutex = nullptr;
+uint16_t OTAManager::otaPort = OTA_PORT;
+volatile TaskHandle_t OTAManager::listenerTaskHandle = nullptr;
+volatile bool OTAManager::listenerStopRequested = false;
+bool OTAManager::signingRequired = false;
+volatile TaskHandle_t OTAManager::callbackTaskHandle = nullptr;
+bool OTAManager::callbacksQueued = false;
+volatile TaskHandle_t OTAManager::pollTaskHandle = nullptr;
+volatile bool OTAManager::pollStopRequested = false;
+SemaphoreHandle_t OTAManager::callbackMutex = nullptr;
+ArduinoOTAClass::THandlerFunction OTAManager::userStartCallback = nullptr;
+ArduinoOTAClass::THandlerFunction OTAManager::userEndCallback = nullptr;
+ArduinoOTAClass::THandlerFunction_Progress OTAManager::userProgressCallback = nullptr;
+ArduinoOTAClass::THandlerFunction_Error OTAManager::userErrorCallback = nullptr;
+OTAManager::BoundHandler<OTAManager::StartHandler> OTAManager::startHandler = {nullptr, nullptr};
+OTAManager::BoundHandler<OTAManager::EndHandler> OTAManager::endHandler = {nullptr, nullptr};
+OTAManager::BoundHandler<OTAManager::ProgressHandler> OTAManager::progressHandler = {nullptr, nullptr};
+OTAManager::BoundHandler<OTAManager::ErrorHandler> OTAManager::errorHandler = {nullptr, nullptr};
+
+// Built-in espota receiver used in listener mode
+static OTAReceiver receiver;
+
+// Interface readiness, written by network events
+static OTANetworkState networkState;
+
+// Session events for the callback task
+static OTACallbackQueue callbackQueue;
+
+// Application parts paused for the length of a session
+static OTAQuiesce quiesce;
+
+// Priority and core of the session task (OTA_SESSION_PRIORITY, OTA_SESSION_CORE)
+static OTASessionBoost sessionBoost;
+
+// Subscribers to session events, next to the application's callbacks
+static OTAEventBus eventBus;
+
+// Delay handleUpdates() recommends, and ArduinoOTA's socket it watches (under the mutex)
+static OTAPollCadence pollCadence;
+static OTAUdpProbe otaSocket;
+static unsigned long lastAttachAttempt = 0;
+static bool attachWarned = false;
+
+// Set by handleUpdates(): the poll task may wait on otaSocket instead of pollWake
+static std::atomic<bool> pollOnSocket{false};
+
+// Looks for ArduinoOTA's socket again, at most every OTA_CHECK_INTERVAL_MS
+static void attachOtaSocket(uint16_t port, unsigned long now) {
+    if (otaSocket.attached() || (lastAttachAttempt && now - lastAttachAttempt < OTA_CHECK_INTERVAL_MS)) {
+        return;
+    }
+    lastAttachAttempt = now ? now : 1;
+    if (otaSocket.attach(port)) {
+        OTAM_LOG_D("Watching UDP port %u for invites", port);
+        attachWarned = false;
+    } else if (!attachWarned) {
+        OTAM_LOG_W("No UDP socket on port %u yet, polling every %u ms", port, OTA_CHECK_INTERVAL_MS);
+        attachWarned = true;
+    }
+}
+
+// Cuts the poll task's wait short; created by the first startPollTask(), then kept
+static SemaphoreHandle_t pollWake = nullptr;
+
+static void wakePollTask() {
+    if (pollWake) {
+        xSemaphoreGive(pollWake);
+    }
+}
+
+// Session and handleUpdates() counters, read by getStats() without the mutex
+static OTAStatsRecorder stats;
+
+// Duration of handleUpdates() calls that poll (the receiver keeps the other histograms)
+static OTAHistogram handleUpdatesLatency;
+
+// Session trace position, kept by the session hooks (which run under the mutex)
+static uint32_t traceReports = 0;
+static uint32_t traceBaseBytes = 0;
+static uint32_t traceBytes = 0;
+
+// Address for the periodic status log, formatted again only when it changes
+static char waitLogAddress[16] = "unknown";
+static uint32_t waitLogChanges = 0;
+
+#ifdef OTA_NETWORK_EVENT_SOURCE
+static void onNetworkEvent(arduino_event_id_t event, arduino_event_info_t info) {
+    switch (event) {
+        case ARDUINO_EVENT_ETH_GOT_IP:
+            networkState.up(OTANetworkState::ETHERNET, info.got_ip.ip_info.ip.addr);
+            wakePollTask();
+            break;
+        case ARDUINO_EVENT_ETH_LOST_IP:
+        case ARDUINO_EVENT_ETH_DISCONNECTED:
+        case ARDUINO_EVENT_ETH_STOP:
+            networkState.down(OTANetworkState::ETHERNET);
+            break;
+        case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+            networkState.up(OTANetworkState::WIFI, info.got_ip.ip_info.ip.addr);
+            wakePollTask();
+            break;
+        case ARDUINO_EVENT_WIFI_STA_LOST_IP:
+        case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+        case ARDUINO_EVENT_WIFI_STA_STOP:
+            networkState.down(OTANetworkState::WIFI);
+            break;
+        default:
+            break;
+    }
+}
+#endif
 
 void OTAManager::initialize(const char* hostname, const char* password, uint16_t port,
-                            NetworkCheckCallback networkCheckCb) {
-    // Create mutex on first initialization
+                            NetworkCheckCallback networkCheckCb, const OTATuning& tuning) {
+    // Create mutexes on first initialization
     if (!mutex) {
         mutex = xSemaphoreCreateMutex();
         if (!mutex) {
@@ -22,6 +150,13 @@ void OTAManager::initialize(const char* hostname, const char* password, uint16_t
             return;
         }
     }
+    if (!callbackMutex) {
+        callbackMutex = xSemaphoreCreateMutex();
+        if (!callbackMutex) {
+            OTAM_LOG_E("Failed to create callback mutex for OTA Manager");
+            return;
+        }
+    }
     
     MutexGuard lock(mutex);
     
@@ -41,12 +176,14 @@ void OTAManager::initialize(const char* hostname, const char* password, uint16_t
 
     // Store the network check callback
     networkCheckCallback = networkCheckCb;
+    subscribeNetworkEvents();
 
     // Configure ArduinoOTA
     ArduinoOTA.setHostname(hostname);
 
     if (password && strlen(password) > 0) {
         ArduinoOTA.setPassword(password);
+        receiver.setPassword(password);
         OTAM_LOG_I("OTA password protection enabled");
     } else {
         OTAM_LOG_W("OTA running without password protection");
@@ -56,76 +193,107 @@ void OTAManager::initialize(const char* hostname, const char* password, uint16_t
         ArduinoOTA.setPort(port);
         OTAM_LOG_D("OTA port set to %u", port);
     }
+    otaPort = port;
 
-    // Set default callbacks
+#if defined(OTA_SIGNING_PUBLIC_KEY) && OTA_SIGNATURE_ENABLED
+    uint8_t signingKey[OTASignature::PUBLIC_KEY_SIZE];
+    if (!OTASignature::fromHex(OTA_SIGNING_PUBLIC_KEY, signingKey, sizeof(signingKey))) {
+        // Failing closed: a mistyped key must not leave the device accepting anything
+        OTAM_LOG_E("OTA_SIGNING_PUBLIC_KEY must be 64 hex characters");
+        return;
+    }
+    receiver.setSigningKey(signingKey);
+    signingRequired = true;
+    OTAM_LOG_I("OTA signature checking enabled");
+#endif
+
+    // ArduinoOTA's transfer loop is fixed; tuning applies to the listener's receiver
+    receiver.setTuning(tuning);
+
+    // Session hooks record statistics, then run the application's callback or the default
     ArduinoOTA
-        .onStart([]() {
-            const char* type = (ArduinoOTA.getCommand() == U_FLASH) ? "sketch" : "filesystem";
-            OTAM_LOG_I("Start updating %s", type);
-            (void)type; // Suppress unused warning when logging is disabled
-        })
-        .onEnd([]() {
-            OTAM_LOG_I("Update complete. Rebooting...");
-            delay(1000);
-            ESP.restart();
-        })
-        .onProgress(handleOTAProgress)
-        .onError([](ota_error_t error) { handleOTAError(error); });
-
-    // Begin OTA server and check for success
-    ArduinoOTA.begin();
+        .onStart(onSessionStart)
+        .onEnd(onSessionEnd)
+        .onProgress(onArduinoOTAProgress)
+        .onError(onSessionError);
+    receiver
+        .onStart(onSessionStart)
+        .onEnd(onReceiverEnd)
+        .onProgress(onReceiverProgress)
+        .onError(onSessionError);
+
+    // Begin OTA server unless the listener already owns the port
+    if (!listenerTaskHandle) {
+        ArduinoOTA.begin();
+    }
     initialized = true;  // ArduinoOTA.begin() doesn't return error status
+    updatePolling();
 
     OTAM_LOG_I("OTA Manager initialized successfully");
 }
 
 bool OTAManager::isInitialized() {
-    MutexGuard lock(mutex);
     return initialized;
 }
 
-void OTAManager::handleUpdates() {
-    // Quick check without lock for performance
-    if (!initialized) {
-        return;
+void OTAManager::updatePolling() {
+    // Signed images are only accepted by the listener, which also serves updates in
+    // listener mode
+    bool polling = initialized && !listenerTaskHandle && !signingRequired;
+    otaSocket.detach();
+    lastAttachAttempt = 0;
+    if (polling) {
+        attachOtaSocket(otaPort, millis());
+        pollCadence.activity();  // Poll at once on a new socket, then back off again
     }
-    
-    // Protected static variables to avoid race conditions
-    static unsigned long lastLog = 0;
-    static unsigned long lastErrorLog = 0;
+    pollingActive.store(polling, std::memory_order_release);
+    wakePollTask();
+}
 
-    if (isNetworkReady()) {
-        MutexGuard lock(mutex);
-        if (initialized) {  // Double-check with lock held
-            ArduinoOTA.handle();  // must be called frequently (every few hundred ms)
-        }
+uint32_t OTAManager::handleUpdates() {
+    // Idle fast path: a single atomic load, no lock and no shared write
+    if (!pollingActive.load(std::memory_order_acquire)) {
+        return OTA_POLL_IDLE_MAX_MS;
+    }
 
-        unsigned long now = millis();
-        if (now - lastLog >= OTA_LOG_INTERVAL_MS) {
-            // Get IP address based on available network
-            String ipAddr = "unknown";
-            #if defined(ESP32) && defined(ETH)
-                if (ETH.linkSpeed() > 0 && ETH.localIP() != IPAddress(0, 0, 0, 0)) {
-                    ipAddr = ETH.localIP().toString();
-                }
-            #endif
-            #if defined(ESP32) && CONFIG_WIFI_ENABLED == 1
-                if (WiFi.status() == WL_CONNECTED && WiFi.localIP() != IPAddress(0, 0, 0, 0)) {
-                    ipAddr = WiFi.localIP().toString();
-                }
-            #endif
-            
-            OTAM_LOG_D("Waiting for OTA updates on %s:%u...", 
-                         ipAddr.c_str(), OTA_PORT);
-            lastLog = now;
-        }
-    } else {
-        unsigned long now = millis();
-        if (now - lastErrorLog >= OTA_ERROR_LOG_INTERVAL_MS) {
-            OTAM_LOG_E("Network not connected, skipping OTA check");
-            lastErrorLog = now;
+    // One lock covers the network check, ArduinoOTA and the log timestamps
+    unsigned long enteredAt = micros();
+    MutexGuard lock(mutex);
+    if (!pollingActive.load(std::memory_order_relaxed)) {
+        return OTA_POLL_IDLE_MAX_MS;  // The listener started (or a key was set) while we waited
+    }
+    stats.countPoll();
+    unsigned long lockedAt = micros();
+
+    bool networkReady = checkNetworkLocked();
+    bool packet = false;
+    unsigned long now = millis();
+    if (networkReady) {
+        attachOtaSocket(otaPort, now);  // Late bind, or the socket was replaced
+        packet = otaSocket.pending();   // Answered by this call; the next step is due soon
+        ArduinoOTA.handle();            // must be called frequently (every few hundred ms)
+    }
+    if (networkReady) {
+        if (now - lastWaitLog >= OTA_LOG_INTERVAL_MS) {
+            uint32_t changes = networkState.changes();
+            if (changes != waitLogChanges) {
+                networkState.formatAddress(waitLogAddress, sizeof(waitLogAddress));
+                waitLogChanges = changes;
+            }
+            OTAM_LOG_D("Waiting for OTA updates on %s:%u...", waitLogAddress, otaPort);
+            lastWaitLog = now;
         }
+    } else if (now - lastNetworkErrorLog >= OTA_ERROR_LOG_INTERVAL_MS) {
+        OTAM_LOG_E("Network not connected, skipping OTA check");
+        lastNetworkErrorLog = now;
     }
+    unsigned long leftAt = micros();
+    stats.addLockedUs(leftAt - lockedAt);
+    handleUpdatesLatency.record(leftAt - enteredAt);
+
+    bool watched = networkReady && otaSocket.attached();
+    pollOnSocket.store(watched, std::memory_order_relaxed);
+    return networkReady ? pollCadence.next(packet, watched) : pollCadence.networkDown();
 }
 
 void OTAManager::setStartCallback(ArduinoOTAClass::THandlerFunction cb) {
@@ -135,7 +303,9 @@ void OTAManager::setStartCallback(ArduinoOTAClass::THandlerFunction cb) {
         return;
     }
     if (cb) {
-        ArduinoOTA.onStart(cb);
+        MutexGuard callbacks(callbackMutex);
+        userStartCallback = cb;
+        startHandler = {nullptr, nullptr};
         OTAM_LOG_D("Custom OTA start callback set");
     }
 }
@@ -147,7 +317,9 @@ void OTAManager::setEndCallback(ArduinoOTAClass::THandlerFunction cb) {
         return;
     }
     if (cb) {
-        ArduinoOTA.onEnd(cb);
+        MutexGuard callbacks(callbackMutex);
+        userEndCallback = cb;
+        endHandler = {nullptr, nullptr};
         OTAM_LOG_D("Custom OTA end callback set");
     }
 }
@@ -159,7 +331,9 @@ void OTAManager::setProgressCallback(ArduinoOTAClass::THandlerFunction_Progress
         return;
     }
     if (cb) {
-        ArduinoOTA.onProgress(cb);
+        MutexGuard callbacks(callbackMutex);
+        userProgressCallback = cb;
+        progressHandler = {nullptr, nullptr};
         OTAM_LOG_D("Custom OTA progress callback set");
     }
 }
@@ -171,27 +345,652 @@ void OTAManager::setErrorCallback(ArduinoOTAClass::THandlerFunction_Error cb) {
         return;
     }
     if (cb) {
-        ArduinoOTA.onError(cb);
+        MutexGuard callbacks(callbackMutex);
+        userErrorCallback = cb;
+        errorHandler = {nullptr, nullptr};
         OTAM_LOG_D("Custom OTA error callback set");
     }
 }
 
+void OTAManager::setStartCallback(StartHandler handler, void* context) {
+    MutexGuard lock(mutex);
+    if (!initialized) {
+        OTAM_LOG_W("Cannot set callback - OTA not initialized");
+        return;
+    }
+    if (handler) {
+        MutexGuard callbacks(callbackMutex);
+        startHandler = {handler, context};
+        userStartCallback = nullptr;
+        OTAM_LOG_D("Custom OTA start handler set");
+    }
+}
+
+void OTAManager::setEndCallback(EndHandler handler, void* context) {
+    MutexGuard lock(mutex);
+    if (!initialized) {
+        OTAM_LOG_W("Cannot set callback - OTA not initialized");
+        return;
+    }
+    if (handler) {
+        MutexGuard callbacks(callbackMutex);
+        endHandler = {handler, context};
+        userEndCallback = nullptr;
+        OTAM_LOG_D("Custom OTA end handler set");
+    }
+}
+
+void OTAManager::setProgressCallback(ProgressHandler handler, void* context) {
+    MutexGuard lock(mutex);
+    if (!initialized) {
+        OTAM_LOG_W("Cannot set callback - OTA not initialized");
+        return;
+    }
+    if (handler) {
+        MutexGuard callbacks(callbackMutex);
+        progressHandler = {handler, context};
+        userProgressCallback = nullptr;
+        OTAM_LOG_D("Custom OTA progress handler set");
+    }
+}
+
+void OTAManager::setErrorCallback(ErrorHandler handler, void* context) {
+    MutexGuard lock(mutex);
+    if (!initialized) {
+        OTAM_LOG_W("Cannot set callback - OTA not initialized");
+        return;
+    }
+    if (handler) {
+        MutexGuard callbacks(callbackMutex);
+        errorHandler = {handler, context};
+        userErrorCallback = nullptr;
+        OTAM_LOG_D("Custom OTA error handler set");
+    }
+}
+
+int OTAManager::subscribe(const OTASubscriber& subscriber) {
+    MutexGuard lock(mutex);
+    if (!initialized) {
+        OTAM_LOG_W("Cannot subscribe - OTA not initialized");
+        return -1;
+    }
+    int id = eventBus.subscribe(subscriber);
+    if (id < 0) {
+        OTAM_LOG_W("Cannot subscribe - %d subscribers already", OTAEventBus::CAPACITY);
+    } else {
+        OTAM_LOG_D("Subscriber %d added", id);
+    }
+    return id;
+}
+
+bool OTAManager::unsubscribe(int id) {
+    MutexGuard lock(mutex);
+    if (!initialized) {
+        return false;
+    }
+    return eventBus.unsubscribe(id);
+}
+
+bool OTAManager::startListener(UBaseType_t priority, BaseType_t core) {
+    MutexGuard lock(mutex);
+    if (!initialized) {
+        OTAM_LOG_W("Cannot start listener - OTA not initialized");
+        return false;
+    }
+    if (listenerTaskHandle) {
+        return true;
+    }
+
+    // Hand the OTA port over from ArduinoOTA to the built-in receiver
+    ArduinoOTA.end();
+    otaSocket.detach();
+    pollOnSocket.store(false, std::memory_order_relaxed);
+    if (!receiver.begin(otaPort)) {
+        ArduinoOTA.begin();
+        updatePolling();
+        return false;
+    }
+
+    listenerStopRequested = false;
+    TaskHandle_t handle = nullptr;
+    if (xTaskCreatePinnedToCore(listenerTask, "OTAListener", OTA_LISTENER_TASK_STACK, nullptr,
+                                priority, &handle, core) != pdPASS) {
+        OTAM_LOG_E("Failed to create OTA listener task");
+        receiver.end();
+        ArduinoOTA.begin();
+        updatePolling();
+        return false;
+    }
+    listenerTaskHandle = handle;
+    updatePolling();
+
+    OTAM_LOG_I("OTA listener started on port %u", otaPort);
+    return true;
+}
+
+void OTAManager::stopListener() {
+    if (!listenerTaskHandle) {
+        return;
+    }
+
+    // Must not hold the mutex here: the task takes it to finish a pending session
+    listenerStopRequested = true;
+    while (listenerTaskHandle) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    MutexGuard lock(mutex);
+    receiver.end();
+    ArduinoOTA.begin();
+    updatePolling();
+    OTAM_LOG_I("OTA listener stopped, polling mode restored");
+}
+
+bool OTAManager::startCallbackTask(UBaseType_t priority, BaseType_t core) {
+    MutexGuard lock(mutex);
+    if (!initialized) {
+        OTAM_LOG_W("Cannot start callback task - OTA not initialized");
+        return false;
+    }
+    if (callbackTaskHandle) {
+        return true;
+    }
+
+    if (!callbackQueue.begin(OTA_CALLBACK_QUEUE_LENGTH)) {
+        OTAM_LOG_E("Failed to create OTA callback queue");
+        return false;
+    }
+    TaskHandle_t handle = nullptr;
+    if (xTaskCreatePinnedToCore(callbackTask, "OTACallbacks", OTA_CALLBACK_TASK_STACK, nullptr,
+                                priority, &handle, core) != pdPASS) {
+        OTAM_LOG_E("Failed to create OTA callback task");
+        callbackQueue.end();
+        return false;
+    }
+    callbackTaskHandle = handle;
+    callbacksQueued = true;
+
+    OTAM_LOG_I("OTA callbacks run on their own task");
+    return true;
+}
+
+void OTAManager::stopCallbackTask() {
+    {
+        MutexGuard lock(mutex);
+        if (!callbackTaskHandle) {
+            return;
+        }
+        callbacksQueued = false;  // From here on the session hooks call the callbacks inline
+    }
+
+    // Must not hold the mutex here: the events still queued may run callbacks that take it
+    callbackQueue.post(OTA_CALLBACK_STOP, 0, portMAX_DELAY);
+    while (callbackTaskHandle) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    callbackQueue.end();
+    OTAM_LOG_I("OTA callback task stopped, callbacks run inline");
+}
+
+bool OTAManager::isCallbackTaskRunning() {
+    return callbackTaskHandle != nullptr;
+}
+
+bool OTAManager::startPollTask(UBaseType_t priority, BaseType_t core) {
+    MutexGuard lock(mutex);
+    if (!initialized) {
+        OTAM_LOG_W("Cannot start poll task - OTA not initialized");
+        return false;
+    }
+    if (pollTaskHandle) {
+        return true;
+    }
+
+    if (!pollWake) {
+        pollWake = xSemaphoreCreateBinary();
+        if (!pollWake) {
+            OTAM_LOG_E("Failed to create OTA poll semaphore");
+            return false;
+        }
+    }
+    pollStopRequested = false;
+    TaskHandle_t handle = nullptr;
+    if (xTaskCreatePinnedToCore(pollTask, "OTAPoll", OTA_POLL_TASK_STACK, nullptr, priority, &handle,
+                                core) != pdPASS) {
+        OTAM_LOG_E("Failed to create OTA poll task");
+        return false;
+    }
+    pollTaskHandle = handle;
+
+    OTAM_LOG_I("OTA poll task started");
+    return true;
+}
+
+void OTAManager::stopPollTask() {
+    if (!pollTaskHandle) {
+        return;
+    }
+    // Must not hold the mutex here: the task needs it to finish its call
+    pollStopRequested = true;
+    wakePollTask();
+    while (pollTaskHandle) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    OTAM_LOG_I("OTA poll task stopped");
+}
+
+bool OTAManager::isPollTaskRunning() {
+    return pollTaskHandle != nullptr;
+}
+
+OTACallbackStats OTAManager::getCallbackStats() {
+    return callbackQueue.getStats();
+}
+
+int OTAManager::addQuiesceParticipant(const OTAParticipant& participant) {
+    MutexGuard lock(mutex);
+    if (!initialized) {
+        OTAM_LOG_W("Cannot add participant - OTA not initialized");
+        return -1;
+    }
+    int id = quiesce.add(participant);
+    if (id < 0) {
+        OTAM_LOG_W("Cannot add participant %s", participant.name ? participant.name : "");
+    }
+    return id;
+}
+
+bool OTAManager::removeQuiesceParticipant(int id) {
+    MutexGuard lock(mutex);
+    if (!initialized) {
+        return false;
+    }
+    return quiesce.remove(id);
+}
+
+void OTAManager::acknowledgeQuiesce(int id) {
+    quiesce.acknowledge(id);
+}
+
+OTAQuiesceStats OTAManager::getQuiesceStats() {
+    return quiesce.getStats();
+}
+
+bool OTAManager::setSessionBoost(UBaseType_t priority, BaseType_t core) {
+    MutexGuard lock(mutex);
+    return sessionBoost.configure(priority, core);
+}
+
+void OTAManager::setPipelineEnabled(bool enabled) {
+    MutexGuard lock(mutex);
+    receiver.setPipelineEnabled(enabled);
+}
+
+void OTAManager::setSigningKey(const uint8_t* publicKey) {
+    MutexGuard lock(mutex);
+#if OTA_SIGNATURE_ENABLED
+    receiver.setSigningKey(publicKey);
+    signingRequired = publicKey != nullptr;
+    updatePolling();
+    if (signingRequired && !listenerTaskHandle) {
+        OTAM_LOG_W("Signed updates need listener mode; ArduinoOTA updates are refused");
+    }
+#else
+    (void)publicKey;
+    OTAM_LOG_E("Signature checking is disabled (OTA_SIGNATURE_ENABLED)");
+#endif
+}
+
+bool OTAManager::pullUpdate(const char* url, const OTAPullOptions& options) {
+    if (!initialized) {
+        OTAM_LOG_W("OTA not initialized, cannot pull %s", url);
+        return false;
+    }
+    if (!isNetworkReady()) {
+        OTAM_LOG_E("Network not connected, cannot pull %s", url);
+        return false;
+    }
+    // Holding the mutex keeps the listener and handleUpdates() out until the pull ends
+    MutexGuard lock(mutex);
+    return receiver.pull(url, options);
+}
+
+OTAPullStats OTAManager::getPullStats() {
+    MutexGuard lock(mutex);
+    return receiver.getPullStats();
+}
+
+bool OTAManager::joinMulticast(const char* group, uint16_t port, const char* interfaceIp) {
+    MutexGuard lock(mutex);
+    if (!listenerTaskHandle) {
+        OTAM_LOG_W("Cannot join %s - multicast sessions need the listener", group ? group : "(null)");
+        return false;
+    }
+    return receiver.joinMulticast(group, port, interfaceIp);
+}
+
+void OTAManager::leaveMulticast() {
+    MutexGuard lock(mutex);
+    receiver.leaveMulticast();
+}
+
+OTAStats OTAManager::getStats() {
+    return stats.snapshot();
+}
+
+OTAHistogramSnapshot OTAManager::getLatencyHistogram(OTALatencySource source) {
+    return latencyHistogram(source).snapshot();
+}
+
+void OTAManager::resetLatencyHistograms() {
+    for (int i = 0; i < OTA_LATENCY_SOURCES; i++) {
+        latencyHistogram((OTALatencySource)i).reset();
+    }
+}
+
+void OTAManager::logLatencyHistograms() {
+    static const char* const names[OTA_LATENCY_SOURCES] = {"Socket read", "Flash write",
+                                                           "handleUpdates()"};
+    for (int i = 0; i < OTA_LATENCY_SOURCES; i++) {
+        OTAHistogramSnapshot h = latencyHistogram((OTALatencySource)i).snapshot();
+        OTAM_LOG_I("%s: %u samples, p50 <= %u us, p99 <= %u us, max %u us", names[i],
+                   (unsigned)h.count, (unsigned)h.percentileUs(0.5f), (unsigned)h.percentileUs(0.99f),
+                   (unsigned)h.maxUs);
+        for (int b = 0; b < OTA_LATENCY_BUCKETS; b++) {
+            if (h.buckets[b]) {
+                OTAM_LOG_I("  %8u us+: %u", (unsigned)OTAHistogramSnapshot::bucketLowUs(b),
+                           (unsigned)h.buckets[b]);
+            }
+        }
+        (void)names;
+    }
+}
+
+size_t OTAManager::getTrace(uint8_t* buffer, size_t len) {
+    return receiver.eventTrace().dump(buffer, len);
+}
+
+void OTAManager::clearTrace() {
+    receiver.eventTrace().clear();
+}
+
+void OTAManager::logTrace() {
+    // 32 bytes per line, each line read straight from the ring: no dump buffer
+    const OTATrace& trace = receiver.eventTrace();
+    OTAM_LOG_I("Trace: %u events recorded, %u bytes", (unsigned)trace.recorded(),
+               (unsigned)trace.dumpSize());
+    uint8_t bytes[32];
+    size_t n;
+    for (size_t offset = 0; (n = trace.dump(bytes, sizeof(bytes), offset)) > 0; offset += n) {
+        char hex[2 * sizeof(bytes) + 1];
+        for (size_t i = 0; i < n; i++) {
+            snprintf(hex + 2 * i, 3, "%02x", bytes[i]);
+        }
+        OTAM_LOG_I("Trace %04x: %s", (unsigned)offset, hex);
+    }
+}
+
+OTAHistogram& OTAManager::latencyHistogram(OTALatencySource source) {
+    switch (source) {
+        case OTA_LATENCY_SOCKET_READ:
+            return receiver.socketReadLatency();
+        case OTA_LATENCY_FLASH_WRITE:
+            return receiver.flashWriteLatency();
+        default:
+            return handleUpdatesLatency;
+    }
+}
+
+OTAMulticastStats OTAManager::getMulticastStats() {
+    MutexGuard lock(mutex);
+    return receiver.getMulticastStats();
+}
+
+OTAPipelineStats OTAManager::getPipelineStats() {
+    MutexGuard lock(mutex);
+    return receiver.getPipelineStats();
+}
+
+OTATuning OTAManager::getTuning() {
+    MutexGuard lock(mutex);
+    return receiver.getTuning();
+}
+
+bool OTAManager::isListenerRunning() {
+    return listenerTaskHandle != nullptr;
+}
+
+void OTAManager::listenerTask(void* pvParameters) {
+    (void)pvParameters;
+
+    while (!listenerStopRequested) {
+        // Blocks in select(); no CPU is used until a packet arrives
+        if (!receiver.waitForActivity(OTA_LISTENER_WAKE_MS)) {
+            continue;
+        }
+        MutexGuard lock(mutex);
+        receiver.handle();
+    }
+
+    listenerTaskHandle = nullptr;
+    vTaskDelete(NULL);
+}
+
+void OTAManager::callbackTask(void* pvParameters) {
+    (void)pvParameters;
+
+    OTACallbackMessage message;
+    for (;;) {
+        if (!callbackQueue.receive(&message, portMAX_DELAY)) {
+            continue;  // A progress token whose report was already delivered
+        }
+        if (message.event == OTA_CALLBACK_STOP) {
+            break;
+        }
+        dispatchCallback(message);
+        if (message.seq) {
+            callbackQueue.handled(message.seq);
+        }
+    }
+
+    callbackTaskHandle = nullptr;
+    vTaskDelete(NULL);
+}
+
+void OTAManager::pollTask(void* pvParameters) {
+    (void)pvParameters;
+
+    while (!pollStopRequested) {
+        uint32_t delayMs = handleUpdates();
+        if (delayMs == 0) {
+            taskYIELD();  // The next step of a session is due: call again once others had their turn
+            continue;
+        }
+        if (!pollOnSocket.load(std::memory_order_relaxed)) {
+            xSemaphoreTake(pollWake, pdMS_TO_TICKS(delayMs));
+            continue;
+        }
+        // An invite ends the wait, so the idle delay costs no latency. In slices,
+        // so a stop or a wake is seen within OTA_POLL_TASK_SLICE_MS
+        while (delayMs > 0 && !pollStopRequested) {
+            uint32_t sliceMs = delayMs < OTA_POLL_TASK_SLICE_MS ? delayMs : OTA_POLL_TASK_SLICE_MS;
+            if (otaSocket.wait(sliceMs) || xSemaphoreTake(pollWake, 0) == pdTRUE) {
+                break;
+            }
+            delayMs -= sliceMs;
+        }
+    }
+
+    pollTaskHandle = nullptr;
+    vTaskDelete(NULL);
+}
+
+void OTAManager::dispatchCallback(const OTACallbackMessage& message) {
+    // Copied under callbackMutex only: the OTA mutex is held for a whole session
+    switch (message.event) {
+        case OTA_CALLBACK_START: {
+            BoundHandler<StartHandler> handler;
+            ArduinoOTAClass::THandlerFunction cb;
+            {
+                MutexGuard callbacks(callbackMutex);
+                handler = startHandler;
+                if (!handler.fn) {
+                    cb = userStartCallback;
+                }
+            }
+            callStart(handler, cb);
+            break;
+        }
+        case OTA_CALLBACK_PROGRESS: {
+            BoundHandler<ProgressHandler> handler;
+            ArduinoOTAClass::THandlerFunction_Progress cb;
+            {
+                MutexGuard callbacks(callbackMutex);
+                handler = progressHandler;
+                if (!handler.fn) {
+                    cb = userProgressCallback;
+                }
+            }
+            callProgress(handler, cb, message.arg, message.total);
+            break;
+        }
+        case OTA_CALLBACK_END: {
+            BoundHandler<EndHandler> handler;
+            ArduinoOTAClass::THandlerFunction cb;
+            {
+                MutexGuard callbacks(callbackMutex);
+                handler = endHandler;
+                if (!handler.fn) {
+                    cb = userEndCallback;
+                }
+            }
+            callEnd(handler, cb);
+            break;
+        }
+        case OTA_CALLBACK_ERROR: {
+            BoundHandler<ErrorHandler> handler;
+            ArduinoOTAClass::THandlerFunction_Error cb;
+            {
+                MutexGuard callbacks(callbackMutex);
+                handler = errorHandler;
+                if (!handler.fn) {
+                    cb = userErrorCallback;
+                }
+            }
+            callError(handler, cb, (ota_error_t)message.arg);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void OTAManager::callStart(const BoundHandler<StartHandler>& handler,
+                           const ArduinoOTAClass::THandlerFunction& cb) {
+    if (handler.fn) {
+        handler.fn(handler.context);
+    } else if (cb) {
+        cb();
+    }
+}
+
+void OTAManager::callEnd(const BoundHandler<EndHandler>& handler,
+                         const ArduinoOTAClass::THandlerFunction& cb) {
+    if (handler.fn) {
+        handler.fn(handler.context);
+    } else if (cb) {
+        cb();
+    }
+}
+
+void OTAManager::callProgress(const BoundHandler<ProgressHandler>& handler,
+                              const ArduinoOTAClass::THandlerFunction_Progress& cb,
+                              unsigned int progress, unsigned int total) {
+    if (handler.fn) {
+        handler.fn(progress, total, handler.context);
+    } else if (cb) {
+        cb(progress, total);
+    }
+}
+
+void OTAManager::callError(const BoundHandler<ErrorHandler>& handler,
+                           const ArduinoOTAClass::THandlerFunction_Error& cb, ota_error_t error) {
+    if (handler.fn) {
+        handler.fn(error, handler.context);
+    } else if (cb) {
+        cb(error);
+    }
+}
+
 bool OTAManager::isNetworkReady() {
-    // If user provided a custom network check function, use it
     MutexGuard lock(mutex);
+    return checkNetworkLocked();
+}
+
+void OTAManager::notifyNetworkUp(const IPAddress& ip) {
+    networkState.up(OTANetworkState::EXTERNAL, (uint32_t)ip);
+    networkEvents = true;
+    wakePollTask();
+}
+
+void OTAManager::notifyNetworkDown() {
+    networkState.down(OTANetworkState::EXTERNAL);
+    networkEvents = true;
+}
+
+IPAddress OTAManager::getNetworkAddress() {
+    return IPAddress(networkState.address());
+}
+
+void OTAManager::subscribeNetworkEvents() {
+#ifdef OTA_NETWORK_EVENT_SOURCE
+    static bool subscribed = false;  // initialize() may run more than once
+    if (subscribed) {
+        return;
+    }
+    subscribed = true;
+    OTA_NETWORK_EVENT_SOURCE.onEvent(onNetworkEvent);
+    // Interfaces that came up before initialize() sent their events already
+    #if defined(ETH)
+    if (ETH.linkSpeed() > 0 && ETH.localIP() != IPAddress(0, 0, 0, 0)) {
+        networkState.up(OTANetworkState::ETHERNET, (uint32_t)ETH.localIP());
+    }
+    #endif
+    #if CONFIG_WIFI_ENABLED == 1
+    if (WiFi.status() == WL_CONNECTED && WiFi.localIP() != IPAddress(0, 0, 0, 0)) {
+        networkState.up(OTANetworkState::WIFI, (uint32_t)WiFi.localIP());
+    }
+    #endif
+    networkEvents = true;
+    OTAM_LOG_D("Network readiness follows interface events (now %s)",
+               networkState.isReady() ? "up" : "down");
+#endif
+}
+
+bool OTAManager::checkNetworkLocked() {
+    // A custom check is polled: it may know about links that send no events
     if (networkCheckCallback) {
         bool ready = networkCheckCallback();
         OTAM_LOG_NET("Custom network check returned: %s", ready ? "ready" : "not ready");
         return ready;
     }
+    if (networkEvents.load(std::memory_order_relaxed)) {
+        return networkState.isReady();
+    }
+    return pollNetworkInterfaces();
+}
 
-    // Default implementation - check for common network types
+bool OTAManager::pollNetworkInterfaces() {
+    // Fallback without events - check for common network types
 #if defined(ESP32)
     #if defined(ETH)
     // Check Ethernet
     if (ETH.linkSpeed() > 0 && ETH.localIP() != IPAddress(0, 0, 0, 0)) {
-        OTAM_LOG_NET("Ethernet connected: %s, speed: %d Mbps", 
-                     ETH.localIP().toString().c_str(), ETH.linkSpeed());
+    #ifdef OTAMANAGER_DEBUG_NETWORK
+        char ethAddr[16];
+        OTANetworkState::format(ETH.localIP(), ethAddr, sizeof(ethAddr));
+        OTAM_LOG_NET("Ethernet connected: %s, speed: %d Mbps", ethAddr, ETH.linkSpeed());
+    #endif
         return true;
     }
     #endif
@@ -199,8 +998,11 @@ bool OTAManager::isNetworkReady() {
     #if CONFIG_WIFI_ENABLED == 1
     // Check WiFi
     if (WiFi.status() == WL_CONNECTED && WiFi.localIP() != IPAddress(0, 0, 0, 0)) {
-        OTAM_LOG_NET("WiFi connected: %s, RSSI: %d dBm", 
-                     WiFi.localIP().toString().c_str(), WiFi.RSSI());
+    #ifdef OTAMANAGER_DEBUG_NETWORK
+        char wifiAddr[16];
+        OTANetworkState::format(WiFi.localIP(), wifiAddr, sizeof(wifiAddr));
+        OTAM_LOG_NET("WiFi connected: %s, RSSI: %d dBm", wifiAddr, WiFi.RSSI());
+    #endif
         return true;
     }
     #endif
@@ -215,6 +1017,133 @@ bool OTAManager::isNetworkReady() {
     return false;
 }
 
+static void traceProgress(unsigned int progress) {
+    // Every session reports its starting point (0 or a resume offset) first
+    if (traceReports == 0) {
+        traceBaseBytes = progress;
+    } else if (traceBytes == traceBaseBytes && progress > traceBaseBytes) {
+        receiver.eventTrace().record(OTA_TRACE_FIRST_BYTE, progress);
+    } else if (traceReports % OTA_TRACE_CHUNK_INTERVAL == 0) {
+        receiver.eventTrace().record(OTA_TRACE_CHUNK, progress);
+    }
+    traceReports++;
+    traceBytes = progress;
+}
+
+void OTAManager::onSessionStart() {
+    uint32_t now = micros();
+    stats.sessionStarted(now);
+    traceReports = 0;
+    traceBytes = 0;
+    receiver.eventTrace().record(OTA_TRACE_START, stats.snapshot().sessionsStarted, now);
+    pollCadence.activity();
+    sessionBoost.begin();
+    quiesce.pause(OTA_QUIESCE_BUDGET_MS);
+    eventBus.start();
+    if (startHandler.fn || userStartCallback) {
+        if (!callbacksQueued) {
+            callStart(startHandler, userStartCallback);
+        } else if (!callbackQueue.post(OTA_CALLBACK_START)) {
+            OTAM_LOG_W("Callback queue full, start event dropped");
+        }
+        return;
+    }
+    int command = listenerTaskHandle ? receiver.getCommand() : ArduinoOTA.getCommand();
+    const char* type = (command == U_FLASH) ? "sketch" : "filesystem";
+    OTAM_LOG_I("Start updating %s", type);
+    (void)type; // Suppress unused warning when logging is disabled
+}
+
+void OTAManager::onSessionEnd() {
+    uint32_t now = micros();
+    stats.sessionCompleted(now);
+    receiver.eventTrace().record(OTA_TRACE_END, traceBytes, now);
+    pollCadence.activity();
+    quiesce.resume();
+    sessionBoost.end();
+    eventBus.end();  // Before the restart below
+    if (endHandler.fn || userEndCallback) {
+        if (!callbacksQueued) {
+            callEnd(endHandler, userEndCallback);
+            return;
+        }
+        // The device restarts when this returns: give the callback its chance first
+        uint32_t seq = callbackQueue.post(OTA_CALLBACK_END, 0, pdMS_TO_TICKS(OTA_CALLBACK_END_WAIT_MS));
+        if (!seq) {
+            OTAM_LOG_W("Callback queue full, end event dropped");
+        } else if (!callbackQueue.waitHandled(seq, OTA_CALLBACK_END_WAIT_MS)) {
+            OTAM_LOG_W("End callback still running after %u ms", (unsigned)OTA_CALLBACK_END_WAIT_MS);
+        }
+        return;
+    }
+    OTAM_LOG_I("Update complete. Rebooting...");
+    delay(1000);
+    ESP.restart();
+}
+
+void OTAManager::onReceiverEnd() {
+    // The flash writer task may have finished after the last progress report
+    if (receiver.isCompressed() || receiver.isPatch()) {
+        stats.sessionFlashed(receiver.getImageBytes());
+    }
+    onSessionEnd();
+}
+
+void OTAManager::onSessionError(ota_error_t error) {
+    stats.error(error);
+    receiver.eventTrace().record(OTA_TRACE_ERROR, error);
+    pollCadence.activity();
+    quiesce.resume();
+    sessionBoost.end();
+    eventBus.error(error);
+    if (errorHandler.fn || userErrorCallback) {
+        if (!callbacksQueued) {
+            callError(errorHandler, userErrorCallback, error);
+        } else if (!callbackQueue.post(OTA_CALLBACK_ERROR, error)) {
+            OTAM_LOG_W("Callback queue full, error %u dropped", error);
+        }
+        return;
+    }
+    handleOTAError(error);
+}
+
+void OTAManager::onArduinoOTAProgress(unsigned int progress, unsigned int total) {
+    stats.sessionProgress(micros(), progress, progress, total);
+    traceProgress(progress);
+    if (eventBus.mayBeDue(progress, total)) {
+        eventBus.progress(progress, total, millis());
+    }
+    if (progressHandler.fn || userProgressCallback) {
+        if (callbacksQueued) {
+            callbackQueue.postProgress(progress, total);  // Coalesced, never waits
+        } else {
+            callProgress(progressHandler, userProgressCallback, progress, total);
+        }
+        return;
+    }
+    handleOTAProgress(progress, total, false);
+}
+
+void OTAManager::onReceiverProgress(unsigned int progress, unsigned int total) {
+    // Compressed images and patches write a different number of bytes than arrive
+    bool transformed = receiver.isCompressed() || receiver.isPatch();
+    stats.sessionProgress(micros(), progress, transformed ? (uint32_t)receiver.getImageBytes() : progress,
+                          total);
+    traceProgress(progress);
+    if (eventBus.mayBeDue(progress, total)) {
+        eventBus.progress(progress, total, millis());
+    }
+    if (progressHandler.fn || userProgressCallback) {
+        if (callbacksQueued) {
+            callbackQueue.postProgress(progress, total);  // Coalesced, never waits
+        } else {
+            callProgress(progressHandler, userProgressCallback, progress, total);
+        }
+        return;
+    }
+    handleOTAProgress(progress, total, transformed);
+}
+
 void OTAManager::handleOTAError(const ota_error_t error) {
     switch (error) {
         case OTA_AUTH_ERROR:
@@ -240,17 +1169,34 @@ void OTAManager::handleOTAError(const ota_error_t error) {
 
 // === PRIVATE STATIC ===
 
-void OTAManager::handleOTAProgress(unsigned int progress, unsigned int total) {
+void OTAManager::handleOTAProgress(unsigned int progress, unsigned int total, bool transformed) {
     static int lastPrintedStep = -5;
     int currentProgress = (progress * 100) / total;
+    if (currentProgress < lastPrintedStep) {
+        lastPrintedStep = -5;  // A new session
+    }
+
+    // Compressed images and patches (receiver sessions) report wire bytes; show the flash side too
+    unsigned int imageBytes = transformed ? (unsigned int)receiver.getImageBytes() : progress;
+
+    // Updated from this report just before the callback ran
+    const OTAThroughput& rate = stats.throughput();
 
     if (currentProgress >= lastPrintedStep + 5) {
-        OTAM_LOG_I("Progress: %u%%", currentProgress);
+        if (transformed) {
+            OTAM_LOG_I("Progress: %u%% (%u bytes received, %u bytes written, %.1f KB/s)",
+                       currentProgress, progress, imageBytes, rate.rate() / 1024.0f);
+        } else {
+            OTAM_LOG_I("Progress: %u%% (%.1f KB/s)", currentProgress, rate.rate() / 1024.0f);
+        }
         lastPrintedStep = currentProgress - (currentProgress % 5);
     }
     
     // Detailed progress tracking for debugging
-    OTAM_LOG_PROG("Bytes: %u/%u, Progress: %u%%, Speed: ~%.1f KB/s", 
-                  progress, total, currentProgress, 
-                  progress > 0 ? (float)progress / (millis() / 1000.0) / 1024.0 : 0);
-}
+    OTAM_LOG_PROG("Bytes: %u/%u (image %u), Progress: %u%%, Speed: %.1f KB/s (average %.1f KB/s), ETA: %ld ms",
+                  progress, total, imageBytes, currentProgress, rate.rate() / 1024.0f,
+                  rate.averageRate() / 1024.0f,
+                  rate.etaMs() == OTAThroughput::ETA_UNKNOWN ? -1L : (long)rate.etaMs());
+    (void)imageBytes;  // Suppress unused warning when logging is disabled
+    (void)rate;
+}
\ No newline at end of file
@@ -28,8 +28,22 @@
 #include <freertos/semphr.h>
 #include <MutexGuard.h>
 
+#include <atomic>
+
 // Include the configuration file
 #include "OTAManagerConfig.h"
+#include "OTACallbackQueue.h"
+#include "OTAEventBus.h"
+#include "OTAHistogram.h"
+#include "OTAMulticast.h"
+#include "OTAPipeline.h"
+#include "OTAPollCadence.h"
+#include "OTAPull.h"
+#include "OTAQuiesce.h"
+#include "OTASessionBoost.h"
+#include "OTAStats.h"
+#include "OTATrace.h"
+#include "OTATuning.h"
 
 /**
  * @brief A manager class for ESP32 Over-The-Air updates
@@ -47,6 +61,19 @@ class OTAManager {
      */
     typedef bool (*NetworkCheckCallback)();
 
+    /**
+     * @brief Plain session handlers: a function and a context pointer
+     *
+     * The alternative to the std::function callbacks: storing one never
+     * allocates, and each event is a direct call. The context is passed back
+     * unchanged. A ProgressHandler reads the rate and ETA through getStats(),
+     * as the progress callback does.
+     */
+    typedef void (*StartHandler)(void* context);
+    typedef void (*EndHandler)(void* context);
+    typedef void (*ProgressHandler)(unsigned int progress, unsigned int total, void* context);
+    typedef void (*ErrorHandler)(ota_error_t error, void* context);
+
     /**
      * @brief Initialize the OTA update system
      *
@@ -55,19 +82,357 @@ class OTAManager {
      * @param password Optional password for OTA updates (defaults to OTA_PASSWORD from config)
      * @param port Optional port for OTA server (defaults to OTA_PORT from config)
      * @param networkCheckCb Optional callback to check network readiness (defaults to nullptr)
+     * @param tuning Optional listener-mode data path tuning (chunk size, socket and
+     * pipeline buffers); clamped to bounds and fitted to the free heap, see getTuning()
      */
     static void initialize(const char* hostname = OTA_HOSTNAME, const char* password = OTA_PASSWORD,
                            uint16_t port = OTA_PORT,
-                           NetworkCheckCallback networkCheckCb = OTA_CALLBACK_NONE);
+                           NetworkCheckCallback networkCheckCb = OTA_CALLBACK_NONE,
+                           const OTATuning& tuning = OTATuning());
 
     /**
      * @brief Check for and process pending OTA updates
      *
-     * This method should be called frequently in your main loop.
+     * This method should be called frequently in your main loop, or from the
+     * task startPollTask() runs.
      * @note Thread-safe: Can be called from multiple tasks
+     *
+     * @return Recommended delay in ms before the next call (see OTAPollCadence):
+     * 0 when the next step of a session is due (a datagram was waiting on the OTA
+     * port, or a session event was seen); otherwise OTA_POLL_MIN_MS, doubling on
+     * every quiet call up to OTA_POLL_IDLE_MAX_MS (OTA_CHECK_INTERVAL_MS if
+     * ArduinoOTA's socket cannot be found); OTA_POLL_NETWORK_DOWN_MS
+     * while the network is down, and OTA_POLL_IDLE_MAX_MS when there is nothing
+     * to poll (not initialized, listener running). Callers on a fixed interval
+     * may ignore it.
      */
-    static void handleUpdates();
-    
+    static uint32_t handleUpdates();
+
+    /**
+     * @brief Call handleUpdates() from a task that waits as long as it recommends
+     *
+     * Yields when the delay is 0. While idle it waits on ArduinoOTA's socket,
+     * so an invite is answered as soon as it arrives however long the delay.
+     * A network-up event, or the listener stopping, wakes the task before its
+     * delay is over.
+     *
+     * @param priority FreeRTOS priority of the poll task
+     * @param core Core to pin the task to (tskNO_AFFINITY for any)
+     * @return true if the poll task is running
+     */
+    static bool startPollTask(UBaseType_t priority = OTA_POLL_TASK_PRIORITY,
+                              BaseType_t core = OTA_POLL_TASK_CORE);
+
+    /**
+     * @brief Stop the poll task; returns once it has finished its current call
+     */
+    static void stopPollTask();
+
+    /**
+     * @brief Check if the poll task is running
+     */
+    static bool isPollTaskRunning();
+
+    /**
+     * @brief Start the built-in event-driven listener task
+     *
+     * Instead of polling handleUpdates(), a dedicated task blocks on the OTA
+     * sockets with select() and wakes only when an invite or data arrives. It
+     * uses no CPU while idle and starts a transfer as soon as the invite lands.
+     * While the listener runs, handleUpdates() returns immediately.
+     *
+     * @note The listener speaks the espota protocol itself and does not announce
+     * the device via mDNS; upload by IP address.
+     *
+     * @param priority FreeRTOS priority of the listener task
+     * @param core Core to pin the task to (tskNO_AFFINITY for any)
+     * @return true if the listener is running
+     */
+    static bool startListener(UBaseType_t priority = OTA_LISTENER_TASK_PRIORITY,
+                              BaseType_t core = OTA_LISTENER_TASK_CORE);
+
+    /**
+     * @brief Stop the listener task and return to polling mode
+     *
+     * Blocks for up to OTA_LISTENER_WAKE_MS while the task notices the request.
+     */
+    static void stopListener();
+
+    /**
+     * @brief Check if the event-driven listener task is running
+     */
+    static bool isListenerRunning();
+
+    /**
+     * @brief Run the application's callbacks on their own task
+     *
+     * By default the callbacks set with setStartCallback() and the others run
+     * inside the session, with the OTA mutex held: a slow callback stalls the
+     * transfer. Once this task runs, the session only posts events to a queue
+     * and the task calls the callbacks in order. Progress reports are coalesced,
+     * so the progress callback sees the latest report whenever it is ready for
+     * the next one and a slow one costs the transfer nothing.
+     *
+     * At the end of a successful update the session waits up to
+     * OTA_CALLBACK_END_WAIT_MS for the end callback, since the device restarts
+     * right after it. The built-in defaults (logs, restart) still run inline.
+     *
+     * @note Callbacks no longer run under the OTA mutex and may call any method;
+     * an end callback that waits for the mutex delays the restart until the
+     * session's wait times out.
+     *
+     * @param priority FreeRTOS priority of the callback task
+     * @param core Core to pin the task to (tskNO_AFFINITY for any)
+     * @return true if the callback task is running
+     */
+    static bool startCallbackTask(UBaseType_t priority = OTA_CALLBACK_TASK_PRIORITY,
+                                  BaseType_t core = OTA_CALLBACK_TASK_CORE);
+
+    /**
+     * @brief Stop the callback task once it has handled the queued events; the
+     * callbacks run inline again
+     */
+    static void stopCallbackTask();
+
+    /**
+     * @brief Check if the callback task is running
+     */
+    static bool isCallbackTaskRunning();
+
+    /**
+     * @brief Events queued, dropped and coalesced since the callback task started
+     */
+    static OTACallbackStats getCallbackStats();
+
+    /**
+     * @brief Register a part of the application to pause during update sessions
+     *
+     * At session start, before anything is written, every participant's pause
+     * handler is called, and the session waits up to OTA_QUIESCE_BUDGET_MS for
+     * all to acknowledge (see OTAParticipant). Participants are resumed, last
+     * paused first, when the session ends or fails, and when removed.
+     *
+     * @return an id for acknowledgeQuiesce() and removeQuiesceParticipant(), or -1
+     *         if OTA_QUIESCE_PARTICIPANTS_MAX are registered
+     */
+    static int addQuiesceParticipant(const OTAParticipant& participant);
+
+    /**
+     * @brief Unregister a participant, resuming it if it is paused
+     */
+    static bool removeQuiesceParticipant(int id);
+
+    /**
+     * @brief Report that participant id has paused
+     *
+     * Does not take the OTA mutex, so the participant's own task can call it
+     * while the session waits.
+     */
+    static void acknowledgeQuiesce(int id);
+
+    /**
+     * @brief Pauses requested, late participants and the time the last pause took
+     *
+     * Never blocks.
+     */
+    static OTAQuiesceStats getQuiesceStats();
+
+    /**
+     * @brief Raise the task running an update session for the length of the session
+     *
+     * At session start the listener, or the task calling handleUpdates(), is
+     * raised to priority (if below it) and moved to core; both are restored when
+     * the session ends or fails. Defaults: OTA_SESSION_PRIORITY (0, no boost) and
+     * OTA_SESSION_CORE; call this to opt in.
+     *
+     * @param priority Priority for the session (0 = no boost)
+     * @param core Core for the session (tskNO_AFFINITY = stay); needs a kernel
+     *             with configUSE_CORE_AFFINITY
+     * @return false if core cannot be honoured (the priority still applies)
+     */
+    static bool setSessionBoost(UBaseType_t priority, BaseType_t core = tskNO_AFFINITY);
+
+    /**
+     * @brief Enable or disable the receive/flash-write pipeline in listener mode
+     *
+     * When enabled (default: OTA_PIPELINE_ENABLED) one buffer fills from the
+     * socket while a writer task on the other core programs the previous one.
+     * Costs OTA_PIPELINE_BUFFERS x OTA_PIPELINE_BUFFER_SIZE bytes of heap plus a
+     * task stack, allocated only for the duration of an update.
+     *
+     * @param enabled true to overlap network and flash, false to write inline
+     */
+    static void setPipelineEnabled(bool enabled);
+
+    /**
+     * @brief Get per-stage timings of the last pipelined update
+     *
+     * @return Copy of the stats; all zero if no pipelined session has run
+     */
+    static OTAPipelineStats getPipelineStats();
+
+    /**
+     * @brief Get the data path tuning in effect after validation
+     */
+    static OTATuning getTuning();
+
+    /**
+     * @brief Require updates to carry an Ed25519 signature by this key
+     *
+     * The listener checks the signature ("sig=" in the invite) while the image
+     * streams in and refuses unsigned or badly signed images. ArduinoOTA cannot
+     * check signatures, so handleUpdates() stops serving polling mode updates
+     * while a key is set. OTA_SIGNING_PUBLIC_KEY sets a key at initialize().
+     *
+     * @param publicKey 32-byte Ed25519 public key, or nullptr to accept unsigned images
+     */
+    static void setSigningKey(const uint8_t* publicKey);
+
+    /**
+     * @brief Download an image from an HTTP(S) server and install it
+     *
+     * The body is streamed into the same write path as listener mode
+     * (decompression, delta patches, SHA-256 and signature checks) without
+     * buffering the image. A dropped connection is continued with a Range
+     * request up to OTA_PULL_RETRIES times. Blocks until the update is done;
+     * on success the device restarts, as after a pushed update.
+     *
+     * @param url http:// (or https:// on the device) URL of the image
+     * @param options Expected digests, signature and CA certificate
+     * @return false if the download or a check failed
+     */
+    static bool pullUpdate(const char* url, const OTAPullOptions& options = OTAPullOptions());
+
+    /**
+     * @brief Get status, size, timing and heap figures of the last pullUpdate()
+     */
+    static OTAPullStats getPullStats();
+
+    /**
+     * @brief Also receive updates streamed to a multicast group
+     *
+     * One sender streams the image once for every device in the group, with
+     * Reed-Solomon parity per group of blocks; each device rebuilds its own
+     * losses and fetches what is still missing from the sender over TCP. The
+     * image is checked as a whole (MD5, SHA-256, signature) before the device
+     * boots it. Sessions are served by the listener task, so it must be running;
+     * stopListener() leaves the group.
+     *
+     * A session has no login, so a signing key is required (setSigningKey() or
+     * OTA_SIGNING_PUBLIC_KEY) and only sessions signed by it are installed.
+     *
+     * @param group Multicast group address, e.g. "239.255.32.32"
+     * @param port UDP port of the stream
+     * @param interfaceIp Local interface to join on (nullptr = default)
+     * @return true if the group was joined, false without a signing key
+     */
+    static bool joinMulticast(const char* group, uint16_t port = OTA_MULTICAST_PORT,
+                              const char* interfaceIp = nullptr);
+
+    /**
+     * @brief Leave the multicast group
+     */
+    static void leaveMulticast();
+
+    /**
+     * @brief Get packet, FEC and repair figures of the last multicast session
+     */
+    static OTAMulticastStats getMulticastStats();
+
+    /**
+     * @brief Get counters for update sessions and handleUpdates() since boot
+     *
+     * Never blocks: the counters are relaxed atomics, so this is safe to call
+     * from a monitoring task while an update is running, or from a progress
+     * callback for the current rate and ETA. Sessions are counted in both polling
+     * and listener mode, and for pull and multicast updates.
+     */
+    static OTAStats getStats();
+
+    /**
+     * @brief Latency histogram of socket reads, flash writes or handleUpdates()
+     *
+     * Durations in log2 buckets of microseconds since boot or the last reset.
+     * Socket reads and flash writes are timed per chunk in listener, pull and
+     * multicast mode (ArduinoOTA's transfer loop cannot be timed from outside);
+     * handleUpdates() is timed on calls that poll, lock wait included. Never
+     * blocks. All zero when OTA_LATENCY_HISTOGRAMS_ENABLED is 0.
+     */
+    static OTAHistogramSnapshot getLatencyHistogram(OTALatencySource source);
+
+    /**
+     * @brief Clear all latency histograms
+     */
+    static void resetLatencyHistograms();
+
+    /**
+     * @brief Log each histogram (count, p50, p99, max) and its non-empty buckets
+     */
+    static void logLatencyHistograms();
+
+    /**
+     * @brief Copy the session event trace (see OTATrace for the format)
+     *
+     * The trace holds the last OTA_TRACE_EVENTS events of all sessions: invites,
+     * logins, first byte, every OTA_TRACE_CHUNK_INTERVAL-th chunk, sector
+     * erases, stalls, end and errors, with micros() timestamps. Invites, logins,
+     * erases and stalls are recorded in listener, pull and multicast mode only.
+     * Never blocks, so it can be called from an error callback.
+     *
+     * @param buffer Destination; OTATrace::DUMP_SIZE bytes hold any trace
+     * @param len Size of buffer; a shorter buffer gets the oldest part
+     * @return Bytes written, 0 when OTA_TRACE_ENABLED is 0
+     */
+    static size_t getTrace(uint8_t* buffer, size_t len);
+
+    /**
+     * @brief Discard all recorded trace events
+     */
+    static void clearTrace();
+
+    /**
+     * @brief Log the trace as hex lines ("Trace <offset>: <hex>") for otatrace
+     *
+     * Needs no buffer. Never blocks, so it can be called from an error callback.
+     */
+    static void logTrace();
+
+    /**
+     * @brief Check if the network is ready for OTA updates
+     *
+     * Calls the NetworkCheckCallback if one was given to initialize(). Otherwise
+     * returns the state kept by network events (see notifyNetworkUp()): one
+     * atomic load instead of querying the interfaces, which is the fallback when
+     * no events are available.
+     *
+     * @return true if network is ready, false otherwise
+     */
+    static bool isNetworkReady();
+
+    /**
+     * @brief Report that a network the core does not announce has an address
+     *
+     * On ESP32, Ethernet and WiFi station events are subscribed to at
+     * initialize(). Stacks that bring their own events (PPP, SPI Ethernet
+     * drivers) report through this pair instead. May be called from any task or
+     * event handler, before or after initialize().
+     *
+     * @param ip Address of the interface
+     */
+    static void notifyNetworkUp(const IPAddress& ip);
+
+    /**
+     * @brief Report that the network given to notifyNetworkUp() went away
+     */
+    static void notifyNetworkDown();
+
+    /**
+     * @brief Address of an interface that is up, as last reported by events
+     *
+     * @return The address, or 0.0.0.0 if no interface is up
+     */
+    static IPAddress getNetworkAddress();
+
     /**
      * @brief Check if OTA manager has been initialized
      *
@@ -92,6 +457,11 @@ class OTAManager {
     /**
      * @brief Set custom progress callback
      *
+     * The callback gets bytes written and the image size. For the transfer rate
+     * and ETA, call getStats() from it: it takes no lock, and currentRate,
+     * averageRate and etaMs already include the report being delivered (on the
+     * callback task, they are as of when the callback runs).
+     *
      * @param cb Function to call to report OTA update progress
      */
     static void setProgressCallback(ArduinoOTAClass::THandlerFunction_Progress cb);
@@ -103,13 +473,66 @@ class OTAManager {
      */
     static void setErrorCallback(ArduinoOTAClass::THandlerFunction_Error cb);
 
-   private:
     /**
-     * @brief Check if the network is ready for OTA updates
+     * @brief Set a plain start, end, progress or error handler
      *
-     * @return true if network is ready, false otherwise
+     * Replaces the callback of the same event set in either form. Nothing is
+     * allocated, and the handler is called directly with context.
+     *
+     * @param handler Function to call (nullptr is ignored, as for the std::function setters)
+     * @param context Pointer passed to every call
      */
-    static bool isNetworkReady();
+    static void setStartCallback(StartHandler handler, void* context);
+    static void setEndCallback(EndHandler handler, void* context);
+    static void setProgressCallback(ProgressHandler handler, void* context);
+    static void setErrorCallback(ErrorHandler handler, void* context);
+
+    /**
+     * @brief Add a subscriber to session events, next to the callbacks above
+     *
+     * Unlike the callbacks, subscribers do not replace the built-in logging or
+     * each other: every subscriber gets start, end and error, and the progress
+     * reports its minProgressBytes / minProgressMs let through (the first and
+     * last always). They run inline in the session, also with the callback
+     * task, before the callback of the same event, and must not call OTAManager.
+     *
+     * @return an id for unsubscribe(), or -1 if OTA_SUBSCRIBERS_MAX are subscribed
+     */
+    static int subscribe(const OTASubscriber& subscriber);
+
+    /**
+     * @brief Remove a subscriber
+     *
+     * @return false if id is not subscribed
+     */
+    static bool unsubscribe(int id);
+
+   private:
+    template <typename Handler>
+    struct BoundHandler {
+        Handler fn;
+        void* context;
+    };
+    /**
+     * @brief isNetworkReady() for callers that already hold the mutex
+     */
+    static bool checkNetworkLocked();
+
+    /**
+     * @brief Query the Ethernet and WiFi interfaces (no events available)
+     */
+    static bool pollNetworkInterfaces();
+
+    /**
+     * @brief Subscribe to the core's network events and record the current state
+     */
+    static void subscribeNetworkEvents();
+
+    /**
+     * @brief Recompute pollingActive; call with the mutex held after changing
+     * initialized, listenerTaskHandle or signingRequired
+     */
+    static void updatePolling();
 
     /**
      * @brief Handle errors that occur during OTA updates
@@ -118,8 +541,63 @@ class OTAManager {
      */
     static void handleOTAError(const ota_error_t error);
 
+    /**
+     * @brief Session callbacks given to ArduinoOTA and the receiver: record the
+     * statistics, then call the application's callback (or post it to the
+     * callback task), or log (and restart after a completed update) if none is set
+     */
+    static void onSessionStart();
+    static void onSessionEnd();
+    static void onReceiverEnd();
+    static void onSessionError(ota_error_t error);
+    static void onArduinoOTAProgress(unsigned int progress, unsigned int total);
+    static void onReceiverProgress(unsigned int progress, unsigned int total);
+
+    static OTAHistogram& latencyHistogram(OTALatencySource source);
+
+    /**
+     * @brief Listener task body: wait for OTA socket activity, then handle it
+     */
+    static void listenerTask(void* pvParameters);
+
+    /**
+     * @brief Callback task body: call the application's callbacks for queued events
+     */
+    static void callbackTask(void* pvParameters);
+    static void dispatchCallback(const OTACallbackMessage& message);
+
+    /**
+     * @brief Poll task body: call handleUpdates(), wait as long as it recommends
+     */
+    static void pollTask(void* pvParameters);
+
+    /**
+     * @brief Call the application's callback for an event, in whichever form it
+     * was set; the caller holds the mutex, or has a copy taken under callbackMutex
+     */
+    static void callStart(const BoundHandler<StartHandler>& handler,
+                          const ArduinoOTAClass::THandlerFunction& cb);
+    static void callEnd(const BoundHandler<EndHandler>& handler,
+                        const ArduinoOTAClass::THandlerFunction& cb);
+    static void callProgress(const BoundHandler<ProgressHandler>& handler,
+                             const ArduinoOTAClass::THandlerFunction_Progress& cb,
+                             unsigned int progress, unsigned int total);
+    static void callError(const BoundHandler<ErrorHandler>& handler,
+                          const ArduinoOTAClass::THandlerFunction_Error& cb, ota_error_t error);
+
     // Whether OTA has been initialized
-    static bool initialized;
+    static std::atomic<bool> initialized;
+
+    // handleUpdates() has ArduinoOTA to poll: initialized, no listener, no signing
+    // key. Read without the lock on every call; written under it by updatePolling()
+    static std::atomic<bool> pollingActive;
+
+    // Network readiness is event-driven (subscribed on ESP32, or notifyNetworkUp() used)
+    static std::atomic<bool> networkEvents;
+
+    // Last "waiting" and "network down" messages of handleUpdates() (under the mutex)
+    static unsigned long lastWaitLog;
+    static unsigned long lastNetworkErrorLog;
 
     // User-provided network check callback
     static NetworkCheckCallback networkCheckCallback;
@@ -127,5 +605,43 @@ class OTAManager {
     // Mutex for thread safety
     static SemaphoreHandle_t mutex;
 
-    static void handleOTAProgress(unsigned int progress, unsigned int total);
+    // Port the OTA service listens on
+    static uint16_t otaPort;
+
+    // Listener mode task (nullptr while polling via handleUpdates())
+    static volatile TaskHandle_t listenerTaskHandle;
+    static volatile bool listenerStopRequested;
+
+    // A signing key is set, so ArduinoOTA (which cannot check it) is not served
+    static bool signingRequired;
+
+    // Callback task (nullptr while callbacks run inline). callbacksQueued is
+    // written under the mutex and tells the session hooks to post events
+    static volatile TaskHandle_t callbackTaskHandle;
+    static bool callbacksQueued;
+
+    // Poll task (nullptr unless startPollTask() was called)
+    static volatile TaskHandle_t pollTaskHandle;
+    static volatile bool pollStopRequested;
+
+    // Callbacks set by the application (nullptr = default behaviour). Written under
+    // both mutexes; the callback task copies them under callbackMutex only
+    static SemaphoreHandle_t callbackMutex;
+    static ArduinoOTAClass::THandlerFunction userStartCallback;
+    static ArduinoOTAClass::THandlerFunction userEndCallback;
+    static ArduinoOTAClass::THandlerFunction_Progress userProgressCallback;
+    static ArduinoOTAClass::THandlerFunction_Error userErrorCallback;
+
+    // Plain handlers set by the application (fn nullptr = not set); same locking.
+    // At most one form is set per event
+    static BoundHandler<StartHandler> startHandler;
+    static BoundHandler<EndHandler> endHandler;
+    static BoundHandler<ProgressHandler> progressHandler;
+    static BoundHandler<ErrorHandler> errorHandler;
+
+    /**
+     * @brief Default progress log; transformed is set for a receiver session whose
+     * image bytes differ from the wire bytes (compressed image or patch)
+     */
+    static void handleOTAProgress(unsigned int progress, unsigned int total, bool transformed);
 };
\ No newline at end of file
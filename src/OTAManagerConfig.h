@@ -26,6 +26,43 @@
 #define OTA_CHECK_INTERVAL_MS 250
 #endif
 
+// Delays handleUpdates() recommends (see OTAPollCadence): the first quiet poll
+// after a packet or session event, doubling up to the idle maximum, and while the
+// network is down (a network event wakes the poll task early). espota repeats its
+// invite, so a multi-second idle delay is safe; the poll task also wakes as soon
+// as the invite arrives. Without a view of ArduinoOTA's socket the idle delay
+// stays at OTA_CHECK_INTERVAL_MS
+#ifndef OTA_POLL_MIN_MS
+#define OTA_POLL_MIN_MS 10
+#endif
+
+#ifndef OTA_POLL_IDLE_MAX_MS
+#define OTA_POLL_IDLE_MAX_MS 3000
+#endif
+
+#ifndef OTA_POLL_NETWORK_DOWN_MS
+#define OTA_POLL_NETWORK_DOWN_MS 1000
+#endif
+
+// Poll task settings (see OTAManager::startPollTask)
+#ifndef OTA_POLL_TASK_STACK
+#define OTA_POLL_TASK_STACK 4096
+#endif
+
+#ifndef OTA_POLL_TASK_PRIORITY
+#define OTA_POLL_TASK_PRIORITY 1
+#endif
+
+#ifndef OTA_POLL_TASK_CORE
+#define OTA_POLL_TASK_CORE tskNO_AFFINITY
+#endif
+
+// Longest single wait of the poll task on ArduinoOTA's socket; bounds how long
+// stopPollTask() and startListener() wait for it
+#ifndef OTA_POLL_TASK_SLICE_MS
+#define OTA_POLL_TASK_SLICE_MS 1000
+#endif
+
 // Default interval for logging status messages
 #ifndef OTA_LOG_INTERVAL_MS
 #define OTA_LOG_INTERVAL_MS 60000
@@ -36,6 +73,55 @@
 #define OTA_ERROR_LOG_INTERVAL_MS 10000
 #endif
 
+// Track network readiness from the core's Ethernet/WiFi events instead of querying
+// the interfaces on every check (ESP32 only; 0 = query them, as before)
+#ifndef OTA_NETWORK_EVENTS_ENABLED
+#define OTA_NETWORK_EVENTS_ENABLED 1
+#endif
+
+// Time constant of the transfer rate estimate (EWMA): a step in the link speed is
+// 63% reflected after this long
+#ifndef OTA_THROUGHPUT_TAU_MS
+#define OTA_THROUGHPUT_TAU_MS 2000
+#endif
+
+// Latency histograms of socket reads, flash writes and handleUpdates() (0 = compiled
+// out, no RAM). Bucket i counts durations of 2^i to 2^(i+1)-1 us (bucket 0 also 0 us);
+// the last bucket takes everything longer. Each histogram is (buckets + 2) x 4 bytes.
+#ifndef OTA_LATENCY_HISTOGRAMS_ENABLED
+#define OTA_LATENCY_HISTOGRAMS_ENABLED 1
+#endif
+
+#ifndef OTA_LATENCY_BUCKETS
+#define OTA_LATENCY_BUCKETS 24  // Last bucket from 2^23 us (8.4 s)
+#endif
+
+// Session event trace (0 = compiled out, no RAM). The ring keeps the last
+// OTA_TRACE_EVENTS events at 8 bytes each; older ones are overwritten.
+#ifndef OTA_TRACE_ENABLED
+#define OTA_TRACE_ENABLED 1
+#endif
+
+#ifndef OTA_TRACE_EVENTS
+#define OTA_TRACE_EVENTS 256
+#endif
+
+// Trace every n-th progress report (one per received chunk) and every n-th flash
+// write that erases a sector
+#ifndef OTA_TRACE_CHUNK_INTERVAL
+#define OTA_TRACE_CHUNK_INTERVAL 64
+#endif
+
+#ifndef OTA_TRACE_SECTOR_INTERVAL
+#define OTA_TRACE_SECTOR_INTERVAL 16
+#endif
+
+// A socket read waiting at least this long is traced as a stall; a sector write
+// taking this long is traced whatever OTA_TRACE_SECTOR_INTERVAL says
+#ifndef OTA_TRACE_STALL_MS
+#define OTA_TRACE_STALL_MS 100
+#endif
+
 // Default timeout waiting for initialization
 #ifndef OTA_INIT_TIMEOUT_MS
 #define OTA_INIT_TIMEOUT_MS 5000
@@ -56,6 +142,283 @@
 #define OTA_HOSTNAME "esp32-ota"
 #endif
 
+// Bytes read from the socket per receive step (one TCP MSS, as ArduinoOTA)
+#ifndef OTA_RECEIVE_CHUNK_SIZE
+#define OTA_RECEIVE_CHUNK_SIZE 1460
+#endif
+
+// Bounds for OTATuning::chunkSize
+#ifndef OTA_RECEIVE_CHUNK_MIN
+#define OTA_RECEIVE_CHUNK_MIN 512
+#endif
+
+#ifndef OTA_RECEIVE_CHUNK_MAX
+#define OTA_RECEIVE_CHUNK_MAX 16384
+#endif
+
+// SO_RCVBUF requested for the OTA data connection (0 = TCP/IP stack default).
+// On the ESP32 the TCP window itself is set by CONFIG_LWIP_TCP_WND_DEFAULT.
+#ifndef OTA_SOCKET_RX_BUFFER
+#define OTA_SOCKET_RX_BUFFER 0
+#endif
+
+#ifndef OTA_SOCKET_RX_BUFFER_MAX
+#define OTA_SOCKET_RX_BUFFER_MAX 65535
+#endif
+
+// Time without data before a transfer is aborted with OTA_RECEIVE_ERROR
+#ifndef OTA_RECEIVE_TIMEOUT_MS
+#define OTA_RECEIVE_TIMEOUT_MS 1000
+#endif
+
+// Listener mode task settings (see OTAManager::startListener)
+#ifndef OTA_LISTENER_TASK_STACK
+#define OTA_LISTENER_TASK_STACK 8192
+#endif
+
+#ifndef OTA_LISTENER_TASK_PRIORITY
+#define OTA_LISTENER_TASK_PRIORITY 2
+#endif
+
+#ifndef OTA_LISTENER_TASK_CORE
+#define OTA_LISTENER_TASK_CORE tskNO_AFFINITY
+#endif
+
+// Longest the listener blocks before re-checking for a stop request
+#ifndef OTA_LISTENER_WAKE_MS
+#define OTA_LISTENER_WAKE_MS 1000
+#endif
+
+// Callback task settings (see OTAManager::startCallbackTask). Below the listener
+// and the flash writer, so application callbacks never preempt the data path
+#ifndef OTA_CALLBACK_TASK_STACK
+#define OTA_CALLBACK_TASK_STACK 4096
+#endif
+
+#ifndef OTA_CALLBACK_TASK_PRIORITY
+#define OTA_CALLBACK_TASK_PRIORITY 1
+#endif
+
+#ifndef OTA_CALLBACK_TASK_CORE
+#define OTA_CALLBACK_TASK_CORE tskNO_AFFINITY
+#endif
+
+// Start, end and error events waiting for the callback task; progress is coalesced
+// and takes at most one entry
+#ifndef OTA_CALLBACK_QUEUE_LENGTH
+#define OTA_CALLBACK_QUEUE_LENGTH 8
+#endif
+
+// Longest a finished session waits for the end callback before the restart
+#ifndef OTA_CALLBACK_END_WAIT_MS
+#define OTA_CALLBACK_END_WAIT_MS 2000
+#endif
+
+// Entries in the subscriber table (see OTAManager::subscribe())
+#ifndef OTA_SUBSCRIBERS_MAX
+#define OTA_SUBSCRIBERS_MAX 8
+#endif
+
+// Entries in the quiesce participant table (see OTAManager::addQuiesceParticipant())
+#ifndef OTA_QUIESCE_PARTICIPANTS_MAX
+#define OTA_QUIESCE_PARTICIPANTS_MAX 8
+#endif
+
+// Longest a session start waits for participants to acknowledge the pause; the
+// transfer goes ahead without the late ones
+#ifndef OTA_QUIESCE_BUDGET_MS
+#define OTA_QUIESCE_BUDGET_MS 500
+#endif
+
+// Priority the task running an update session is raised to until the session ends
+// or fails; a task already at or above it is left alone (0 = no boost). Off by
+// default: opt in with e.g. -DOTA_SESSION_PRIORITY=5 or setSessionBoost(5)
+#ifndef OTA_SESSION_PRIORITY
+#define OTA_SESSION_PRIORITY 0
+#endif
+
+// Core the session task moves to for the session (tskNO_AFFINITY = stays). Needs a
+// kernel with configUSE_CORE_AFFINITY (the SMP kernel); ignored with a warning otherwise
+#ifndef OTA_SESSION_CORE
+#define OTA_SESSION_CORE tskNO_AFFINITY
+#endif
+
+// Listener mode: overlap socket reads with flash writes (see OTAPipeline)
+#ifndef OTA_PIPELINE_ENABLED
+#define OTA_PIPELINE_ENABLED 1
+#endif
+
+// Size of each pipeline buffer; a multiple of the 4 KB flash sector works best
+#ifndef OTA_PIPELINE_BUFFER_SIZE
+#define OTA_PIPELINE_BUFFER_SIZE 4096
+#endif
+
+// Number of pipeline buffers (2 = double buffering)
+#ifndef OTA_PIPELINE_BUFFERS
+#define OTA_PIPELINE_BUFFERS 2
+#endif
+
+// Bounds for OTATuning::pipelineBufferSize / pipelineBuffers
+#ifndef OTA_PIPELINE_BUFFER_MIN
+#define OTA_PIPELINE_BUFFER_MIN 1024
+#endif
+
+#ifndef OTA_PIPELINE_BUFFER_MAX
+#define OTA_PIPELINE_BUFFER_MAX 65536
+#endif
+
+#ifndef OTA_PIPELINE_BUFFERS_MAX
+#define OTA_PIPELINE_BUFFERS_MAX 8
+#endif
+
+#ifndef OTA_PIPELINE_WRITER_STACK
+#define OTA_PIPELINE_WRITER_STACK 4096
+#endif
+
+#ifndef OTA_PIPELINE_WRITER_PRIORITY
+#define OTA_PIPELINE_WRITER_PRIORITY OTA_LISTENER_TASK_PRIORITY
+#endif
+
+// Core for the flash writer task; -1 = the core the receiver is not running on
+#ifndef OTA_PIPELINE_WRITER_CORE
+#define OTA_PIPELINE_WRITER_CORE -1
+#endif
+
+// Listener mode: accept gzip/zlib compressed images and inflate them while writing.
+// Needs OTAInflater::memoryRequired() (~37 KB) of heap during a compressed update.
+#ifndef OTA_COMPRESSION_ENABLED
+#define OTA_COMPRESSION_ENABLED 1
+#endif
+
+// Listener mode: accept delta patches (see OTAPatcher) built against the running image
+#ifndef OTA_DELTA_ENABLED
+#define OTA_DELTA_ENABLED 1
+#endif
+
+// Work buffer used while applying a patch (base reads and reconstructed output)
+#ifndef OTA_PATCH_BUFFER_SIZE
+#define OTA_PATCH_BUFFER_SIZE 4096
+#endif
+
+// Listener mode: remember how far an interrupted image got (in NVS) and let a
+// resume-capable uploader continue from there instead of byte zero
+#ifndef OTA_RESUME_ENABLED
+#define OTA_RESUME_ENABLED 1
+#endif
+
+// NVS namespace holding the resume record
+#ifndef OTA_RESUME_NVS_NAMESPACE
+#define OTA_RESUME_NVS_NAMESPACE "otamanager"
+#endif
+
+// Committed bytes between resume checkpoints during a session (bounds the NVS writes
+// per image; the offset is also saved whenever a transfer is cut off)
+#ifndef OTA_RESUME_CHECKPOINT_BYTES
+#define OTA_RESUME_CHECKPOINT_BYTES 65536
+#endif
+
+// Listener mode: SHA-256 the image as it is written and check it against the digest
+// ESP-IDF appends to app images, and against a "sha256=" digest in the invite
+#ifndef OTA_SHA256_ENABLED
+#define OTA_SHA256_ENABLED 1
+#endif
+
+// Reject app images that carry no appended SHA-256 (or whose layout cannot be parsed)
+#ifndef OTA_SHA256_REQUIRED
+#define OTA_SHA256_REQUIRED 0
+#endif
+
+// SHA-256 implementation: mbedTLS (hardware accelerated on the ESP32) or portable C++
+#define OTA_SHA256_SOFTWARE 0
+#define OTA_SHA256_MBEDTLS 1
+#ifndef OTA_SHA256_BACKEND
+    #if defined(ESP32)
+        #define OTA_SHA256_BACKEND OTA_SHA256_MBEDTLS
+    #else
+        #define OTA_SHA256_BACKEND OTA_SHA256_SOFTWARE
+    #endif
+#endif
+
+// Listener mode: check an Ed25519 signature ("sig=" in the invite) over the stream
+// once a signing key is set (see OTAManager::setSigningKey)
+#ifndef OTA_SIGNATURE_ENABLED
+#define OTA_SIGNATURE_ENABLED 1
+#endif
+
+// Signing key applied by initialize(), as 64 hex characters; leave undefined to
+// accept unsigned images unless setSigningKey() is called
+// #define OTA_SIGNING_PUBLIC_KEY "d75a980182b10ab7d54bfed3c964073a0ee172f3daa62325af021a68f707511a"
+
+// SHA-512 implementation for the signature hash; same choices as OTA_SHA256_BACKEND
+#ifndef OTA_SHA512_BACKEND
+#define OTA_SHA512_BACKEND OTA_SHA256_BACKEND
+#endif
+
+// Pull mode (OTAManager::pullUpdate): longest wait for the server, from connecting
+// to each read of the body
+#ifndef OTA_PULL_TIMEOUT_MS
+#define OTA_PULL_TIMEOUT_MS 10000
+#endif
+
+// Pull mode: reconnects after a dropped download, each continuing with a Range request
+#ifndef OTA_PULL_RETRIES
+#define OTA_PULL_RETRIES 3
+#endif
+
+#ifndef OTA_PULL_MAX_REDIRECTS
+#define OTA_PULL_MAX_REDIRECTS 3
+#endif
+
+// Longest URL (including redirect targets) and response header line kept
+#ifndef OTA_PULL_URL_MAX
+#define OTA_PULL_URL_MAX 256
+#endif
+
+// Pull mode: https:// URLs through ESP-TLS (server checked against the certificate
+// bundle, or OTAPullOptions::caCert); not available in the host build
+#ifndef OTA_PULL_TLS_ENABLED
+    #if defined(ESP32)
+        #define OTA_PULL_TLS_ENABLED 1
+    #else
+        #define OTA_PULL_TLS_ENABLED 0
+    #endif
+#endif
+
+// Multicast mode (OTAManager::joinMulticast): receive one shared stream with FEC and
+// repair the remaining gaps over unicast
+#ifndef OTA_MULTICAST_ENABLED
+#define OTA_MULTICAST_ENABLED 1
+#endif
+
+#ifndef OTA_MULTICAST_PORT
+#define OTA_MULTICAST_PORT 3233
+#endif
+
+// Largest FEC group (data blocks x block size) accepted; two are buffered for the
+// flash pipeline, plus the group's parity blocks
+#ifndef OTA_MULTICAST_GROUP_MAX
+#define OTA_MULTICAST_GROUP_MAX 16384
+#endif
+
+// Silence that ends the multicast stream (a lost END packet, or a sender that stopped)
+#ifndef OTA_MULTICAST_IDLE_MS
+#define OTA_MULTICAST_IDLE_MS 2000
+#endif
+
+// Unicast repair: timeout per request, and block ranges asked for per request
+#ifndef OTA_MULTICAST_REPAIR_TIMEOUT_MS
+#define OTA_MULTICAST_REPAIR_TIMEOUT_MS 5000
+#endif
+
+#ifndef OTA_MULTICAST_REPAIR_RANGES
+#define OTA_MULTICAST_REPAIR_RANGES 64
+#endif
+
+// Heap left untouched when sizing the OTA buffers (for WiFi/lwIP and the application)
+#ifndef OTA_TUNING_HEAP_RESERVE
+#define OTA_TUNING_HEAP_RESERVE 32768
+#endif
+
 // Callback function types - set to nullptr if not used
 #ifndef OTA_CALLBACK_NONE
 #define OTA_CALLBACK_NONE nullptr
@@ -0,0 +1,465 @@
+// OTAMulticast.cpp
+#include "OTAMulticast.h"
+
+#if defined(ESP32)
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <lwip/sockets.h>
+#else
+    #include <arpa/inet.h>
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <netinet/in.h>
+    #include <sys/select.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static const uint8_t packetMagic[4] = {'O', 'T', 'M', 'C'};
+static const uint8_t repairMagic[4] = {'O', 'T', 'M', 'R'};
+
+// Each pipeline buffer starts with the group's image offset and the mask of the
+// blocks it holds, so the writer task needs no other state
+static const size_t groupHeaderSize = 12;
+
+static uint16_t get16(const uint8_t* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put16(uint8_t* p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+static int waitReadable(int sock, uint32_t timeoutMs) {
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    FD_SET(sock, &readSet);
+    struct timeval tv;
+    tv.tv_sec = timeoutMs / 1000;
+    tv.tv_usec = (timeoutMs % 1000) * 1000;
+    return select(sock + 1, &readSet, nullptr, nullptr, &tv);
+}
+
+bool OTAMulticast::fits(const OTAMulticastSession& s) {
+    return s.imageSize > 0 && s.blockSize > 0 && s.blockSize <= MAX_BLOCK_SIZE && s.k > 0 &&
+           s.k <= OTAFec::MAX_DATA && s.p <= OTAFec::MAX_PARITY &&
+           (uint32_t)s.k * s.blockSize <= OTA_MULTICAST_GROUP_MAX;
+}
+
+bool OTAMulticast::begin(const char* group, uint16_t port, const char* interfaceIp) {
+    end();
+    struct in_addr groupAddr;
+    struct in_addr interfaceAddr;
+    interfaceAddr.s_addr = htonl(INADDR_ANY);
+    if (!group || inet_aton(group, &groupAddr) == 0 ||
+        (ntohl(groupAddr.s_addr) & 0xF0000000) != 0xE0000000) {
+        OTAM_LOG_E("Multicast: %s is not a multicast address", group ? group : "(null)");
+        return false;
+    }
+    if (interfaceIp && inet_aton(interfaceIp, &interfaceAddr) == 0) {
+        OTAM_LOG_E("Multicast: bad interface address %s", interfaceIp);
+        return false;
+    }
+
+    sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+        OTAM_LOG_E("Multicast: UDP socket failed (%d)", errno);
+        return false;
+    }
+    int yes = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+#ifdef SO_REUSEPORT
+    setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes));
+#endif
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    struct ip_mreq mreq = {};
+    mreq.imr_multiaddr = groupAddr;
+    mreq.imr_interface = interfaceAddr;
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) != 0) {
+        OTAM_LOG_E("Multicast: cannot join %s:%u (%d)", group, port, errno);
+        end();
+        return false;
+    }
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+    OTAM_LOG_I("Multicast: joined %s:%u", group, port);
+    return true;
+}
+
+void OTAMulticast::end() {
+    if (sock >= 0) {
+        close(sock);  // Leaves the group
+        sock = -1;
+    }
+}
+
+bool OTAMulticast::poll() {
+    if (sock < 0) {
+        return false;
+    }
+    // Only announcements matter between sessions; longer packets are cut and dropped
+    uint8_t buf[ANNOUNCE_SIZE];
+    struct sockaddr_in from = {};
+    socklen_t fromLen = sizeof(from);
+    int n = recvfrom(sock, buf, sizeof(buf), 0, (struct sockaddr*)&from, &fromLen);
+    if (n < (int)ANNOUNCE_SIZE || memcmp(buf, packetMagic, 4) != 0 || buf[4] != ANNOUNCE) {
+        return false;
+    }
+    uint16_t id = get16(buf + 6);
+    if ((int32_t)id == finishedSession) {
+        return false;
+    }
+
+    OTAMulticastSession s = {};
+    const uint8_t* p = buf + HEADER_SIZE;
+    s.id = id;
+    s.imageSize = get32(p);
+    s.blockSize = get16(p + 4);
+    s.k = p[6];
+    s.p = p[7];
+    s.repairPort = get16(p + 8);
+    s.hasSha256 = p[10] & 1;
+    s.hasSignature = (p[10] >> 1) & 1;
+    memcpy(s.md5, p + 12, 32);
+    s.md5[32] = '\0';
+    memcpy(s.sha256, p + 44, sizeof(s.sha256));
+    memcpy(s.signature, p + 76, sizeof(s.signature));
+    s.senderAddr = from.sin_addr.s_addr;
+    current = s;
+    return true;
+}
+
+bool OTAMulticast::waitForSession(uint32_t timeoutMs) {
+    uint32_t start = millis();
+    while (sock >= 0) {
+        uint32_t elapsed = millis() - start;
+        if (elapsed >= timeoutMs) {
+            return false;
+        }
+        if (waitReadable(sock, timeoutMs - elapsed) > 0 && poll()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool OTAMulticast::dropped() {
+    if (lossPercent == 0) {
+        return false;
+    }
+    lossSeed = lossSeed * 1103515245u + 12345u;
+    return (lossSeed >> 16) % 100 < lossPercent;
+}
+
+uint32_t OTAMulticast::groupBlocks(uint32_t g) const {
+    uint32_t first = g * current.k;
+    return blockCount - first < current.k ? blockCount - first : current.k;
+}
+
+size_t OTAMulticast::blockLength(uint32_t block) const {
+    size_t offset = (size_t)block * current.blockSize;
+    return current.imageSize - offset < current.blockSize ? current.imageSize - offset
+                                                          : current.blockSize;
+}
+
+bool OTAMulticast::receive(WriteFunction writer, ProgressFunction progress, void* context) {
+    memset(&stats, 0, sizeof(stats));
+    stats.session = current.id;
+    stats.imageSize = current.imageSize;
+    if (sock < 0 || !fits(current)) {
+        return false;
+    }
+    writeFn = writer;
+    progressFn = progress;
+    writeContext = context;
+    blockCount = (current.imageSize + current.blockSize - 1) / current.blockSize;
+    groupCount = (blockCount + current.k - 1) / current.k;
+    blocksDone = 0;
+    stats.blocks = blockCount;
+
+    size_t packetSize = HEADER_SIZE + current.blockSize;
+    bitmap = (uint8_t*)calloc((blockCount + 7) / 8, 1);
+    packet = (uint8_t*)malloc(packetSize);
+    parityBuffer = current.p ? (uint8_t*)malloc((size_t)current.p * current.blockSize) : nullptr;
+    BaseType_t core = OTA_PIPELINE_WRITER_CORE;
+    if (core < 0) {
+        core = portNUM_PROCESSORS > 1 ? 1 - xPortGetCoreID() : tskNO_AFFINITY;
+    }
+    bool ok = bitmap && packet && (parityBuffer || !current.p) &&
+              pipeline.begin(groupHeaderSize + (size_t)current.k * current.blockSize, 2, writeGroup,
+                             this, core);
+    if (!ok) {
+        OTAM_LOG_E("Multicast: no memory for a %u x %u byte group", current.k,
+                   (unsigned)current.blockSize);
+    } else {
+        OTAM_LOG_I("Multicast: session %u, %u bytes in %u groups of %u+%u blocks", current.id,
+                   (unsigned)current.imageSize, (unsigned)groupCount, current.k, current.p);
+        uint32_t start = micros();
+        ok = receiveStream();
+        if (ok) {
+            ok = pipeline.finish();
+        } else {
+            pipeline.end();
+        }
+        stats.streamUs = micros() - start;
+
+        if (ok && blocksDone < blockCount) {
+            OTAM_LOG_I("Multicast: %u blocks missing after the stream, repairing",
+                       (unsigned)(blockCount - blocksDone));
+            start = micros();
+            ok = repair();
+            stats.repairUs = micros() - start;
+        }
+        OTAM_LOG_I("Multicast: %u packets, %u blocks rebuilt by FEC, %u repaired", (unsigned)stats.packets,
+                   (unsigned)stats.recovered, (unsigned)stats.repaired);
+    }
+
+    pipeline.end();
+    free(bitmap);
+    free(packet);
+    free(parityBuffer);
+    bitmap = packet = parityBuffer = nullptr;
+    groupBuffer = nullptr;
+    finishedSession = current.id;  // Announcements keep coming until the sender is done
+    return ok && blocksDone == blockCount;
+}
+
+void OTAMulticast::startGroup(uint32_t g) {
+    group = (int32_t)g;
+    groupBuffer = pipeline.acquire();
+    memset(present, 0, sizeof(present));
+    dataCount = 0;
+    parityCount = 0;
+}
+
+bool OTAMulticast::receiveStream() {
+    size_t packetSize = HEADER_SIZE + current.blockSize;
+    group = -1;
+    groupBuffer = nullptr;
+    for (;;) {
+        if (waitReadable(sock, OTA_MULTICAST_IDLE_MS) <= 0) {
+            break;  // The stream went quiet; repair fills in the rest
+        }
+        int n = recv(sock, packet, packetSize, 0);
+        if (n < (int)HEADER_SIZE || memcmp(packet, packetMagic, 4) != 0 ||
+            get16(packet + 6) != current.id || dropped()) {
+            continue;
+        }
+        stats.packets++;
+        uint8_t type = packet[4];
+        uint8_t index = packet[5];
+        uint32_t g = get32(packet + 8);
+        if (type == END) {
+            break;
+        }
+        if ((type != DATA && type != PARITY) || g >= groupCount || (int32_t)g < group) {
+            continue;  // A late packet of a written group is left to repair
+        }
+        if ((int32_t)g != group) {
+            if (groupBuffer && !finishGroup()) {
+                return false;
+            }
+            startGroup(g);
+            if (!groupBuffer) {
+                return false;  // The flash writer failed
+            }
+        }
+        if (!groupBuffer) {
+            continue;  // This group has already been written
+        }
+
+        uint32_t kg = groupBlocks(g);
+        size_t len = n - HEADER_SIZE;
+        if (type == DATA) {
+            if (index >= kg || present[index] || len != blockLength(g * current.k + index)) {
+                continue;
+            }
+            uint8_t* dst = groupBuffer + groupHeaderSize + (size_t)index * current.blockSize;
+            memcpy(dst, packet + HEADER_SIZE, len);
+            memset(dst + len, 0, current.blockSize - len);  // FEC treats short blocks as padded
+            present[index] = true;
+            dataCount++;
+        } else {
+            if (index >= current.p || len != current.blockSize || parityCount >= current.p ||
+                memchr(parityRows, index, parityCount)) {
+                continue;
+            }
+            memcpy(parityBuffer + (size_t)parityCount * current.blockSize, packet + HEADER_SIZE, len);
+            parityRows[parityCount++] = index;
+        }
+        // As soon as the group can be rebuilt it goes to flash; its remaining parity is not needed
+        if (dataCount + parityCount >= kg && !finishGroup()) {
+            return false;
+        }
+    }
+    return !groupBuffer || finishGroup();
+}
+
+bool OTAMulticast::finishGroup() {
+    uint32_t kg = groupBlocks(group);
+    uint8_t* data = groupBuffer + groupHeaderSize;
+    if (dataCount < kg && parityCount > 0) {
+        uint8_t* blocks[OTAFec::MAX_DATA];
+        uint8_t* parity[OTAFec::MAX_PARITY];
+        for (uint32_t j = 0; j < kg; j++) {
+            blocks[j] = data + (size_t)j * current.blockSize;
+        }
+        for (uint8_t i = 0; i < parityCount; i++) {
+            parity[i] = parityBuffer + (size_t)i * current.blockSize;
+        }
+        if (OTAFec::decode(blocks, present, kg, parity, parityRows, parityCount, current.blockSize)) {
+            stats.recovered += kg - dataCount;
+            memset(present, 1, kg);
+        }
+    }
+
+    uint32_t first = group * current.k;
+    uint32_t maskLow = 0;
+    uint32_t maskHigh = 0;
+    for (uint32_t j = 0; j < kg; j++) {
+        if (present[j]) {
+            (j < 32 ? maskLow : maskHigh) |= 1u << (j & 31);
+            markBlock(first + j);
+            blocksDone++;
+        }
+    }
+    put32(groupBuffer, first);
+    put32(groupBuffer + 4, maskLow);
+    put32(groupBuffer + 8, maskHigh);
+    pipeline.submit(groupBuffer, groupHeaderSize + (size_t)kg * current.blockSize);
+    groupBuffer = nullptr;
+
+    if (progressFn) {
+        size_t done = (size_t)blocksDone * current.blockSize;
+        progressFn(writeContext, done < current.imageSize ? done : current.imageSize, current.imageSize);
+    }
+    return !pipeline.hasFailed();
+}
+
+bool OTAMulticast::writeGroup(void* context, uint8_t* data, size_t len) {
+    OTAMulticast* self = static_cast<OTAMulticast*>(context);
+    uint32_t blockSize = self->current.blockSize;
+    uint32_t first = get32(data);
+    uint64_t mask = get32(data + 4) | ((uint64_t)get32(data + 8) << 32);
+    uint32_t kg = (len - groupHeaderSize) / blockSize;
+    const uint8_t* blocks = data + groupHeaderSize;
+
+    // Runs of consecutive blocks go to flash in one write
+    uint32_t j = 0;
+    while (j < kg) {
+        if (!((mask >> j) & 1)) {
+            j++;
+            continue;
+        }
+        uint32_t end = j;
+        size_t bytes = 0;
+        while (end < kg && ((mask >> end) & 1)) {
+            bytes += self->blockLength(first + end);
+            end++;
+        }
+        if (!self->writeFn(self->writeContext, (first + j) * blockSize, blocks + (size_t)j * blockSize,
+                           bytes)) {
+            return false;
+        }
+        j = end;
+    }
+    return true;
+}
+
+bool OTAMulticast::repair() {
+    int failures = 0;
+    while (blocksDone < blockCount && failures < 3) {
+        int tcp = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        struct timeval tv;
+        tv.tv_sec = OTA_MULTICAST_REPAIR_TIMEOUT_MS / 1000;
+        tv.tv_usec = (OTA_MULTICAST_REPAIR_TIMEOUT_MS % 1000) * 1000;
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = current.senderAddr;
+        addr.sin_port = htons(current.repairPort);
+        if (tcp < 0 || setsockopt(tcp, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) != 0 ||
+            connect(tcp, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+            OTAM_LOG_W("Multicast: repair connection failed (%d)", errno);
+            if (tcp >= 0) {
+                close(tcp);
+            }
+            failures++;
+            delay(100);
+            continue;
+        }
+
+        // Ask for the next OTA_MULTICAST_REPAIR_RANGES runs of missing blocks
+        uint8_t request[8 + 8 * OTA_MULTICAST_REPAIR_RANGES];
+        uint16_t ranges = 0;
+        for (uint32_t b = 0; b < blockCount && ranges < OTA_MULTICAST_REPAIR_RANGES;) {
+            if (hasBlock(b)) {
+                b++;
+                continue;
+            }
+            uint32_t end = b;
+            while (end < blockCount && !hasBlock(end)) {
+                end++;
+            }
+            put32(request + 8 + 8 * ranges, b);
+            put32(request + 12 + 8 * ranges, end - b);
+            ranges++;
+            b = end;
+        }
+        memcpy(request, repairMagic, 4);
+        put16(request + 4, current.id);
+        put16(request + 6, ranges);
+        size_t requestLen = 8 + 8 * (size_t)ranges;
+        bool ok = send(tcp, request, requestLen, MSG_NOSIGNAL) == (int)requestLen;
+
+        for (uint16_t r = 0; ok && r < ranges; r++) {
+            uint32_t b = get32(request + 8 + 8 * r);
+            uint32_t end = b + get32(request + 12 + 8 * r);
+            for (; ok && b < end; b++) {
+                size_t len = blockLength(b);
+                size_t got = 0;
+                while (ok && got < len) {
+                    int n = recv(tcp, packet + got, len - got, 0);
+                    ok = n > 0;
+                    got += ok ? n : 0;
+                }
+                if (ok && !writeFn(writeContext, b * current.blockSize, packet, len)) {
+                    close(tcp);
+                    return false;
+                }
+                if (ok) {
+                    markBlock(b);
+                    blocksDone++;
+                    stats.repaired++;
+                }
+            }
+        }
+        close(tcp);
+        if (!ok) {
+            OTAM_LOG_W("Multicast: repair cut off, %u blocks still missing",
+                       (unsigned)(blockCount - blocksDone));
+            failures++;
+        }
+    }
+    if (progressFn && blocksDone == blockCount) {
+        progressFn(writeContext, current.imageSize, current.imageSize);
+    }
+    return blocksDone == blockCount;
+}
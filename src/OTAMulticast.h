@@ -0,0 +1,179 @@
+/**
+ * @file OTAMulticast.h
+ * @brief Multicast image distribution: one stream for a whole fleet
+ *
+ * @details A sender announces a session on a multicast group and streams the
+ * image once, in groups of k data blocks each followed by p Reed-Solomon parity
+ * blocks (OTAFec). Every device joined to the group rebuilds up to p lost blocks
+ * per group by itself, so the stream does not slow down with the number of
+ * devices or their individual losses. Blocks a device still lacks at the end
+ * are fetched from the sender over TCP (repair), each device asking only for
+ * its own gaps.
+ *
+ * Wire format, all integers little endian. Every packet starts with a 12 byte
+ * header: "OTMC", type, index, session (16 bit), group (32 bit).
+ *
+ * - ANNOUNCE: image size (32), block size (16), k, p, repair TCP port (16),
+ *   flags (bit 0 SHA-256, bit 1 signature), reserved, MD5 (32 hex characters),
+ *   SHA-256 (32 bytes), Ed25519 signature (64 bytes). Repeated during the stream
+ *   so devices can join late.
+ * - DATA: data block `index` of `group`; the last block of the image is short.
+ * - PARITY: parity row `index` of `group`, over the group's blocks zero padded
+ *   to the block size.
+ * - END: the stream is over; `group` holds the number of groups.
+ *
+ * Repair request: "OTMR", session (16), range count (16), then per range the
+ * first block and the block count (32 bit each). The sender answers with the
+ * blocks' bytes in order and closes the connection.
+ *
+ * Received groups go to flash through an OTAPipeline, so the network side keeps
+ * draining the socket while a group is written.
+ *
+ * @note Not thread-safe; used by OTAReceiver under OTAManager's mutex.
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include "OTAFec.h"
+#include "OTAManagerConfig.h"
+#include "OTAPipeline.h"
+
+struct OTAMulticastSession {
+    uint16_t id;
+    uint32_t imageSize;
+    uint16_t blockSize;
+    uint8_t k;  // Data blocks per group
+    uint8_t p;  // Parity blocks per group
+    uint32_t senderAddr;  // Network byte order
+    uint16_t repairPort;
+    char md5[33];
+    bool hasSha256;
+    uint8_t sha256[32];
+    bool hasSignature;
+    uint8_t signature[64];
+};
+
+struct OTAMulticastStats {
+    uint16_t session;
+    uint32_t imageSize;
+    uint32_t packets;    // Packets of the session received
+    uint32_t blocks;     // Data blocks in the image
+    uint32_t recovered;  // Data blocks rebuilt from parity
+    uint32_t repaired;   // Data blocks fetched over unicast
+    uint32_t streamUs;   // Session start -> end of the multicast stream
+    uint32_t repairUs;   // Unicast repair
+};
+
+class OTAMulticast {
+   public:
+    enum PacketType : uint8_t { ANNOUNCE = 1, DATA = 2, PARITY = 3, END = 4 };
+
+    static const size_t HEADER_SIZE = 12;
+    static const size_t ANNOUNCE_SIZE = HEADER_SIZE + 140;
+    static const size_t MAX_BLOCK_SIZE = 1400;  // One datagram within a 1500 byte MTU
+
+    /**
+     * @brief Stage of the write path; called with whole blocks, in any order,
+     * each block once. Returns false to abort the session.
+     */
+    typedef bool (*WriteFunction)(void* context, uint32_t offset, const uint8_t* data, size_t len);
+    typedef void (*ProgressFunction)(void* context, size_t done, size_t total);
+
+    ~OTAMulticast() { end(); }
+
+    /**
+     * @brief Join a multicast group
+     *
+     * @param group Group address, e.g. "239.255.32.32"
+     * @param port UDP port of the stream
+     * @param interfaceIp Address of the local interface to join on (nullptr = default)
+     */
+    bool begin(const char* group, uint16_t port, const char* interfaceIp = nullptr);
+    void end();
+    bool isJoined() const { return sock >= 0; }
+    int socketFd() const { return sock; }
+
+    /**
+     * @brief Read one pending packet without blocking
+     *
+     * @return true if it announced a session not received yet; session() has it
+     */
+    bool poll();
+
+    /**
+     * @brief Block up to timeoutMs for a session announcement
+     */
+    bool waitForSession(uint32_t timeoutMs);
+
+    const OTAMulticastSession& session() const { return current; }
+
+    /**
+     * @brief Receive the announced session
+     *
+     * Runs until every block has been written, through FEC and unicast repair.
+     *
+     * @return false if blocks are still missing or a write failed
+     */
+    bool receive(WriteFunction writer, ProgressFunction progress, void* context);
+
+    /**
+     * @brief Do not offer this session again (done, or refused)
+     */
+    void skipSession() { finishedSession = current.id; }
+
+    const OTAMulticastStats& getStats() const { return stats; }
+
+    /**
+     * @brief Drop this percentage of received packets, to try FEC settings on a
+     * clean network (0 = off)
+     */
+    void setSimulatedLoss(uint8_t percent, uint32_t seed = 1) {
+        lossPercent = percent;
+        lossSeed = seed;
+    }
+
+    /**
+     * @brief Whether a session with this FEC group fits OTA_MULTICAST_GROUP_MAX
+     */
+    static bool fits(const OTAMulticastSession& s);
+
+   private:
+    static bool writeGroup(void* context, uint8_t* data, size_t len);
+    bool receiveStream();
+    void startGroup(uint32_t group);
+    bool finishGroup();
+    bool repair();
+    bool dropped();
+    uint32_t groupBlocks(uint32_t group) const;
+    size_t blockLength(uint32_t block) const;
+    bool hasBlock(uint32_t block) const { return (bitmap[block >> 3] >> (block & 7)) & 1; }
+    void markBlock(uint32_t block) { bitmap[block >> 3] |= 1 << (block & 7); }
+
+    int sock = -1;
+    OTAMulticastSession current = {};
+    int32_t finishedSession = -1;
+    OTAMulticastStats stats = {};
+    uint8_t lossPercent = 0;
+    uint32_t lossSeed = 1;
+
+    // Session state
+    WriteFunction writeFn = nullptr;
+    ProgressFunction progressFn = nullptr;
+    void* writeContext = nullptr;
+    OTAPipeline pipeline;
+    uint32_t blockCount = 0;
+    uint32_t groupCount = 0;
+    uint32_t blocksDone = 0;
+    uint8_t* bitmap = nullptr;  // Blocks written
+
+    // Group being received: data goes straight into a pipeline buffer
+    int32_t group = -1;
+    uint8_t* groupBuffer = nullptr;
+    bool present[OTAFec::MAX_DATA];
+    uint8_t dataCount = 0;
+    uint8_t* parityBuffer = nullptr;
+    uint8_t parityRows[OTAFec::MAX_PARITY];
+    uint8_t parityCount = 0;
+    uint8_t* packet = nullptr;  // Receive buffer: header + one block
+};
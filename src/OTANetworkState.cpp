@@ -0,0 +1,42 @@
+// OTANetworkState.cpp
+#include "OTANetworkState.h"
+
+void OTANetworkState::up(Interface iface, uint32_t address) {
+    // The address is stored before the interface counts as up, so a reader that
+    // sees it up also sees its address
+    uint32_t previous = addresses[iface].exchange(address, std::memory_order_relaxed);
+    uint8_t bit = 1 << iface;
+    uint8_t mask = upMask.fetch_or(bit, std::memory_order_release);
+    if (!(mask & bit) || previous != address) {
+        changeCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void OTANetworkState::down(Interface iface) {
+    uint8_t bit = 1 << iface;
+    uint8_t mask = upMask.fetch_and(~bit, std::memory_order_release);
+    addresses[iface].store(0, std::memory_order_relaxed);
+    if (mask & bit) {
+        changeCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+uint32_t OTANetworkState::address() const {
+    static const Interface order[] = {WIFI, ETHERNET, EXTERNAL};
+    uint8_t mask = upMask.load(std::memory_order_acquire);
+    for (Interface iface : order) {
+        if (mask & (1 << iface)) {
+            return addresses[iface].load(std::memory_order_relaxed);
+        }
+    }
+    return 0;
+}
+
+void OTANetworkState::format(uint32_t a, char* out, size_t len) {
+    if (!a) {
+        snprintf(out, len, "unknown");
+        return;
+    }
+    snprintf(out, len, "%u.%u.%u.%u", (unsigned)(a & 0xFF), (unsigned)((a >> 8) & 0xFF),
+             (unsigned)((a >> 16) & 0xFF), (unsigned)(a >> 24));
+}
@@ -0,0 +1,56 @@
+/**
+ * @file OTANetworkState.h
+ * @brief Network readiness kept up to date by link and IP events
+ *
+ * @details Each interface (Ethernet, WiFi station, or one reported by the
+ * application) is marked up when it gets an address and down when it loses the
+ * link or the address. Events arrive on the network event task while
+ * handleUpdates() reads the state on another, so everything is a lock-free
+ * atomic and a readiness check is a single load.
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include <atomic>
+
+class OTANetworkState {
+   public:
+    enum Interface : uint8_t { ETHERNET = 0, WIFI = 1, EXTERNAL = 2, INTERFACE_COUNT = 3 };
+
+    /**
+     * @brief The interface has an address (again, or a new one)
+     *
+     * @param address IPv4 address as IPAddress stores it (first octet in the low byte)
+     */
+    void up(Interface iface, uint32_t address);
+    void down(Interface iface);
+
+    bool isReady() const { return upMask.load(std::memory_order_acquire) != 0; }
+
+    /**
+     * @brief Address of an interface that is up (WiFi first, then Ethernet, then
+     * the external one), or 0
+     */
+    uint32_t address() const;
+
+    /**
+     * @brief Dotted address into out (at least 16 bytes), "unknown" if none
+     */
+    void formatAddress(char* out, size_t len) const { format(address(), out, len); }
+
+    /**
+     * @brief Dotted form of any address, without touching the heap
+     */
+    static void format(uint32_t address, char* out, size_t len);
+
+    /**
+     * @brief Up/down transitions and address changes seen so far
+     */
+    uint32_t changes() const { return changeCount.load(std::memory_order_relaxed); }
+
+   private:
+    std::atomic<uint8_t> upMask{0};
+    std::atomic<uint32_t> addresses[INTERFACE_COUNT] = {};
+    std::atomic<uint32_t> changeCount{0};
+};
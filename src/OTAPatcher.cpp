@@ -0,0 +1,214 @@
+// OTAPatcher.cpp
+#include "OTAPatcher.h"
+
+#include <MD5Builder.h>
+
+static const uint8_t patchMagic[4] = {'O', 'T', 'A', 'P'};
+static const uint8_t patchVersion = 1;
+
+static uint32_t readLE32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool OTAPatcher::isPatch(const uint8_t* data, size_t len) {
+    return len >= sizeof(patchMagic) && memcmp(data, patchMagic, sizeof(patchMagic)) == 0;
+}
+
+bool OTAPatcher::begin(ReadFunction readBase, OutputFunction out, void* context) {
+    end();
+    work = (uint8_t*)malloc(OTA_PATCH_BUFFER_SIZE);
+    if (!work) {
+        OTAM_LOG_E("Patch: allocation of %u bytes failed", (unsigned)OTA_PATCH_BUFFER_SIZE);
+        return false;
+    }
+    readFn = readBase;
+    outputFn = out;
+    fnContext = context;
+    state = HEADER;
+    error = nullptr;
+    headerFill = 0;
+    controlIndex = 0;
+    varintShift = 0;
+    control[0] = control[1] = control[2] = 0;
+    basePos = 0;
+    inBytes = 0;
+    outBytes = 0;
+    return true;
+}
+
+void OTAPatcher::end() {
+    free(work);
+    work = nullptr;
+    if (state != DONE) {
+        state = FAILED;
+    }
+}
+
+void OTAPatcher::getTargetMD5(char out[33]) const {
+    for (uint8_t i = 0; i < 16; i++) {
+        snprintf(out + 2 * i, 3, "%02x", targetMD5[i]);
+    }
+}
+
+bool OTAPatcher::fail(const char* msg) {
+    if (!error) {
+        error = msg;
+    }
+    state = FAILED;
+    return false;
+}
+
+bool OTAPatcher::output(uint8_t* data, size_t len) {
+    outBytes += len;
+    if (!outputFn(fnContext, data, len)) {
+        return fail("output rejected");
+    }
+    return true;
+}
+
+bool OTAPatcher::parseHeader() {
+    if (memcmp(work, patchMagic, sizeof(patchMagic)) != 0 || work[4] != patchVersion) {
+        return fail("unsupported patch format");
+    }
+    baseLen = readLE32(work + 8);
+    targetLen = readLE32(work + 12);
+    memcpy(targetMD5, work + 32, sizeof(targetMD5));
+    if (targetLen == 0) {
+        return fail("empty target image");
+    }
+
+    // Refuse to build on top of anything but the exact image the patch was made for
+    uint8_t expected[16];
+    memcpy(expected, work + 16, sizeof(expected));
+    MD5Builder md5;
+    md5.begin();
+    for (uint32_t off = 0; off < baseLen; off += OTA_PATCH_BUFFER_SIZE) {
+        size_t n = baseLen - off < OTA_PATCH_BUFFER_SIZE ? baseLen - off : OTA_PATCH_BUFFER_SIZE;
+        if (!readFn(fnContext, off, work, n)) {
+            return fail("base image unreadable");
+        }
+        md5.add(work, n);
+    }
+    md5.calculate();
+    uint8_t actual[16];
+    md5.getBytes(actual);
+    if (memcmp(actual, expected, sizeof(actual)) != 0) {
+        return fail("patch was made for a different base image");
+    }
+
+    OTAM_LOG_I("Patch: %u byte base verified, building %u byte image", (unsigned)baseLen,
+               (unsigned)targetLen);
+    state = CONTROL;
+    return true;
+}
+
+bool OTAPatcher::controlByte(uint8_t b) {
+    if (varintShift > 28) {
+        return fail("malformed record");
+    }
+    control[controlIndex] |= (uint32_t)(b & 0x7f) << varintShift;
+    if (b & 0x80) {
+        varintShift += 7;
+        return true;
+    }
+    varintShift = 0;
+    if (++controlIndex < 3) {
+        return true;
+    }
+
+    controlIndex = 0;
+    diffRemaining = control[0];
+    extraRemaining = control[1];
+    seek = (int64_t)(control[2] >> 1) ^ -(int64_t)(control[2] & 1);
+    control[0] = control[1] = control[2] = 0;
+    if ((uint64_t)outBytes + diffRemaining + extraRemaining > targetLen) {
+        return fail("record exceeds target size");
+    }
+    if (basePos + diffRemaining > baseLen) {
+        return fail("record exceeds base image");
+    }
+    state = diffRemaining ? DIFF : EXTRA;
+    return extraRemaining || diffRemaining ? true : endRecord();
+}
+
+bool OTAPatcher::endRecord() {
+    basePos += seek;
+    if (basePos < 0 || basePos > baseLen) {
+        return fail("seek outside base image");
+    }
+    state = outBytes == targetLen ? DONE : CONTROL;
+    return true;
+}
+
+bool OTAPatcher::write(uint8_t* data, size_t len) {
+    if (state == FAILED) {
+        return false;
+    }
+    inBytes += len;
+
+    while (len > 0 && state != DONE) {
+        switch (state) {
+            case HEADER: {
+                size_t n = HEADER_SIZE - headerFill < len ? HEADER_SIZE - headerFill : len;
+                memcpy(work + headerFill, data, n);
+                headerFill += n;
+                data += n;
+                len -= n;
+                if (headerFill == HEADER_SIZE && !parseHeader()) {
+                    return false;
+                }
+                break;
+            }
+            case CONTROL:
+                if (!controlByte(*data)) {
+                    return false;
+                }
+                data++;
+                len--;
+                break;
+            case DIFF: {
+                // New byte = base byte + diff byte, one work buffer at a time
+                size_t n = diffRemaining < len ? diffRemaining : len;
+                if (n > OTA_PATCH_BUFFER_SIZE) {
+                    n = OTA_PATCH_BUFFER_SIZE;
+                }
+                if (!readFn(fnContext, (uint32_t)basePos, work, n)) {
+                    return fail("base image unreadable");
+                }
+                for (size_t i = 0; i < n; i++) {
+                    work[i] += data[i];
+                }
+                if (!output(work, n)) {
+                    return false;
+                }
+                basePos += n;
+                diffRemaining -= n;
+                data += n;
+                len -= n;
+                if (diffRemaining == 0) {
+                    state = EXTRA;
+                    if (extraRemaining == 0 && !endRecord()) {
+                        return false;
+                    }
+                }
+                break;
+            }
+            case EXTRA: {
+                size_t n = extraRemaining < len ? extraRemaining : len;
+                if (!output(data, n)) {
+                    return false;
+                }
+                extraRemaining -= n;
+                data += n;
+                len -= n;
+                if (extraRemaining == 0 && !endRecord()) {
+                    return false;
+                }
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,119 @@
+/**
+ * @file OTAPatcher.h
+ * @brief Streaming application of binary delta patches to the running image
+ *
+ * @details A patch describes the new image relative to the image in the running
+ * app partition, bsdiff style: a sequence of records, each adding a run of
+ * "diff" bytes to the base image at a moving offset (code that merely moved or
+ * had its addresses relocated becomes small, highly compressible differences),
+ * followed by a run of literal "extra" bytes and a seek within the base.
+ *
+ * Layout (little endian):
+ *
+ *     "OTAP" | version (1) | 3 reserved | base size (4) | target size (4)
+ *     base MD5 (16) | target MD5 (16)
+ *     records: varint diff length, varint extra length, zigzag varint seek,
+ *              diff bytes, extra bytes
+ *
+ * The base MD5 is checked against the running partition before any output is
+ * produced; the target MD5 is handed to Update so the written image is verified
+ * like a full one. Patches may additionally be gzip/zlib compressed on the wire.
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include "OTAManagerConfig.h"
+
+class OTAPatcher {
+   public:
+    /**
+     * @brief Reads len bytes of the base image at offset
+     */
+    typedef bool (*ReadFunction)(void* context, uint32_t offset, uint8_t* dst, size_t len);
+
+    /**
+     * @brief Receives reconstructed image data; returns false to abort
+     */
+    typedef bool (*OutputFunction)(void* context, uint8_t* data, size_t len);
+
+    static const size_t HEADER_SIZE = 48;
+
+    ~OTAPatcher() { end(); }
+
+    /**
+     * @brief Check for the patch magic at the start of a stream
+     */
+    static bool isPatch(const uint8_t* data, size_t len);
+
+    /**
+     * @brief Allocate the work buffer (OTA_PATCH_BUFFER_SIZE) and reset
+     */
+    bool begin(ReadFunction readBase, OutputFunction output, void* context);
+
+    /**
+     * @brief Release the work buffer
+     */
+    void end();
+
+    /**
+     * @brief Apply the next piece of the patch stream
+     *
+     * @return false if the patch is malformed, made for another base image, or
+     * the output function failed
+     */
+    bool write(uint8_t* data, size_t len);
+
+    /**
+     * @brief True once the whole target image has been produced
+     */
+    bool isFinished() const { return state == DONE; }
+    bool hasFailed() const { return state == FAILED; }
+
+    uint32_t baseSize() const { return baseLen; }
+    uint32_t targetSize() const { return targetLen; }
+
+    /**
+     * @brief MD5 of the target image as hex, from the patch header
+     */
+    void getTargetMD5(char out[33]) const;
+
+    size_t totalIn() const { return inBytes; }
+    size_t totalOut() const { return outBytes; }
+
+    const char* errorString() const { return error; }
+
+   private:
+    enum State { HEADER, CONTROL, DIFF, EXTRA, DONE, FAILED };
+
+    bool fail(const char* msg);
+    bool parseHeader();
+    bool controlByte(uint8_t b);
+    bool endRecord();
+    bool output(uint8_t* data, size_t len);
+
+    uint8_t* work = nullptr;
+    ReadFunction readFn = nullptr;
+    OutputFunction outputFn = nullptr;
+    void* fnContext = nullptr;
+
+    State state = FAILED;
+    const char* error = nullptr;
+
+    uint32_t baseLen = 0;
+    uint32_t targetLen = 0;
+    uint8_t targetMD5[16] = {0};
+
+    size_t headerFill = 0;
+    uint32_t control[3] = {0};
+    uint8_t controlIndex = 0;
+    uint8_t varintShift = 0;
+
+    uint32_t diffRemaining = 0;
+    uint32_t extraRemaining = 0;
+    int64_t seek = 0;
+    int64_t basePos = 0;
+
+    size_t inBytes = 0;
+    size_t outBytes = 0;
+};
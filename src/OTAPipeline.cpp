@@ -0,0 +1,138 @@
+// OTAPipeline.cpp
+#include "OTAPipeline.h"
+
+bool OTAPipeline::begin(size_t bufferSize, uint8_t bufferCount, WriteFunction writer,
+                        void* context, BaseType_t core) {
+    end();
+    if (bufferCount < 2 || bufferSize == 0 || !writer) {
+        return false;
+    }
+
+    pool = (uint8_t*)malloc(bufferSize * bufferCount);
+    freeQueue = xQueueCreate(bufferCount, sizeof(Job));
+    fullQueue = xQueueCreate(bufferCount + 1, sizeof(Job));  // +1 for the stop marker
+    writerDone = xSemaphoreCreateBinary();
+    if (!pool || !freeQueue || !fullQueue || !writerDone) {
+        OTAM_LOG_E("Pipeline: allocation of %u x %u bytes failed", bufferCount,
+                   (unsigned)bufferSize);
+        end();
+        return false;
+    }
+
+    bufSize = bufferSize;
+    writeFn = writer;
+    writeContext = context;
+    writeFailed = false;
+    stats = {};
+    for (uint8_t i = 0; i < bufferCount; i++) {
+        Job job = {pool + i * bufferSize, 0};
+        xQueueSend(freeQueue, &job, 0);
+    }
+
+    // At least the receiver's priority, which a session boost may have raised: a
+    // writer left below the application's tasks would stall the receiver instead
+    UBaseType_t priority = uxTaskPriorityGet(NULL);
+    if (priority < OTA_PIPELINE_WRITER_PRIORITY) {
+        priority = OTA_PIPELINE_WRITER_PRIORITY;
+    }
+    if (xTaskCreatePinnedToCore(writerTask, "OTAFlashWr", OTA_PIPELINE_WRITER_STACK, this, priority,
+                                nullptr, core) != pdPASS) {
+        OTAM_LOG_E("Pipeline: failed to create flash writer task");
+        end();
+        return false;
+    }
+    running = true;
+    startUs = micros();
+    return true;
+}
+
+void OTAPipeline::writerTask(void* pvParameters) {
+    OTAPipeline* self = static_cast<OTAPipeline*>(pvParameters);
+    Job job;
+
+    for (;;) {
+        uint32_t waitStart = micros();
+        xQueueReceive(self->fullQueue, &job, portMAX_DELAY);
+        self->stats.flashIdleUs += micros() - waitStart;
+        if (job.len == 0) {
+            break;
+        }
+
+        // Keep draining after a failure so the receiver never blocks on a full queue
+        if (!self->writeFailed) {
+            uint32_t writeStart = micros();
+            if (!self->writeFn(self->writeContext, job.data, job.len)) {
+                self->writeFailed = true;
+            }
+            self->stats.flashBusyUs += micros() - writeStart;
+            self->stats.buffersWritten++;
+        }
+        xQueueSend(self->freeQueue, &job, portMAX_DELAY);
+    }
+
+    xSemaphoreGive(self->writerDone);
+    vTaskDelete(NULL);
+}
+
+uint8_t* OTAPipeline::acquire() {
+    if (!running || writeFailed) {
+        return nullptr;
+    }
+    Job job;
+    uint32_t waitStart = micros();
+    xQueueReceive(freeQueue, &job, portMAX_DELAY);
+    stats.bufferWaitUs += micros() - waitStart;
+    return writeFailed ? nullptr : job.data;
+}
+
+void OTAPipeline::submit(uint8_t* buffer, size_t len) {
+    if (len == 0) {
+        // Nothing to write; recycle the buffer
+        Job job = {buffer, 0};
+        xQueueSend(freeQueue, &job, portMAX_DELAY);
+        return;
+    }
+    Job job = {buffer, len};
+    stats.bytes += len;
+    xQueueSend(fullQueue, &job, portMAX_DELAY);
+}
+
+bool OTAPipeline::finish() {
+    if (!running) {
+        return false;
+    }
+    Job stop = {nullptr, 0};
+    xQueueSend(fullQueue, &stop, portMAX_DELAY);
+    xSemaphoreTake(writerDone, portMAX_DELAY);
+    running = false;
+    stats.sessionUs = micros() - startUs;
+    bool ok = !writeFailed;
+    end();
+    return ok;
+}
+
+void OTAPipeline::end() {
+    if (running) {
+        // Writer drains the queue (skipping writes) and exits on the stop marker
+        writeFailed = true;
+        Job stop = {nullptr, 0};
+        xQueueSend(fullQueue, &stop, portMAX_DELAY);
+        xSemaphoreTake(writerDone, portMAX_DELAY);
+        running = false;
+        stats.sessionUs = micros() - startUs;
+    }
+    if (freeQueue) {
+        vQueueDelete(freeQueue);
+        freeQueue = nullptr;
+    }
+    if (fullQueue) {
+        vQueueDelete(fullQueue);
+        fullQueue = nullptr;
+    }
+    if (writerDone) {
+        vSemaphoreDelete(writerDone);
+        writerDone = nullptr;
+    }
+    free(pool);
+    pool = nullptr;
+}
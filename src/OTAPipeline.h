@@ -0,0 +1,113 @@
+/**
+ * @file OTAPipeline.h
+ * @brief Double-buffered receive/flash-write pipeline for the OTA data path
+ *
+ * @details The receiving task fills one buffer from the socket while a
+ * flash-writer task, pinned to the other core, programs the previous one. Network
+ * I/O and flash erase/program therefore overlap instead of alternating. Buffers
+ * circulate between a "free" and a "full" queue, so no data is copied between
+ * the stages.
+ *
+ * Per-stage timings are collected for every session so it is visible which side
+ * (network or flash) is the bottleneck.
+ */
+#pragma once
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+#include "OTAManagerConfig.h"
+
+/**
+ * @brief Per-stage timing of the last pipelined session
+ *
+ * Utilisation of a stage is its busy time divided by sessionUs.
+ */
+struct OTAPipelineStats {
+    uint32_t sessionUs;       // First buffer requested -> last buffer written
+    uint32_t networkWaitUs;   // Receiver blocked waiting for socket data
+    uint32_t bufferWaitUs;    // Receiver blocked waiting for a free buffer (flash-bound)
+    uint32_t flashBusyUs;     // Writer programming flash
+    uint32_t flashIdleUs;     // Writer waiting for a filled buffer (network-bound)
+    uint32_t bytes;           // Bytes passed through the pipeline
+    uint16_t buffersWritten;  // Number of buffers handed to the writer
+};
+
+class OTAPipeline {
+   public:
+    /**
+     * @brief Flash write stage; returns false to abort the session
+     */
+    typedef bool (*WriteFunction)(void* context, uint8_t* data, size_t len);
+
+    ~OTAPipeline() { end(); }
+
+    /**
+     * @brief Allocate buffers and start the writer task
+     *
+     * @param bufferSize Size of each buffer in bytes
+     * @param bufferCount Number of buffers (2 = classic double buffering)
+     * @param writer Function called by the writer task for every filled buffer
+     * @param context Opaque pointer passed to writer
+     * @param core Core for the writer task (tskNO_AFFINITY for any)
+     * @return false if memory or the task could not be allocated
+     */
+    bool begin(size_t bufferSize, uint8_t bufferCount, WriteFunction writer, void* context,
+               BaseType_t core);
+
+    /**
+     * @brief Get a buffer to fill; blocks while all buffers are being written
+     *
+     * @return nullptr if the writer failed
+     */
+    uint8_t* acquire();
+
+    /**
+     * @brief Hand a filled buffer to the writer
+     */
+    void submit(uint8_t* buffer, size_t len);
+
+    /**
+     * @brief Wait for all submitted buffers to be written and stop the writer
+     *
+     * @return true if every write succeeded
+     */
+    bool finish();
+
+    /**
+     * @brief Abort: stop the writer, discarding queued buffers, and free memory
+     */
+    void end();
+
+    bool hasFailed() const { return writeFailed; }
+    size_t bufferSize() const { return bufSize; }
+
+    /**
+     * @brief Account time the receiver spent blocked on the socket
+     */
+    void addNetworkWait(uint32_t us) { stats.networkWaitUs += us; }
+
+    const OTAPipelineStats& getStats() const { return stats; }
+
+   private:
+    struct Job {
+        uint8_t* data;
+        size_t len;  // 0 = stop
+    };
+
+    static void writerTask(void* pvParameters);
+
+    uint8_t* pool = nullptr;
+    size_t bufSize = 0;
+    QueueHandle_t freeQueue = nullptr;
+    QueueHandle_t fullQueue = nullptr;
+    SemaphoreHandle_t writerDone = nullptr;
+    WriteFunction writeFn = nullptr;
+    void* writeContext = nullptr;
+    volatile bool writeFailed = false;
+    bool running = false;
+    uint32_t startUs = 0;
+    OTAPipelineStats stats = {};
+};
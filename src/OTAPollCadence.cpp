@@ -0,0 +1,21 @@
+// OTAPollCadence.cpp
+#include "OTAPollCadence.h"
+
+uint32_t OTAPollCadence::next(bool packet, bool watched) {
+    bool busy = packet || active;
+    active = false;
+    if (busy) {
+        backoffMs = OTA_POLL_MIN_MS;
+        return 0;
+    }
+    uint32_t maxMs = watched ? OTA_POLL_IDLE_MAX_MS : OTA_CHECK_INTERVAL_MS;
+    uint32_t delayMs = backoffMs < maxMs ? backoffMs : maxMs;
+    backoffMs = delayMs * 2 < maxMs ? delayMs * 2 : maxMs;
+    return delayMs;
+}
+
+uint32_t OTAPollCadence::networkDown() {
+    active = false;
+    backoffMs = OTA_POLL_MIN_MS;
+    return OTA_POLL_NETWORK_DOWN_MS;
+}
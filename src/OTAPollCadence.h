@@ -0,0 +1,51 @@
+/**
+ * @file OTAPollCadence.h
+ * @brief Recommended delay before the next handleUpdates() call
+ *
+ * @details ArduinoOTA answers one UDP packet per handle() call: the invite, then
+ * (with a password) the login, and the transfer itself runs on the call after
+ * that. Polling on a fixed interval therefore pays that interval up to three
+ * times before a transfer starts, and burns the same CPU while nothing happens.
+ *
+ * The cadence follows the session instead. When a datagram was waiting on the
+ * OTA port before handle() (see OTAUdpProbe), or a session event was seen, it
+ * recommends calling again at once, since the next step (login or transfer) is
+ * due on that call. Otherwise the delay starts at OTA_POLL_MIN_MS and doubles on
+ * every quiet call up to OTA_POLL_IDLE_MAX_MS, so the sender's reply to a step
+ * is picked up within a few milliseconds and an idle device polls every few
+ * seconds. Without a view of the socket nothing but session events shows a
+ * session coming, so the idle delay then stops at OTA_CHECK_INTERVAL_MS.
+ *
+ * Not thread-safe: OTAManager calls it under its mutex.
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include "OTAManagerConfig.h"
+
+class OTAPollCadence {
+   public:
+    /**
+     * @brief Delay after a call to ArduinoOTA.handle()
+     *
+     * @param packet A datagram was waiting on the OTA port when the call began
+     * @param watched The OTA socket could be checked at all
+     */
+    uint32_t next(bool packet, bool watched);
+
+    /**
+     * @brief Delay while the network is down; the next quiet call starts over
+     * from OTA_POLL_MIN_MS
+     */
+    uint32_t networkDown();
+
+    /**
+     * @brief A session started, ended or failed: no delay after the current call
+     */
+    void activity() { active = true; }
+
+   private:
+    bool active = false;
+    uint32_t backoffMs = OTA_POLL_MIN_MS;
+};
@@ -0,0 +1,37 @@
+/**
+ * @file OTAPull.h
+ * @brief Options and statistics for pull-mode updates (OTAManager::pullUpdate)
+ *
+ * @details In pull mode the device fetches the image itself with an HTTP(S) GET
+ * and streams the body through the same stages as a pushed image (inflate,
+ * patch, SHA-256, signature, flash pipeline). A dropped connection is picked up
+ * again with a Range request from the last byte received.
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include "OTAManagerConfig.h"
+
+struct OTAPullOptions {
+    // Hex MD5 of the file as served; checked like the MD5 in an espota invite
+    const char* md5 = nullptr;
+
+    // Hex SHA-256 of the file as served
+    const char* sha256 = nullptr;
+
+    // Hex Ed25519 signature of the file; required once a signing key is set
+    const char* signature = nullptr;
+
+    // PEM CA certificate for https:// (nullptr = the ESP-IDF certificate bundle)
+    const char* caCert = nullptr;
+};
+
+struct OTAPullStats {
+    int httpStatus;         // Status of the last response (0 = no response)
+    uint32_t bytes;         // Body bytes received, over all connections
+    uint32_t imageSize;     // Size of the file as served
+    uint32_t transferUs;    // First request -> last byte received
+    uint8_t reconnects;     // Range requests after a dropped connection
+    uint32_t minFreeHeap;   // Lowest free heap seen during the download
+};
@@ -0,0 +1,134 @@
+// OTAQuiesce.cpp
+#include "OTAQuiesce.h"
+
+static_assert(OTA_QUIESCE_PARTICIPANTS_MAX <= 32, "Acknowledgements are a 32-bit mask");
+
+OTAQuiesce::~OTAQuiesce() {
+    if (acknowledged) {
+        vSemaphoreDelete(acknowledged);
+    }
+}
+
+int OTAQuiesce::add(const OTAParticipant& participant) {
+    if (!participant.pause) {
+        return -1;
+    }
+    if (!acknowledged) {
+        acknowledged = xSemaphoreCreateBinary();
+        if (!acknowledged) {
+            return -1;
+        }
+    }
+    for (int i = 0; i < CAPACITY; i++) {
+        if (!slots[i].used) {
+            slots[i] = {participant, true};
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool OTAQuiesce::remove(int id) {
+    if (id < 0 || id >= CAPACITY || !slots[id].used) {
+        return false;
+    }
+    for (int i = 0; i < pausedCount; i++) {
+        if (pausedOrder[i] != id) {
+            continue;
+        }
+        const OTAParticipant& p = slots[id].participant;
+        if (p.resume) {
+            p.resume(p.context);
+        }
+        for (int j = i; j + 1 < pausedCount; j++) {
+            pausedOrder[j] = pausedOrder[j + 1];
+        }
+        pausedCount--;
+        break;
+    }
+    pending.fetch_and(~(1u << id));
+    slots[id].used = false;
+    return true;
+}
+
+void OTAQuiesce::acknowledge(int id) {
+    if (id < 0 || id >= CAPACITY) {
+        return;
+    }
+    uint32_t bit = 1u << id;
+    if (pending.fetch_and(~bit) & bit) {
+        xSemaphoreGive(acknowledged);
+    }
+}
+
+bool OTAQuiesce::pause(uint32_t budgetMs) {
+    resume();  // A session that never reported its end
+    uint32_t mask = 0;
+    for (int i = 0; i < CAPACITY; i++) {
+        mask |= slots[i].used ? 1u << i : 0;
+    }
+    if (!mask) {
+        return true;
+    }
+    xSemaphoreTake(acknowledged, 0);  // A late acknowledgement from the last session
+    pending.store(mask);
+
+    uint32_t start = micros();
+    for (int i = 0; i < CAPACITY; i++) {
+        if (!slots[i].used) {
+            continue;
+        }
+        const OTAParticipant& p = slots[i].participant;
+        pausedOrder[pausedCount++] = i;
+        if (p.pause(p.context)) {
+            pending.fetch_and(~(1u << i));
+        }
+    }
+    uint32_t startMs = millis();
+    while (pending.load()) {
+        uint32_t elapsed = millis() - startMs;
+        if (elapsed >= budgetMs) {
+            break;
+        }
+        xSemaphoreTake(acknowledged, pdMS_TO_TICKS(budgetMs - elapsed));
+    }
+
+    uint32_t late = pending.load();
+    uint32_t waitUs = micros() - start;
+    lastWaitUs.store(waitUs, std::memory_order_relaxed);
+    lastLateMask.store(late, std::memory_order_relaxed);
+    pauses.fetch_add(1, std::memory_order_relaxed);
+    if (!late) {
+        OTAM_LOG_D("Quiesce: %d participant(s) paused in %u us", pausedCount, (unsigned)waitUs);
+        return true;
+    }
+    timeouts.fetch_add(1, std::memory_order_relaxed);
+    for (int i = 0; i < CAPACITY; i++) {
+        if (late & (1u << i)) {
+            const char* name = slots[i].participant.name;
+            OTAM_LOG_W("Quiesce: %s not paused after %u ms, continuing", name ? name : "participant",
+                       (unsigned)budgetMs);
+            (void)name;
+        }
+    }
+    return false;
+}
+
+void OTAQuiesce::resume() {
+    pending.store(0);
+    while (pausedCount > 0) {
+        const OTAParticipant& p = slots[pausedOrder[--pausedCount]].participant;
+        if (p.resume) {
+            p.resume(p.context);
+        }
+    }
+}
+
+OTAQuiesceStats OTAQuiesce::getStats() const {
+    OTAQuiesceStats s;
+    s.pauses = pauses.load(std::memory_order_relaxed);
+    s.timeouts = timeouts.load(std::memory_order_relaxed);
+    s.lastWaitUs = lastWaitUs.load(std::memory_order_relaxed);
+    s.lastLateMask = lastLateMask.load(std::memory_order_relaxed);
+    return s;
+}
@@ -0,0 +1,101 @@
+/**
+ * @file OTAQuiesce.h
+ * @brief Pauses registered parts of the application for the length of a session
+ *
+ * @details At session start, before the first byte is written, pause() asks each
+ * participant to pause and waits, up to a time budget, until all have
+ * acknowledged: by returning true from their pause handler, or later from their
+ * own task through acknowledge(). The transfer then starts with their bus and
+ * peripheral load gone. resume() resumes every participant asked to pause, in
+ * reverse order, and is called on every way out of a session.
+ *
+ * add(), remove(), pause() and resume() are called under the OTA mutex;
+ * acknowledge() and getStats() are lock-free and may be called from any task.
+ */
+#pragma once
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include <atomic>
+
+#include "OTAManagerConfig.h"
+
+/**
+ * @brief A part of the application that pauses during updates
+ */
+struct OTAParticipant {
+    const char* name;  // For logs
+    // Pause; return true if paused on return, false to acknowledge later with
+    // OTAManager::acknowledgeQuiesce(). Must not call other OTAManager methods
+    bool (*pause)(void* context);
+    void (*resume)(void* context);
+    void* context;
+};
+
+struct OTAQuiesceStats {
+    uint32_t pauses;        // Sessions that asked participants to pause
+    uint32_t timeouts;      // ... in which some had not acknowledged within the budget
+    uint32_t lastWaitUs;    // From the first request to the last acknowledgement, or the budget
+    uint32_t lastLateMask;  // Participants (bit = id) late in the last session
+};
+
+class OTAQuiesce {
+   public:
+    static const int CAPACITY = OTA_QUIESCE_PARTICIPANTS_MAX;
+
+    ~OTAQuiesce();
+
+    /**
+     * @brief Register a participant
+     *
+     * @return its id, or -1 if the table is full or participant has no pause handler
+     */
+    int add(const OTAParticipant& participant);
+
+    /**
+     * @brief Unregister a participant, resuming it first if it is paused
+     */
+    bool remove(int id);
+
+    /**
+     * @brief A participant has paused
+     */
+    void acknowledge(int id);
+
+    /**
+     * @brief Ask every participant to pause and wait up to budgetMs for them
+     *
+     * @return true if all acknowledged in time
+     */
+    bool pause(uint32_t budgetMs);
+
+    /**
+     * @brief Resume the participants asked to pause, last paused first
+     */
+    void resume();
+
+    bool isPaused() const { return pausedCount > 0; }
+
+    /**
+     * @brief Counters of the pauses so far; never blocks
+     */
+    OTAQuiesceStats getStats() const;
+
+   private:
+    struct Slot {
+        OTAParticipant participant;
+        bool used;
+    };
+
+    Slot slots[CAPACITY] = {};
+    int pausedOrder[CAPACITY] = {};  // Ids in the order they were asked to pause
+    int pausedCount = 0;
+    std::atomic<uint32_t> pending{0};  // Bit per participant still to acknowledge
+    SemaphoreHandle_t acknowledged = nullptr;
+    std::atomic<uint32_t> pauses{0};
+    std::atomic<uint32_t> timeouts{0};
+    std::atomic<uint32_t> lastWaitUs{0};
+    std::atomic<uint32_t> lastLateMask{0};
+};
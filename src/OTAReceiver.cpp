@@ -0,0 +1,1375 @@
+// OTAReceiver.cpp
+#include "OTAReceiver.h"
+
+#include <MD5Builder.h>
+#include <Update.h>
+#include <esp_ota_ops.h>
+
+#if defined(ESP32)
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <lwip/sockets.h>
+#else
+    #include <arpa/inet.h>
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <sys/select.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// Update erases and programs whole sectors; only complete ones count as committed
+static const size_t flashSectorSize = 4096;
+
+static void md5Hex(const char* text, char out[33]) {
+    MD5Builder md5;
+    md5.begin();
+    md5.add(text);
+    md5.calculate();
+    md5.getChars(out);
+}
+
+// select() on one socket (or two); returns >0 when readable
+static int waitReadable(int sock, uint32_t timeoutMs, int other = -1) {
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    FD_SET(sock, &readSet);
+    if (other >= 0) {
+        FD_SET(other, &readSet);
+    }
+    struct timeval tv;
+    tv.tv_sec = timeoutMs / 1000;
+    tv.tv_usec = (timeoutMs % 1000) * 1000;
+    return select((sock > other ? sock : other) + 1, &readSet, nullptr, nullptr, &tv);
+}
+
+template <typename T>
+static T clampTo(T value, T lo, T hi) {
+    return value < lo ? lo : (value > hi ? hi : value);
+}
+
+bool OTAReceiver::setTuning(const OTATuning& requested) {
+    OTATuning t = requested;
+    t.chunkSize = clampTo<uint32_t>(t.chunkSize, OTA_RECEIVE_CHUNK_MIN, OTA_RECEIVE_CHUNK_MAX);
+    t.socketRxBuffer = clampTo<uint32_t>(t.socketRxBuffer, 0, OTA_SOCKET_RX_BUFFER_MAX);
+    t.pipelineBufferSize = clampTo<uint32_t>(t.pipelineBufferSize, OTA_PIPELINE_BUFFER_MIN,
+                                             OTA_PIPELINE_BUFFER_MAX);
+    t.pipelineBuffers = clampTo<uint8_t>(t.pipelineBuffers, 2, OTA_PIPELINE_BUFFERS_MAX);
+    t.receiveTimeoutMs = clampTo<uint32_t>(t.receiveTimeoutMs, 100, 60000);
+
+    // Shrink the largest consumers until a session fits next to the reserve
+    uint32_t freeHeap = ESP.getFreeHeap();
+    uint32_t budget = freeHeap > OTA_TUNING_HEAP_RESERVE ? freeHeap - OTA_TUNING_HEAP_RESERVE : 0;
+    uint32_t maxBlock = ESP.getMaxAllocHeap();
+    while (t.sessionHeapBytes() > budget || t.pipelineBufferSize * t.pipelineBuffers > maxBlock) {
+        if (t.pipelineBuffers > 2) {
+            t.pipelineBuffers--;
+        } else if (t.pipelineBufferSize > OTA_PIPELINE_BUFFER_MIN) {
+            t.pipelineBufferSize = clampTo<uint32_t>(t.pipelineBufferSize / 2, OTA_PIPELINE_BUFFER_MIN,
+                                                     OTA_PIPELINE_BUFFER_MAX);
+        } else if (t.socketRxBuffer > 0) {
+            t.socketRxBuffer /= 2;
+            if (t.socketRxBuffer < 2 * 1460) {
+                t.socketRxBuffer = 0;
+            }
+        } else if (t.chunkSize > OTA_RECEIVE_CHUNK_MIN) {
+            t.chunkSize = clampTo<uint32_t>(t.chunkSize / 2, OTA_RECEIVE_CHUNK_MIN,
+                                           OTA_RECEIVE_CHUNK_MAX);
+        } else {
+            OTAM_LOG_E("Tuning: %u bytes free, even minimum buffers leave less than %u in reserve",
+                       (unsigned)freeHeap, (unsigned)OTA_TUNING_HEAP_RESERVE);
+            break;
+        }
+    }
+
+    tuning = t;
+    bool unchanged = t.chunkSize == requested.chunkSize &&
+                     t.socketRxBuffer == requested.socketRxBuffer &&
+                     t.pipelineBufferSize == requested.pipelineBufferSize &&
+                     t.pipelineBuffers == requested.pipelineBuffers &&
+                     t.receiveTimeoutMs == requested.receiveTimeoutMs;
+    if (!unchanged) {
+        OTAM_LOG_W("Tuning adjusted: chunk %u, socket rx %u, pipeline %u x %u, timeout %u ms",
+                   (unsigned)t.chunkSize, (unsigned)t.socketRxBuffer, t.pipelineBuffers,
+                   (unsigned)t.pipelineBufferSize, (unsigned)t.receiveTimeoutMs);
+    }
+    return unchanged;
+}
+
+bool OTAReceiver::begin(uint16_t port) {
+    if (udpSocket >= 0) {
+        return true;
+    }
+
+    udpSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (udpSocket < 0) {
+        OTAM_LOG_E("Listener: UDP socket failed (%d)", errno);
+        return false;
+    }
+    int yes = 1;
+    setsockopt(udpSocket, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(udpSocket, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        OTAM_LOG_E("Listener: bind to UDP %u failed (%d)", port, errno);
+        close(udpSocket);
+        udpSocket = -1;
+        return false;
+    }
+    fcntl(udpSocket, F_SETFL, fcntl(udpSocket, F_GETFL, 0) | O_NONBLOCK);
+
+    state = IDLE;
+    OTAM_LOG_D("Listener: waiting for invites on UDP %u", port);
+    return true;
+}
+
+void OTAReceiver::end() {
+    multicast.end();
+    if (udpSocket >= 0) {
+        close(udpSocket);
+        udpSocket = -1;
+    }
+    state = IDLE;
+}
+
+bool OTAReceiver::joinMulticast(const char* group, uint16_t port, const char* interfaceIp) {
+#if OTA_MULTICAST_ENABLED
+    // Multicast has no login: the signature is the only check on who sent the image
+    if (!OTA_SIGNATURE_ENABLED || !signingKeySet) {
+        OTAM_LOG_E("Multicast: a signing key is required to join %s", group ? group : "(null)");
+        return false;
+    }
+    return multicast.begin(group, port, interfaceIp);
+#else
+    (void)group;
+    (void)port;
+    (void)interfaceIp;
+    OTAM_LOG_E("Multicast: disabled (OTA_MULTICAST_ENABLED)");
+    return false;
+#endif
+}
+
+void OTAReceiver::setSigningKey(const uint8_t* publicKey) {
+    signingKeySet = publicKey != nullptr;
+    if (publicKey) {
+        memcpy(signingKey, publicKey, sizeof(signingKey));
+    }
+}
+
+void OTAReceiver::setPassword(const char* password) {
+    if (password && strlen(password) > 0) {
+        md5Hex(password, passwordMD5);
+    } else {
+        passwordMD5[0] = '\0';
+    }
+}
+
+OTAReceiver& OTAReceiver::onStart(ArduinoOTAClass::THandlerFunction fn) {
+    startCallback = fn;
+    return *this;
+}
+
+OTAReceiver& OTAReceiver::onEnd(ArduinoOTAClass::THandlerFunction fn) {
+    endCallback = fn;
+    return *this;
+}
+
+OTAReceiver& OTAReceiver::onProgress(ArduinoOTAClass::THandlerFunction_Progress fn) {
+    progressCallback = fn;
+    return *this;
+}
+
+OTAReceiver& OTAReceiver::onError(ArduinoOTAClass::THandlerFunction_Error fn) {
+    errorCallback = fn;
+    return *this;
+}
+
+bool OTAReceiver::waitForActivity(uint32_t timeoutMs) {
+    if (udpSocket < 0) {
+        return false;
+    }
+    return waitReadable(udpSocket, timeoutMs, multicast.socketFd()) > 0;
+}
+
+void OTAReceiver::handle() {
+    if (udpSocket < 0) {
+        return;
+    }
+#if OTA_MULTICAST_ENABLED
+    if (multicast.poll()) {
+        runMulticastSession();
+        return;
+    }
+#endif
+
+    char packet[320];
+    struct sockaddr_in from = {};
+    socklen_t fromLen = sizeof(from);
+    int n = recvfrom(udpSocket, packet, sizeof(packet) - 1, 0, (struct sockaddr*)&from, &fromLen);
+    if (n <= 0) {
+        return;
+    }
+    packet[n] = '\0';
+
+    if (state == IDLE) {
+        remoteAddr = from.sin_addr.s_addr;
+        remoteUdpPort = ntohs(from.sin_port);
+        onInvite(packet);
+    } else if (from.sin_addr.s_addr == remoteAddr) {
+        onAuth(packet);
+    }
+}
+
+void OTAReceiver::reply(const char* msg) {
+    struct sockaddr_in to = {};
+    to.sin_family = AF_INET;
+    to.sin_addr.s_addr = remoteAddr;
+    to.sin_port = htons(remoteUdpPort);
+    sendto(udpSocket, msg, strlen(msg), 0, (struct sockaddr*)&to, sizeof(to));
+}
+
+void OTAReceiver::onInvite(const char* packet) {
+    // "<command> <tcp port> <size> <md5>[ resume][ sha256=<hex>][ sig=<hex>]\n"
+    int cmd = 0;
+    unsigned int tcpPort = 0;
+    unsigned long size = 0;
+    char md5[40] = {0};
+    int optionsAt = 0;
+    if (sscanf(packet, "%d %u %lu %39s%n", &cmd, &tcpPort, &size, md5, &optionsAt) != 4 ||
+        (cmd != U_FLASH && cmd != U_SPIFFS) || strlen(md5) != 32 || tcpPort == 0) {
+        OTAM_LOG_D("Listener: ignoring malformed invite");
+        return;
+    }
+    resumeRequested = false;
+    shaExpected = false;
+    signaturePresent = false;
+    char option[136];
+    for (const char* p = packet + optionsAt; sscanf(p, " %135s%n", option, &optionsAt) == 1;
+         p += optionsAt) {
+        if (strcmp(option, "resume") == 0) {
+            resumeRequested = true;
+        } else if (strncmp(option, "sha256=", 7) == 0) {
+            shaExpected = OTASha256::fromHex(option + 7, expectedSha);
+        } else if (strncmp(option, "sig=", 4) == 0) {
+            signaturePresent =
+                OTASignature::fromHex(option + 4, inviteSignature, sizeof(inviteSignature));
+        }
+    }
+#if OTA_SIGNATURE_ENABLED
+    if (signingKeySet && !signaturePresent) {
+        OTAM_LOG_E("Listener: unsigned image refused");
+        reply("Signature Required");
+        if (errorCallback) {
+            errorCallback(OTA_AUTH_ERROR);
+        }
+        return;
+    }
+#endif
+    command = cmd;
+    remoteTcpPort = (uint16_t)tcpPort;
+    imageSize = size;
+    memcpy(imageMD5, md5, sizeof(imageMD5));
+    trace.record(OTA_TRACE_INVITE, size);
+
+    if (passwordMD5[0]) {
+        char seed[32];
+        snprintf(seed, sizeof(seed), "%lu%ld", micros(), random(0x7FFFFFFF));
+        md5Hex(seed, nonce);
+        char challenge[40];
+        snprintf(challenge, sizeof(challenge), "AUTH %s", nonce);
+        reply(challenge);
+        state = WAIT_AUTH;
+        return;
+    }
+
+    accept();
+}
+
+void OTAReceiver::onAuth(const char* packet) {
+    // "200 <cnonce> <md5(md5(password):nonce:cnonce)>\n"
+    state = IDLE;
+    int cmd = 0;
+    char cnonce[40] = {0};
+    char response[40] = {0};
+    if (sscanf(packet, "%d %39s %39s", &cmd, cnonce, response) != 3 || cmd != U_AUTH) {
+        return;
+    }
+
+    char challenge[112];
+    snprintf(challenge, sizeof(challenge), "%s:%s:%s", passwordMD5, nonce, cnonce);
+    char expected[33];
+    md5Hex(challenge, expected);
+    if (strcmp(expected, response) != 0) {
+        reply("Authentication Failed");
+        if (errorCallback) {
+            errorCallback(OTA_AUTH_ERROR);
+        }
+        return;
+    }
+
+    accept();
+}
+
+void OTAReceiver::accept() {
+    if (!beginSignature()) {
+        reply("Signature Invalid");
+        return;
+    }
+    size_t offset = prepareResume();
+    trace.record(OTA_TRACE_AUTH_OK, offset);
+    if (resumeRequested) {
+        char msg[16];
+        snprintf(msg, sizeof(msg), "OK %u", (unsigned)offset);
+        reply(msg);
+    } else {
+        reply("OK");
+    }
+    runSession();
+}
+
+bool OTAReceiver::beginSignature() {
+    signatureVerified = false;
+#if OTA_SIGNATURE_ENABLED
+    if (!signingKeySet) {
+        return true;
+    }
+    // Most of the verification work ([S]B) happens here, before any data arrives
+    if (!signature.begin(signingKey, inviteSignature)) {
+        OTAM_LOG_E("Listener: signature rejected: %s", signature.errorString());
+        if (errorCallback) {
+            errorCallback(OTA_AUTH_ERROR);
+        }
+        return false;
+    }
+#endif
+    return true;
+}
+
+size_t OTAReceiver::prepareResume() {
+    resumable = false;
+    resumeOffset = 0;
+    lastCheckpoint = 0;
+#if OTA_RESUME_ENABLED
+    const esp_partition_t* partition = esp_ota_get_next_update_partition(nullptr);
+    if (command != U_FLASH || !partition) {
+        return 0;
+    }
+    OTAResume::Record stored;
+    bool sameImage = resumeStore.load(stored) && stored.partition == partition->address &&
+                     stored.size == imageSize && strcmp(stored.md5, imageMD5) == 0 &&
+                     stored.committed > 0 && stored.committed < imageSize;
+    if (sameImage && resumeRequested) {
+        // Restored before the reply: the uploader is only promised an offset that holds
+        resumeRecord = stored;
+        resumeOffset = stored.committed;
+        if (resumeImage()) {
+            lastCheckpoint = stored.committed;
+            resumable = true;
+            OTAM_LOG_I("Listener: resuming at %u/%u bytes", (unsigned)resumeOffset,
+                       (unsigned)imageSize);
+            return resumeOffset;
+        }
+        OTAM_LOG_E("Listener: could not restore the first %u bytes, sending the whole image",
+                   (unsigned)resumeOffset);
+        resumeOffset = 0;
+        beginSignature();  // The restored bytes were hashed already
+    }
+    // This session rewrites the partition, so an older record no longer describes it
+    resumeStore.clear();
+    memset(&resumeRecord, 0, sizeof(resumeRecord));
+    resumeRecord.partition = partition->address;
+    resumeRecord.size = imageSize;
+    memcpy(resumeRecord.md5, imageMD5, sizeof(resumeRecord.md5));
+    resumable = true;  // Until beginImage() finds a compressed stream or a patch
+#endif
+    return 0;
+}
+
+bool OTAReceiver::resumeImage() {
+    // Update has no way to start mid-image, so the committed part is fed to it again
+    // from the update partition itself (each sector is read before Update erases it)
+    const esp_partition_t* partition = esp_ota_get_next_update_partition(nullptr);
+    uint8_t* sector = (uint8_t*)malloc(flashSectorSize);
+    bool ok = partition && sector && Update.begin(imageSize, command);
+    if (ok) {
+        Update.setMD5(imageMD5);
+        verifier.begin(true);
+    }
+    for (size_t off = 0; ok && off < resumeOffset; off += flashSectorSize) {
+        size_t n = resumeOffset - off < flashSectorSize ? resumeOffset - off : flashSectorSize;
+        ok = esp_partition_read(partition, off, sector, n) == ESP_OK;
+        if (ok && off == 0) {
+            memcpy(sector, resumeRecord.header, OTAResume::HEADER_BYTES);
+        }
+#if OTA_SHA256_ENABLED
+        ok = ok && verifier.write(sector, n);
+#endif
+#if OTA_SIGNATURE_ENABLED
+        if (ok && signingKeySet) {
+            signature.update(sector, n);
+        }
+#endif
+        ok = ok && Update.write(sector, n) == n;
+    }
+    free(sector);
+    if (!ok) {
+        Update.abort();
+        return false;
+    }
+    compressed = false;
+    patched = false;
+    formatPending = false;
+    sha256Verified = false;
+    imageBytes = resumeOffset;
+    return true;
+}
+
+void OTAReceiver::trackResume(const uint8_t* data, size_t len, size_t offset) {
+    if (!resumable) {
+        return;
+    }
+    if (offset < OTAResume::HEADER_BYTES) {
+        size_t n = OTAResume::HEADER_BYTES - offset < len ? OTAResume::HEADER_BYTES - offset : len;
+        memcpy(resumeRecord.header + offset, data, n);
+    }
+    size_t committed = imageBytes & ~(flashSectorSize - 1);
+    if (committed >= lastCheckpoint + OTA_RESUME_CHECKPOINT_BYTES) {
+        resumeRecord.committed = committed;
+        resumeStore.save(resumeRecord);
+        lastCheckpoint = committed;
+    }
+}
+
+void OTAReceiver::saveResume() {
+    if (!resumable) {
+        return;
+    }
+    size_t committed = imageBytes & ~(flashSectorSize - 1);
+    if (Update.hasError() || verifier.hasFailed() || committed == 0) {
+        // Nothing trustworthy on flash to continue from
+        resumeStore.clear();
+        return;
+    }
+    if (committed != lastCheckpoint) {
+        resumeRecord.committed = committed;
+        resumeStore.save(resumeRecord);
+        lastCheckpoint = committed;
+    }
+    OTAM_LOG_I("Listener: %u/%u bytes kept for a resumed transfer", (unsigned)committed,
+               (unsigned)imageSize);
+}
+
+void OTAReceiver::sendAck(int sock, size_t written) {
+    char ack[12];
+    int len = snprintf(ack, sizeof(ack), "%u", (unsigned)written);
+    send(sock, ack, len, MSG_NOSIGNAL);
+}
+
+int OTAReceiver::readStream(int sock, uint8_t* dst, size_t maxLen, size_t lastAck) {
+    int retries = 0;
+    uint32_t readStart = micros();
+    for (;;) {
+        uint32_t waitStart = micros();
+        int ready = waitReadable(sock, tuning.receiveTimeoutMs);
+        pipeline.addNetworkWait(micros() - waitStart);
+        if (ready > 0) {
+            int r = recv(sock, dst, maxLen, 0);
+            readDone(readStart);
+            return r > 0 ? r : 0;
+        }
+        trace.record(OTA_TRACE_STALL, (micros() - readStart) / 1000);
+        // Re-acknowledge the last chunk a few times before giving up (as ArduinoOTA does)
+        if (lastAck && retries++ < 3) {
+            sendAck(sock, lastAck);
+            continue;
+        }
+        return -1;
+    }
+}
+
+void OTAReceiver::readDone(uint32_t startUs) {
+    uint32_t us = micros() - startUs;
+    readLatency.record(us);
+    if (us >= OTA_TRACE_STALL_MS * 1000UL) {
+        trace.record(OTA_TRACE_STALL, us / 1000);
+    }
+}
+
+void OTAReceiver::flashDone(size_t offset, size_t len, uint32_t startUs) {
+    uint32_t endUs = micros();
+    writeLatency.record(endUs - startUs);
+    // A write that fills the staged sector erases and programs it
+    if ((offset + len) / flashSectorSize == offset / flashSectorSize) {
+        return;
+    }
+    traceErase((offset + len) / flashSectorSize * flashSectorSize - flashSectorSize, startUs, endUs);
+}
+
+void OTAReceiver::traceErase(size_t offset, uint32_t startUs, uint32_t endUs) {
+    if (sectorWrites++ % OTA_TRACE_SECTOR_INTERVAL == 0 ||
+        endUs - startUs >= OTA_TRACE_STALL_MS * 1000UL) {
+        trace.record(OTA_TRACE_ERASE_START, offset, startUs);
+        trace.record(OTA_TRACE_ERASE_END, offset, endUs);
+    }
+}
+
+void OTAReceiver::reportReceiveTimeout(size_t received) {
+    OTAM_LOG_E("Listener: receive timeout at %u/%u", (unsigned)received, (unsigned)imageSize);
+    if (errorCallback) {
+        errorCallback(OTA_RECEIVE_ERROR);
+    }
+}
+
+bool OTAReceiver::receiveDirect(int sock) {
+    uint8_t* rxBuffer = (uint8_t*)malloc(tuning.chunkSize);
+    if (!rxBuffer) {
+        OTAM_LOG_E("Listener: no memory for a %u byte receive buffer", (unsigned)tuning.chunkSize);
+        if (errorCallback) {
+            errorCallback(OTA_RECEIVE_ERROR);
+        }
+        return false;
+    }
+
+    size_t total = resumeOffset;
+    size_t lastAck = 0;
+    while (total < imageSize) {
+        size_t want = imageSize - total < tuning.chunkSize ? imageSize - total : tuning.chunkSize;
+        int r = readStream(sock, rxBuffer, want, lastAck);
+        if (r < 0) {
+            free(rxBuffer);
+            receivedBytes = total;
+            reportReceiveTimeout(total);
+            return false;
+        }
+        if (r == 0) {
+            break;  // Uploader closed early; finishImage() reports the short image
+        }
+        if (!writeImage(rxBuffer, (size_t)r)) {
+            OTAM_LOG_E("Listener: flash write failed");
+            break;
+        }
+        trackResume(rxBuffer, r, total);
+        lastAck = r;
+        sendAck(sock, r);
+        total += r;
+        if (progressCallback) {
+            progressCallback(total, imageSize);
+        }
+    }
+    free(rxBuffer);
+    receivedBytes = total;
+    return true;
+}
+
+bool OTAReceiver::flashWrite(void* context, uint8_t* data, size_t len) {
+    return static_cast<OTAReceiver*>(context)->writeImage(data, len);
+}
+
+bool OTAReceiver::inflateOutput(void* context, uint8_t* data, size_t len) {
+    return static_cast<OTAReceiver*>(context)->writeDecoded(data, len);
+}
+
+bool OTAReceiver::imageOutput(void* context, uint8_t* data, size_t len) {
+    OTAReceiver* self = static_cast<OTAReceiver*>(context);
+#if OTA_SHA256_ENABLED
+    // Hashed in place, before the bytes reach flash
+    if (!self->verifier.write(data, len)) {
+        OTAM_LOG_E("Listener: image rejected: %s", self->verifier.errorString());
+        return false;
+    }
+#endif
+    uint32_t writeStart = micros();
+    size_t written = Update.write(data, len);
+    self->flashDone(self->imageBytes, len, writeStart);
+    if (written != len) {
+        return false;
+    }
+    self->imageBytes = self->imageBytes + len;
+    return true;
+}
+
+bool OTAReceiver::readRunningPartition(void* context, uint32_t offset, uint8_t* dst, size_t len) {
+    (void)context;
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    return running && esp_partition_read(running, offset, dst, len) == ESP_OK;
+}
+
+bool OTAReceiver::writeImage(uint8_t* data, size_t len) {
+#if OTA_SIGNATURE_ENABLED
+    // The signature covers the file as sent, whatever it decodes to
+    if (signingKeySet) {
+        signature.update(data, len);
+    }
+#endif
+    if (!compressed && !patched) {
+        return imageOutput(this, data, len);
+    }
+    // MD5Builder::add() takes a 16-bit length on older cores
+    for (size_t off = 0; off < len; off += 32768) {
+        wireMD5.add(data + off, len - off < 32768 ? len - off : 32768);
+    }
+#if OTA_SHA256_ENABLED
+    if (shaExpected) {
+        wireSha.update(data, len);
+    }
+#endif
+    return compressed ? inflater.write(data, len) : writeDecoded(data, len);
+}
+
+bool OTAReceiver::writeDecoded(uint8_t* data, size_t len) {
+    if (formatPending) {
+        // A compressed stream may carry a patch; its magic is in the first decoded bytes
+        size_t n = sizeof(decodedMagic) - decodedMagicLen < len ? sizeof(decodedMagic) - decodedMagicLen
+                                                                : len;
+        memcpy(decodedMagic + decodedMagicLen, data, n);
+        decodedMagicLen += n;
+        data += n;
+        len -= n;
+        if (decodedMagicLen < sizeof(decodedMagic)) {
+            return true;
+        }
+        formatPending = false;
+        if (OTAPatcher::isPatch(decodedMagic, decodedMagicLen) && !beginPatch()) {
+            return false;
+        }
+        if (!writeDecoded(decodedMagic, decodedMagicLen)) {
+            return false;
+        }
+    }
+    if (len == 0) {
+        return true;
+    }
+    if (patched) {
+        return patcher.write(data, len);
+    }
+    return imageOutput(this, data, len);
+}
+
+bool OTAReceiver::beginPatch() {
+#if OTA_DELTA_ENABLED
+    if (!patcher.begin(readRunningPartition, imageOutput, this)) {
+        return false;
+    }
+    patched = true;
+    OTAM_LOG_I("Listener: delta patch against the running partition");
+    return true;
+#else
+    OTAM_LOG_E("Listener: delta patches are disabled (OTA_DELTA_ENABLED)");
+    return false;
+#endif
+}
+
+int OTAReceiver::peekStream(int sock, uint8_t* dst, size_t len) {
+    uint32_t start = millis();
+    for (;;) {
+        if (waitReadable(sock, tuning.receiveTimeoutMs) <= 0) {
+            return -1;
+        }
+        int n = recv(sock, dst, len, MSG_PEEK);
+        if (n <= 0 || (size_t)n >= len || (size_t)n >= imageSize ||
+            millis() - start > tuning.receiveTimeoutMs) {
+            return n < 0 ? 0 : n;
+        }
+        delay(1);  // Only part of the header has arrived yet
+    }
+}
+
+bool OTAReceiver::beginImage(int sock) {
+    uint8_t magic[4];
+    int n = peekStream(sock, magic, sizeof(magic));
+    if (n < 0) {
+        reportReceiveTimeout(0);
+        return false;
+    }
+    return beginImage(magic, n);
+}
+
+bool OTAReceiver::beginImage(const uint8_t* magic, int n) {
+    compressed = false;
+    patched = false;
+    formatPending = false;
+    decodedMagicLen = 0;
+    imageBytes = 0;
+    sectorWrites = 0;
+
+    verifier.begin(command == U_FLASH);
+    sha256Verified = false;
+
+#if OTA_COMPRESSION_ENABLED
+    compressed = OTAInflater::isCompressed(magic, n);
+#endif
+    bool patch = OTAPatcher::isPatch(magic, n);
+
+    // The size of a decompressed or patched image is only known at the end of the stream;
+    // neither can be resumed, since the decoder state is lost with the connection
+    bool transformed = compressed || patch;
+    if (transformed) {
+        resumable = false;
+    }
+    if (!Update.begin(transformed ? UPDATE_SIZE_UNKNOWN : imageSize, command)) {
+        OTAM_LOG_E("Listener: Update.begin failed");
+        if (errorCallback) {
+            errorCallback(OTA_BEGIN_ERROR);
+        }
+        return false;
+    }
+    if (!transformed) {
+        if (imageMD5[0]) {
+            Update.setMD5(imageMD5);
+        }
+        return true;
+    }
+
+    // The invite carries the MD5 of the file as sent, so check it on the wire bytes
+    bool ok;
+    if (compressed) {
+        ok = inflater.begin(inflateOutput, this);
+        formatPending = true;
+        OTAM_LOG_I("Listener: compressed image, %u bytes on the wire", (unsigned)imageSize);
+    } else {
+        ok = beginPatch();
+    }
+    if (!ok) {
+        Update.abort();
+        if (errorCallback) {
+            errorCallback(OTA_BEGIN_ERROR);
+        }
+        return false;
+    }
+    wireMD5.begin();
+    wireSha.begin();
+    return true;
+}
+
+bool OTAReceiver::finishImage() {
+    bool transformed = compressed || patched;
+    bool ok = true;
+    if (compressed) {
+        ok = inflater.isFinished();
+        if (!ok) {
+            OTAM_LOG_E("Listener: compressed image %s",
+                       inflater.errorString() ? inflater.errorString() : "truncated");
+        } else if (formatPending && decodedMagicLen) {
+            // Decoded image shorter than a patch header: plain data
+            formatPending = false;
+            ok = writeDecoded(decodedMagic, decodedMagicLen);
+        }
+        OTAM_LOG_I("Listener: inflated %u -> %u bytes", (unsigned)inflater.totalIn(),
+                   (unsigned)inflater.totalOut());
+    }
+    if (ok && patched) {
+        ok = patcher.isFinished();
+        if (!ok) {
+            OTAM_LOG_E("Listener: patch rejected: %s",
+                       patcher.errorString() ? patcher.errorString() : "truncated");
+        } else {
+            // Update verifies the rebuilt image like a full one
+            char targetMD5[33];
+            patcher.getTargetMD5(targetMD5);
+            Update.setMD5(targetMD5);
+            OTAM_LOG_I("Listener: patched %u -> %u bytes", (unsigned)patcher.totalIn(),
+                       (unsigned)patcher.totalOut());
+        }
+    }
+    if (ok && transformed && imageMD5[0]) {
+        char md5[33];
+        wireMD5.calculate();
+        wireMD5.getChars(md5);
+        if (strcmp(md5, imageMD5) != 0) {
+            OTAM_LOG_E("Listener: MD5 mismatch on the received stream");
+            ok = false;
+        }
+    }
+    ok = ok && verifyImage() && verifySignature();
+    inflater.end();
+    patcher.end();
+    if (!ok) {
+        Update.abort();
+        return false;
+    }
+    return transformed ? Update.end(true) : Update.end();
+}
+
+bool OTAReceiver::verifyImage() {
+#if OTA_SHA256_ENABLED
+    uint8_t digest[OTASha256::DIGEST_SIZE];
+    if (!verifier.finish(digest)) {
+        OTAM_LOG_E("Listener: image rejected: %s", verifier.errorString());
+        return false;
+    }
+    if (shaExpected) {
+        // The invite digest, like the MD5, covers the file as sent
+        if (compressed || patched) {
+            wireSha.finish(digest);
+        }
+        if (memcmp(digest, expectedSha, sizeof(digest)) != 0) {
+            OTAM_LOG_E("Listener: SHA-256 mismatch on the received stream");
+            return false;
+        }
+    }
+    sha256Verified = shaExpected || verifier.isAppDigestVerified();
+    if (sha256Verified) {
+        OTAM_LOG_I("Listener: SHA-256 verified");
+    }
+#endif
+    return true;
+}
+
+bool OTAReceiver::verifySignature() {
+#if OTA_SIGNATURE_ENABLED
+    if (!signingKeySet) {
+        return true;
+    }
+    if (!signature.finish()) {
+        OTAM_LOG_E("Listener: image rejected: %s", signature.errorString());
+        return false;
+    }
+    signatureVerified = true;
+    OTAM_LOG_I("Listener: signature verified");
+#endif
+    return true;
+}
+
+void OTAReceiver::abortImage() {
+    Update.abort();
+    inflater.end();
+    patcher.end();
+}
+
+bool OTAReceiver::beginPipeline() {
+    BaseType_t core = OTA_PIPELINE_WRITER_CORE;
+    if (core < 0) {
+        // Put the flash writer on the core the receiver is not running on
+        core = portNUM_PROCESSORS > 1 ? 1 - xPortGetCoreID() : tskNO_AFFINITY;
+    }
+    if (!pipeline.begin(tuning.pipelineBufferSize, tuning.pipelineBuffers, flashWrite, this, core)) {
+        OTAM_LOG_W("Listener: pipeline unavailable, writing flash inline");
+        return false;
+    }
+    return true;
+}
+
+bool OTAReceiver::receivePipelined(int sock) {
+    size_t received = resumeOffset;
+    size_t lastAck = 0;
+    uint8_t* buffer = nullptr;
+    size_t fill = 0;
+
+    // Acknowledge on receipt; the flash writer catches up in parallel
+    while (received < imageSize) {
+        if (!buffer) {
+            buffer = pipeline.acquire();
+            if (!buffer) {
+                OTAM_LOG_E("Listener: flash write failed");
+                break;
+            }
+            fill = 0;
+        }
+        size_t want = pipeline.bufferSize() - fill;
+        if (want > tuning.chunkSize) {
+            want = tuning.chunkSize;
+        }
+        if (want > imageSize - received) {
+            want = imageSize - received;
+        }
+        int r = readStream(sock, buffer + fill, want, lastAck);
+        if (r < 0) {
+            pipeline.end();
+            lastPipelineStats = pipeline.getStats();
+            receivedBytes = received;
+            reportReceiveTimeout(received);
+            return false;
+        }
+        if (r == 0) {
+            break;
+        }
+        trackResume(buffer + fill, r, received);
+        fill += r;
+        received += r;
+        lastAck = r;
+        sendAck(sock, r);
+        if (progressCallback) {
+            progressCallback(received, imageSize);
+        }
+        if (fill == pipeline.bufferSize() || received == imageSize) {
+            pipeline.submit(buffer, fill);
+            buffer = nullptr;
+        }
+    }
+    if (buffer) {
+        pipeline.submit(buffer, fill);
+    }
+
+    // A failed write leaves the image short or in error, so finishImage() reports it
+    pipeline.finish();
+    lastPipelineStats = pipeline.getStats();
+    receivedBytes = received;
+
+    const OTAPipelineStats& st = lastPipelineStats;
+    uint32_t session = st.sessionUs ? st.sessionUs : 1;
+    OTAM_LOG_I("Pipeline: %u bytes in %u ms, flash busy %u%%, rx waited on flash %u%%, "
+               "flash waited on rx %u%%",
+               (unsigned)st.bytes, (unsigned)(session / 1000),
+               (unsigned)(100ULL * st.flashBusyUs / session),
+               (unsigned)(100ULL * st.bufferWaitUs / session),
+               (unsigned)(100ULL * st.flashIdleUs / session));
+    return true;
+}
+
+void OTAReceiver::runSession() {
+    // prepareResume() restored the committed part; the uploader streams from resumeOffset
+    int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock >= 0 && tuning.socketRxBuffer > 0) {
+        // Must be set before connect() so the advertised window can use it
+        int rcvbuf = (int)tuning.socketRxBuffer;
+        if (setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) != 0) {
+            OTAM_LOG_D("Listener: SO_RCVBUF %d not supported by the stack", rcvbuf);
+        }
+    }
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = remoteAddr;
+    addr.sin_port = htons(remoteTcpPort);
+    if (sock < 0 || connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        if (sock >= 0) {
+            close(sock);
+        }
+        if (resumeOffset > 0) {
+            Update.abort();  // The record stays; the uploader can try again
+        }
+        if (errorCallback) {
+            errorCallback(OTA_CONNECT_ERROR);
+        }
+        return;
+    }
+    int yes = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    trace.record(OTA_TRACE_CONNECTED, resumeOffset);
+
+    // The first bytes of the stream tell whether the image is compressed
+    if (resumeOffset == 0 && !beginImage(sock)) {
+        close(sock);
+        return;
+    }
+
+    if (startCallback) {
+        startCallback();
+    }
+    if (progressCallback) {
+        progressCallback(resumeOffset, imageSize);
+    }
+
+    bool received;
+    if (pipelineEnabled && beginPipeline()) {
+        received = receivePipelined(sock);
+    } else {
+        received = receiveDirect(sock);
+    }
+    if (!received) {
+        // Timed out: the error has been reported, Update must not be finalised
+        saveResume();
+        abortImage();
+        close(sock);
+        return;
+    }
+    bool complete = receivedBytes == imageSize;
+    if (!complete) {
+        saveResume();  // Cut off; finishImage() reports the short image
+    }
+
+    if (finishImage()) {
+        resumeStore.clear();
+        send(sock, "OK", 2, MSG_NOSIGNAL);
+        close(sock);
+        if (endCallback) {
+            endCallback();
+        }
+        ESP.restart();
+    } else {
+        if (complete) {
+            resumeStore.clear();  // All bytes arrived and the image is bad: start over next time
+        }
+        if (errorCallback) {
+            errorCallback(OTA_END_ERROR);
+        }
+        close(sock);
+    }
+}
+
+bool OTAReceiver::pull(const char* url, const OTAPullOptions& options) {
+    memset(&pullStats, 0, sizeof(pullStats));
+    pullStats.minFreeHeap = ESP.getFreeHeap();
+    command = U_FLASH;
+    resumeRequested = false;
+    resumable = false;
+    resumeOffset = 0;
+    imageMD5[0] = '\0';
+    if (options.md5) {
+        if (strlen(options.md5) != 32) {
+            OTAM_LOG_E("Pull: MD5 must be 32 hex digits");
+            if (errorCallback) {
+                errorCallback(OTA_BEGIN_ERROR);
+            }
+            return false;
+        }
+        memcpy(imageMD5, options.md5, sizeof(imageMD5));
+    }
+    shaExpected = options.sha256 && OTASha256::fromHex(options.sha256, expectedSha);
+    signaturePresent = options.signature && OTASignature::fromHex(options.signature, inviteSignature,
+                                                                  sizeof(inviteSignature));
+#if OTA_SIGNATURE_ENABLED
+    if (signingKeySet && !signaturePresent) {
+        OTAM_LOG_E("Pull: unsigned image refused");
+        if (errorCallback) {
+            errorCallback(OTA_AUTH_ERROR);
+        }
+        return false;
+    }
+#endif
+
+    bool ok = pullImage(url, options.caCert);
+    http.close();
+    return ok;
+}
+
+bool OTAReceiver::pullImage(const char* url, const char* caCert) {
+    if (!beginSignature()) {
+        return false;
+    }
+    uint32_t startUs = micros();
+    http.setCACert(caCert);
+    int status = http.setUrl(url) ? http.get(0, OTA_PULL_TIMEOUT_MS) : -1;
+    pullStats.httpStatus = status > 0 ? status : 0;
+    if (status != 200) {
+        OTAM_LOG_E("Pull: %s (HTTP %d)", http.errorString() ? http.errorString() : "unexpected response",
+                   status);
+        if (errorCallback) {
+            errorCallback(OTA_CONNECT_ERROR);
+        }
+        return false;
+    }
+    imageSize = http.totalSize();
+    pullStats.imageSize = imageSize;
+    OTAM_LOG_I("Pull: %u bytes from %s", (unsigned)imageSize, url);
+
+    // The first bytes of the body tell whether the image is compressed
+    uint8_t magic[4];
+    int n = http.peek(magic, sizeof(magic), OTA_PULL_TIMEOUT_MS);
+    if (n < 0) {
+        reportReceiveTimeout(0);
+        return false;
+    }
+    if (!beginImage(magic, n)) {
+        return false;
+    }
+
+    if (startCallback) {
+        startCallback();
+    }
+    if (progressCallback) {
+        progressCallback(0, imageSize);
+    }
+
+    bool received = receiveHttp(pipelineEnabled && beginPipeline());
+    pullStats.transferUs = micros() - startUs;
+    if (!received) {
+        abortImage();
+        return false;
+    }
+    OTAM_LOG_I("Pull: %u bytes in %u ms, %u reconnects", (unsigned)pullStats.bytes,
+               (unsigned)(pullStats.transferUs / 1000), pullStats.reconnects);
+
+    if (!finishImage()) {
+        if (errorCallback) {
+            errorCallback(OTA_END_ERROR);
+        }
+        return false;
+    }
+    http.close();
+    if (endCallback) {
+        endCallback();
+    }
+    ESP.restart();
+    return true;
+}
+
+bool OTAReceiver::receiveHttp(bool pipelined) {
+    // Body bytes go straight from the connection into a pipeline buffer (or the
+    // direct-write chunk); nothing is staged in between
+    size_t bufferSize = pipelined ? pipeline.bufferSize() : tuning.chunkSize;
+    uint8_t* direct = nullptr;
+    if (!pipelined) {
+        direct = (uint8_t*)malloc(bufferSize);
+        if (!direct) {
+            OTAM_LOG_E("Pull: no memory for a %u byte receive buffer", (unsigned)bufferSize);
+            if (errorCallback) {
+                errorCallback(OTA_RECEIVE_ERROR);
+            }
+            return false;
+        }
+    }
+
+    size_t received = 0;
+    uint8_t* buffer = direct;
+    size_t fill = 0;
+    bool lost = false;
+    while (received < imageSize) {
+        if (!buffer) {
+            buffer = pipeline.acquire();
+            if (!buffer) {
+                OTAM_LOG_E("Pull: flash write failed");
+                break;
+            }
+            fill = 0;
+        }
+        uint32_t readStart = micros();
+        int r = http.read(buffer + fill, bufferSize - fill, OTA_PULL_TIMEOUT_MS);
+        readDone(readStart);
+        if (r <= 0) {
+            if (resumeHttp(received)) {
+                continue;
+            }
+            lost = true;
+            break;
+        }
+        fill += r;
+        received += r;
+        pullStats.bytes += r;
+        uint32_t freeHeap = ESP.getFreeHeap();
+        if (freeHeap < pullStats.minFreeHeap) {
+            pullStats.minFreeHeap = freeHeap;
+        }
+        if (progressCallback) {
+            progressCallback(received, imageSize);
+        }
+        if (fill == bufferSize || received == imageSize) {
+            if (pipelined) {
+                pipeline.submit(buffer, fill);
+                buffer = nullptr;
+            } else {
+                if (!writeImage(buffer, fill)) {
+                    OTAM_LOG_E("Pull: flash write failed");
+                    break;
+                }
+                fill = 0;
+            }
+        }
+    }
+    free(direct);
+
+    if (pipelined) {
+        if (lost) {
+            pipeline.end();
+        } else {
+            if (buffer && fill) {
+                pipeline.submit(buffer, fill);
+            }
+            pipeline.finish();
+        }
+        lastPipelineStats = pipeline.getStats();
+    }
+    if (lost) {
+        reportReceiveTimeout(received);
+        return false;
+    }
+    return true;  // A short or failed image is reported by finishImage()
+}
+
+bool OTAReceiver::resumeHttp(size_t received) {
+    while (pullStats.reconnects < OTA_PULL_RETRIES) {
+        pullStats.reconnects++;
+        OTAM_LOG_W("Pull: connection lost at %u/%u, requesting the rest", (unsigned)received,
+                   (unsigned)imageSize);
+        int status = http.get(received, OTA_PULL_TIMEOUT_MS);
+        if (status > 0) {
+            pullStats.httpStatus = status;
+        }
+        if (http.totalSize() != imageSize) {
+            continue;  // No answer, or the file changed under us
+        }
+        if (status == 206 && http.rangeStart() == received) {
+            return true;
+        }
+        if (status == 200) {
+            // The server ignores Range: skip what has already been written
+            uint8_t skip[128];
+            size_t left = received;
+            while (left > 0) {
+                int n = http.read(skip, left < sizeof(skip) ? left : sizeof(skip), OTA_PULL_TIMEOUT_MS);
+                if (n <= 0) {
+                    break;
+                }
+                left -= n;
+            }
+            if (left == 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void OTAReceiver::runMulticastSession() {
+    const OTAMulticastSession& s = multicast.session();
+    stagePartition = esp_ota_get_next_update_partition(nullptr);
+    if (!OTAMulticast::fits(s) || !stagePartition || s.imageSize > stagePartition->size) {
+        OTAM_LOG_E("Multicast: session %u refused (%u bytes, groups of %u x %u bytes)", s.id,
+                   (unsigned)s.imageSize, s.k, (unsigned)s.blockSize);
+        multicast.skipSession();
+        if (errorCallback) {
+            errorCallback(OTA_BEGIN_ERROR);
+        }
+        return;
+    }
+    command = U_FLASH;
+    imageSize = s.imageSize;
+    memcpy(imageMD5, s.md5, sizeof(imageMD5));
+    shaExpected = s.hasSha256;
+    memcpy(expectedSha, s.sha256, sizeof(expectedSha));
+    signaturePresent = s.hasSignature;
+    memcpy(inviteSignature, s.signature, sizeof(inviteSignature));
+    // Anyone on the LAN can announce a session: without a key to check it against
+    // (removed since joining), or without a signature, it is refused
+    if (!OTA_SIGNATURE_ENABLED || !signingKeySet || !signaturePresent) {
+        if (signingKeySet) {
+            OTAM_LOG_E("Multicast: unsigned image refused");
+        } else {
+            OTAM_LOG_E("Multicast: session %u refused, no signing key set", s.id);
+        }
+        multicast.skipSession();
+        if (errorCallback) {
+            errorCallback(OTA_AUTH_ERROR);
+        }
+        return;
+    }
+    if (!beginSignature()) {
+        multicast.skipSession();
+        return;
+    }
+
+    // The stream overwrites the update partition, so a resume record no longer describes it
+    resumeStore.clear();
+    erasedTo = 0;
+    compressed = false;  // Blocks are written as sent
+    patched = false;
+    if (startCallback) {
+        startCallback();
+    }
+    if (progressCallback) {
+        progressCallback(0, imageSize);
+    }
+    if (!multicast.receive(multicastWrite, multicastProgress, this)) {
+        OTAM_LOG_E("Multicast: session %u incomplete", s.id);
+        if (errorCallback) {
+            errorCallback(OTA_RECEIVE_ERROR);
+        }
+        return;
+    }
+    if (!verifyStaged()) {
+        if (errorCallback) {
+            errorCallback(OTA_END_ERROR);
+        }
+        return;
+    }
+    esp_err_t err = esp_ota_set_boot_partition(stagePartition);
+    if (err != ESP_OK) {
+        OTAM_LOG_E("Multicast: cannot set the boot partition (0x%x)", (unsigned)err);
+        if (errorCallback) {
+            errorCallback(OTA_END_ERROR);
+        }
+        return;
+    }
+    if (endCallback) {
+        endCallback();
+    }
+    ESP.restart();
+}
+
+bool OTAReceiver::multicastWrite(void* context, uint32_t offset, const uint8_t* data, size_t len) {
+    OTAReceiver* self = static_cast<OTAReceiver*>(context);
+    uint32_t writeStart = micros();
+    // Blocks arrive group by group, so erasing ahead of the highest one also covers
+    // lost blocks that repair writes later
+    size_t end = offset + len;
+    if (end > self->erasedTo) {
+        size_t eraseEnd = (end + flashSectorSize - 1) / flashSectorSize * flashSectorSize;
+        if (eraseEnd > self->stagePartition->size) {
+            eraseEnd = self->stagePartition->size;
+        }
+        uint32_t eraseStart = micros();
+        if (esp_partition_erase_range(self->stagePartition, self->erasedTo, eraseEnd - self->erasedTo) !=
+            ESP_OK) {
+            OTAM_LOG_E("Multicast: erase at 0x%x failed", (unsigned)self->erasedTo);
+            return false;
+        }
+        self->traceErase(self->erasedTo, eraseStart, micros());
+        self->erasedTo = eraseEnd;
+    }
+    if (esp_partition_write(self->stagePartition, offset, data, len) != ESP_OK) {
+        OTAM_LOG_E("Multicast: write at 0x%x failed", (unsigned)offset);
+        return false;
+    }
+    self->writeLatency.record(micros() - writeStart);
+    return true;
+}
+
+void OTAReceiver::multicastProgress(void* context, size_t done, size_t total) {
+    OTAReceiver* self = static_cast<OTAReceiver*>(context);
+    if (self->progressCallback) {
+        self->progressCallback(done, total);
+    }
+}
+
+bool OTAReceiver::verifyStaged() {
+    // The image was written out of order, so every check runs on a read-back pass
+    compressed = false;
+    patched = false;
+    uint8_t* sector = (uint8_t*)malloc(flashSectorSize);
+    if (!sector) {
+        return false;
+    }
+    MD5Builder md5;
+    md5.begin();
+    verifier.begin(true);
+    bool ok = true;
+    for (size_t off = 0; ok && off < imageSize; off += flashSectorSize) {
+        size_t n = imageSize - off < flashSectorSize ? imageSize - off : flashSectorSize;
+        ok = esp_partition_read(stagePartition, off, sector, n) == ESP_OK;
+        if (!ok) {
+            OTAM_LOG_E("Multicast: read back at 0x%x failed", (unsigned)off);
+            break;
+        }
+        md5.add(sector, n);
+#if OTA_SHA256_ENABLED
+        ok = verifier.write(sector, n);
+        if (!ok) {
+            OTAM_LOG_E("Multicast: image rejected: %s", verifier.errorString());
+        }
+#endif
+#if OTA_SIGNATURE_ENABLED
+        if (signingKeySet) {
+            signature.update(sector, n);
+        }
+#endif
+    }
+    free(sector);
+    if (ok) {
+        char digest[33];
+        md5.calculate();
+        md5.getChars(digest);
+        ok = strcmp(digest, imageMD5) == 0;
+        if (!ok) {
+            OTAM_LOG_E("Multicast: MD5 mismatch on the staged image");
+        }
+    }
+    return ok && verifyImage() && verifySignature();
+}
@@ -0,0 +1,321 @@
+/**
+ * @file OTAReceiver.h
+ * @brief Built-in espota protocol receiver used by OTAManager's listener mode
+ *
+ * @details Speaks the same wire protocol as ArduinoOTA (UDP invite, optional MD5
+ * challenge, TCP data stream with decimal acknowledgements) so `espota.py` and
+ * the PlatformIO uploader work unchanged. Unlike ArduinoOTA it is built on BSD
+ * sockets (lwIP on the ESP32), which lets a task block in select() until an
+ * invite or data actually arrives instead of polling.
+ *
+ * Protocol extension: an uploader that appends " resume" to the invite is
+ * answered "OK <offset>" and sends the image from that offset on; the committed
+ * part of an interrupted transfer of the same image is not sent again. A
+ * " sha256=<hex>" option carries the SHA-256 of the file as sent, which is
+ * checked in addition to the MD5. A " sig=<hex>" option carries a detached
+ * Ed25519 signature of the file as sent; once a signing key is set, invites
+ * without one are refused and the signature is checked over the stream.
+ *
+ * pull() runs the same image stages on a body fetched over HTTP(S) instead.
+ * A joined multicast group (OTAMulticast) is served by the same handle():
+ * announced sessions are received into the update partition out of order, then
+ * checked as a whole before the partition is made bootable.
+ *
+ * @note Not thread-safe on its own; OTAManager serialises access with its mutex.
+ */
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoOTA.h>
+#include <MD5Builder.h>
+#include <esp_partition.h>
+
+#include "OTAHistogram.h"
+#include "OTAHttpClient.h"
+#include "OTAInflater.h"
+#include "OTAManagerConfig.h"
+#include "OTAMulticast.h"
+#include "OTAPatcher.h"
+#include "OTAPipeline.h"
+#include "OTAPull.h"
+#include "OTAResume.h"
+#include "OTASignature.h"
+#include "OTATrace.h"
+#include "OTATuning.h"
+#include "OTAVerifier.h"
+
+class OTAReceiver {
+   public:
+    /**
+     * @brief Open the UDP invite socket
+     *
+     * @param port UDP port to listen on for espota invites
+     * @return true if the socket is bound and ready
+     */
+    bool begin(uint16_t port);
+
+    /**
+     * @brief Close all sockets; any session in progress must have finished
+     */
+    void end();
+
+    /**
+     * @brief Check whether the invite socket is open
+     */
+    bool isRunning() const { return udpSocket >= 0; }
+
+    /**
+     * @brief Set the OTA password (empty or nullptr disables authentication)
+     */
+    void setPassword(const char* password);
+
+    OTAReceiver& onStart(ArduinoOTAClass::THandlerFunction fn);
+    OTAReceiver& onEnd(ArduinoOTAClass::THandlerFunction fn);
+    OTAReceiver& onProgress(ArduinoOTAClass::THandlerFunction_Progress fn);
+    OTAReceiver& onError(ArduinoOTAClass::THandlerFunction_Error fn);
+
+    /**
+     * @brief Also receive multicast sessions on this group (see OTAMulticast)
+     *
+     * @param interfaceIp Local interface to join on (nullptr = default)
+     */
+    bool joinMulticast(const char* group, uint16_t port, const char* interfaceIp);
+    void leaveMulticast() { multicast.end(); }
+    bool isMulticastJoined() const { return multicast.isJoined(); }
+
+    /**
+     * @brief Statistics of the last multicast session
+     */
+    const OTAMulticastStats& getMulticastStats() const { return multicast.getStats(); }
+
+    /**
+     * @brief Block until an invite/auth packet is pending or the timeout expires
+     *
+     * Uses no CPU while waiting. Multicast packets count once a group is joined.
+     *
+     * @param timeoutMs Maximum time to block
+     * @return true if a packet is ready for handle()
+     */
+    bool waitForActivity(uint32_t timeoutMs);
+
+    /**
+     * @brief Process one pending packet without blocking
+     *
+     * If the packet completes the invite handshake the whole update session runs
+     * inside this call, exactly like ArduinoOTA.handle().
+     */
+    void handle();
+
+    /**
+     * @brief Download an image and install it (pull mode)
+     *
+     * Runs the whole session inside this call. On success the device restarts.
+     *
+     * @return false if the download or a check failed (the error callback has run)
+     */
+    bool pull(const char* url, const OTAPullOptions& options);
+
+    /**
+     * @brief Statistics of the last pull()
+     */
+    const OTAPullStats& getPullStats() const { return pullStats; }
+
+    /**
+     * @brief Per-chunk socket read and flash write times of all sessions
+     *
+     * Recorded by the receiving task and the flash writer task; safe to read or
+     * reset from any task.
+     */
+    OTAHistogram& socketReadLatency() { return readLatency; }
+    OTAHistogram& flashWriteLatency() { return writeLatency; }
+
+    /**
+     * @brief Session event trace; OTAManager adds the session events
+     *
+     * The receiver records invites, logins, connections, read stalls and
+     * sector erases from the receiving and flash writer tasks.
+     */
+    OTATrace& eventTrace() { return trace; }
+
+    /**
+     * @brief Command of the current/last session (U_FLASH or U_SPIFFS)
+     */
+    int getCommand() const { return command; }
+
+    /**
+     * @brief Whether the current/last image arrived gzip or zlib compressed
+     */
+    bool isCompressed() const { return compressed; }
+
+    /**
+     * @brief Whether the current/last image arrived as a delta patch
+     */
+    bool isPatch() const { return patched; }
+
+    /**
+     * @brief Image offset the current/last session continued from (0 = from the start)
+     */
+    size_t getResumeOffset() const { return resumeOffset; }
+
+    /**
+     * @brief Whether the current/last image was checked against a SHA-256 (the one
+     * appended to app images or one from the invite)
+     */
+    bool isSha256Verified() const { return sha256Verified; }
+
+    /**
+     * @brief Require every image to be signed by this Ed25519 key
+     *
+     * @param publicKey 32-byte public key, or nullptr to accept unsigned images
+     */
+    void setSigningKey(const uint8_t* publicKey);
+    bool isSigningRequired() const { return signingKeySet; }
+
+    /**
+     * @brief Whether the current/last image carried a valid signature
+     */
+    bool isSignatureVerified() const { return signatureVerified; }
+
+    /**
+     * @brief Bytes written to flash in the current/last session (after decompression
+     * and patching)
+     */
+    size_t getImageBytes() const { return imageBytes; }
+
+    /**
+     * @brief Overlap socket reads with flash writes (see OTAPipeline)
+     */
+    void setPipelineEnabled(bool enabled) { pipelineEnabled = enabled; }
+    bool isPipelineEnabled() const { return pipelineEnabled; }
+
+    /**
+     * @brief Apply data path tuning, clamped to bounds and fitted to the free heap
+     *
+     * @return true if the values were accepted unchanged
+     */
+    bool setTuning(const OTATuning& requested);
+    const OTATuning& getTuning() const { return tuning; }
+
+    /**
+     * @brief Stage timings of the last pipelined session
+     */
+    const OTAPipelineStats& getPipelineStats() const { return lastPipelineStats; }
+
+   private:
+    enum State { IDLE, WAIT_AUTH };
+
+    void onInvite(const char* packet);
+    void onAuth(const char* packet);
+    void reply(const char* msg);
+    void accept();
+    bool beginSignature();
+    size_t prepareResume();
+    bool resumeImage();
+    void trackResume(const uint8_t* data, size_t len, size_t offset);
+    void saveResume();
+    void runSession();
+    void sendAck(int sock, size_t written);
+    int readStream(int sock, uint8_t* dst, size_t maxLen, size_t lastAck);
+    void readDone(uint32_t startUs);
+    void flashDone(size_t offset, size_t len, uint32_t startUs);
+    void traceErase(size_t offset, uint32_t startUs, uint32_t endUs);
+    void reportReceiveTimeout(size_t received);
+    bool receiveDirect(int sock);
+    int peekStream(int sock, uint8_t* dst, size_t len);
+    bool beginImage(int sock);
+    bool beginImage(const uint8_t* magic, int n);
+    bool writeImage(uint8_t* data, size_t len);
+    bool writeDecoded(uint8_t* data, size_t len);
+    bool beginPatch();
+    bool finishImage();
+    bool verifyImage();
+    bool verifySignature();
+    void abortImage();
+    bool beginPipeline();
+    bool receivePipelined(int sock);
+    bool pullImage(const char* url, const char* caCert);
+    void runMulticastSession();
+    bool verifyStaged();
+    static bool multicastWrite(void* context, uint32_t offset, const uint8_t* data, size_t len);
+    static void multicastProgress(void* context, size_t done, size_t total);
+    bool receiveHttp(bool pipelined);
+    bool resumeHttp(size_t received);
+    static bool flashWrite(void* context, uint8_t* data, size_t len);
+    static bool inflateOutput(void* context, uint8_t* data, size_t len);
+    static bool imageOutput(void* context, uint8_t* data, size_t len);
+    static bool readRunningPartition(void* context, uint32_t offset, uint8_t* dst, size_t len);
+
+    int udpSocket = -1;
+    State state = IDLE;
+
+    char passwordMD5[33] = {0};
+    char nonce[33] = {0};
+
+    int command = 0;
+    size_t imageSize = 0;
+    char imageMD5[33] = {0};  // Empty for a pulled image without an MD5
+    uint32_t remoteAddr = 0;     // Uploader address (network byte order)
+    uint16_t remoteUdpPort = 0;  // Source port of the invite, for replies
+    uint16_t remoteTcpPort = 0;  // Port the uploader listens on for the data stream
+
+    ArduinoOTAClass::THandlerFunction startCallback;
+    ArduinoOTAClass::THandlerFunction endCallback;
+    ArduinoOTAClass::THandlerFunction_Progress progressCallback;
+    ArduinoOTAClass::THandlerFunction_Error errorCallback;
+
+    OTATuning tuning;
+
+    // Image stages between the socket and Update.write(): inflate, then patch
+    bool compressed = false;
+    bool patched = false;
+    bool formatPending = false;  // Compressed: patch magic not yet decoded
+    uint8_t decodedMagic[4];
+    uint8_t decodedMagicLen = 0;
+    OTAInflater inflater;
+    OTAPatcher patcher;
+    MD5Builder wireMD5;
+
+    // SHA-256 of the image as written, and of the wire bytes when they differ
+    OTAVerifier verifier;
+    OTASha256 wireSha;
+    bool shaExpected = false;
+    uint8_t expectedSha[OTASha256::DIGEST_SIZE];
+    bool sha256Verified = false;
+    volatile size_t imageBytes = 0;  // Updated by the flash writer task
+
+    // Ed25519 signature of the file as sent, hashed alongside the wire MD5
+    OTASignature signature;
+    uint8_t signingKey[OTASignature::PUBLIC_KEY_SIZE];
+    bool signingKeySet = false;
+    bool signaturePresent = false;  // The invite carried "sig="
+    uint8_t inviteSignature[OTASignature::SIGNATURE_SIZE];
+    bool signatureVerified = false;
+
+    // Resuming an interrupted transfer (plain flash images only)
+    bool resumeRequested = false;  // The uploader asked for a resume offset
+    bool resumable = false;        // This session keeps a resume record
+    size_t resumeOffset = 0;
+    size_t receivedBytes = 0;      // Stream position reached, including resumeOffset
+    size_t lastCheckpoint = 0;
+    OTAResume resumeStore;
+    OTAResume::Record resumeRecord = {};
+
+    // Pull mode: the HTTP connection replaces the espota data stream
+    OTAHttpClient http;
+    OTAPullStats pullStats = {};
+
+    OTAHistogram readLatency;
+    OTAHistogram writeLatency;
+    OTATrace trace;
+    uint32_t sectorWrites = 0;  // Flash writer task only
+
+    // Multicast mode: blocks are written straight to the update partition, whose
+    // sectors are erased ahead of the highest block written
+    OTAMulticast multicast;
+    const esp_partition_t* stagePartition = nullptr;
+    size_t erasedTo = 0;
+
+    bool pipelineEnabled = OTA_PIPELINE_ENABLED;
+    OTAPipeline pipeline;
+    OTAPipelineStats lastPipelineStats = {};
+};
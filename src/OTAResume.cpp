@@ -0,0 +1,68 @@
+// OTAResume.cpp
+#include "OTAResume.h"
+
+#include <Preferences.h>
+
+static const char* const recordKey = "resume";
+
+// Bumped whenever Record changes so an old blob is never misread
+static const uint8_t recordVersion = 1;
+
+struct StoredRecord {
+    uint8_t version;
+    OTAResume::Record record;
+};
+
+bool OTAResume::load(Record& record) {
+    Preferences prefs;
+    if (!prefs.begin(OTA_RESUME_NVS_NAMESPACE, true)) {
+        stored = false;
+        return false;
+    }
+    StoredRecord blob;
+    size_t len = prefs.getBytesLength(recordKey) == sizeof(blob)
+                     ? prefs.getBytes(recordKey, &blob, sizeof(blob))
+                     : 0;
+    prefs.end();
+
+    stored = len > 0;
+    if (len != sizeof(blob) || blob.version != recordVersion ||
+        blob.record.md5[sizeof(blob.record.md5) - 1] != '\0') {
+        return false;
+    }
+    record = blob.record;
+    return true;
+}
+
+bool OTAResume::save(const Record& record) {
+    Preferences prefs;
+    if (!prefs.begin(OTA_RESUME_NVS_NAMESPACE, false)) {
+        OTAM_LOG_W("Resume: NVS namespace unavailable");
+        return false;
+    }
+    StoredRecord blob;
+    memset(&blob, 0, sizeof(blob));
+    blob.version = recordVersion;
+    blob.record = record;
+    bool ok = prefs.putBytes(recordKey, &blob, sizeof(blob)) == sizeof(blob);
+    prefs.end();
+    if (!ok) {
+        OTAM_LOG_W("Resume: saving the record failed");
+        return false;
+    }
+    stored = true;
+    OTAM_LOG_D("Resume: %u/%u bytes committed", (unsigned)record.committed, (unsigned)record.size);
+    return true;
+}
+
+void OTAResume::clear() {
+    if (!stored) {
+        return;
+    }
+    Preferences prefs;
+    if (prefs.begin(OTA_RESUME_NVS_NAMESPACE, false)) {
+        prefs.remove(recordKey);
+        prefs.end();
+    }
+    stored = false;
+}
@@ -0,0 +1,50 @@
+/**
+ * @file OTAResume.h
+ * @brief Persistent record of an interrupted image transfer
+ *
+ * @details Stores, in NVS, which image was being written (size and MD5 from the
+ * invite, and the update partition it went to) and how many bytes of it are
+ * committed to flash. A later invite for the same image can then continue from
+ * that offset. The first bytes of the image are kept in the record as well: the
+ * Update class holds them back from flash until the image is verified, so they
+ * cannot be read back from the partition.
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include "OTAManagerConfig.h"
+
+class OTAResume {
+   public:
+    // Bytes Update writes last (ENCRYPTED_BLOCK_SIZE in the core's Updater)
+    static const size_t HEADER_BYTES = 16;
+
+    struct Record {
+        uint32_t partition;  // Address of the update partition
+        uint32_t size;       // Image size from the invite
+        uint32_t committed;  // Bytes programmed, a multiple of the flash sector size
+        char md5[33];        // Image MD5 from the invite
+        uint8_t header[HEADER_BYTES];
+    };
+
+    /**
+     * @brief Read the stored record
+     *
+     * @return false if there is none (or it was written by another layout)
+     */
+    bool load(Record& record);
+
+    /**
+     * @brief Store a record, replacing any previous one
+     */
+    bool save(const Record& record);
+
+    /**
+     * @brief Forget the stored record; a no-op when there is none
+     */
+    void clear();
+
+   private:
+    bool stored = true;  // Unknown until the first load(); avoids erasing an empty key
+};
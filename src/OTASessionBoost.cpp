@@ -0,0 +1,66 @@
+// OTASessionBoost.cpp
+#include "OTASessionBoost.h"
+
+#if defined(configUSE_CORE_AFFINITY) && configUSE_CORE_AFFINITY && portNUM_PROCESSORS > 1
+    #define OTA_SESSION_CORE_SUPPORTED 1
+#else
+    #define OTA_SESSION_CORE_SUPPORTED 0
+#endif
+
+bool OTASessionBoost::configure(UBaseType_t newPriority, BaseType_t newCore) {
+    priority = newPriority < configMAX_PRIORITIES ? newPriority : configMAX_PRIORITIES - 1;
+    if (newCore != tskNO_AFFINITY && (newCore < 0 || newCore >= portNUM_PROCESSORS)) {
+        OTAM_LOG_W("Session core %d does not exist, the session task stays where it is", (int)newCore);
+        core = tskNO_AFFINITY;
+        return false;
+    }
+    core = newCore;
+#if !OTA_SESSION_CORE_SUPPORTED
+    if (core != tskNO_AFFINITY) {
+        OTAM_LOG_W("This kernel cannot move a running task, the session task stays where it is");
+        core = tskNO_AFFINITY;
+        return false;
+    }
+#endif
+    return true;
+}
+
+void OTASessionBoost::begin() {
+    end();  // A session that never reported its end
+    task = xTaskGetCurrentTaskHandle();
+    savedPriority = uxTaskPriorityGet(task);
+    if (priority > savedPriority) {
+        vTaskPrioritySet(task, priority);
+        priorityRaised = true;
+        OTAM_LOG_D("Session task %s: priority %u -> %u", pcTaskGetName(task), (unsigned)savedPriority,
+                   (unsigned)priority);
+    }
+#if OTA_SESSION_CORE_SUPPORTED
+    if (core != tskNO_AFFINITY) {
+        savedAffinity = vTaskCoreAffinityGet(task);
+        UBaseType_t mask = (UBaseType_t)1 << core;
+        if (savedAffinity != mask) {
+            vTaskCoreAffinitySet(task, mask);
+            affinityChanged = true;
+            OTAM_LOG_D("Session task %s: moved to core %d", pcTaskGetName(task), (int)core);
+        }
+    }
+#endif
+}
+
+void OTASessionBoost::end() {
+    if (!task) {
+        return;
+    }
+    if (priorityRaised) {
+        vTaskPrioritySet(task, savedPriority);
+        priorityRaised = false;
+    }
+#if OTA_SESSION_CORE_SUPPORTED
+    if (affinityChanged) {
+        vTaskCoreAffinitySet(task, savedAffinity);
+        affinityChanged = false;
+    }
+#endif
+    task = nullptr;
+}
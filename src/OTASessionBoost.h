@@ -0,0 +1,59 @@
+/**
+ * @file OTASessionBoost.h
+ * @brief Raises the task running an update session above the application
+ *
+ * @details A session runs on whichever task drives it: the listener, or the task
+ * calling handleUpdates(). At the same priority as the application's tasks it
+ * shares its core with them, and the transfer slows down accordingly. begin(),
+ * called from the session's start hook, raises that task to the configured
+ * priority and optionally moves it to another core; end(), from the end and
+ * error hooks, puts both back as they were.
+ *
+ * Not thread-safe: OTAManager calls it under its mutex.
+ */
+#pragma once
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "OTAManagerConfig.h"
+
+class OTASessionBoost {
+   public:
+    /**
+     * @brief Set the policy for the following sessions
+     *
+     * @param priority Priority for the session task (0 = leave it alone)
+     * @param core Core for the session task (tskNO_AFFINITY = leave it alone)
+     * @return false if core cannot be honoured by this kernel (the priority still is)
+     */
+    bool configure(UBaseType_t priority, BaseType_t core);
+
+    UBaseType_t getPriority() const { return priority; }
+    BaseType_t getCore() const { return core; }
+
+    /**
+     * @brief Boost the calling task for its session
+     */
+    void begin();
+
+    /**
+     * @brief Restore what begin() changed; does nothing if it changed nothing
+     */
+    void end();
+
+    /**
+     * @brief The task boosted by the running session, or nullptr
+     */
+    TaskHandle_t boostedTask() const { return task; }
+
+   private:
+    UBaseType_t priority = OTA_SESSION_PRIORITY;
+    BaseType_t core = OTA_SESSION_CORE;
+    TaskHandle_t task = nullptr;
+    UBaseType_t savedPriority = 0;
+    bool priorityRaised = false;
+    bool affinityChanged = false;
+    UBaseType_t savedAffinity = 0;
+};
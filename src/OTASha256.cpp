@@ -0,0 +1,192 @@
+// OTASha256.cpp
+#include "OTASha256.h"
+
+bool OTASha256::fromHex(const char* hex, uint8_t digest[DIGEST_SIZE]) {
+    if (!hex || strlen(hex) != 2 * DIGEST_SIZE) {
+        return false;
+    }
+    for (size_t i = 0; i < 2 * DIGEST_SIZE; i++) {
+        char c = hex[i];
+        uint8_t v;
+        if (c >= '0' && c <= '9') {
+            v = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            v = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            v = c - 'A' + 10;
+        } else {
+            return false;
+        }
+        digest[i / 2] = (i & 1) ? (digest[i / 2] | v) : (uint8_t)(v << 4);
+    }
+    return true;
+}
+
+#if OTA_SHA256_BACKEND == OTA_SHA256_MBEDTLS
+
+// mbedTLS 3 dropped the _ret suffix that 2.x uses for the error-returning calls
+#if MBEDTLS_VERSION_MAJOR >= 3
+    #define OTA_SHA256_STARTS mbedtls_sha256_starts
+    #define OTA_SHA256_UPDATE mbedtls_sha256_update
+    #define OTA_SHA256_FINISH mbedtls_sha256_finish
+#else
+    #define OTA_SHA256_STARTS mbedtls_sha256_starts_ret
+    #define OTA_SHA256_UPDATE mbedtls_sha256_update_ret
+    #define OTA_SHA256_FINISH mbedtls_sha256_finish_ret
+#endif
+
+OTASha256::OTASha256() {
+    mbedtls_sha256_init(&ctx);
+}
+
+OTASha256::~OTASha256() {
+    mbedtls_sha256_free(&ctx);
+}
+
+OTASha256::OTASha256(const OTASha256& other) {
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_clone(&ctx, &other.ctx);
+}
+
+OTASha256& OTASha256::operator=(const OTASha256& other) {
+    if (this != &other) {
+        mbedtls_sha256_clone(&ctx, &other.ctx);
+    }
+    return *this;
+}
+
+void OTASha256::begin() {
+    OTA_SHA256_STARTS(&ctx, 0);
+}
+
+void OTASha256::update(const uint8_t* data, size_t len) {
+    OTA_SHA256_UPDATE(&ctx, data, len);
+}
+
+void OTASha256::finish(uint8_t digest[DIGEST_SIZE]) {
+    OTA_SHA256_FINISH(&ctx, digest);
+}
+
+const char* OTASha256::backendName() {
+    return "mbedtls";
+}
+
+#else
+
+static const uint32_t roundConstants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+static inline uint32_t rotr(uint32_t x, uint8_t n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+OTASha256::OTASha256() {
+    begin();
+}
+
+OTASha256::~OTASha256() {}
+
+OTASha256::OTASha256(const OTASha256& other) = default;
+
+OTASha256& OTASha256::operator=(const OTASha256& other) = default;
+
+void OTASha256::begin() {
+    static const uint32_t initial[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    memcpy(state, initial, sizeof(state));
+    length = 0;
+    pendingLen = 0;
+}
+
+void OTASha256::compress(const uint8_t* block) {
+    uint32_t w[64];
+    for (uint8_t i = 0; i < 16; i++) {
+        w[i] = (uint32_t)block[4 * i] << 24 | (uint32_t)block[4 * i + 1] << 16 |
+               (uint32_t)block[4 * i + 2] << 8 | block[4 * i + 3];
+    }
+    for (uint8_t i = 16; i < 64; i++) {
+        uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (uint8_t i = 0; i < 64; i++) {
+        uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) +
+                      roundConstants[i] + w[i];
+        uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+void OTASha256::update(const uint8_t* data, size_t len) {
+    length += len;
+    if (pendingLen) {
+        size_t n = sizeof(pending) - pendingLen < len ? sizeof(pending) - pendingLen : len;
+        memcpy(pending + pendingLen, data, n);
+        pendingLen += n;
+        data += n;
+        len -= n;
+        if (pendingLen < sizeof(pending)) {
+            return;
+        }
+        compress(pending);
+        pendingLen = 0;
+    }
+    // Whole blocks straight from the caller's buffer
+    for (; len >= sizeof(pending); data += sizeof(pending), len -= sizeof(pending)) {
+        compress(data);
+    }
+    memcpy(pending, data, len);
+    pendingLen = len;
+}
+
+void OTASha256::finish(uint8_t digest[DIGEST_SIZE]) {
+    uint64_t bits = length * 8;
+    uint8_t pad[72] = {0x80};
+    size_t padLen = (pendingLen < 56 ? 56 : 120) - pendingLen;
+    for (uint8_t i = 0; i < 8; i++) {
+        pad[padLen + i] = (uint8_t)(bits >> (56 - 8 * i));
+    }
+    update(pad, padLen + 8);
+    for (uint8_t i = 0; i < 8; i++) {
+        digest[4 * i] = (uint8_t)(state[i] >> 24);
+        digest[4 * i + 1] = (uint8_t)(state[i] >> 16);
+        digest[4 * i + 2] = (uint8_t)(state[i] >> 8);
+        digest[4 * i + 3] = (uint8_t)state[i];
+    }
+}
+
+const char* OTASha256::backendName() {
+    return "software";
+}
+
+#endif
+
+void OTASha256::peek(uint8_t digest[DIGEST_SIZE]) const {
+    OTASha256 copy(*this);
+    copy.finish(digest);
+}
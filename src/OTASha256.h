@@ -0,0 +1,61 @@
+/**
+ * @file OTASha256.h
+ * @brief Incremental SHA-256 over a pluggable backend
+ *
+ * @details OTA_SHA256_BACKEND selects the implementation at build time:
+ * OTA_SHA256_MBEDTLS uses the mbedTLS context that the ESP32 core routes to the
+ * SHA accelerator, OTA_SHA256_SOFTWARE is a portable implementation used by the
+ * host build (and available on the device for comparison). Data is hashed in
+ * place; nothing is copied except the partial 64-byte block of the software
+ * backend.
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include "OTAManagerConfig.h"
+
+#if OTA_SHA256_BACKEND == OTA_SHA256_MBEDTLS
+    #include <mbedtls/sha256.h>
+#endif
+
+class OTASha256 {
+   public:
+    static const size_t DIGEST_SIZE = 32;
+
+    OTASha256();
+    ~OTASha256();
+    OTASha256(const OTASha256& other);
+    OTASha256& operator=(const OTASha256& other);
+
+    void begin();
+    void update(const uint8_t* data, size_t len);
+    void finish(uint8_t digest[DIGEST_SIZE]);
+
+    /**
+     * @brief Digest of the data so far; hashing can continue afterwards
+     */
+    void peek(uint8_t digest[DIGEST_SIZE]) const;
+
+    /**
+     * @brief Name of the compiled-in backend, for logs and benchmarks
+     */
+    static const char* backendName();
+
+    /**
+     * @brief Parse 64 hex characters into a digest
+     */
+    static bool fromHex(const char* hex, uint8_t digest[DIGEST_SIZE]);
+
+   private:
+#if OTA_SHA256_BACKEND == OTA_SHA256_MBEDTLS
+    mbedtls_sha256_context ctx;
+#else
+    void compress(const uint8_t* block);
+
+    uint32_t state[8];
+    uint64_t length = 0;
+    uint8_t pending[64];
+    size_t pendingLen = 0;
+#endif
+};
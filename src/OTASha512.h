@@ -0,0 +1,48 @@
+/**
+ * @file OTASha512.h
+ * @brief Incremental SHA-512 for Ed25519 signature checks
+ *
+ * @details Same shape as OTASha256: OTA_SHA512_BACKEND selects mbedTLS (the
+ * ESP32 core routes it to the SHA accelerator where the chip has SHA-512) or a
+ * portable implementation used by the host build.
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include "OTAManagerConfig.h"
+
+#if OTA_SHA512_BACKEND == OTA_SHA256_MBEDTLS
+    #include <mbedtls/sha512.h>
+#endif
+
+class OTASha512 {
+   public:
+    static const size_t DIGEST_SIZE = 64;
+
+    OTASha512();
+    ~OTASha512();
+    OTASha512(const OTASha512&) = delete;
+    OTASha512& operator=(const OTASha512&) = delete;
+
+    void begin();
+    void update(const uint8_t* data, size_t len);
+    void finish(uint8_t digest[DIGEST_SIZE]);
+
+    /**
+     * @brief Name of the compiled-in backend, for logs and benchmarks
+     */
+    static const char* backendName();
+
+   private:
+#if OTA_SHA512_BACKEND == OTA_SHA256_MBEDTLS
+    mbedtls_sha512_context ctx;
+#else
+    void compress(const uint8_t* block);
+
+    uint64_t state[8];
+    uint64_t length = 0;
+    uint8_t pending[128];
+    size_t pendingLen = 0;
+#endif
+};
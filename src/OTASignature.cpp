@@ -0,0 +1,465 @@
+// OTASignature.cpp
+#include "OTASignature.h"
+
+// Field and group arithmetic after TweetNaCl: 16 signed limbs of 16 bits, with
+// products reduced by 2^256 = 38 (mod p)
+typedef int64_t Fe[16];
+typedef Fe Ge[4];
+
+static const Fe feZero = {0};
+static const Fe feOne = {1};
+static const Fe curveD = {0x78a3, 0x1359, 0x4dca, 0x75eb, 0xd8ab, 0x4141, 0x0a4d, 0x0070,
+                          0xe898, 0x7779, 0x4079, 0x8cc7, 0xfe73, 0x2b6f, 0x6cee, 0x5203};
+static const Fe curveD2 = {0xf159, 0x26b2, 0x9b94, 0xebd6, 0xb156, 0x8283, 0x149a, 0x00e0,
+                           0xd130, 0xeef3, 0x80f2, 0x198e, 0xfce7, 0x56df, 0xd9dc, 0x2406};
+static const Fe baseX = {0xd51a, 0x8f25, 0x2d60, 0xc956, 0xa7b2, 0x9525, 0xc760, 0x692c,
+                         0xdc5c, 0xfdd6, 0xe231, 0xc0a4, 0x53fe, 0xcd6e, 0x36d3, 0x2169};
+static const Fe baseY = {0x6658, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666,
+                         0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666};
+static const Fe sqrtM1 = {0xa0b0, 0x4a0e, 0x1b27, 0xc4ee, 0xe478, 0xad2f, 0x1806, 0x2f43,
+                          0xd7a7, 0x3dfb, 0x0099, 0x2b4d, 0xdf0b, 0x4fc1, 0x2480, 0x2b83};
+
+// Group order L = 2^252 + 27742317777372353535851937790883648493, little endian
+static const int64_t groupOrder[32] = {0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58,
+                                       0xd6, 0x9c, 0xf7, 0xa2, 0xde, 0xf9, 0xde, 0x14,
+                                       0,    0,    0,    0,    0,    0,    0,    0,
+                                       0,    0,    0,    0,    0,    0,    0,    0x10};
+
+static void feCopy(Fe o, const Fe a) {
+    memcpy(o, a, sizeof(Fe));
+}
+
+static void feCarry(Fe o) {
+    for (int i = 0; i < 16; i++) {
+        o[i] += 1 << 16;
+        int64_t c = o[i] >> 16;
+        if (i < 15) {
+            o[i + 1] += c - 1;
+        } else {
+            o[0] += 38 * (c - 1);
+        }
+        o[i] -= c * 65536;
+    }
+}
+
+// Swaps p and q when b is 1
+static void feSwap(Fe p, Fe q, int b) {
+    int64_t mask = ~((int64_t)b - 1);
+    for (int i = 0; i < 16; i++) {
+        int64_t t = mask & (p[i] ^ q[i]);
+        p[i] ^= t;
+        q[i] ^= t;
+    }
+}
+
+static void fePack(uint8_t o[32], const Fe n) {
+    Fe m, t;
+    feCopy(t, n);
+    feCarry(t);
+    feCarry(t);
+    feCarry(t);
+    // Subtract p at most twice to reach the canonical value
+    for (int j = 0; j < 2; j++) {
+        m[0] = t[0] - 0xffed;
+        for (int i = 1; i < 15; i++) {
+            m[i] = t[i] - 0xffff - ((m[i - 1] >> 16) & 1);
+            m[i - 1] &= 0xffff;
+        }
+        m[15] = t[15] - 0x7fff - ((m[14] >> 16) & 1);
+        int borrow = (m[15] >> 16) & 1;
+        m[14] &= 0xffff;
+        feSwap(t, m, 1 - borrow);
+    }
+    for (int i = 0; i < 16; i++) {
+        o[2 * i] = (uint8_t)t[i];
+        o[2 * i + 1] = (uint8_t)(t[i] >> 8);
+    }
+}
+
+static void feUnpack(Fe o, const uint8_t n[32]) {
+    for (int i = 0; i < 16; i++) {
+        o[i] = n[2 * i] + ((int64_t)n[2 * i + 1] << 8);
+    }
+    o[15] &= 0x7fff;
+}
+
+static bool feEqual(const Fe a, const Fe b) {
+    uint8_t x[32], y[32];
+    fePack(x, a);
+    fePack(y, b);
+    return memcmp(x, y, 32) == 0;
+}
+
+static int feParity(const Fe a) {
+    uint8_t d[32];
+    fePack(d, a);
+    return d[0] & 1;
+}
+
+static void feAdd(Fe o, const Fe a, const Fe b) {
+    for (int i = 0; i < 16; i++) {
+        o[i] = a[i] + b[i];
+    }
+}
+
+static void feSub(Fe o, const Fe a, const Fe b) {
+    for (int i = 0; i < 16; i++) {
+        o[i] = a[i] - b[i];
+    }
+}
+
+static void feMul(Fe o, const Fe a, const Fe b) {
+    int64_t t[31] = {0};
+    for (int i = 0; i < 16; i++) {
+        for (int j = 0; j < 16; j++) {
+            t[i + j] += a[i] * b[j];
+        }
+    }
+    for (int i = 0; i < 15; i++) {
+        t[i] += 38 * t[i + 16];
+    }
+    memcpy(o, t, sizeof(Fe));
+    feCarry(o);
+    feCarry(o);
+}
+
+// Half the limb products of feMul; squarings dominate point doubling
+static void feSquare(Fe o, const Fe a) {
+    int64_t t[31] = {0};
+    for (int i = 0; i < 16; i++) {
+        t[2 * i] += a[i] * a[i];
+        int64_t twice = 2 * a[i];
+        for (int j = i + 1; j < 16; j++) {
+            t[i + j] += twice * a[j];
+        }
+    }
+    for (int i = 0; i < 15; i++) {
+        t[i] += 38 * t[i + 16];
+    }
+    memcpy(o, t, sizeof(Fe));
+    feCarry(o);
+    feCarry(o);
+}
+
+static void feInvert(Fe o, const Fe in) {
+    // in^(p - 2)
+    Fe c;
+    feCopy(c, in);
+    for (int a = 253; a >= 0; a--) {
+        feSquare(c, c);
+        if (a != 2 && a != 4) {
+            feMul(c, c, in);
+        }
+    }
+    feCopy(o, c);
+}
+
+static void fePow2523(Fe o, const Fe in) {
+    // in^((p - 5) / 8), for the square root in point decoding
+    Fe c;
+    feCopy(c, in);
+    for (int a = 250; a >= 0; a--) {
+        feSquare(c, c);
+        if (a != 1) {
+            feMul(c, c, in);
+        }
+    }
+    feCopy(o, c);
+}
+
+static void geIdentity(Ge p) {
+    feCopy(p[0], feZero);
+    feCopy(p[1], feOne);
+    feCopy(p[2], feOne);
+    feCopy(p[3], feZero);
+}
+
+static void geCopy(Ge o, const Ge p) {
+    memcpy(o, p, sizeof(Ge));
+}
+
+// p += q (unified addition, a = -1)
+static void geAdd(Ge p, const Ge q) {
+    Fe a, b, c, d, t, e, f, g, h;
+    feSub(a, p[1], p[0]);
+    feSub(t, q[1], q[0]);
+    feMul(a, a, t);
+    feAdd(b, p[0], p[1]);
+    feAdd(t, q[0], q[1]);
+    feMul(b, b, t);
+    feMul(c, p[3], q[3]);
+    feMul(c, c, curveD2);
+    feMul(d, p[2], q[2]);
+    feAdd(d, d, d);
+    feSub(e, b, a);
+    feSub(f, d, c);
+    feAdd(g, d, c);
+    feAdd(h, b, a);
+    feMul(p[0], e, f);
+    feMul(p[1], h, g);
+    feMul(p[2], g, f);
+    feMul(p[3], e, h);
+}
+
+// p = 2p; every term is computed negated, which cancels in the products
+static void geDouble(Ge p) {
+    Fe a, b, c, e, f, g, h;
+    feSquare(a, p[0]);
+    feSquare(b, p[1]);
+    feSquare(c, p[2]);
+    feAdd(c, c, c);
+    feAdd(h, a, b);
+    feAdd(e, p[0], p[1]);
+    feSquare(e, e);
+    feSub(e, h, e);
+    feSub(g, a, b);
+    feAdd(f, c, g);
+    feMul(p[0], e, f);
+    feMul(p[1], g, h);
+    feMul(p[2], f, g);
+    feMul(p[3], e, h);
+}
+
+static void geNegate(Ge o, const Ge p) {
+    feSub(o[0], feZero, p[0]);
+    feCopy(o[1], p[1]);
+    feCopy(o[2], p[2]);
+    feSub(o[3], feZero, p[3]);
+}
+
+static void gePack(uint8_t out[32], const Ge p) {
+    Fe zi, x, y;
+    feInvert(zi, p[2]);
+    feMul(x, p[0], zi);
+    feMul(y, p[1], zi);
+    fePack(out, y);
+    out[31] ^= feParity(x) << 7;
+}
+
+// Decodes a point and negates it; false if the encoding is not a curve point
+static bool geUnpackNegated(Ge r, const uint8_t in[32]) {
+    Fe t, chk, num, den, den2, den4, den6;
+    feCopy(r[2], feOne);
+    feUnpack(r[1], in);
+
+    // y must be canonical (below p)
+    uint8_t canonical[32];
+    fePack(canonical, r[1]);
+    canonical[31] |= in[31] & 0x80;
+    if (memcmp(canonical, in, 32) != 0) {
+        return false;
+    }
+
+    // x = sqrt((y^2 - 1) / (d y^2 + 1))
+    feSquare(num, r[1]);
+    feMul(den, num, curveD);
+    feSub(num, num, r[2]);
+    feAdd(den, r[2], den);
+    feSquare(den2, den);
+    feSquare(den4, den2);
+    feMul(den6, den4, den2);
+    feMul(t, den6, num);
+    feMul(t, t, den);
+    fePow2523(t, t);
+    feMul(t, t, num);
+    feMul(t, t, den);
+    feMul(t, t, den);
+    feMul(r[0], t, den);
+
+    feSquare(chk, r[0]);
+    feMul(chk, chk, den);
+    if (!feEqual(chk, num)) {
+        feMul(r[0], r[0], sqrtM1);
+    }
+    feSquare(chk, r[0]);
+    feMul(chk, chk, den);
+    if (!feEqual(chk, num)) {
+        return false;
+    }
+    if (feParity(r[0]) == (in[31] >> 7)) {
+        feSub(r[0], feZero, r[0]);
+    }
+    feMul(r[3], r[0], r[1]);
+    return true;
+}
+
+// o = [s]p for a reduced scalar, four bits at a time with signed digits so that
+// only 1p..8p are tabulated (the table is 4 KB, so it lives on the heap)
+static bool geScalarMult(Ge o, const Ge p, const uint8_t s[32]) {
+    Ge* table = (Ge*)malloc(8 * sizeof(Ge));
+    if (!table) {
+        return false;
+    }
+    geCopy(table[0], p);
+    for (int i = 1; i < 8; i++) {
+        geCopy(table[i], table[i - 1]);
+        geAdd(table[i], p);
+    }
+
+    int8_t digits[64];
+    for (int i = 0; i < 32; i++) {
+        digits[2 * i] = s[i] & 15;
+        digits[2 * i + 1] = s[i] >> 4;
+    }
+    int8_t carry = 0;
+    for (int i = 0; i < 63; i++) {
+        digits[i] += carry;
+        carry = (digits[i] + 8) >> 4;
+        digits[i] -= carry * 16;
+    }
+    digits[63] += carry;
+
+    Ge neg;
+    geIdentity(o);
+    for (int i = 63; i >= 0; i--) {
+        if (i < 63) {
+            geDouble(o);
+            geDouble(o);
+            geDouble(o);
+            geDouble(o);
+        }
+        if (digits[i] > 0) {
+            geAdd(o, table[digits[i] - 1]);
+        } else if (digits[i] < 0) {
+            geNegate(neg, table[-digits[i] - 1]);
+            geAdd(o, neg);
+        }
+    }
+    free(table);
+    return true;
+}
+
+// r = x mod L, for the 64-byte SHA-512 output
+static void scalarReduce(uint8_t r[32], const uint8_t in[64]) {
+    int64_t x[64];
+    for (int i = 0; i < 64; i++) {
+        x[i] = in[i];
+    }
+    for (int i = 63; i >= 32; i--) {
+        int64_t carry = 0;
+        int j;
+        for (j = i - 32; j < i - 12; j++) {
+            x[j] += carry - 16 * x[i] * groupOrder[j - (i - 32)];
+            carry = (x[j] + 128) >> 8;
+            x[j] -= carry * 256;
+        }
+        x[j] += carry;
+        x[i] = 0;
+    }
+    int64_t carry = 0;
+    for (int j = 0; j < 32; j++) {
+        x[j] += carry - (x[31] >> 4) * groupOrder[j];
+        carry = x[j] >> 8;
+        x[j] &= 255;
+    }
+    for (int j = 0; j < 32; j++) {
+        x[j] -= carry * groupOrder[j];
+    }
+    for (int i = 0; i < 32; i++) {
+        x[i + 1] += x[i] >> 8;
+        r[i] = (uint8_t)(x[i] & 255);
+    }
+}
+
+// RFC 8032 requires S < L, otherwise signatures are malleable
+static bool scalarIsReduced(const uint8_t s[32]) {
+    for (int i = 31; i >= 0; i--) {
+        if (s[i] != groupOrder[i]) {
+            return s[i] < groupOrder[i];
+        }
+    }
+    return false;
+}
+
+bool OTASignature::begin(const uint8_t publicKey[PUBLIC_KEY_SIZE],
+                         const uint8_t signature[SIGNATURE_SIZE]) {
+    ready = false;
+    error = nullptr;
+    if (!scalarIsReduced(signature + 32)) {
+        error = "malformed signature";
+        return false;
+    }
+    if (!geUnpackNegated(negA, publicKey)) {
+        error = "invalid public key";
+        return false;
+    }
+    Ge base;
+    feCopy(base[0], baseX);
+    feCopy(base[1], baseY);
+    feCopy(base[2], feOne);
+    feMul(base[3], baseX, baseY);
+    if (!geScalarMult(sB, base, signature + 32)) {
+        error = "out of memory";
+        return false;
+    }
+    memcpy(r, signature, sizeof(r));
+    sha.begin();
+    sha.update(signature, 32);
+    sha.update(publicKey, PUBLIC_KEY_SIZE);
+    ready = true;
+    return true;
+}
+
+void OTASignature::update(const uint8_t* data, size_t len) {
+    if (ready) {
+        sha.update(data, len);
+    }
+}
+
+bool OTASignature::finish() {
+    if (!ready) {
+        return false;
+    }
+    ready = false;
+    uint8_t digest[OTASha512::DIGEST_SIZE];
+    sha.finish(digest);
+    uint8_t k[32];
+    scalarReduce(k, digest);
+
+    // [S]B - [k]A must encode to R
+    Ge check;
+    if (!geScalarMult(check, negA, k)) {
+        error = "out of memory";
+        return false;
+    }
+    geAdd(check, sB);
+    uint8_t encoded[32];
+    gePack(encoded, check);
+    if (memcmp(encoded, r, sizeof(r)) != 0) {
+        error = "signature mismatch";
+        return false;
+    }
+    return true;
+}
+
+bool OTASignature::verify(const uint8_t publicKey[PUBLIC_KEY_SIZE],
+                          const uint8_t signature[SIGNATURE_SIZE], const uint8_t* message,
+                          size_t len) {
+    OTASignature sig;
+    if (!sig.begin(publicKey, signature)) {
+        return false;
+    }
+    sig.update(message, len);
+    return sig.finish();
+}
+
+bool OTASignature::fromHex(const char* hex, uint8_t* out, size_t len) {
+    if (!hex || strlen(hex) != 2 * len) {
+        return false;
+    }
+    for (size_t i = 0; i < 2 * len; i++) {
+        char c = hex[i];
+        uint8_t v;
+        if (c >= '0' && c <= '9') {
+            v = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            v = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            v = c - 'A' + 10;
+        } else {
+            return false;
+        }
+        out[i / 2] = (i & 1) ? (out[i / 2] | v) : (uint8_t)(v << 4);
+    }
+    return true;
+}
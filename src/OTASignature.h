@@ -0,0 +1,68 @@
+/**
+ * @file OTASignature.h
+ * @brief Streaming Ed25519 (RFC 8032) check of a detached image signature
+ *
+ * @details The signature is the plain Ed25519 signature of the file as sent, so
+ * `openssl pkeyutl -sign -rawin` produces it. Ed25519 hashes R || A || message
+ * with SHA-512, and R and A are known before the first image byte, so the hash
+ * runs over the stream as it arrives and no second pass over the image (or
+ * flash read) is needed. begin() also computes [S]B up front, which leaves a
+ * single variable-base scalar multiplication for finish().
+ *
+ * Verification works on public data only and is not constant time.
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include "OTAManagerConfig.h"
+#include "OTASha512.h"
+
+class OTASignature {
+   public:
+    static const size_t PUBLIC_KEY_SIZE = 32;
+    static const size_t SIGNATURE_SIZE = 64;
+
+    /**
+     * @brief Start checking a message against a signature
+     *
+     * @return false if the key or signature cannot be valid (bad point encoding,
+     * S not reduced); errorString() says which
+     */
+    bool begin(const uint8_t publicKey[PUBLIC_KEY_SIZE], const uint8_t signature[SIGNATURE_SIZE]);
+
+    /**
+     * @brief Hash the next piece of the message
+     */
+    void update(const uint8_t* data, size_t len);
+
+    /**
+     * @brief Check the signature against everything passed to update()
+     */
+    bool finish();
+
+    const char* errorString() const { return error; }
+
+    /**
+     * @brief One-shot check of a message held in memory
+     */
+    static bool verify(const uint8_t publicKey[PUBLIC_KEY_SIZE],
+                       const uint8_t signature[SIGNATURE_SIZE], const uint8_t* message,
+                       size_t len);
+
+    /**
+     * @brief Parse exactly 2 * len hex characters
+     */
+    static bool fromHex(const char* hex, uint8_t* out, size_t len);
+
+   private:
+    typedef int64_t Field[16];  // 16 limbs of 16 bits, mod 2^255 - 19
+    typedef Field Point[4];     // Extended coordinates X, Y, Z, T
+
+    OTASha512 sha;
+    Point negA;                 // The public key, negated
+    Point sB;                   // [S]B, from the second half of the signature
+    uint8_t r[32];              // First half of the signature
+    bool ready = false;
+    const char* error = nullptr;
+};
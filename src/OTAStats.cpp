@@ -0,0 +1,98 @@
+// OTAStats.cpp
+#include "OTAStats.h"
+
+void OTAStatsRecorder::sessionStarted(uint32_t nowUs) {
+    sessionStartUs = nowUs;
+    baselinePending = true;
+    sessionBaseReceived = 0;
+    sessionReceived = 0;
+    sessionWritten = 0;
+    progressBytes.store(0, std::memory_order_relaxed);
+    progressTotal.store(0, std::memory_order_relaxed);
+    currentRate.store(0, std::memory_order_relaxed);
+    averageRate.store(0, std::memory_order_relaxed);
+    etaMs.store(OTAThroughput::ETA_UNKNOWN, std::memory_order_relaxed);
+    started.fetch_add(1, std::memory_order_relaxed);
+    active.store(true, std::memory_order_relaxed);
+}
+
+void OTAStatsRecorder::sessionProgress(uint32_t nowUs, uint32_t receivedNow, uint32_t writtenNow,
+                                       uint32_t total) {
+    if (!active.load(std::memory_order_relaxed)) {
+        return;
+    }
+    progressBytes.store(receivedNow, std::memory_order_relaxed);
+    progressTotal.store(total, std::memory_order_relaxed);
+    if (baselinePending) {
+        baselinePending = false;
+        sessionBaseReceived = receivedNow;
+        sessionReceived = receivedNow;
+        sessionWritten = writtenNow;
+        estimator.begin(nowUs, receivedNow, total);
+        return;
+    }
+    estimator.update(nowUs, receivedNow);
+    currentRate.store(estimator.rate(), std::memory_order_relaxed);
+    averageRate.store(estimator.averageRate(), std::memory_order_relaxed);
+    etaMs.store(estimator.etaMs(), std::memory_order_relaxed);
+    // Only what is new since the last report goes into the totals
+    if (receivedNow > sessionReceived) {
+        received.fetch_add(receivedNow - sessionReceived, std::memory_order_relaxed);
+        sessionReceived = receivedNow;
+    }
+    sessionFlashed(writtenNow);
+}
+
+void OTAStatsRecorder::sessionFlashed(uint32_t writtenNow) {
+    if (writtenNow > sessionWritten) {
+        written.fetch_add(writtenNow - sessionWritten, std::memory_order_relaxed);
+        sessionWritten = writtenNow;
+    }
+}
+
+void OTAStatsRecorder::sessionCompleted(uint32_t nowUs) {
+    if (!active.exchange(false, std::memory_order_relaxed)) {
+        return;
+    }
+    completed.fetch_add(1, std::memory_order_relaxed);
+    uint32_t elapsedUs = nowUs - sessionStartUs;
+    uint64_t bytes = sessionReceived - sessionBaseReceived;
+    uint32_t throughput = elapsedUs ? (uint32_t)(bytes * 1000000ULL / elapsedUs) : 0;
+    lastThroughput.store(throughput, std::memory_order_relaxed);
+    if (throughput > peakThroughput.load(std::memory_order_relaxed)) {
+        peakThroughput.store(throughput, std::memory_order_relaxed);
+    }
+}
+
+void OTAStatsRecorder::error(ota_error_t error) {
+    if ((unsigned)error < OTA_STATS_ERROR_SLOTS) {
+        errors[error].fetch_add(1, std::memory_order_relaxed);
+    }
+    // Errors before the start (refused invites, failed logins) are not sessions
+    if (active.exchange(false, std::memory_order_relaxed)) {
+        failed.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+OTAStats OTAStatsRecorder::snapshot() const {
+    OTAStats s;
+    s.handleUpdatesPolls = polls.load(std::memory_order_relaxed);
+    s.handleUpdatesLockedUs = lockedUs.load(std::memory_order_relaxed);
+    s.sessionsStarted = started.load(std::memory_order_relaxed);
+    s.sessionsCompleted = completed.load(std::memory_order_relaxed);
+    s.sessionsFailed = failed.load(std::memory_order_relaxed);
+    for (int i = 0; i < OTA_STATS_ERROR_SLOTS; i++) {
+        s.errors[i] = errors[i].load(std::memory_order_relaxed);
+    }
+    s.bytesReceived = received.load(std::memory_order_relaxed);
+    s.bytesWritten = written.load(std::memory_order_relaxed);
+    s.lastThroughput = lastThroughput.load(std::memory_order_relaxed);
+    s.peakThroughput = peakThroughput.load(std::memory_order_relaxed);
+    s.sessionActive = active.load(std::memory_order_relaxed);
+    s.sessionBytes = progressBytes.load(std::memory_order_relaxed);
+    s.sessionTotal = progressTotal.load(std::memory_order_relaxed);
+    s.currentRate = currentRate.load(std::memory_order_relaxed);
+    s.averageRate = averageRate.load(std::memory_order_relaxed);
+    s.etaMs = etaMs.load(std::memory_order_relaxed);
+    return s;
+}
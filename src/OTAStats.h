@@ -0,0 +1,110 @@
+/**
+ * @file OTAStats.h
+ * @brief Counters for update sessions and the handleUpdates() loop
+ *
+ * @details Every counter is a relaxed atomic. The task serving an update bumps
+ * them as it goes and any other task can take a snapshot at any time; neither
+ * side takes a lock. A snapshot is therefore not one consistent instant: a
+ * counter may already include a chunk that another one does not.
+ */
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoOTA.h>
+
+#include <atomic>
+
+#include "OTAThroughput.h"
+
+// Slots in OTAStats::errors, one per ota_error_t (OTA_AUTH_ERROR .. OTA_END_ERROR)
+#define OTA_STATS_ERROR_SLOTS 5
+
+/**
+ * @brief Snapshot returned by OTAManager::getStats()
+ *
+ * Counts start at boot. All counters are 32 bits so they stay lock-free on the
+ * ESP32, and wrap (the byte counts after 4 GiB); compare two snapshots with
+ * unsigned subtraction.
+ */
+struct OTAStats {
+    uint32_t handleUpdatesPolls;             // handleUpdates() calls that polled; idle ones are not counted
+    uint32_t handleUpdatesLockedUs;          // Time handleUpdates() held the OTA mutex
+    uint32_t sessionsStarted;                // Transfers that got past the invite
+    uint32_t sessionsCompleted;              // Transfers that finished and were accepted
+    uint32_t sessionsFailed;                 // Transfers that ended with an error
+    uint32_t errors[OTA_STATS_ERROR_SLOTS];  // Every reported error by ota_error_t, sessions or not
+    uint32_t bytesReceived;                  // Image bytes off the wire, all sessions; wraps at 4 GiB
+    uint32_t bytesWritten;                   // Bytes to flash; differs for compressed and delta images
+    uint32_t lastThroughput;                 // Bytes/s received by the last completed session
+    uint32_t peakThroughput;                 // Highest lastThroughput so far
+    bool sessionActive;                      // A session is running now
+
+    // Progress of the running session (or of the last one, once it has ended)
+    uint32_t sessionBytes;                   // Bytes received, including a resume offset
+    uint32_t sessionTotal;                   // Size the sender announced
+    uint32_t currentRate;                    // Recent bytes/s (moving average, OTA_THROUGHPUT_TAU_MS)
+    uint32_t averageRate;                    // Bytes/s since the session started
+    uint32_t etaMs;                          // Time left at currentRate; OTAThroughput::ETA_UNKNOWN
+};
+
+class OTAStatsRecorder {
+   public:
+    void countPoll() { polls.fetch_add(1, std::memory_order_relaxed); }
+    void addLockedUs(uint32_t us) { lockedUs.fetch_add(us, std::memory_order_relaxed); }
+
+    /**
+     * @brief A session started; the next progress report is its starting point
+     */
+    void sessionStarted(uint32_t nowUs);
+
+    /**
+     * @brief Bytes received and written by the running session so far, of total
+     *
+     * The first report after sessionStarted() only sets the starting point, so a
+     * resumed transfer does not count the part it skipped.
+     */
+    void sessionProgress(uint32_t nowUs, uint32_t received, uint32_t written, uint32_t total);
+
+    /**
+     * @brief Bytes written by the running session, when flash lags the progress
+     * reports (the pipeline's writer task finishes after the last one)
+     */
+    void sessionFlashed(uint32_t written);
+
+    void sessionCompleted(uint32_t nowUs);
+    void error(ota_error_t error);
+
+    OTAStats snapshot() const;
+
+    /**
+     * @brief Rate estimate of the running session; only for the task serving it
+     */
+    const OTAThroughput& throughput() const { return estimator; }
+
+   private:
+    std::atomic<uint32_t> polls{0};
+    std::atomic<uint32_t> lockedUs{0};
+    std::atomic<uint32_t> started{0};
+    std::atomic<uint32_t> completed{0};
+    std::atomic<uint32_t> failed{0};
+    std::atomic<uint32_t> errors[OTA_STATS_ERROR_SLOTS] = {};
+    // 32-bit like the rest: 64-bit atomics are not lock-free on 32-bit Xtensa
+    std::atomic<uint32_t> received{0};
+    std::atomic<uint32_t> written{0};
+    std::atomic<uint32_t> lastThroughput{0};
+    std::atomic<uint32_t> peakThroughput{0};
+    std::atomic<bool> active{false};
+    std::atomic<uint32_t> progressBytes{0};
+    std::atomic<uint32_t> progressTotal{0};
+    std::atomic<uint32_t> currentRate{0};
+    std::atomic<uint32_t> averageRate{0};
+    std::atomic<uint32_t> etaMs{OTAThroughput::ETA_UNKNOWN};
+
+    // Running session, only touched by the task serving it
+    uint32_t sessionStartUs = 0;
+    bool baselinePending = false;
+    uint32_t sessionBaseReceived = 0;
+    uint32_t sessionReceived = 0;
+    uint32_t sessionWritten = 0;
+    OTAThroughput estimator;
+};
@@ -0,0 +1,54 @@
+// OTAThroughput.cpp
+#include "OTAThroughput.h"
+
+void OTAThroughput::begin(uint32_t nowUs, uint32_t bytes, uint32_t total) {
+    ewma = 0;
+    weight = 0;
+    startUs = nowUs;
+    startBytes = bytes;
+    lastUs = nowUs;
+    lastBytes = bytes;
+    totalBytes = total;
+}
+
+void OTAThroughput::update(uint32_t nowUs, uint32_t bytes) {
+    if (bytes < lastBytes) {
+        // Progress went back (the stream restarted): measure from here
+        lastUs = nowUs;
+        lastBytes = bytes;
+        return;
+    }
+    uint32_t dtUs = nowUs - lastUs;
+    if (!dtUs) {
+        return;  // Same microsecond: counted with the next report
+    }
+    float instant = (float)(bytes - lastBytes) * 1000000.0f / (float)dtUs;
+    float alpha = (float)dtUs / (tauUs + (float)dtUs);
+    ewma += (instant - ewma) * alpha;
+    weight += (1.0f - weight) * alpha;
+    lastUs = nowUs;
+    lastBytes = bytes;
+}
+
+uint32_t OTAThroughput::rate() const {
+    return weight > 0 ? (uint32_t)(ewma / weight) : 0;
+}
+
+uint32_t OTAThroughput::averageRate() const {
+    uint32_t elapsedUs = lastUs - startUs;
+    if (!elapsedUs || lastBytes < startBytes) {
+        return 0;
+    }
+    return (uint32_t)((uint64_t)(lastBytes - startBytes) * 1000000ULL / elapsedUs);
+}
+
+uint32_t OTAThroughput::etaMs() const {
+    if (lastBytes >= totalBytes) {
+        return 0;
+    }
+    uint32_t r = rate();
+    if (!r) {
+        return ETA_UNKNOWN;
+    }
+    return (uint32_t)((uint64_t)(totalBytes - lastBytes) * 1000ULL / r);
+}
@@ -0,0 +1,63 @@
+/**
+ * @file OTAThroughput.h
+ * @brief Transfer rate and time-to-completion estimate for one session
+ *
+ * @details Each progress report adds the rate since the previous one to an
+ * exponentially weighted moving average. The weight grows with the time the
+ * report covers (dt / (tau + dt)), so reports that come in uneven bursts, as TCP
+ * reads do, still average over time rather than over report count. Time is passed
+ * in, in microseconds, so the estimate can be driven by any clock. The average
+ * starts empty and is scaled by how full it is, so a first chunk that lands in
+ * a few microseconds does not dominate the estimate.
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include "OTAManagerConfig.h"
+
+class OTAThroughput {
+   public:
+    // etaMs() while the rate is not known yet
+    static const uint32_t ETA_UNKNOWN = 0xFFFFFFFF;
+
+    explicit OTAThroughput(uint32_t tauMs = OTA_THROUGHPUT_TAU_MS) : tauUs((float)tauMs * 1000.0f) {}
+
+    /**
+     * @brief Start a session at nowUs with bytes already done (a resume offset)
+     */
+    void begin(uint32_t nowUs, uint32_t bytes, uint32_t total);
+
+    /**
+     * @brief Bytes done so far (not the increment) at nowUs
+     */
+    void update(uint32_t nowUs, uint32_t bytes);
+
+    /**
+     * @brief Recent rate in bytes/s (the moving average); 0 until the first update
+     */
+    uint32_t rate() const;
+
+    /**
+     * @brief Bytes/s since begin()
+     */
+    uint32_t averageRate() const;
+
+    /**
+     * @brief Remaining bytes at the recent rate, in ms; 0 once done
+     */
+    uint32_t etaMs() const;
+
+    uint32_t bytes() const { return lastBytes; }
+    uint32_t total() const { return totalBytes; }
+
+   private:
+    float tauUs;
+    float ewma = 0;
+    float weight = 0;  // Share of the average filled so far; rate() divides it out
+    uint32_t startUs = 0;
+    uint32_t startBytes = 0;
+    uint32_t lastUs = 0;
+    uint32_t lastBytes = 0;
+    uint32_t totalBytes = 0;
+};
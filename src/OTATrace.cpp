@@ -0,0 +1,78 @@
+// OTATrace.cpp
+#include "OTATrace.h"
+
+#if OTA_TRACE_ENABLED
+static void putLE32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+#endif
+
+size_t OTATrace::dump(uint8_t* buffer, size_t len, size_t offset) const {
+#if OTA_TRACE_ENABLED
+    uint32_t total = head.load(std::memory_order_relaxed);
+    uint32_t count = total < OTA_TRACE_EVENTS ? total : OTA_TRACE_EVENTS;
+    size_t size = HEADER_SIZE + (size_t)count * RECORD_SIZE;
+    if (!buffer || offset >= size) {
+        return 0;
+    }
+    if (len > size - offset) {
+        len = size - offset;
+    }
+
+    // Build the header or record holding each position, oldest record first
+    uint8_t unit[RECORD_SIZE];
+    size_t unitStart = SIZE_MAX;
+    for (size_t i = 0; i < len; i++) {
+        size_t pos = offset + i;
+        size_t start = pos < HEADER_SIZE ? 0 : pos - (pos - HEADER_SIZE) % RECORD_SIZE;
+        if (start != unitStart) {
+            unitStart = start;
+            if (start == 0) {
+                unit[0] = 'O';
+                unit[1] = 'T';
+                unit[2] = 'R';
+                unit[3] = VERSION;
+                putLE32(unit + 4, total);
+            } else {
+                uint32_t slot = (total - count + (uint32_t)((start - HEADER_SIZE) / RECORD_SIZE)) %
+                                OTA_TRACE_EVENTS;
+                putLE32(unit, times[slot].load(std::memory_order_relaxed));
+                putLE32(unit + 4, words[slot].load(std::memory_order_relaxed));
+            }
+        }
+        buffer[i] = unit[pos - start];
+    }
+    return len;
+#else
+    (void)buffer;
+    (void)len;
+    (void)offset;
+    return 0;
+#endif
+}
+
+size_t OTATrace::dumpSize() const {
+#if OTA_TRACE_ENABLED
+    uint32_t total = head.load(std::memory_order_relaxed);
+    return HEADER_SIZE + (size_t)(total < OTA_TRACE_EVENTS ? total : OTA_TRACE_EVENTS) * RECORD_SIZE;
+#else
+    return 0;
+#endif
+}
+
+void OTATrace::clear() {
+#if OTA_TRACE_ENABLED
+    head.store(0, std::memory_order_relaxed);
+#endif
+}
+
+uint32_t OTATrace::recorded() const {
+#if OTA_TRACE_ENABLED
+    return head.load(std::memory_order_relaxed);
+#else
+    return 0;
+#endif
+}
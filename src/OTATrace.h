@@ -0,0 +1,91 @@
+/**
+ * @file OTATrace.h
+ * @brief Bounded binary trace of OTA session events
+ *
+ * @details A failed update in the field usually leaves one log line behind.
+ * The trace keeps the last OTA_TRACE_EVENTS events (invite, login, first byte,
+ * every OTA_TRACE_CHUNK_INTERVAL-th chunk, sector erases, stalls, end or
+ * error) with their micros() timestamps in a static ring, so the timeline that
+ * led to the failure can be dumped afterwards. A record is 8 bytes; recording
+ * claims a slot with one atomic increment and may run from any task. With
+ * OTA_TRACE_ENABLED set to 0 the ring holds nothing and record() compiles away.
+ *
+ * Dump format (little-endian): "OTR" and a version byte, the number of events
+ * recorded since the last clear (older ones were overwritten when it exceeds
+ * the capacity), then the records oldest first: 32-bit micros() timestamp,
+ * then a 32-bit word holding the event in the top 8 bits and its argument in
+ * the low 24. test/host/TraceDecoder.cpp turns a dump into timelines.
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include <atomic>
+
+#include "OTAManagerConfig.h"
+
+// Events and what their 24-bit argument holds
+enum OTATraceEvent : uint8_t {
+    OTA_TRACE_INVITE = 1,    // Listener invite accepted for parsing; image size
+    OTA_TRACE_AUTH_OK,       // Password check passed (or none set); resume offset
+    OTA_TRACE_CONNECTED,     // TCP connection to the uploader open; resume offset
+    OTA_TRACE_START,         // Session started (any mode); image size, 0 if unknown
+    OTA_TRACE_FIRST_BYTE,    // First progress past the start; bytes
+    OTA_TRACE_CHUNK,         // Every OTA_TRACE_CHUNK_INTERVAL-th progress report; bytes
+    OTA_TRACE_ERASE_START,   // Flash write that erases a sector; offset
+    OTA_TRACE_ERASE_END,     // Same write done; offset
+    OTA_TRACE_STALL,         // A read waited OTA_TRACE_STALL_MS or longer; milliseconds
+    OTA_TRACE_END,           // Session completed; bytes
+    OTA_TRACE_ERROR,         // Error reported; ota_error_t
+};
+
+class OTATrace {
+   public:
+    static const uint8_t VERSION = 1;
+    static const size_t HEADER_SIZE = 8;
+    static const size_t RECORD_SIZE = 8;
+    static const uint32_t ARG_MAX = 0xFFFFFF;
+
+    // Largest dump: header plus a full ring
+    static const size_t DUMP_SIZE = HEADER_SIZE + RECORD_SIZE * OTA_TRACE_EVENTS;
+
+#if OTA_TRACE_ENABLED
+    void record(OTATraceEvent event, uint32_t arg, uint32_t timeUs) {
+        uint32_t slot = head.fetch_add(1, std::memory_order_relaxed) % OTA_TRACE_EVENTS;
+        times[slot].store(timeUs, std::memory_order_relaxed);
+        words[slot].store((uint32_t)event << 24 | (arg < ARG_MAX ? arg : ARG_MAX),
+                          std::memory_order_relaxed);
+    }
+#else
+    void record(OTATraceEvent, uint32_t, uint32_t) {}
+#endif
+
+    void record(OTATraceEvent event, uint32_t arg) { record(event, arg, micros()); }
+
+    /**
+     * @brief Copy part of the trace in the dump format
+     *
+     * Copies bytes [offset, offset + len) of the dump, so it can be taken in
+     * pieces (each piece reads the ring again). A record written by another task
+     * meanwhile may come out half updated; dump after the session for a
+     * consistent trace.
+     *
+     * @return Bytes copied; 0 past the end, or when the trace is compiled out
+     */
+    size_t dump(uint8_t* buffer, size_t len, size_t offset = 0) const;
+
+    // Size of the whole dump: the header and the records the ring still holds
+    size_t dumpSize() const;
+
+    void clear();
+
+    // Events recorded since the last clear, including overwritten ones
+    uint32_t recorded() const;
+
+#if OTA_TRACE_ENABLED
+   private:
+    std::atomic<uint32_t> head{0};
+    std::atomic<uint32_t> times[OTA_TRACE_EVENTS] = {};
+    std::atomic<uint32_t> words[OTA_TRACE_EVENTS] = {};
+#endif
+};
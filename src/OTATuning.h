@@ -0,0 +1,38 @@
+/**
+ * @file OTATuning.h
+ * @brief Data path tuning for the listener-mode receiver
+ *
+ * @details Defaults come from OTAManagerConfig.h. Values passed to
+ * OTAManager::initialize() are clamped to the OTA_*_MIN/MAX bounds and then
+ * shrunk, if necessary, until the per-session allocations fit the free heap
+ * minus OTA_TUNING_HEAP_RESERVE. OTAManager::getTuning() returns the values
+ * actually in effect.
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include "OTAManagerConfig.h"
+
+struct OTATuning {
+    // Largest single socket read, and therefore the acknowledgement granularity
+    uint32_t chunkSize = OTA_RECEIVE_CHUNK_SIZE;
+
+    // SO_RCVBUF for the data connection (0 = keep the TCP/IP stack default)
+    uint32_t socketRxBuffer = OTA_SOCKET_RX_BUFFER;
+
+    // Size and number of the receive/flash-write pipeline buffers
+    uint32_t pipelineBufferSize = OTA_PIPELINE_BUFFER_SIZE;
+    uint8_t pipelineBuffers = OTA_PIPELINE_BUFFERS;
+
+    // Time without data before a transfer is aborted with OTA_RECEIVE_ERROR
+    uint32_t receiveTimeoutMs = OTA_RECEIVE_TIMEOUT_MS;
+
+    /**
+     * @brief Heap needed while an update runs with these settings
+     */
+    uint32_t sessionHeapBytes() const {
+        return chunkSize + socketRxBuffer + pipelineBufferSize * pipelineBuffers +
+               OTA_PIPELINE_WRITER_STACK;
+    }
+};
@@ -0,0 +1,76 @@
+// OTAUdpProbe.cpp
+#include "OTAUdpProbe.h"
+
+#if defined(ESP32)
+    #include <lwip/sockets.h>
+// lwIP numbers its sockets from LWIP_SOCKET_OFFSET
+static const int firstSocket = LWIP_SOCKET_OFFSET;
+static const int socketCount = CONFIG_LWIP_MAX_SOCKETS;
+#else
+    #include <netinet/in.h>
+    #include <sys/select.h>
+    #include <sys/socket.h>
+static const int firstSocket = 0;
+static const int socketCount = FD_SETSIZE;
+#endif
+
+static int waitReadable(int sock, uint32_t timeoutMs) {
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    FD_SET(sock, &readSet);
+    struct timeval tv;
+    tv.tv_sec = timeoutMs / 1000;
+    tv.tv_usec = (timeoutMs % 1000) * 1000;
+    return select(sock + 1, &readSet, nullptr, nullptr, &tv);
+}
+
+bool OTAUdpProbe::boundTo(int fd, uint16_t port) {
+    int type = 0;
+    socklen_t typeLen = sizeof(type);
+    if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &typeLen) != 0 || type != SOCK_DGRAM) {
+        return false;
+    }
+    struct sockaddr_storage addr = {};
+    socklen_t addrLen = sizeof(addr);
+    if (getsockname(fd, (struct sockaddr*)&addr, &addrLen) != 0) {
+        return false;
+    }
+    if (addr.ss_family == AF_INET) {
+        return ntohs(((struct sockaddr_in*)&addr)->sin_port) == port;
+    }
+#if !defined(ESP32) || LWIP_IPV6
+    if (addr.ss_family == AF_INET6) {
+        return ntohs(((struct sockaddr_in6*)&addr)->sin6_port) == port;
+    }
+#endif
+    return false;
+}
+
+bool OTAUdpProbe::attach(uint16_t port) {
+    detach();
+    this->port = port;
+    for (int fd = firstSocket; fd < firstSocket + socketCount; fd++) {
+        if (boundTo(fd, port)) {
+            sock.store(fd, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool OTAUdpProbe::pending() {
+    int fd = sock.load(std::memory_order_relaxed);
+    if (fd < 0) {
+        return false;
+    }
+    if (!boundTo(fd, port)) {
+        detach();  // Closed, and perhaps reused for another socket
+        return false;
+    }
+    return waitReadable(fd, 0) > 0;
+}
+
+bool OTAUdpProbe::wait(uint32_t timeoutMs) const {
+    int fd = sock.load(std::memory_order_relaxed);
+    return fd < 0 || waitReadable(fd, timeoutMs) != 0;
+}
@@ -0,0 +1,51 @@
+/**
+ * @file OTAUdpProbe.h
+ * @brief Tells whether a datagram is waiting on ArduinoOTA's UDP socket
+ *
+ * @details ArduinoOTA keeps its WiFiUDP private and has no state accessor, so
+ * handleUpdates() cannot ask it whether an invite or login came in. The socket
+ * is an ordinary (lwIP or POSIX) descriptor though: attach() finds the UDP
+ * socket (IPv4 or IPv6) bound to the OTA port among the open descriptors, and
+ * pending() is then a select() with no timeout. The datagram stays queued for
+ * handle() to read.
+ *
+ * pending() checks first that the descriptor is still a datagram socket on the
+ * port and detaches if not, so a descriptor number reused after
+ * ArduinoOTA.end() is never mistaken for it. The owner attaches again while
+ * detached. attach(), detach() and pending() run under OTAManager's mutex;
+ * wait() may run on another task, and at worst sees a closed descriptor.
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include <atomic>
+
+class OTAUdpProbe {
+   public:
+    /**
+     * @brief Find the UDP socket bound to port
+     * @return false if there is none (ArduinoOTA not started, or no network stack yet)
+     */
+    bool attach(uint16_t port);
+
+    void detach() { sock.store(-1, std::memory_order_relaxed); }
+    bool attached() const { return sock.load(std::memory_order_relaxed) >= 0; }
+
+    /**
+     * @brief A datagram is waiting; false while detached or once the socket is gone
+     */
+    bool pending();
+
+    /**
+     * @brief Block until a datagram arrives or timeoutMs passes
+     * @return true if a datagram is waiting (or the socket failed); false on timeout
+     */
+    bool wait(uint32_t timeoutMs) const;
+
+   private:
+    static bool boundTo(int fd, uint16_t port);
+
+    std::atomic<int> sock{-1};
+    uint16_t port = 0;
+};
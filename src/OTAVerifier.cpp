@@ -0,0 +1,126 @@
+// OTAVerifier.cpp
+#include "OTAVerifier.h"
+
+// esp_image_header_t: magic, segment count, flash settings, entry point, then the
+// extended header whose last byte is hash_appended
+static const size_t imageHeaderSize = 24;
+static const uint8_t imageMagic = 0xE9;
+static const uint8_t maxSegments = 16;   // ESP_IMAGE_MAX_SEGMENTS
+static const size_t segmentHeaderSize = 8;  // Load address, data length
+static const uint32_t maxSegmentLength = 16 * 1024 * 1024;
+
+void OTAVerifier::begin(bool appImage) {
+    sha.begin();
+    stage = appImage ? IMAGE_HEADER : UNCHECKED;
+    error = nullptr;
+    pos = 0;
+    next = imageHeaderSize;
+    segmentsLeft = 0;
+}
+
+bool OTAVerifier::fail(const char* msg) {
+    if (!error) {
+        error = msg;
+    }
+    stage = FAILED;
+    return false;
+}
+
+bool OTAVerifier::write(const uint8_t* data, size_t len) {
+    if (stage == FAILED) {
+        return false;
+    }
+    while (len > 0) {
+        // Spans end at stage boundaries so the appended digest covers exactly the body
+        size_t n = parsing() && next - pos < len ? next - pos : len;
+        if (stage == IMAGE_HEADER || stage == SEGMENT_HEADER || stage == APPENDED_DIGEST) {
+            size_t fieldStart = stage == IMAGE_HEADER     ? 0
+                                : stage == SEGMENT_HEADER ? next - segmentHeaderSize
+                                                          : next - OTASha256::DIGEST_SIZE;
+            memcpy(field + (pos - fieldStart), data, n);
+        }
+        sha.update(data, n);
+        pos += n;
+        data += n;
+        len -= n;
+        while (parsing() && pos == next) {
+            if (!advance()) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool OTAVerifier::advance() {
+    switch (stage) {
+        case IMAGE_HEADER:
+            if (field[0] != imageMagic || field[23] != 1) {
+                stage = UNCHECKED;
+#if OTA_SHA256_REQUIRED
+                return fail("image has no appended SHA-256");
+#else
+                OTAM_LOG_D("Verify: no appended SHA-256, checking the stream digest only");
+                return true;
+#endif
+            }
+            if (field[1] == 0 || field[1] > maxSegments) {
+                return fail("bad segment count in image header");
+            }
+            segmentsLeft = field[1];
+            stage = SEGMENT_HEADER;
+            next = pos + segmentHeaderSize;
+            return true;
+
+        case SEGMENT_HEADER: {
+            uint32_t segmentLength = (uint32_t)field[4] | ((uint32_t)field[5] << 8) |
+                                     ((uint32_t)field[6] << 16) | ((uint32_t)field[7] << 24);
+            if (segmentLength > maxSegmentLength) {
+                return fail("bad segment length in image");
+            }
+            stage = SEGMENT_DATA;
+            next = pos + segmentLength;
+            return true;
+        }
+
+        case SEGMENT_DATA:
+            if (--segmentsLeft > 0) {
+                stage = SEGMENT_HEADER;
+                next = pos + segmentHeaderSize;
+            } else {
+                // A checksum byte follows the segments, padded to a 16 byte boundary
+                stage = PADDING;
+                next = (pos + 1 + 15) & ~(size_t)15;
+            }
+            return true;
+
+        case PADDING:
+            sha.peek(bodyDigest);
+            stage = APPENDED_DIGEST;
+            next = pos + OTASha256::DIGEST_SIZE;
+            return true;
+
+        case APPENDED_DIGEST:
+            if (memcmp(field, bodyDigest, sizeof(bodyDigest)) != 0) {
+                return fail("SHA-256 mismatch");
+            }
+            OTAM_LOG_D("Verify: appended SHA-256 matches at %u bytes", (unsigned)pos);
+            stage = VERIFIED;  // Anything after it (e.g. a signature block) is not covered
+            return true;
+
+        default:
+            return true;
+    }
+}
+
+bool OTAVerifier::finish(uint8_t* digest) {
+    if (parsing() && stage != IMAGE_HEADER) {
+        fail("image ends before its SHA-256");
+    } else if (stage == IMAGE_HEADER && OTA_SHA256_REQUIRED) {
+        fail("image too short");
+    }
+    if (digest) {
+        sha.finish(digest);
+    }
+    return stage != FAILED;
+}
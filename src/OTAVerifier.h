@@ -0,0 +1,79 @@
+/**
+ * @file OTAVerifier.h
+ * @brief Streaming SHA-256 verification of the image being written
+ *
+ * @details Hashes every image byte in place as it goes to flash (on the flash
+ * writer task when the pipeline runs, so alongside the receive stream) and
+ * follows the ESP app image layout while doing so: image header, segment
+ * headers and lengths, checksum padding and the SHA-256 that ESP-IDF appends
+ * when `hash_appended` is set. A malformed header fails at once; the appended
+ * digest is compared as soon as it arrives, before the image is finalised. The
+ * digest of the whole stream is also available for a digest sent by the
+ * uploader.
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include "OTAManagerConfig.h"
+#include "OTASha256.h"
+
+class OTAVerifier {
+   public:
+    /**
+     * @brief Reset for a new image
+     *
+     * @param appImage Parse the ESP app image layout and check its appended digest
+     */
+    void begin(bool appImage);
+
+    /**
+     * @brief Hash the next piece of the image
+     *
+     * @return false once the image is known to be bad
+     */
+    bool write(const uint8_t* data, size_t len);
+
+    /**
+     * @brief End of the image; checks nothing is missing
+     *
+     * @param digest Receives the SHA-256 of everything written (may be nullptr)
+     * @return false if the image is bad, or ended before its appended digest
+     */
+    bool finish(uint8_t* digest);
+
+    /**
+     * @brief True once the appended SHA-256 has matched
+     */
+    bool isAppDigestVerified() const { return stage == VERIFIED; }
+    bool hasFailed() const { return stage == FAILED; }
+    const char* errorString() const { return error; }
+
+    size_t totalBytes() const { return pos; }
+
+   private:
+    enum Stage {
+        IMAGE_HEADER,
+        SEGMENT_HEADER,
+        SEGMENT_DATA,
+        PADDING,
+        APPENDED_DIGEST,
+        UNCHECKED,  // Not an app image with an appended digest, or past it
+        VERIFIED,
+        FAILED
+    };
+
+    bool fail(const char* msg);
+    bool advance();
+    bool parsing() const { return stage <= APPENDED_DIGEST; }
+
+    OTASha256 sha;
+    Stage stage = UNCHECKED;
+    const char* error = nullptr;
+
+    size_t pos = 0;   // Bytes hashed
+    size_t next = 0;  // Where the current stage ends
+    uint8_t field[OTASha256::DIGEST_SIZE];
+    uint8_t segmentsLeft = 0;
+    uint8_t bodyDigest[OTASha256::DIGEST_SIZE];
+};
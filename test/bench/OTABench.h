@@ -0,0 +1,223 @@
+/**
+ * @file OTABench.h
+ * @brief Microbenchmark harness for the device and the host build
+ *
+ * @details Runs one operation from N FreeRTOS tasks (pthreads on the host) for a
+ * fixed number of iterations per task. Each task first runs a warm-up, waits at
+ * a start barrier, then times its iterations in batches of OTA_BENCH_BATCH calls
+ * into its own sample array: nothing is shared while the clock runs, so the
+ * figures are those of the operation, not of the harness. The per-call times
+ * (batch time / batch size) of all tasks give the percentiles; the wall time
+ * from the barrier to the last task finishing gives the throughput.
+ *
+ * Results are compared with a baseline table (OTABenchBaselines.h); a result
+ * whose median or throughput is more than OTA_BENCH_TOLERANCE times worse is a
+ * regression. Header-only, so the device and the host test include it directly.
+ */
+#pragma once
+
+#include <Arduino.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#if !defined(ESP32)
+    #include <time.h>
+#endif
+
+#ifndef OTA_BENCH_BATCH
+#define OTA_BENCH_BATCH 64
+#endif
+
+// Slowdown against the baseline that counts as a regression
+#ifndef OTA_BENCH_TOLERANCE
+#define OTA_BENCH_TOLERANCE 3.0f
+#endif
+
+#ifndef OTA_BENCH_TASK_STACK
+#define OTA_BENCH_TASK_STACK 4096
+#endif
+
+// The operation under test; i counts the calls of one task from 0
+typedef void (*OTABenchOp)(uint32_t i);
+
+struct OTABenchResult {
+    const char* name;
+    int tasks;
+    uint32_t iterations;  // Per task, warm-up excluded
+    float callsPerSecond; // All tasks together
+    uint32_t p50Ns;
+    uint32_t p90Ns;
+    uint32_t p99Ns;
+    uint32_t maxNs;
+};
+
+struct OTABenchBaseline {
+    const char* name;
+    int tasks;
+    uint32_t p50Ns;
+    float callsPerSecond;
+};
+
+// Nanoseconds from a free-running clock: the cycle counter of the calling core on
+// the ESP32, a monotonic clock on the host
+static inline uint64_t otaBenchNowNs() {
+#if defined(ESP32)
+    static const uint32_t mhz = ESP.getCpuFreqMHz();
+    return (uint64_t)ESP.getCycleCount() * 1000 / mhz;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+namespace otabench {
+
+// One per task, padded so tasks never write to the same cache line
+struct alignas(64) Slot {
+    OTABenchOp op;
+    uint32_t iterations;
+    uint32_t warmup;
+    uint32_t* samples;  // ns per call, one per batch
+    uint64_t endNs;
+};
+
+struct Run {
+    std::atomic<int> ready{0};
+    std::atomic<bool> go{false};
+    std::atomic<int> done{0};
+};
+
+static Run* currentRun = nullptr;
+
+static void task(void* pvParameters) {
+    Slot* slot = static_cast<Slot*>(pvParameters);
+    for (uint32_t i = 0; i < slot->warmup; i++) {
+        slot->op(i);
+    }
+    currentRun->ready.fetch_add(1);
+    while (!currentRun->go.load(std::memory_order_acquire)) {
+        taskYIELD();
+    }
+    uint32_t i = slot->warmup;
+    uint32_t batches = slot->iterations / OTA_BENCH_BATCH;
+    for (uint32_t b = 0; b < batches; b++) {
+        uint64_t start = otaBenchNowNs();
+        for (uint32_t end = i + OTA_BENCH_BATCH; i < end; i++) {
+            slot->op(i);
+        }
+        slot->samples[b] = (uint32_t)((otaBenchNowNs() - start + OTA_BENCH_BATCH / 2) / OTA_BENCH_BATCH);
+    }
+    slot->endNs = otaBenchNowNs();
+    currentRun->done.fetch_add(1);
+    vTaskDelete(NULL);
+}
+
+static uint32_t percentile(const std::vector<uint32_t>& sorted, float fraction) {
+    size_t rank = (size_t)(fraction * (sorted.size() - 1) + 0.5f);
+    return sorted[rank];
+}
+
+}  // namespace otabench
+
+/**
+ * @brief Time op from `tasks` tasks, `iterations` calls each after a warm-up
+ *
+ * iterations is rounded down to whole batches. Tasks are spread over the cores
+ * at priority 1; the caller waits in vTaskDelay() until they are done.
+ */
+static inline OTABenchResult otaBenchRun(const char* name, OTABenchOp op, int tasks, uint32_t iterations,
+                                         uint32_t warmup) {
+    using namespace otabench;
+    uint32_t batches = iterations / OTA_BENCH_BATCH;
+    std::vector<Slot> slots(tasks);
+    std::vector<uint32_t> samples((size_t)tasks * batches);
+    Run run;
+    currentRun = &run;
+    for (int t = 0; t < tasks; t++) {
+        slots[t] = {op, batches * OTA_BENCH_BATCH, warmup, samples.data() + (size_t)t * batches, 0};
+        xTaskCreatePinnedToCore(task, "OTABench", OTA_BENCH_TASK_STACK, &slots[t], 1, NULL,
+                                t % portNUM_PROCESSORS);
+    }
+    while (run.ready.load() < tasks) {
+        vTaskDelay(1);
+    }
+    uint64_t startNs = otaBenchNowNs();
+    run.go.store(true, std::memory_order_release);
+    while (run.done.load() < tasks) {
+        vTaskDelay(1);
+    }
+    currentRun = nullptr;
+
+    // The cycle counters of the two cores are not aligned, so on the device the wall
+    // time is taken on this core, up to when the last task was seen done
+    uint64_t elapsedNs = otaBenchNowNs() - startNs;
+#if !defined(ESP32)
+    uint64_t lastEnd = startNs;
+    for (const Slot& s : slots) {
+        lastEnd = std::max(lastEnd, s.endNs);
+    }
+    elapsedNs = lastEnd - startNs;
+#endif
+
+    std::sort(samples.begin(), samples.end());
+    OTABenchResult r;
+    r.name = name;
+    r.tasks = tasks;
+    r.iterations = batches * OTA_BENCH_BATCH;
+    r.callsPerSecond = elapsedNs ? (float)((double)tasks * r.iterations * 1e9 / elapsedNs) : 0;
+    r.p50Ns = samples.empty() ? 0 : otabench::percentile(samples, 0.50f);
+    r.p90Ns = samples.empty() ? 0 : otabench::percentile(samples, 0.90f);
+    r.p99Ns = samples.empty() ? 0 : otabench::percentile(samples, 0.99f);
+    r.maxNs = samples.empty() ? 0 : samples.back();
+    return r;
+}
+
+static inline void otaBenchPrintHeader() {
+    printf("  %-28s %5s %14s %9s %9s %9s %9s\n", "benchmark", "tasks", "calls/s", "p50 ns", "p90 ns",
+           "p99 ns", "max ns");
+}
+
+// Outcome of comparing a result with the baseline table
+enum OTABenchVerdict {
+    OTA_BENCH_OK,
+    OTA_BENCH_REGRESSION,  // Median or throughput more than OTA_BENCH_TOLERANCE times worse
+    OTA_BENCH_NO_BASELINE  // No entry for this case and task count
+};
+
+/**
+ * @brief Print a result and compare it with its baseline
+ *
+ * @return OTA_BENCH_REGRESSION if the median or the throughput is more than
+ * OTA_BENCH_TOLERANCE times worse than the baseline, OTA_BENCH_NO_BASELINE if
+ * the table has no entry for the case
+ */
+static inline OTABenchVerdict otaBenchCheck(const OTABenchResult& r, const OTABenchBaseline* baselines, size_t count) {
+    printf("  %-28s %5d %14.0f %9u %9u %9u %9u", r.name, r.tasks, r.callsPerSecond, (unsigned)r.p50Ns,
+           (unsigned)r.p90Ns, (unsigned)r.p99Ns, (unsigned)r.maxNs);
+    for (size_t i = 0; i < count; i++) {
+        const OTABenchBaseline& b = baselines[i];
+        if (strcmp(b.name, r.name) != 0 || b.tasks != r.tasks) {
+            continue;
+        }
+        // The median is in whole nanoseconds; allow one for operations that take a few
+        bool slower = r.p50Ns > (b.p50Ns + 1) * OTA_BENCH_TOLERANCE;
+        bool fewer = r.callsPerSecond * OTA_BENCH_TOLERANCE < b.callsPerSecond;
+        printf("  (baseline p50 %u ns, %.0f calls/s)%s\n", (unsigned)b.p50Ns, b.callsPerSecond,
+               slower || fewer ? "  REGRESSION" : "");
+        return slower || fewer ? OTA_BENCH_REGRESSION : OTA_BENCH_OK;
+    }
+    printf("  (NO BASELINE)\n");
+    return OTA_BENCH_NO_BASELINE;
+}
+
+// Print results as baseline table entries, to paste into OTABenchBaselines.h
+static inline void otaBenchPrintBaselines(const OTABenchResult* results, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        printf("    {\"%s\", %d, %u, %.0f},\n", results[i].name, results[i].tasks, (unsigned)results[i].p50Ns,
+               results[i].callsPerSecond);
+    }
+}
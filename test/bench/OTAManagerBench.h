@@ -0,0 +1,215 @@
+/**
+ * @file OTAManagerBench.h
+ * @brief OTAManager benchmark cases, shared by test_bench.cpp and test_native_bench.cpp
+ *
+ * @details Each case runs with 1 and 4 tasks and is checked against the
+ * baselines for the platform; a case without a baseline fails unless
+ * OTA_BENCH_RECORD is set. The last test prints the results as baseline
+ * entries; after an intended change in speed, paste them into
+ * OTABenchBaselines.h.
+ */
+#pragma once
+
+#include <OTAManager.h>
+#include <unity.h>
+
+#include "OTABench.h"
+#include "OTABenchBaselines.h"
+
+// Calls per task, and warm-up calls before the clock starts
+#ifndef OTA_BENCH_ITERATIONS
+    #if defined(ESP32)
+        #define OTA_BENCH_ITERATIONS 20000
+    #else
+        #define OTA_BENCH_ITERATIONS 200000
+    #endif
+#endif
+
+#ifndef OTA_BENCH_WARMUP
+#define OTA_BENCH_WARMUP (OTA_BENCH_ITERATIONS / 10)
+#endif
+
+#ifndef OTA_BENCH_PORT
+#define OTA_BENCH_PORT 3232
+#endif
+
+// Recording run for a platform without baselines: a case with no entry is
+// ignored instead of failing, and the last test prints the entries to paste
+#ifndef OTA_BENCH_RECORD
+#define OTA_BENCH_RECORD 0
+#endif
+
+static OTABenchResult benchResults[16];
+static size_t benchResultCount = 0;
+
+static bool benchNetworkReady() {
+    return true;
+}
+
+static void benchHandleUpdates(uint32_t) {
+    OTAManager::handleUpdates();
+}
+
+static void benchIsInitialized(uint32_t) {
+    volatile bool initialized = OTAManager::isInitialized();
+    (void)initialized;
+}
+
+static void benchSetCallbacks(uint32_t i) {
+    switch (i & 3) {
+        case 0:
+            OTAManager::setStartCallback([]() {});
+            break;
+        case 1:
+            OTAManager::setEndCallback([]() {});
+            break;
+        case 2:
+            OTAManager::setProgressCallback([](unsigned int, unsigned int) {});
+            break;
+        default:
+            OTAManager::setErrorCallback([](ota_error_t) {});
+            break;
+    }
+}
+
+static void benchStartHandler(void*) {}
+static void benchEndHandler(void*) {}
+static void benchProgressNop(unsigned int, unsigned int, void*) {}
+static void benchErrorHandler(ota_error_t, void*) {}
+
+static void benchSetHandlers(uint32_t i) {
+    switch (i & 3) {
+        case 0:
+            OTAManager::setStartCallback(benchStartHandler, nullptr);
+            break;
+        case 1:
+            OTAManager::setEndCallback(benchEndHandler, nullptr);
+            break;
+        case 2:
+            OTAManager::setProgressCallback(benchProgressNop, nullptr);
+            break;
+        default:
+            OTAManager::setErrorCallback(benchErrorHandler, nullptr);
+            break;
+    }
+}
+
+// Runs the case with 1 and 4 tasks (up to maxTasks); fails the test on a regression
+// or a missing baseline
+static void benchCase(const char* name, OTABenchOp op, int maxTasks = 4) {
+    const int taskCounts[] = {1, 4};
+    bool ok = true;
+    bool unchecked = false;
+    otaBenchPrintHeader();
+    for (int tasks : taskCounts) {
+        if (tasks > maxTasks) {
+            continue;
+        }
+        OTABenchResult r = otaBenchRun(name, op, tasks, OTA_BENCH_ITERATIONS, OTA_BENCH_WARMUP);
+        OTABenchVerdict verdict = otaBenchCheck(r, otaBenchBaselines, otaBenchBaselineCount);
+        ok &= verdict != OTA_BENCH_REGRESSION;
+        unchecked |= verdict == OTA_BENCH_NO_BASELINE;
+        if (benchResultCount < sizeof(benchResults) / sizeof(benchResults[0])) {
+            benchResults[benchResultCount++] = r;
+        }
+    }
+    TEST_ASSERT_TRUE_MESSAGE(ok, "slower than the baseline (OTABenchBaselines.h)");
+    if (unchecked) {
+#if OTA_BENCH_RECORD
+        TEST_IGNORE_MESSAGE("no " OTA_BENCH_PLATFORM " baseline, recorded only");
+#else
+        TEST_FAIL_MESSAGE("no " OTA_BENCH_PLATFORM " baseline in OTABenchBaselines.h: "
+                          "record one with -D OTA_BENCH_RECORD=1");
+#endif
+    }
+}
+
+#if !defined(ESP32)
+// One chunk's progress report through OTAManager's session hook (statistics,
+// trace, then the application's handler), driven by the host ArduinoOTA
+static void benchProgressHook(uint32_t i) {
+    ArduinoOTA.emitProgress(1460 * (i + 1), 0xFFFFFFFF);
+}
+
+static volatile uint32_t benchProgressSeen = 0;
+
+static void benchProgressHandler(unsigned int progress, unsigned int, void* context) {
+    *static_cast<volatile uint32_t*>(context) = progress;
+}
+#endif
+
+void test_bench_idle() {
+    // Before initialize() both return after an atomic load
+    TEST_ASSERT_FALSE(OTAManager::isInitialized());
+    benchCase("handleUpdates/idle", benchHandleUpdates);
+    benchCase("isInitialized", benchIsInitialized);
+}
+
+void test_bench_polling() {
+    OTAManager::initialize("ota-bench", "", OTA_BENCH_PORT, benchNetworkReady);
+    TEST_ASSERT_TRUE(OTAManager::isInitialized());
+    benchCase("handleUpdates/polling", benchHandleUpdates);
+}
+
+void test_bench_callback_setters() {
+    benchCase("set*Callback", benchSetCallbacks);
+    benchCase("set*Callback(fn, context)", benchSetHandlers);
+}
+
+void test_bench_progress_callback() {
+#if defined(ESP32)
+    TEST_IGNORE_MESSAGE("ArduinoOTA cannot be driven without a transfer on the device");
+#else
+    // The hook is single-threaded in a session, so one task. The std::function
+    // captures more than fits its inline buffer, as capturing lambdas often do
+    volatile uint32_t* seen = &benchProgressSeen;
+    uint32_t a = 1, b = 2, c = 3;
+    ArduinoOTA.emitStart();
+    OTAManager::setProgressCallback([seen, a, b, c](unsigned int progress, unsigned int) {
+        *seen = progress + a + b + c - 6;
+    });
+    benchCase("progress/std::function", benchProgressHook, 1);
+    OTAManager::setProgressCallback(benchProgressHandler, (void*)&benchProgressSeen);
+    benchCase("progress/function+context", benchProgressHook, 1);
+    ArduinoOTA.emitError(OTA_RECEIVE_ERROR);  // Closes the session
+    TEST_ASSERT_NOT_EQUAL(0, benchProgressSeen);
+#endif
+}
+
+void test_bench_progress_subscribers() {
+#if defined(ESP32)
+    TEST_IGNORE_MESSAGE("ArduinoOTA cannot be driven without a transfer on the device");
+#else
+    // A full table on top of the handler above: with filters no report passes
+    // after the first, then with none, so that every subscriber gets every report
+    int ids[OTA_SUBSCRIBERS_MAX];
+    for (uint32_t minBytes : {0x80000000u, 0u}) {
+        for (int& id : ids) {
+            id = OTAManager::subscribe({nullptr, benchProgressHandler, nullptr, nullptr,
+                                        (void*)&benchProgressSeen, minBytes, 0});
+            TEST_ASSERT_TRUE(id >= 0);
+        }
+        ArduinoOTA.emitStart();
+        benchCase(minBytes ? "progress/subscribers not due" : "progress/subscribers all due", benchProgressHook,
+                  1);
+        ArduinoOTA.emitError(OTA_RECEIVE_ERROR);
+        for (int id : ids) {
+            OTAManager::unsubscribe(id);
+        }
+    }
+#endif
+}
+
+void test_bench_print_baselines() {
+    printf("Baseline entries for %s:\n", OTA_BENCH_PLATFORM);
+    otaBenchPrintBaselines(benchResults, benchResultCount);
+}
+
+static void runOTAManagerBenchmarks() {
+    RUN_TEST(test_bench_idle);
+    RUN_TEST(test_bench_polling);
+    RUN_TEST(test_bench_callback_setters);
+    RUN_TEST(test_bench_progress_callback);
+    RUN_TEST(test_bench_progress_subscribers);
+    RUN_TEST(test_bench_print_baselines);
+}
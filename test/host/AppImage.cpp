@@ -0,0 +1,58 @@
+// AppImage.cpp - ESP app image layout for host tests
+#include "AppImage.h"
+
+#include <string.h>
+
+#include "OTASha256.h"
+
+static void putLE32(std::vector<uint8_t>& out, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back((uint8_t)(v >> (8 * i)));
+    }
+}
+
+size_t appImageBodySize(const std::vector<uint8_t>& image) {
+    return image.size() - OTASha256::DIGEST_SIZE;
+}
+
+std::vector<uint8_t> makeAppImage(const std::vector<uint8_t>& payload, uint8_t segments) {
+    std::vector<uint8_t> image = {
+        0xE9, segments, 0x02, 0x20,  // Magic, segment count, DIO, 4 MB @ 40 MHz
+        0x18, 0x07, 0x08, 0x40,      // Entry point 0x40080718
+        0xEE, 0x00, 0x00, 0x00,      // WP pin, SPI pin drive
+        0x00, 0x00, 0x00, 0x00,      // Chip ID (ESP32), minimum revision
+        0x00, 0x00, 0x00, 0x00,      // Maximum revision, reserved
+        0x00, 0x00, 0x00, 0x01,      // Reserved, hash_appended
+    };
+
+    // Segments are word multiples; the last one takes the remainder
+    uint8_t checksum = 0xEF;
+    size_t share = (payload.size() / segments) & ~(size_t)3;
+    size_t offset = 0;
+    for (uint8_t i = 0; i < segments; i++) {
+        size_t len = i + 1 < segments ? share : payload.size() - offset;
+        size_t padded = (len + 3) & ~(size_t)3;
+        putLE32(image, 0x3F400020 + (uint32_t)offset);
+        putLE32(image, (uint32_t)padded);
+        for (size_t j = 0; j < padded; j++) {
+            uint8_t b = j < len ? payload[offset + j] : 0;
+            image.push_back(b);
+            checksum ^= b;
+        }
+        offset += len;
+    }
+
+    // Checksum in the last byte of a 16 byte block
+    while ((image.size() + 1) % 16 != 0) {
+        image.push_back(0);
+    }
+    image.push_back(checksum);
+
+    OTASha256 sha;
+    sha.begin();
+    sha.update(image.data(), image.size());
+    uint8_t digest[OTASha256::DIGEST_SIZE];
+    sha.finish(digest);
+    image.insert(image.end(), digest, digest + sizeof(digest));
+    return image;
+}
@@ -0,0 +1,20 @@
+/**
+ * @file AppImage.h
+ * @brief Host-side builder for ESP app images
+ *
+ * @details Wraps a payload in the layout the ESP-IDF bootloader expects: image
+ * header with `hash_appended` set, the payload split into segments, the
+ * checksum byte padded to a 16 byte boundary and the SHA-256 of all of that
+ * appended, exactly as `esptool.py elf2image` produces it.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+// Offset of the byte after the checksum padding (where the appended SHA-256 starts)
+size_t appImageBodySize(const std::vector<uint8_t>& image);
+
+std::vector<uint8_t> makeAppImage(const std::vector<uint8_t>& payload, uint8_t segments = 3);
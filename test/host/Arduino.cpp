@@ -0,0 +1,64 @@
+// Arduino.cpp - host implementation of the Arduino core subset
+#include "Arduino.h"
+
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <random>
+
+EspClass ESP;
+
+static uint64_t monotonicMicros() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static const uint64_t bootMicros = monotonicMicros();
+static std::atomic<uint64_t> advancedMicros{0};
+
+unsigned long millis() {
+    return (unsigned long)((monotonicMicros() - bootMicros + advancedMicros.load()) / 1000ULL);
+}
+
+unsigned long micros() {
+    return (unsigned long)(monotonicMicros() - bootMicros + advancedMicros.load());
+}
+
+void hostAdvanceMillis(unsigned long ms) {
+    advancedMicros += (uint64_t)ms * 1000ULL;
+}
+
+void delay(uint32_t ms) {
+    usleep((useconds_t)ms * 1000);
+}
+
+void delayMicroseconds(uint32_t us) {
+    usleep(us);
+}
+
+long random(long max) {
+    return random(0, max);
+}
+
+long random(long min, long max) {
+    if (max <= min) {
+        return min;
+    }
+    static thread_local std::mt19937 rng(std::random_device{}());
+    std::uniform_int_distribution<long> dist(min, max - 1);
+    return dist(rng);
+}
+
+void EspClass::restart() {
+    restartCount = restartCount + 1;
+}
+
+uint32_t EspClass::getFreeHeap() {
+    return freeHeap;
+}
+
+uint32_t EspClass::getMaxAllocHeap() {
+    return maxAllocHeap;
+}
@@ -0,0 +1,109 @@
+/**
+ * @file Arduino.h
+ * @brief Host (Linux) stand-in for the subset of the Arduino core used by OTAManager
+ *
+ * @details Only what the library and its host tests touch is provided: timing,
+ * a minimal String, IPAddress and the ESP system object. Everything is backed by
+ * POSIX/libstdc++ so the library can be built and benchmarked with platform = native.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#define OTA_HOST_BUILD 1
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+long random(long max);
+long random(long min, long max);
+
+// Host only: move millis() and micros() forward, for tests of interval logic
+void hostAdvanceMillis(unsigned long ms);
+
+/**
+ * @brief Minimal Arduino String backed by std::string
+ */
+class String {
+   public:
+    String() = default;
+    String(const char* s) : str(s ? s : "") {}
+    String(const std::string& s) : str(s) {}
+    explicit String(unsigned long v) : str(std::to_string(v)) {}
+
+    const char* c_str() const { return str.c_str(); }
+    unsigned int length() const { return str.length(); }
+    bool isEmpty() const { return str.empty(); }
+
+    String& operator+=(const String& rhs) { str += rhs.str; return *this; }
+    String& operator+=(const char* rhs) { str += rhs; return *this; }
+    String& operator+=(char c) { str += c; return *this; }
+    friend String operator+(const String& a, const String& b) { return String(a.str + b.str); }
+    bool operator==(const String& rhs) const { return str == rhs.str; }
+    bool operator!=(const String& rhs) const { return str != rhs.str; }
+    bool equals(const char* s) const { return str == s; }
+
+   private:
+    std::string str;
+};
+
+/**
+ * @brief IPv4 address value type
+ */
+class IPAddress {
+   public:
+    IPAddress() : addr(0) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+        : addr((uint32_t)a | ((uint32_t)b << 8) | ((uint32_t)c << 16) | ((uint32_t)d << 24)) {}
+    IPAddress(uint32_t raw) : addr(raw) {}
+
+    operator uint32_t() const { return addr; }
+    uint8_t operator[](int i) const { return (addr >> (8 * i)) & 0xFF; }
+    bool operator==(const IPAddress& rhs) const { return addr == rhs.addr; }
+    bool operator!=(const IPAddress& rhs) const { return addr != rhs.addr; }
+
+    String toString() const {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+        return String(buf);
+    }
+
+   private:
+    uint32_t addr;  // Network byte order, like the ESP32 core
+};
+
+/**
+ * @brief Host replacement for the ESP system object
+ *
+ * restart() does not terminate the process; it only records the request so tests
+ * can assert that an update completed the way the device would.
+ */
+class EspClass {
+   public:
+    void restart();
+    uint32_t getFreeHeap();
+    uint32_t getMaxAllocHeap();
+
+    // Host-only helpers
+    uint32_t getRestartCount() const { return restartCount; }
+    void clearRestartCount() { restartCount = 0; }
+    void setHeapForTest(uint32_t freeBytes, uint32_t maxAllocBytes) {
+        freeHeap = freeBytes;
+        maxAllocHeap = maxAllocBytes;
+    }
+
+   private:
+    volatile uint32_t restartCount = 0;
+    // Typical ESP32 figures; the host heap is effectively unbounded
+    uint32_t freeHeap = 200 * 1024;
+    uint32_t maxAllocHeap = 110 * 1024;
+};
+
+extern EspClass ESP;
@@ -0,0 +1,298 @@
+// ArduinoOTA.cpp - espota device protocol over POSIX sockets
+#include "ArduinoOTA.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "MD5Builder.h"
+#include "esp_log.h"
+
+ArduinoOTAClass ArduinoOTA;
+
+// Same receive granularity as the ESP32 core (one TCP MSS)
+static const size_t OTA_HOST_RX_CHUNK = 1460;
+
+ArduinoOTAClass& ArduinoOTAClass::setPort(uint16_t p) {
+    if (!initialized && p != 0) {
+        port = p;
+    }
+    return *this;
+}
+
+ArduinoOTAClass& ArduinoOTAClass::setHostname(const char* name) {
+    if (!initialized && name) {
+        hostname = name;
+    }
+    return *this;
+}
+
+ArduinoOTAClass& ArduinoOTAClass::setPassword(const char* password) {
+    if (state == OTA_IDLE && password) {
+        MD5Builder passmd5;
+        passmd5.begin();
+        passmd5.add(password);
+        passmd5.calculate();
+        passwordMD5 = passmd5.toString();
+    }
+    return *this;
+}
+
+ArduinoOTAClass& ArduinoOTAClass::setRebootOnSuccess(bool reboot) {
+    rebootOnSuccess = reboot;
+    return *this;
+}
+
+ArduinoOTAClass& ArduinoOTAClass::setTimeout(int ms) {
+    timeoutMs = ms;
+    return *this;
+}
+
+ArduinoOTAClass& ArduinoOTAClass::onStart(THandlerFunction fn) {
+    startCallback = fn;
+    return *this;
+}
+
+ArduinoOTAClass& ArduinoOTAClass::onEnd(THandlerFunction fn) {
+    endCallback = fn;
+    return *this;
+}
+
+ArduinoOTAClass& ArduinoOTAClass::onError(THandlerFunction_Error fn) {
+    errorCallback = fn;
+    return *this;
+}
+
+ArduinoOTAClass& ArduinoOTAClass::onProgress(THandlerFunction_Progress fn) {
+    progressCallback = fn;
+    return *this;
+}
+
+void ArduinoOTAClass::begin() {
+    if (initialized) {
+        // Matches the ESP32 core: a second begin() is ignored
+        return;
+    }
+    udpFd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (udpFd < 0) {
+        ESP_LOGE("ArduinoOTA", "udp socket failed: %d", errno);
+        return;
+    }
+    int yes = 1;
+    setsockopt(udpFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(udpFd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        ESP_LOGE("ArduinoOTA", "udp bind to %u failed: %d", port, errno);
+        close(udpFd);
+        udpFd = -1;
+        return;
+    }
+    fcntl(udpFd, F_SETFL, fcntl(udpFd, F_GETFL) | O_NONBLOCK);
+    state = OTA_IDLE;
+    initialized = true;
+}
+
+void ArduinoOTAClass::end() {
+    if (udpFd >= 0) {
+        close(udpFd);
+        udpFd = -1;
+    }
+    initialized = false;
+    state = OTA_IDLE;
+}
+
+void ArduinoOTAClass::sendUdp(const char* msg) {
+    struct sockaddr_in to = {};
+    to.sin_family = AF_INET;
+    to.sin_addr.s_addr = remoteAddr;
+    to.sin_port = htons(remoteUdpPort);
+    sendto(udpFd, msg, strlen(msg), 0, (struct sockaddr*)&to, sizeof(to));
+}
+
+void ArduinoOTAClass::handle() {
+    if (!initialized) {
+        return;
+    }
+    if (state == OTA_RUNUPDATE) {
+        runUpdate();
+        state = OTA_IDLE;
+    }
+    onRx();
+}
+
+void ArduinoOTAClass::onRx() {
+    char packet[256];
+    struct sockaddr_in from = {};
+    socklen_t fromLen = sizeof(from);
+    ssize_t n = recvfrom(udpFd, packet, sizeof(packet) - 1, 0, (struct sockaddr*)&from, &fromLen);
+    if (n <= 0) {
+        return;
+    }
+    packet[n] = '\0';
+
+    if (state == OTA_IDLE) {
+        int cmd = 0;
+        unsigned int clientPort = 0;
+        unsigned long imageSize = 0;
+        char imageMD5[64] = {0};
+        if (sscanf(packet, "%d %u %lu %63s", &cmd, &clientPort, &imageSize, imageMD5) != 4) {
+            return;
+        }
+        if ((cmd != U_FLASH && cmd != U_SPIFFS) || strlen(imageMD5) != 32) {
+            return;
+        }
+        command = cmd;
+        remoteAddr = from.sin_addr.s_addr;
+        remoteUdpPort = ntohs(from.sin_port);
+        remotePort = (uint16_t)clientPort;
+        size = imageSize;
+        memcpy(md5, imageMD5, 33);
+
+        if (passwordMD5.length()) {
+            MD5Builder nonceMd5;
+            nonceMd5.begin();
+            char seed[32];
+            snprintf(seed, sizeof(seed), "%lu-%ld", micros(), random(0x7FFFFFFF));
+            nonceMd5.add(seed);
+            nonceMd5.calculate();
+            nonce = nonceMd5.toString();
+            String reply = String("AUTH ") + nonce;
+            sendUdp(reply.c_str());
+            state = OTA_WAITAUTH;
+        } else {
+            sendUdp("OK");
+            state = OTA_RUNUPDATE;
+        }
+    } else if (state == OTA_WAITAUTH) {
+        int cmd = 0;
+        char cnonce[64] = {0};
+        char response[64] = {0};
+        if (sscanf(packet, "%d %63s %63s", &cmd, cnonce, response) != 3 || cmd != U_AUTH) {
+            state = OTA_IDLE;
+            return;
+        }
+        MD5Builder challenge;
+        challenge.begin();
+        challenge.add(passwordMD5 + ":" + nonce + ":" + String(cnonce));
+        challenge.calculate();
+        if (challenge.toString().equals(response)) {
+            sendUdp("OK");
+            state = OTA_RUNUPDATE;
+        } else {
+            sendUdp("Authentication Failed");
+            if (errorCallback) {
+                errorCallback(OTA_AUTH_ERROR);
+            }
+            state = OTA_IDLE;
+        }
+    }
+}
+
+void ArduinoOTAClass::runUpdate() {
+    if (!Update.begin(size, command)) {
+        ESP_LOGE("ArduinoOTA", "Begin ERROR: %s", Update.errorString());
+        if (errorCallback) {
+            errorCallback(OTA_BEGIN_ERROR);
+        }
+        return;
+    }
+    Update.setMD5(md5);
+
+    if (startCallback) {
+        startCallback();
+    }
+    if (progressCallback) {
+        progressCallback(0, size);
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = remoteAddr;
+    addr.sin_port = htons(remotePort);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (errorCallback) {
+            errorCallback(OTA_CONNECT_ERROR);
+        }
+        Update.abort();
+        return;
+    }
+    int yes = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+    static uint8_t buf[OTA_HOST_RX_CHUNK];
+    uint32_t total = 0;
+    int tried = 0;
+    size_t written = 0;
+    while (!Update.isFinished()) {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if (poll(&pfd, 1, timeoutMs) <= 0) {
+            if (written && tried++ < 3) {
+                // Re-send the last acknowledgement, exactly like the ESP32 core
+                char ack[16];
+                int len = snprintf(ack, sizeof(ack), "%u", (unsigned)written);
+                if (send(fd, ack, len, MSG_NOSIGNAL) != len) {
+                    break;
+                }
+                continue;
+            }
+            ESP_LOGE("ArduinoOTA", "Receive Failed");
+            if (errorCallback) {
+                errorCallback(OTA_RECEIVE_ERROR);
+            }
+            Update.abort();
+            close(fd);
+            return;
+        }
+        tried = 0;
+        ssize_t r = recv(fd, buf, sizeof(buf), 0);
+        if (r <= 0) {
+            // Peer closed before the image was complete
+            break;
+        }
+        written = Update.write(buf, (size_t)r);
+        if (written > 0) {
+            char ack[16];
+            int len = snprintf(ack, sizeof(ack), "%u", (unsigned)written);
+            send(fd, ack, len, MSG_NOSIGNAL);
+            total += written;
+            if (progressCallback) {
+                progressCallback(total, size);
+            }
+        } else {
+            ESP_LOGE("ArduinoOTA", "Write failed: %s", Update.errorString());
+            break;
+        }
+    }
+
+    if (Update.end()) {
+        send(fd, "OK", 2, MSG_NOSIGNAL);
+        close(fd);
+        delay(10);
+        if (endCallback) {
+            endCallback();
+        }
+        if (rebootOnSuccess) {
+            ESP.restart();
+        }
+    } else {
+        if (errorCallback) {
+            errorCallback(OTA_END_ERROR);
+        }
+        const char* err = Update.errorString();
+        send(fd, err, strlen(err), MSG_NOSIGNAL);
+        close(fd);
+        ESP_LOGE("ArduinoOTA", "Update ERROR: %s", err);
+    }
+}
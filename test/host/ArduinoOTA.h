@@ -0,0 +1,96 @@
+/**
+ * @file ArduinoOTA.h
+ * @brief Host stand-in for the ESP32 ArduinoOTA library over POSIX sockets
+ *
+ * @details Implements the device side of the espota protocol the same way the
+ * ESP32 core does: a UDP invite ("<cmd> <port> <size> <md5>"), optional MD5
+ * challenge authentication, then a TCP connection back to the uploader that is
+ * drained synchronously inside handle() into Update (and thus SimFlash).
+ */
+#pragma once
+
+#include <functional>
+
+#include "Arduino.h"
+#include "Update.h"
+
+typedef enum {
+    OTA_AUTH_ERROR,
+    OTA_BEGIN_ERROR,
+    OTA_CONNECT_ERROR,
+    OTA_RECEIVE_ERROR,
+    OTA_END_ERROR
+} ota_error_t;
+
+typedef enum { OTA_IDLE, OTA_WAITAUTH, OTA_RUNUPDATE } ota_state_t;
+
+class ArduinoOTAClass {
+   public:
+    typedef std::function<void(void)> THandlerFunction;
+    typedef std::function<void(ota_error_t)> THandlerFunction_Error;
+    typedef std::function<void(unsigned int, unsigned int)> THandlerFunction_Progress;
+
+    ArduinoOTAClass& setPort(uint16_t port);
+    ArduinoOTAClass& setHostname(const char* hostname);
+    String getHostname() const { return hostname; }
+    ArduinoOTAClass& setPassword(const char* password);
+    ArduinoOTAClass& setRebootOnSuccess(bool reboot);
+    ArduinoOTAClass& setTimeout(int timeoutMs);
+
+    ArduinoOTAClass& onStart(THandlerFunction fn);
+    ArduinoOTAClass& onEnd(THandlerFunction fn);
+    ArduinoOTAClass& onError(THandlerFunction_Error fn);
+    ArduinoOTAClass& onProgress(THandlerFunction_Progress fn);
+
+    void begin();
+    void end();
+    void handle();
+    int getCommand() const { return command; }
+
+    // Host only: run the registered handlers as a session would, without a transfer,
+    // to time the per-event cost of the handlers' owner
+    void emitStart() {
+        if (startCallback) {
+            startCallback();
+        }
+    }
+    void emitProgress(unsigned int progress, unsigned int total) {
+        if (progressCallback) {
+            progressCallback(progress, total);
+        }
+    }
+    void emitError(ota_error_t error) {
+        if (errorCallback) {
+            errorCallback(error);
+        }
+    }
+
+   private:
+    void onRx();
+    void runUpdate();
+    void sendUdp(const char* msg);
+
+    uint16_t port = 3232;
+    String hostname;
+    String passwordMD5;
+    String nonce;
+    bool rebootOnSuccess = true;
+    int timeoutMs = 1000;
+    bool initialized = false;
+    int udpFd = -1;
+    ota_state_t state = OTA_IDLE;
+
+    int command = 0;
+    size_t size = 0;
+    uint16_t remotePort = 0;
+    uint32_t remoteAddr = 0;       // Uploader address (network byte order)
+    uint16_t remoteUdpPort = 0;    // Source port of the invite, for replies
+    char md5[33] = {0};
+
+    THandlerFunction startCallback;
+    THandlerFunction endCallback;
+    THandlerFunction_Error errorCallback;
+    THandlerFunction_Progress progressCallback;
+};
+
+extern ArduinoOTAClass ArduinoOTA;
@@ -0,0 +1,231 @@
+// Ed25519Signer.cpp - RFC 8032 signing for host tests
+#include "Ed25519Signer.h"
+
+#include <string.h>
+
+#include "OTASha512.h"
+
+typedef int64_t gf[16];
+
+static const gf gf0 = {0};
+static const gf gf1 = {1};
+static const gf D2 = {0xf159, 0x26b2, 0x9b94, 0xebd6, 0xb156, 0x8283, 0x149a, 0x00e0,
+                      0xd130, 0xeef3, 0x80f2, 0x198e, 0xfce7, 0x56df, 0xd9dc, 0x2406};
+static const gf X = {0xd51a, 0x8f25, 0x2d60, 0xc956, 0xa7b2, 0x9525, 0xc760, 0x692c,
+                     0xdc5c, 0xfdd6, 0xe231, 0xc0a4, 0x53fe, 0xcd6e, 0x36d3, 0x2169};
+static const gf Y = {0x6658, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666,
+                     0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666};
+static const int64_t L[32] = {0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58, 0xd6, 0x9c, 0xf7,
+                              0xa2, 0xde, 0xf9, 0xde, 0x14, 0,    0,    0,    0,    0,    0,
+                              0,    0,    0,    0,    0,    0,    0,    0,    0,    0x10};
+
+static void set(gf r, const gf a) {
+    memcpy(r, a, sizeof(gf));
+}
+
+static void car(gf o) {
+    for (int i = 0; i < 16; i++) {
+        o[i] += 1 << 16;
+        int64_t c = o[i] >> 16;
+        o[(i + 1) * (i < 15)] += c - 1 + 37 * (c - 1) * (i == 15);
+        o[i] -= c * 65536;
+    }
+}
+
+static void sel(gf p, gf q, int b) {
+    int64_t c = ~((int64_t)b - 1);
+    for (int i = 0; i < 16; i++) {
+        int64_t t = c & (p[i] ^ q[i]);
+        p[i] ^= t;
+        q[i] ^= t;
+    }
+}
+
+static void pack25519(uint8_t* o, const gf n) {
+    gf m, t;
+    set(t, n);
+    car(t);
+    car(t);
+    car(t);
+    for (int j = 0; j < 2; j++) {
+        m[0] = t[0] - 0xffed;
+        for (int i = 1; i < 15; i++) {
+            m[i] = t[i] - 0xffff - ((m[i - 1] >> 16) & 1);
+            m[i - 1] &= 0xffff;
+        }
+        m[15] = t[15] - 0x7fff - ((m[14] >> 16) & 1);
+        int b = (m[15] >> 16) & 1;
+        m[14] &= 0xffff;
+        sel(t, m, 1 - b);
+    }
+    for (int i = 0; i < 16; i++) {
+        o[2 * i] = t[i] & 0xff;
+        o[2 * i + 1] = t[i] >> 8;
+    }
+}
+
+static void A(gf o, const gf a, const gf b) {
+    for (int i = 0; i < 16; i++) o[i] = a[i] + b[i];
+}
+
+static void Z(gf o, const gf a, const gf b) {
+    for (int i = 0; i < 16; i++) o[i] = a[i] - b[i];
+}
+
+static void M(gf o, const gf a, const gf b) {
+    int64_t t[31] = {0};
+    for (int i = 0; i < 16; i++)
+        for (int j = 0; j < 16; j++) t[i + j] += a[i] * b[j];
+    for (int i = 0; i < 15; i++) t[i] += 38 * t[i + 16];
+    for (int i = 0; i < 16; i++) o[i] = t[i];
+    car(o);
+    car(o);
+}
+
+static void inv25519(gf o, const gf i) {
+    gf c;
+    set(c, i);
+    for (int a = 253; a >= 0; a--) {
+        M(c, c, c);
+        if (a != 2 && a != 4) M(c, c, i);
+    }
+    set(o, c);
+}
+
+static void add(gf p[4], gf q[4]) {
+    gf a, b, c, d, t, e, f, g, h;
+    Z(a, p[1], p[0]);
+    Z(t, q[1], q[0]);
+    M(a, a, t);
+    A(b, p[0], p[1]);
+    A(t, q[0], q[1]);
+    M(b, b, t);
+    M(c, p[3], q[3]);
+    M(c, c, D2);
+    M(d, p[2], q[2]);
+    A(d, d, d);
+    Z(e, b, a);
+    Z(f, d, c);
+    A(g, d, c);
+    A(h, b, a);
+    M(p[0], e, f);
+    M(p[1], h, g);
+    M(p[2], g, f);
+    M(p[3], e, h);
+}
+
+static void cswap(gf p[4], gf q[4], uint8_t b) {
+    for (int i = 0; i < 4; i++) sel(p[i], q[i], b);
+}
+
+static void pack(uint8_t* r, gf p[4]) {
+    gf tx, ty, zi;
+    uint8_t d[32];
+    inv25519(zi, p[2]);
+    M(tx, p[0], zi);
+    M(ty, p[1], zi);
+    pack25519(r, ty);
+    pack25519(d, tx);
+    r[31] ^= (d[0] & 1) << 7;
+}
+
+static void scalarbase(gf p[4], const uint8_t* s) {
+    gf q[4];
+    set(q[0], X);
+    set(q[1], Y);
+    set(q[2], gf1);
+    M(q[3], X, Y);
+    set(p[0], gf0);
+    set(p[1], gf1);
+    set(p[2], gf1);
+    set(p[3], gf0);
+    for (int i = 255; i >= 0; --i) {
+        uint8_t b = (s[i / 8] >> (i & 7)) & 1;
+        cswap(p, q, b);
+        add(q, p);
+        add(p, p);
+        cswap(p, q, b);
+    }
+}
+
+static void modL(uint8_t* r, int64_t x[64]) {
+    int64_t carry;
+    int i, j;
+    for (i = 63; i >= 32; --i) {
+        carry = 0;
+        for (j = i - 32; j < i - 12; ++j) {
+            x[j] += carry - 16 * x[i] * L[j - (i - 32)];
+            carry = (x[j] + 128) >> 8;
+            x[j] -= carry * 256;
+        }
+        x[j] += carry;
+        x[i] = 0;
+    }
+    carry = 0;
+    for (j = 0; j < 32; j++) {
+        x[j] += carry - (x[31] >> 4) * L[j];
+        carry = x[j] >> 8;
+        x[j] &= 255;
+    }
+    for (j = 0; j < 32; j++) x[j] -= carry * L[j];
+    for (i = 0; i < 32; i++) {
+        x[i + 1] += x[i] >> 8;
+        r[i] = x[i] & 255;
+    }
+}
+
+static void reduce(uint8_t* r) {
+    int64_t x[64];
+    for (int i = 0; i < 64; i++) x[i] = (uint64_t)r[i];
+    for (int i = 0; i < 64; i++) r[i] = 0;
+    modL(r, x);
+}
+
+static void expandSeed(const uint8_t seed[32], uint8_t h[64]) {
+    OTASha512 sha;
+    sha.begin();
+    sha.update(seed, 32);
+    sha.finish(h);
+    h[0] &= 248;
+    h[31] &= 127;
+    h[31] |= 64;
+}
+
+void ed25519PublicKey(const uint8_t seed[32], uint8_t publicKey[32]) {
+    uint8_t h[64];
+    gf p[4];
+    expandSeed(seed, h);
+    scalarbase(p, h);
+    pack(publicKey, p);
+}
+
+void ed25519Sign(const uint8_t seed[32], const uint8_t* message, size_t len,
+                 uint8_t signature[64]) {
+    uint8_t h[64], r[64], k[64], publicKey[32];
+    gf p[4];
+    expandSeed(seed, h);
+    scalarbase(p, h);
+    pack(publicKey, p);
+
+    OTASha512 sha;
+    sha.begin();
+    sha.update(h + 32, 32);
+    sha.update(message, len);
+    sha.finish(r);
+    reduce(r);
+    scalarbase(p, r);
+    pack(signature, p);
+
+    sha.begin();
+    sha.update(signature, 32);
+    sha.update(publicKey, 32);
+    sha.update(message, len);
+    sha.finish(k);
+    reduce(k);
+
+    int64_t x[64] = {0};
+    for (int i = 0; i < 32; i++) x[i] = (uint64_t)r[i];
+    for (int i = 0; i < 32; i++)
+        for (int j = 0; j < 32; j++) x[i + j] += k[i] * (uint64_t)h[j];
+    modL(signature + 32, x);
+}
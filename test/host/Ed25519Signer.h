@@ -0,0 +1,18 @@
+/**
+ * @file Ed25519Signer.h
+ * @brief Host-side Ed25519 (RFC 8032) signing for the signature tests
+ *
+ * @details A separate implementation from the device verifier (a constant-time
+ * ladder in the TweetNaCl style) so that the two check each other. Real images
+ * are signed with OpenSSL; see the README.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Public key of a 32-byte secret seed
+void ed25519PublicKey(const uint8_t seed[32], uint8_t publicKey[32]);
+
+void ed25519Sign(const uint8_t seed[32], const uint8_t* message, size_t len,
+                 uint8_t signature[64]);
@@ -0,0 +1,216 @@
+// EspotaClient.cpp - espota.py compatible uploader for host tests
+#include "EspotaClient.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "MD5Builder.h"
+
+static uint64_t nowUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void md5Hex(const uint8_t* data, size_t len, char out[33]) {
+    MD5Builder md5;
+    md5.begin();
+    md5.add(data, len);
+    md5.calculate();
+    md5.getChars(out);
+}
+
+// RAII holder so every early return closes its sockets
+struct Fd {
+    int fd;
+    explicit Fd(int f = -1) : fd(f) {}
+    ~Fd() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+};
+
+EspotaClient::EspotaClient(const char* host, uint16_t port) : host(host), port(port) {}
+
+bool EspotaClient::fail(EspotaResult* result, const char* msg) {
+    result->ok = false;
+    snprintf(result->error, sizeof(result->error), "%.63s", msg);
+    return false;
+}
+
+bool EspotaClient::upload(const uint8_t* image, size_t len, EspotaResult* result) {
+    memset(result, 0, sizeof(*result));
+
+    // TCP server the device will connect back to
+    Fd server(socket(AF_INET, SOCK_STREAM, 0));
+    int yes = 1;
+    setsockopt(server.fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    struct sockaddr_in local = {};
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    local.sin_port = 0;
+    socklen_t localLen = sizeof(local);
+    if (bind(server.fd, (struct sockaddr*)&local, sizeof(local)) != 0 || listen(server.fd, 1) != 0 ||
+        getsockname(server.fd, (struct sockaddr*)&local, &localLen) != 0) {
+        return fail(result, "listen failed");
+    }
+
+    Fd udp(socket(AF_INET, SOCK_DGRAM, 0));
+    struct sockaddr_in device = {};
+    device.sin_family = AF_INET;
+    device.sin_port = htons(port);
+    inet_pton(AF_INET, host, &device.sin_addr);
+
+    char imageMD5[33];
+    md5Hex(image, len, imageMD5);
+
+    char msg[320];
+    int msgLen = snprintf(msg, sizeof(msg), "0 %u %zu %s%s%s%s%s%s\n", ntohs(local.sin_port),
+                          len, imageMD5, resume ? " resume" : "", sha256 ? " sha256=" : "",
+                          sha256 ? sha256 : "", signature ? " sig=" : "",
+                          signature ? signature : "");
+    uint64_t inviteAt = nowUs();
+    sendto(udp.fd, msg, msgLen, 0, (struct sockaddr*)&device, sizeof(device));
+
+    char reply[128];
+    struct pollfd pfd = {udp.fd, POLLIN, 0};
+    if (poll(&pfd, 1, timeoutMs) <= 0) {
+        return fail(result, "no response to invite");
+    }
+    ssize_t n = recv(udp.fd, reply, sizeof(reply) - 1, 0);
+    if (n <= 0) {
+        return fail(result, "invite recv failed");
+    }
+    reply[n] = '\0';
+
+    if (strncmp(reply, "AUTH ", 5) == 0) {
+        if (!password) {
+            return fail(result, "device requires a password");
+        }
+        char passMD5[33], cnonce[33], response[33];
+        md5Hex((const uint8_t*)password, strlen(password), passMD5);
+        char seed[32];
+        snprintf(seed, sizeof(seed), "%llu", (unsigned long long)nowUs());
+        md5Hex((const uint8_t*)seed, strlen(seed), cnonce);
+        char challenge[192];
+        snprintf(challenge, sizeof(challenge), "%s:%s:%s", passMD5, reply + 5, cnonce);
+        md5Hex((const uint8_t*)challenge, strlen(challenge), response);
+
+        msgLen = snprintf(msg, sizeof(msg), "200 %s %s\n", cnonce, response);
+        sendto(udp.fd, msg, msgLen, 0, (struct sockaddr*)&device, sizeof(device));
+        if (poll(&pfd, 1, timeoutMs) <= 0) {
+            return fail(result, "no response to auth");
+        }
+        n = recv(udp.fd, reply, sizeof(reply) - 1, 0);
+        if (n <= 0) {
+            return fail(result, "auth recv failed");
+        }
+        reply[n] = '\0';
+    }
+    size_t offset = 0;
+    if (resume && strncmp(reply, "OK ", 3) == 0) {
+        unsigned long from = strtoul(reply + 3, nullptr, 10);
+        if (from >= len) {
+            return fail(result, "resume offset beyond the image");
+        }
+        offset = result->resumedFrom = from;
+    } else if (strcmp(reply, "OK") != 0) {
+        return fail(result, reply);
+    }
+
+    struct pollfd accepting = {server.fd, POLLIN, 0};
+    if (poll(&accepting, 1, timeoutMs) <= 0) {
+        return fail(result, "device did not connect");
+    }
+    Fd conn(accept(server.fd, nullptr, nullptr));
+    if (conn.fd < 0) {
+        return fail(result, "accept failed");
+    }
+    setsockopt(conn.fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    uint64_t connectedAt = nowUs();
+    result->inviteToConnectUs = connectedAt - inviteAt;
+
+    // Acknowledgements are decimal byte counts; only the trailing "OK" matters
+    char tail[3] = {0};
+    auto consumeAcks = [&](int flags) -> int {
+        char acks[256];
+        ssize_t r = recv(conn.fd, acks, sizeof(acks), flags);
+        for (ssize_t i = 0; i < r; i++) {
+            tail[0] = tail[1];
+            tail[1] = acks[i];
+        }
+        return (int)r;
+    };
+
+    struct pollfd data = {conn.fd, POLLIN, 0};
+    size_t cutAt = cutAfter ? offset + cutAfter : len;
+    uint64_t linkFreeAt = 0;
+    while (offset < len) {
+        if (offset >= cutAt) {
+            result->bytesSent = offset;
+            if (cutStalls) {
+                // Keep the connection open and silent until the device times out and closes it
+                while (poll(&data, 1, timeoutMs) > 0 && consumeAcks(0) > 0) {
+                }
+            } else {
+                struct linger reset = {1, 0};
+                setsockopt(conn.fd, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+            }
+            return fail(result, "cut by fault injection");
+        }
+        size_t take = len - offset < chunkSize ? len - offset : chunkSize;
+        if (take > cutAt - offset) {
+            take = cutAt - offset;
+        }
+        size_t sent = 0;
+        while (sent < take) {
+            ssize_t s = send(conn.fd, image + offset + sent, take - sent, MSG_NOSIGNAL);
+            if (s <= 0) {
+                result->bytesSent = offset + sent;
+                return fail(result, "connection lost while sending");
+            }
+            sent += (size_t)s;
+        }
+        offset += take;
+        if (rateLimitKBps) {
+            // The link serialises each chunk; idle time (e.g. waiting for an ack) is not credited
+            uint64_t now = nowUs();
+            if (linkFreeAt < now) {
+                linkFreeAt = now;
+            }
+            linkFreeAt += (uint64_t)take * 1000000ULL / (rateLimitKBps * 1024ULL);
+            usleep((useconds_t)(linkFreeAt - now));
+        }
+        if (lockstep) {
+            if (poll(&data, 1, timeoutMs) <= 0 || consumeAcks(0) <= 0) {
+                result->bytesSent = offset;
+                return fail(result, "no acknowledgement");
+            }
+        } else {
+            consumeAcks(MSG_DONTWAIT);
+        }
+    }
+    result->bytesSent = offset;
+
+    while (!(tail[0] == 'O' && tail[1] == 'K')) {
+        if (poll(&data, 1, timeoutMs) <= 0) {
+            return fail(result, "no final OK");
+        }
+        if (consumeAcks(0) <= 0) {
+            return fail(result, "device closed without OK");
+        }
+    }
+    uint64_t doneAt = nowUs();
+    result->transferUs = doneAt - connectedAt;
+    result->totalUs = doneAt - inviteAt;
+    result->ok = true;
+    return true;
+}
@@ -0,0 +1,66 @@
+/**
+ * @file EspotaClient.h
+ * @brief Host-side uploader speaking the espota.py protocol
+ *
+ * @details Used by the native tests and benchmarks to push an image to the
+ * library over loopback exactly the way `espota.py` would, and to time the phases
+ * of the transfer.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct EspotaResult {
+    bool ok;
+    uint64_t inviteToConnectUs;  // UDP invite sent -> device connected back
+    uint64_t transferUs;         // First data byte sent -> final "OK" received
+    uint64_t totalUs;            // Invite sent -> final "OK" received
+    size_t bytesSent;
+    size_t resumedFrom;          // Offset the device asked to continue from (resume mode)
+    char error[64];
+};
+
+class EspotaClient {
+   public:
+    EspotaClient(const char* host, uint16_t port);
+
+    void setPassword(const char* password) { this->password = password; }
+    // Bytes per send(); espota.py uses 1460
+    void setChunkSize(size_t bytes) { chunkSize = bytes; }
+    // espota.py waits for an acknowledgement after every chunk; streaming mode does not
+    void setLockstep(bool enabled) { lockstep = enabled; }
+    void setTimeoutMs(int ms) { timeoutMs = ms; }
+    // Pace the data stream to emulate a slower link (0 = unlimited)
+    void setRateLimitKBps(uint32_t kbps) { rateLimitKBps = kbps; }
+    // Ask the device for a resume offset (listener mode only; ArduinoOTA ignores the invite)
+    void setResume(bool enabled) { resume = enabled; }
+    // Send the SHA-256 (hex) of the file in the invite (listener mode only)
+    void setSha256(const char* hex) { sha256 = hex; }
+    // Send a detached Ed25519 signature (hex) of the file in the invite (listener mode only)
+    void setSignature(const char* hex) { signature = hex; }
+    // Fault injection: after this many data bytes, reset the connection, or with stall
+    // stop sending and wait for the device to give up (0 = never)
+    void setCutAfter(size_t bytes, bool stall = false) {
+        cutAfter = bytes;
+        cutStalls = stall;
+    }
+
+    bool upload(const uint8_t* image, size_t len, EspotaResult* result);
+
+   private:
+    bool fail(EspotaResult* result, const char* msg);
+
+    const char* host;
+    uint16_t port;
+    const char* password = nullptr;
+    size_t chunkSize = 1460;
+    bool lockstep = true;
+    int timeoutMs = 10000;
+    uint32_t rateLimitKBps = 0;
+    bool resume = false;
+    const char* sha256 = nullptr;
+    const char* signature = nullptr;
+    size_t cutAfter = 0;
+    bool cutStalls = false;
+};
@@ -0,0 +1,104 @@
+// HeapTracker.cpp - malloc accounting for host tests (glibc)
+#include "HeapTracker.h"
+
+#include <errno.h>
+#include <malloc.h>
+
+#include <atomic>
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* ptr);
+}
+
+// Signed: blocks allocated before the counters existed may be freed later
+static std::atomic<int64_t> bytesInUse(0);
+static std::atomic<int64_t> bytesPeak(0);
+static std::atomic<uint64_t> allocationCount(0);
+
+static void* track(void* ptr) {
+    if (ptr) {
+        int64_t size = malloc_usable_size(ptr);
+        int64_t now = bytesInUse.fetch_add(size, std::memory_order_relaxed) + size;
+        int64_t high = bytesPeak.load(std::memory_order_relaxed);
+        while (now > high && !bytesPeak.compare_exchange_weak(high, now, std::memory_order_relaxed)) {
+        }
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    return ptr;
+}
+
+static void untrack(void* ptr) {
+    if (ptr) {
+        bytesInUse.fetch_sub(malloc_usable_size(ptr), std::memory_order_relaxed);
+    }
+}
+
+extern "C" {
+
+void* malloc(size_t size) {
+    return track(__libc_malloc(size));
+}
+
+void* calloc(size_t count, size_t size) {
+    return track(__libc_calloc(count, size));
+}
+
+void* realloc(void* ptr, size_t size) {
+    size_t old = ptr ? malloc_usable_size(ptr) : 0;
+    void* moved = __libc_realloc(ptr, size);
+    if (!moved && size) {
+        return nullptr;  // The old block is untouched
+    }
+    bytesInUse.fetch_sub(old, std::memory_order_relaxed);
+    return track(moved);
+}
+
+void free(void* ptr) {
+    untrack(ptr);
+    __libc_free(ptr);
+}
+
+void* memalign(size_t alignment, size_t size) {
+    return track(__libc_memalign(alignment, size));
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+    return track(__libc_memalign(alignment, size));
+}
+
+int posix_memalign(void** out, size_t alignment, size_t size) {
+    if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    void* ptr = track(__libc_memalign(alignment, size));
+    if (!ptr && size) {
+        return ENOMEM;
+    }
+    *out = ptr;
+    return 0;
+}
+
+}  // extern "C"
+
+size_t HeapTracker::inUse() {
+    int64_t now = bytesInUse.load(std::memory_order_relaxed);
+    return now > 0 ? (size_t)now : 0;
+}
+
+size_t HeapTracker::peak() {
+    int64_t high = bytesPeak.load(std::memory_order_relaxed);
+    return high > 0 ? (size_t)high : 0;
+}
+
+uint64_t HeapTracker::allocations() {
+    return allocationCount.load(std::memory_order_relaxed);
+}
+
+void HeapTracker::resetPeak() {
+    bytesPeak.store(bytesInUse.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    allocationCount.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,28 @@
+/**
+ * @file HeapTracker.h
+ * @brief Heap accounting for the host build
+ *
+ * @details Replaces malloc() and friends (forwarding to glibc) to keep a count
+ * of the bytes in use and the high-water mark, so tests can report how much
+ * heap an operation really needs. The host ESP.getFreeHeap() is a fixed figure
+ * and cannot show this. Counts cover every thread in the process.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+class HeapTracker {
+   public:
+    // Bytes currently allocated (usable size, as the allocator hands it out)
+    static size_t inUse();
+
+    // Highest inUse() since the last resetPeak()
+    static size_t peak();
+
+    // Allocations made since the last resetPeak()
+    static uint64_t allocations();
+
+    // Start a new measurement: peak() = inUse(), allocations() = 0
+    static void resetPeak();
+};
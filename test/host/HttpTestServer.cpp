@@ -0,0 +1,186 @@
+// HttpTestServer.cpp - loopback HTTP file server for host tests
+#include "HttpTestServer.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t nowUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static bool sendAll(int fd, const void* data, size_t len) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool HttpTestServer::begin(uint16_t port) {
+    end();
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    int yes = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    socklen_t addrLen = sizeof(addr);
+    if (listenFd < 0 || bind(listenFd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(listenFd, 4) != 0 || getsockname(listenFd, (struct sockaddr*)&addr, &addrLen) != 0) {
+        end();
+        return false;
+    }
+    listenPort = ntohs(addr.sin_port);
+    requests = 0;
+    rangeStart = 0;
+    bodyBytes = 0;
+    stopping = false;
+    thread = std::thread(&HttpTestServer::run, this);
+    return true;
+}
+
+void HttpTestServer::end() {
+    stopping = true;
+    if (thread.joinable()) {
+        thread.join();
+    }
+    if (listenFd >= 0) {
+        close(listenFd);
+        listenFd = -1;
+    }
+}
+
+void HttpTestServer::run() {
+    while (!stopping) {
+        struct pollfd pfd = {listenFd, POLLIN, 0};
+        if (poll(&pfd, 1, 50) <= 0) {
+            continue;
+        }
+        int conn = accept(listenFd, nullptr, nullptr);
+        if (conn >= 0) {
+            serve(conn);
+            close(conn);
+        }
+    }
+}
+
+void HttpTestServer::serve(int conn) {
+    // Read the request head
+    char req[1024];
+    size_t len = 0;
+    while (len < sizeof(req) - 1) {
+        struct pollfd pfd = {conn, POLLIN, 0};
+        if (poll(&pfd, 1, 2000) <= 0) {
+            return;
+        }
+        ssize_t n = recv(conn, req + len, sizeof(req) - 1 - len, 0);
+        if (n <= 0) {
+            return;
+        }
+        len += n;
+        req[len] = '\0';
+        if (strstr(req, "\r\n\r\n")) {
+            break;
+        }
+    }
+    requests++;
+
+    char path[256] = {0};
+    if (sscanf(req, "GET %255s HTTP/1.1", path) != 1) {
+        const char* bad = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n";
+        sendAll(conn, bad, strlen(bad));
+        return;
+    }
+    size_t from = 0;
+    const char* range = strcasestr(req, "\r\nRange: bytes=");
+    bool ranged = range != nullptr;
+    if (ranged) {
+        from = strtoul(range + 15, nullptr, 10);
+        rangeStart = from;
+    }
+
+    char head[512];
+    if (forcedStatus) {
+        snprintf(head, sizeof(head), "HTTP/1.1 %d Error\r\nContent-Length: 0\r\nConnection: close\r\n\r\n",
+                 forcedStatus);
+        sendAll(conn, head, strlen(head));
+        return;
+    }
+    if (redirectPath && strcmp(path, redirectPath) == 0) {
+        snprintf(head, sizeof(head),
+                 "HTTP/1.1 302 Found\r\nLocation: %s\r\nContent-Length: 0\r\nConnection: close\r\n\r\n",
+                 redirectLocation);
+        sendAll(conn, head, strlen(head));
+        return;
+    }
+    if (ranged && ranges) {
+        if (from >= fileLen) {
+            snprintf(head, sizeof(head),
+                     "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */%zu\r\n"
+                     "Content-Length: 0\r\nConnection: close\r\n\r\n",
+                     fileLen);
+            sendAll(conn, head, strlen(head));
+            return;
+        }
+        snprintf(head, sizeof(head),
+                 "HTTP/1.1 206 Partial Content\r\nContent-Type: application/octet-stream\r\n"
+                 "Content-Range: bytes %zu-%zu/%zu\r\nContent-Length: %zu\r\n"
+                 "Connection: close\r\n\r\n",
+                 from, fileLen - 1, fileLen, fileLen - from);
+    } else {
+        from = 0;
+        snprintf(head, sizeof(head),
+                 "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\n"
+                 "Content-Length: %zu\r\nAccept-Ranges: %s\r\nConnection: close\r\n\r\n",
+                 fileLen, ranges ? "bytes" : "none");
+    }
+    if (!sendAll(conn, head, strlen(head))) {
+        return;
+    }
+
+    size_t limit = fileLen - from;
+    bool cut = false;
+    if (cutAfter > 0 && cutsLeft > 0 && cutAfter < limit) {
+        cutsLeft--;
+        limit = cutAfter;
+        cut = true;
+    }
+    uint64_t startUs = nowUs();
+    size_t sent = 0;
+    while (sent < limit && !stopping) {
+        size_t n = limit - sent < 1460 ? limit - sent : 1460;
+        if (!sendAll(conn, file + from + sent, n)) {
+            return;
+        }
+        sent += n;
+        bodyBytes += n;
+        if (rateLimitKBps) {
+            uint64_t dueUs = startUs + (uint64_t)sent * 1000 / rateLimitKBps;
+            uint64_t now = nowUs();
+            if (dueUs > now) {
+                usleep(dueUs - now);
+            }
+        }
+    }
+    if (cut) {
+        // Reset rather than close, as a dropped link or a proxy timeout would
+        struct linger lin = {1, 0};
+        setsockopt(conn, SOL_SOCKET, SO_LINGER, &lin, sizeof(lin));
+    }
+}
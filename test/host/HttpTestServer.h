@@ -0,0 +1,79 @@
+/**
+ * @file HttpTestServer.h
+ * @brief Local HTTP/1.1 file server for the pull-mode tests
+ *
+ * @details Serves one file on loopback from a background thread, one connection
+ * at a time, with single-range (206) support and the faults a download meets in
+ * the field: connections cut partway, servers that ignore Range, redirects,
+ * error statuses and slow links. The body is sent straight from the caller's
+ * buffer, so serving allocates nothing and does not disturb heap measurements.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <atomic>
+#include <thread>
+
+class HttpTestServer {
+   public:
+    ~HttpTestServer() { end(); }
+
+    /**
+     * @brief Start listening on 127.0.0.1 (port 0 = any free port)
+     */
+    bool begin(uint16_t port = 0);
+    void end();
+    uint16_t port() const { return listenPort; }
+
+    // File returned for every path except the redirect source; must outlive the server
+    void setFile(const uint8_t* data, size_t len) {
+        file = data;
+        fileLen = len;
+    }
+    // Answer Range requests with 206 (true) or ignore them and send the whole file
+    void setRangeSupport(bool enabled) { ranges = enabled; }
+    // Reset the next `times` connections after `bytes` body bytes each (0 = never)
+    void setCutAfter(size_t bytes, int times = 1) {
+        cutAfter = bytes;
+        cutsLeft = times;
+    }
+    // Answer requests for `path` with a 302 to `location`
+    void setRedirect(const char* path, const char* location) {
+        redirectPath = path;
+        redirectLocation = location;
+    }
+    // Answer every request with this status and an empty body (0 = serve normally)
+    void setStatus(int status) { forcedStatus = status; }
+    // Pace the body to emulate a slower link (0 = unlimited)
+    void setRateLimitKBps(uint32_t kbps) { rateLimitKBps = kbps; }
+
+    // Statistics since begin()
+    int requestCount() const { return requests; }
+    size_t lastRangeStart() const { return rangeStart; }
+    uint64_t bodyBytesSent() const { return bodyBytes; }
+
+   private:
+    void run();
+    void serve(int conn);
+
+    int listenFd = -1;
+    uint16_t listenPort = 0;
+    std::thread thread;
+    std::atomic<bool> stopping{false};
+
+    const uint8_t* file = nullptr;
+    size_t fileLen = 0;
+    bool ranges = true;
+    size_t cutAfter = 0;
+    std::atomic<int> cutsLeft{0};
+    const char* redirectPath = nullptr;
+    const char* redirectLocation = nullptr;
+    int forcedStatus = 0;
+    uint32_t rateLimitKBps = 0;
+
+    std::atomic<int> requests{0};
+    std::atomic<size_t> rangeStart{0};
+    std::atomic<uint64_t> bodyBytes{0};
+};
@@ -0,0 +1,115 @@
+// MD5Builder.cpp - RFC 1321 MD5 for the host build
+#include "MD5Builder.h"
+
+static inline uint32_t rotl(uint32_t x, int c) {
+    return (x << c) | (x >> (32 - c));
+}
+
+static const uint32_t K[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391};
+
+static const int R[64] = {7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+                          5, 9,  14, 20, 5, 9,  14, 20, 5, 9,  14, 20, 5, 9,  14, 20,
+                          4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+                          6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21};
+
+void MD5Builder::begin() {
+    state[0] = 0x67452301;
+    state[1] = 0xefcdab89;
+    state[2] = 0x98badcfe;
+    state[3] = 0x10325476;
+    bitCount = 0;
+    memset(digest, 0, sizeof(digest));
+}
+
+void MD5Builder::transform(const uint8_t block[64]) {
+    uint32_t m[16];
+    for (int i = 0; i < 16; i++) {
+        m[i] = (uint32_t)block[i * 4] | ((uint32_t)block[i * 4 + 1] << 8) |
+               ((uint32_t)block[i * 4 + 2] << 16) | ((uint32_t)block[i * 4 + 3] << 24);
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    for (int i = 0; i < 64; i++) {
+        uint32_t f;
+        int g;
+        if (i < 16) {
+            f = (b & c) | (~b & d);
+            g = i;
+        } else if (i < 32) {
+            f = (d & b) | (~d & c);
+            g = (5 * i + 1) % 16;
+        } else if (i < 48) {
+            f = b ^ c ^ d;
+            g = (3 * i + 5) % 16;
+        } else {
+            f = c ^ (b | ~d);
+            g = (7 * i) % 16;
+        }
+        uint32_t tmp = d;
+        d = c;
+        c = b;
+        b = b + rotl(a + f + K[i] + m[g], R[i]);
+        a = tmp;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+}
+
+void MD5Builder::add(const uint8_t* data, size_t len) {
+    size_t used = (bitCount / 8) % 64;
+    bitCount += (uint64_t)len * 8;
+    while (len > 0) {
+        size_t take = 64 - used;
+        if (take > len) {
+            take = len;
+        }
+        memcpy(buffer + used, data, take);
+        used += take;
+        data += take;
+        len -= take;
+        if (used == 64) {
+            transform(buffer);
+            used = 0;
+        }
+    }
+}
+
+void MD5Builder::calculate() {
+    uint64_t bits = bitCount;
+    size_t used = (bits / 8) % 64;
+    uint8_t pad[72] = {0x80};
+    size_t padLen = (used < 56) ? (56 - used) : (120 - used);
+    add(pad, padLen);
+    uint8_t lenBytes[8];
+    for (int i = 0; i < 8; i++) {
+        lenBytes[i] = (uint8_t)(bits >> (8 * i));
+    }
+    add(lenBytes, 8);
+    for (int i = 0; i < 4; i++) {
+        digest[i * 4] = (uint8_t)state[i];
+        digest[i * 4 + 1] = (uint8_t)(state[i] >> 8);
+        digest[i * 4 + 2] = (uint8_t)(state[i] >> 16);
+        digest[i * 4 + 3] = (uint8_t)(state[i] >> 24);
+    }
+}
+
+void MD5Builder::getChars(char* output) const {
+    for (int i = 0; i < 16; i++) {
+        sprintf(output + i * 2, "%02x", digest[i]);
+    }
+}
+
+String MD5Builder::toString() const {
+    char out[33];
+    getChars(out);
+    return String(out);
+}
@@ -0,0 +1,24 @@
+// MD5Builder.h - host stand-in for the ESP32 core MD5Builder
+#pragma once
+
+#include "Arduino.h"
+
+class MD5Builder {
+   public:
+    void begin();
+    void add(const uint8_t* data, size_t len);
+    void add(const char* data) { add((const uint8_t*)data, strlen(data)); }
+    void add(const String& data) { add(data.c_str()); }
+    void calculate();
+    void getBytes(uint8_t* output) const { memcpy(output, digest, 16); }
+    void getChars(char* output) const;
+    String toString() const;
+
+   private:
+    void transform(const uint8_t block[64]);
+
+    uint32_t state[4];
+    uint64_t bitCount;
+    uint8_t buffer[64];
+    uint8_t digest[16];
+};
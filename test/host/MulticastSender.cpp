@@ -0,0 +1,279 @@
+// MulticastSender.cpp - multicast image stream and repair server for host tests
+#include "MulticastSender.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "MD5Builder.h"
+#include "OTAFec.h"
+#include "OTAMulticast.h"
+
+static uint64_t nowUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void put16(uint8_t* p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+static uint32_t get32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static bool recvAll(int fd, uint8_t* dst, size_t len) {
+    while (len > 0) {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if (poll(&pfd, 1, 2000) <= 0) {
+            return false;
+        }
+        ssize_t n = recv(fd, dst, len, 0);
+        if (n <= 0) {
+            return false;
+        }
+        dst += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool sendAll(int fd, const uint8_t* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool MulticastSender::begin(const char* group, uint16_t port) {
+    end();
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_aton(group, &addr.sin_addr) == 0) {
+        return false;
+    }
+    target.assign((uint8_t*)&addr, (uint8_t*)&addr + sizeof(addr));
+
+    udpFd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct in_addr loopback;
+    loopback.s_addr = htonl(INADDR_LOOPBACK);
+    unsigned char yes = 1;
+    int sndbuf = 1 << 20;
+    if (udpFd < 0 || setsockopt(udpFd, IPPROTO_IP, IP_MULTICAST_IF, &loopback, sizeof(loopback)) != 0 ||
+        setsockopt(udpFd, IPPROTO_IP, IP_MULTICAST_LOOP, &yes, sizeof(yes)) != 0) {
+        end();
+        return false;
+    }
+    setsockopt(udpFd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in local = {};
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t localLen = sizeof(local);
+    if (listenFd < 0 || bind(listenFd, (struct sockaddr*)&local, sizeof(local)) != 0 ||
+        listen(listenFd, 64) != 0 || getsockname(listenFd, (struct sockaddr*)&local, &localLen) != 0) {
+        end();
+        return false;
+    }
+    tcpPort = ntohs(local.sin_port);
+    repairs = 0;
+    repairedBytes = 0;
+    stopping = false;
+    repairThread = std::thread(&MulticastSender::runRepair, this);
+    return true;
+}
+
+void MulticastSender::end() {
+    stopping = true;
+    if (repairThread.joinable()) {
+        repairThread.join();
+    }
+    if (udpFd >= 0) {
+        close(udpFd);
+        udpFd = -1;
+    }
+    if (listenFd >= 0) {
+        close(listenFd);
+        listenFd = -1;
+    }
+}
+
+void MulticastSender::setSha256(const uint8_t* digest) {
+    hasSha256 = digest != nullptr;
+    if (digest) {
+        memcpy(sha256, digest, sizeof(sha256));
+    }
+}
+
+void MulticastSender::setSignature(const uint8_t* sig) {
+    hasSignature = sig != nullptr;
+    if (sig) {
+        memcpy(signature, sig, sizeof(signature));
+    }
+}
+
+void MulticastSender::sendPacket(uint8_t type, uint8_t index, uint32_t group, const uint8_t* payload,
+                                 size_t len) {
+    uint8_t packet[OTAMulticast::HEADER_SIZE + OTAMulticast::MAX_BLOCK_SIZE];
+    memcpy(packet, "OTMC", 4);
+    packet[4] = type;
+    packet[5] = index;
+    put16(packet + 6, session);
+    put32(packet + 8, group);
+    if (len) {
+        memcpy(packet + OTAMulticast::HEADER_SIZE, payload, len);
+    }
+    size_t total = OTAMulticast::HEADER_SIZE + len;
+    sendto(udpFd, packet, total, 0, (const struct sockaddr*)target.data(), target.size());
+    lastBytesSent += total;
+    pace();
+}
+
+void MulticastSender::sendAnnounce() {
+    uint8_t a[OTAMulticast::ANNOUNCE_SIZE - OTAMulticast::HEADER_SIZE] = {0};
+    put32(a, image.size());
+    put16(a + 4, blockSize);
+    a[6] = k;
+    a[7] = p;
+    put16(a + 8, tcpPort);
+    a[10] = (hasSha256 ? 1 : 0) | (hasSignature ? 2 : 0);
+    memcpy(a + 12, md5, 32);
+    memcpy(a + 44, sha256, sizeof(sha256));
+    memcpy(a + 76, signature, sizeof(signature));
+    sendPacket(OTAMulticast::ANNOUNCE, 0, 0, a, sizeof(a));
+}
+
+void MulticastSender::pace() {
+    if (!rateLimitKBps) {
+        return;
+    }
+    uint64_t dueUs = startUs + lastBytesSent * 1000 / rateLimitKBps;
+    uint64_t now = nowUs();
+    if (dueUs > now) {
+        usleep(dueUs - now);
+    }
+}
+
+bool MulticastSender::send(const uint8_t* data, size_t len) {
+    if (udpFd < 0 || len == 0 || blockSize > OTAMulticast::MAX_BLOCK_SIZE) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(imageLock);
+        image.assign(data, data + len);
+        session++;
+        MD5Builder builder;
+        builder.begin();
+        builder.add(data, len);
+        builder.calculate();
+        builder.getChars(md5);
+    }
+
+    lastBytesSent = 0;
+    uint64_t leadEnd = nowUs() + (uint64_t)leadMs * 1000;
+    while (nowUs() < leadEnd) {
+        startUs = nowUs();  // Announcements before the stream are not paced
+        sendAnnounce();
+        usleep(50000);
+    }
+
+    startUs = nowUs();
+    lastBytesSent = 0;
+    uint32_t blockCount = (len + blockSize - 1) / blockSize;
+    uint32_t groupCount = (blockCount + k - 1) / k;
+    std::vector<uint8_t> padded((size_t)k * blockSize);
+    std::vector<uint8_t> parity(blockSize);
+    const uint8_t* blocks[64];
+    for (uint32_t g = 0; g < groupCount; g++) {
+        if (g % 8 == 0) {
+            sendAnnounce();  // For receivers that join late
+        }
+        uint32_t first = g * k;
+        uint32_t kg = blockCount - first < k ? blockCount - first : k;
+        std::fill(padded.begin(), padded.end(), 0);
+        for (uint32_t j = 0; j < kg; j++) {
+            size_t offset = (size_t)(first + j) * blockSize;
+            size_t n = len - offset < blockSize ? len - offset : blockSize;
+            memcpy(padded.data() + (size_t)j * blockSize, data + offset, n);
+            blocks[j] = padded.data() + (size_t)j * blockSize;
+            lossSeed = lossSeed * 1103515245u + 12345u;
+            if ((lossSeed >> 16) % 100 >= lossPercent) {
+                sendPacket(OTAMulticast::DATA, j, g, blocks[j], n);
+            }
+        }
+        for (uint8_t r = 0; r < p; r++) {
+            OTAFec::encode(blocks, kg, r, parity.data(), blockSize);
+            lossSeed = lossSeed * 1103515245u + 12345u;
+            if ((lossSeed >> 16) % 100 >= lossPercent) {
+                sendPacket(OTAMulticast::PARITY, r, g, parity.data(), blockSize);
+            }
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        sendPacket(OTAMulticast::END, 0, groupCount, nullptr, 0);
+    }
+    lastStreamUs = nowUs() - startUs;
+    return true;
+}
+
+void MulticastSender::runRepair() {
+    while (!stopping) {
+        struct pollfd pfd = {listenFd, POLLIN, 0};
+        if (poll(&pfd, 1, 50) <= 0) {
+            continue;
+        }
+        int conn = accept(listenFd, nullptr, nullptr);
+        if (conn >= 0) {
+            serveRepair(conn);
+            close(conn);
+        }
+    }
+}
+
+void MulticastSender::serveRepair(int conn) {
+    uint8_t head[8];
+    if (!recvAll(conn, head, sizeof(head)) || memcmp(head, "OTMR", 4) != 0) {
+        return;
+    }
+    uint16_t id = head[4] | (head[5] << 8);
+    uint16_t ranges = head[6] | (head[7] << 8);
+    std::vector<uint8_t> request((size_t)ranges * 8);
+    if (!recvAll(conn, request.data(), request.size())) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(imageLock);
+    if (id != session) {
+        return;
+    }
+    repairs++;
+    for (uint16_t r = 0; r < ranges; r++) {
+        size_t from = (size_t)get32(request.data() + 8 * r) * blockSize;
+        size_t to = from + (size_t)get32(request.data() + 8 * r + 4) * blockSize;
+        if (to > image.size()) {
+            to = image.size();
+        }
+        if (from >= to || !sendAll(conn, image.data() + from, to - from)) {
+            return;
+        }
+        repairedBytes += to - from;
+    }
+}
@@ -0,0 +1,100 @@
+/**
+ * @file MulticastSender.h
+ * @brief Streams an image to a multicast group, as a fleet update server would
+ *
+ * @details Speaks the OTAMulticast wire format: announcements, then each group of
+ * k data blocks followed by p Reed-Solomon parity blocks, then END. A TCP repair
+ * server on an ephemeral loopback port answers block requests until end().
+ * Loss can be injected on the sending side, where every receiver sees the same
+ * gaps; OTAMulticast::setSimulatedLoss() gives each receiver its own.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class MulticastSender {
+   public:
+    ~MulticastSender() { end(); }
+
+    /**
+     * @brief Open the multicast socket (loopback interface) and the repair server
+     */
+    bool begin(const char* group, uint16_t port);
+    void end();
+
+    void setFec(uint16_t blockSize, uint8_t k, uint8_t p) {
+        this->blockSize = blockSize;
+        this->k = k;
+        this->p = p;
+    }
+    // Announce a SHA-256 / signature with the next sessions (nullptr = none)
+    void setSha256(const uint8_t* digest);
+    void setSignature(const uint8_t* signature);
+    // Pace the stream to emulate the link (0 = unlimited)
+    void setRateLimitKBps(uint32_t kbps) { rateLimitKBps = kbps; }
+    // Skip this percentage of data/parity packets
+    void setLoss(uint8_t percent, uint32_t seed = 1) {
+        lossPercent = percent;
+        lossSeed = seed;
+    }
+    // How long to announce before streaming, so receivers can get ready
+    void setLeadMs(uint32_t ms) { leadMs = ms; }
+
+    /**
+     * @brief Stream one session; each call uses a new session id
+     *
+     * Returns once END has been sent; the repair server keeps serving the image.
+     */
+    bool send(const uint8_t* image, size_t len);
+
+    uint16_t sessionId() const { return session; }
+    uint16_t repairPort() const { return tcpPort; }
+    uint64_t streamUs() const { return lastStreamUs; }
+    uint64_t bytesSent() const { return lastBytesSent; }
+    uint32_t repairRequests() const { return repairs; }
+    uint64_t repairBytes() const { return repairedBytes; }
+
+   private:
+    void sendPacket(uint8_t type, uint8_t index, uint32_t group, const uint8_t* payload, size_t len);
+    void sendAnnounce();
+    void pace();
+    void runRepair();
+    void serveRepair(int conn);
+
+    int udpFd = -1;
+    int listenFd = -1;
+    uint16_t tcpPort = 0;
+    std::vector<uint8_t> target;  // sockaddr_in of the group
+
+    uint16_t blockSize = 1024;
+    uint8_t k = 16;
+    uint8_t p = 4;
+    bool hasSha256 = false;
+    uint8_t sha256[32] = {0};
+    bool hasSignature = false;
+    uint8_t signature[64] = {0};
+    uint32_t rateLimitKBps = 0;
+    uint8_t lossPercent = 0;
+    uint32_t lossSeed = 1;
+    uint32_t leadMs = 300;
+
+    // Current session, shared with the repair thread
+    std::mutex imageLock;
+    std::vector<uint8_t> image;
+    uint16_t session = 0;
+    char md5[33] = {0};
+
+    uint64_t startUs = 0;
+    uint64_t lastStreamUs = 0;
+    uint64_t lastBytesSent = 0;
+    std::atomic<uint32_t> repairs{0};
+    std::atomic<uint64_t> repairedBytes{0};
+    std::atomic<bool> stopping{false};
+    std::thread repairThread;
+};
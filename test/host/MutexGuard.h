@@ -0,0 +1,26 @@
+// MutexGuard.h - host stand-in for ESP32-MutexGuard (RAII FreeRTOS mutex lock)
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+class MutexGuard {
+   public:
+    explicit MutexGuard(SemaphoreHandle_t m, TickType_t timeout = portMAX_DELAY)
+        : mutex(m), locked(m && xSemaphoreTake(m, timeout) == pdTRUE) {}
+
+    ~MutexGuard() {
+        if (locked) {
+            xSemaphoreGive(mutex);
+        }
+    }
+
+    MutexGuard(const MutexGuard&) = delete;
+    MutexGuard& operator=(const MutexGuard&) = delete;
+
+    bool hasLock() const { return locked; }
+
+   private:
+    SemaphoreHandle_t mutex;
+    bool locked;
+};
@@ -0,0 +1,219 @@
+// PatchGenerator.cpp - bsdiff-style patch generator for OTAPatcher
+#include "PatchGenerator.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "MD5Builder.h"
+
+// Suffix array including the empty suffix, by prefix doubling
+static std::vector<int32_t> suffixArray(const uint8_t* s, int32_t n) {
+    std::vector<int32_t> sa(n + 1), rank(n + 1), next(n + 1);
+    for (int32_t i = 0; i <= n; i++) {
+        sa[i] = i;
+        rank[i] = i < n ? s[i] : -1;
+    }
+    for (int32_t k = 1;; k <<= 1) {
+        auto key = [&](int32_t i) { return std::make_pair(rank[i], i + k <= n ? rank[i + k] : -1); };
+        std::sort(sa.begin(), sa.end(), [&](int32_t a, int32_t b) { return key(a) < key(b); });
+        next[sa[0]] = 0;
+        for (int32_t i = 1; i <= n; i++) {
+            next[sa[i]] = next[sa[i - 1]] + (key(sa[i - 1]) < key(sa[i]) ? 1 : 0);
+        }
+        rank.swap(next);
+        if (rank[sa[n]] == n) {
+            return sa;
+        }
+    }
+}
+
+static int32_t matchLength(const uint8_t* a, int32_t aLen, const uint8_t* b, int32_t bLen) {
+    int32_t i = 0;
+    while (i < aLen && i < bLen && a[i] == b[i]) {
+        i++;
+    }
+    return i;
+}
+
+// Longest match of target in the base via binary search over the suffix array
+static int32_t search(const std::vector<int32_t>& sa, const uint8_t* base, int32_t baseLen,
+                      const uint8_t* target, int32_t targetLen, int32_t st, int32_t en,
+                      int32_t* pos) {
+    while (en - st >= 2) {
+        int32_t mid = st + (en - st) / 2;
+        int32_t n = std::min(baseLen - sa[mid], targetLen);
+        if (memcmp(base + sa[mid], target, n) < 0) {
+            st = mid;
+        } else {
+            en = mid;
+        }
+    }
+    int32_t x = matchLength(base + sa[st], baseLen - sa[st], target, targetLen);
+    int32_t y = matchLength(base + sa[en], baseLen - sa[en], target, targetLen);
+    *pos = x > y ? sa[st] : sa[en];
+    return x > y ? x : y;
+}
+
+static void putVarint(std::vector<uint8_t>& out, uint32_t v) {
+    while (v >= 0x80) {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+static void putLE32(std::vector<uint8_t>& out, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back((uint8_t)(v >> (8 * i)));
+    }
+}
+
+static void putMD5(std::vector<uint8_t>& out, const uint8_t* data, size_t len) {
+    MD5Builder md5;
+    md5.begin();
+    md5.add(data, len);
+    md5.calculate();
+    uint8_t digest[16];
+    md5.getBytes(digest);
+    out.insert(out.end(), digest, digest + 16);
+}
+
+std::vector<uint8_t> makeOtaPatch(const uint8_t* base, size_t baseLen, const uint8_t* target,
+                                  size_t targetLen) {
+    std::vector<uint8_t> patch = {'O', 'T', 'A', 'P', 1, 0, 0, 0};
+    putLE32(patch, (uint32_t)baseLen);
+    putLE32(patch, (uint32_t)targetLen);
+    putMD5(patch, base, baseLen);
+    putMD5(patch, target, targetLen);
+
+    const int32_t oldSize = (int32_t)baseLen;
+    const int32_t newSize = (int32_t)targetLen;
+    std::vector<int32_t> sa = suffixArray(base, oldSize);
+
+    int32_t scan = 0, len = 0, pos = 0;
+    int32_t lastScan = 0, lastPos = 0, lastOffset = 0;
+    while (scan < newSize) {
+        int32_t oldScore = 0;
+        int32_t scsc;
+        for (scsc = scan += len; scan < newSize; scan++) {
+            len = search(sa, base, oldSize, target + scan, newSize - scan, 0, oldSize, &pos);
+            for (; scsc < scan + len; scsc++) {
+                if (scsc + lastOffset < oldSize && base[scsc + lastOffset] == target[scsc]) {
+                    oldScore++;
+                }
+            }
+            if ((len == oldScore && len != 0) || len > oldScore + 8) {
+                break;
+            }
+            if (scan + lastOffset < oldSize && base[scan + lastOffset] == target[scan]) {
+                oldScore--;
+            }
+        }
+
+        if (len != oldScore || scan == newSize) {
+            // Extend the previous match forwards and this one backwards
+            int32_t s = 0, sf = 0, lenf = 0;
+            for (int32_t i = 0; lastScan + i < scan && lastPos + i < oldSize;) {
+                if (base[lastPos + i] == target[lastScan + i]) {
+                    s++;
+                }
+                i++;
+                if (s * 2 - i > sf * 2 - lenf) {
+                    sf = s;
+                    lenf = i;
+                }
+            }
+
+            int32_t lenb = 0;
+            if (scan < newSize) {
+                int32_t sb = 0;
+                s = 0;
+                for (int32_t i = 1; scan >= lastScan + i && pos >= i; i++) {
+                    if (base[pos - i] == target[scan - i]) {
+                        s++;
+                    }
+                    if (s * 2 - i > sb * 2 - lenb) {
+                        sb = s;
+                        lenb = i;
+                    }
+                }
+            }
+
+            if (lastScan + lenf > scan - lenb) {
+                int32_t overlap = (lastScan + lenf) - (scan - lenb);
+                int32_t ss = 0, lens = 0;
+                s = 0;
+                for (int32_t i = 0; i < overlap; i++) {
+                    if (target[lastScan + lenf - overlap + i] == base[lastPos + lenf - overlap + i]) {
+                        s++;
+                    }
+                    if (target[scan - lenb + i] == base[pos - lenb + i]) {
+                        s--;
+                    }
+                    if (s > ss) {
+                        ss = s;
+                        lens = i + 1;
+                    }
+                }
+                lenf += lens - overlap;
+                lenb -= lens;
+            }
+
+            int32_t extra = (scan - lenb) - (lastScan + lenf);
+            int32_t seek = (pos - lenb) - (lastPos + lenf);
+            putVarint(patch, (uint32_t)lenf);
+            putVarint(patch, (uint32_t)extra);
+            putVarint(patch, ((uint32_t)seek << 1) ^ (uint32_t)(seek >> 31));
+            for (int32_t i = 0; i < lenf; i++) {
+                patch.push_back((uint8_t)(target[lastScan + i] - base[lastPos + i]));
+            }
+            patch.insert(patch.end(), target + lastScan + lenf, target + lastScan + lenf + extra);
+
+            lastScan = scan - lenb;
+            lastPos = pos - lenb;
+            lastOffset = pos - scan;
+        }
+    }
+    return patch;
+}
+
+#ifdef PATCH_GENERATOR_MAIN
+static bool readFile(const char* path, std::vector<uint8_t>* out) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        out->insert(out->end(), buf, buf + n);
+    }
+    fclose(f);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 4) {
+        fprintf(stderr, "usage: %s <running.bin> <new.bin> <patch.otap>\n", argv[0]);
+        return 2;
+    }
+    std::vector<uint8_t> base, target;
+    if (!readFile(argv[1], &base) || !readFile(argv[2], &target)) {
+        fprintf(stderr, "cannot read input images\n");
+        return 1;
+    }
+    std::vector<uint8_t> patch = makeOtaPatch(base.data(), base.size(), target.data(), target.size());
+    FILE* f = fopen(argv[3], "wb");
+    if (!f || fwrite(patch.data(), 1, patch.size(), f) != patch.size()) {
+        fprintf(stderr, "cannot write %s\n", argv[3]);
+        return 1;
+    }
+    fclose(f);
+    printf("%zu -> %zu bytes (%.1f%% of the new image)\n", target.size(), patch.size(),
+           100.0 * patch.size() / target.size());
+    return 0;
+}
+#endif
@@ -0,0 +1,22 @@
+/**
+ * @file PatchGenerator.h
+ * @brief Host-side generator for OTAPatcher delta patches
+ *
+ * @details bsdiff matching (suffix array over the base image, approximate
+ * matches extended forwards and backwards) emitted in the OTAPatcher record
+ * format. Used by the native tests and benchmarks, and buildable as a command
+ * line tool:
+ *
+ *     g++ -O2 -DPATCH_GENERATOR_MAIN -Itest/host test/host/PatchGenerator.cpp \
+ *         test/host/MD5Builder.cpp test/host/Arduino.cpp -o otapatch
+ *     ./otapatch old.bin new.bin update.otap && gzip -9 -n update.otap
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+std::vector<uint8_t> makeOtaPatch(const uint8_t* base, size_t baseLen, const uint8_t* target,
+                                  size_t targetLen);
@@ -0,0 +1,98 @@
+// Preferences.cpp - in-memory NVS for the host build
+#include "Preferences.h"
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+typedef std::map<std::string, std::vector<uint8_t>> Namespace;
+
+static std::mutex storeMutex;
+static std::map<std::string, Namespace> store;
+static uint32_t writeCount = 0;
+
+bool Preferences::begin(const char* name, bool ro) {
+    if (opened || !name || strlen(name) == 0 || strlen(name) > 15) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(storeMutex);
+    if (ro && store.find(name) == store.end()) {
+        return false;  // As nvs_open(): a read-only namespace must already exist
+    }
+    store[name];
+    space = name;
+    readOnly = ro;
+    opened = true;
+    return true;
+}
+
+void Preferences::end() {
+    opened = false;
+}
+
+bool Preferences::clear() {
+    if (!opened || readOnly) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(storeMutex);
+    store[space].clear();
+    writeCount++;
+    return true;
+}
+
+bool Preferences::remove(const char* key) {
+    if (!opened || readOnly) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(storeMutex);
+    writeCount++;
+    return store[space].erase(key) > 0;
+}
+
+bool Preferences::isKey(const char* key) {
+    if (!opened) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(storeMutex);
+    return store[space].count(key) > 0;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t len) {
+    if (!opened || readOnly || !key || !value || len == 0) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(storeMutex);
+    const uint8_t* bytes = static_cast<const uint8_t*>(value);
+    store[space][key].assign(bytes, bytes + len);
+    writeCount++;
+    return len;
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+    if (!opened) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(storeMutex);
+    Namespace& ns = store[space];
+    auto it = ns.find(key);
+    return it == ns.end() ? 0 : it->second.size();
+}
+
+size_t Preferences::getBytes(const char* key, void* buf, size_t maxLen) {
+    if (!opened || !buf) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(storeMutex);
+    Namespace& ns = store[space];
+    auto it = ns.find(key);
+    if (it == ns.end() || it->second.size() > maxLen) {
+        return 0;
+    }
+    memcpy(buf, it->second.data(), it->second.size());
+    return it->second.size();
+}
+
+uint32_t Preferences::getWriteCount() {
+    std::lock_guard<std::mutex> lock(storeMutex);
+    return writeCount;
+}
@@ -0,0 +1,37 @@
+/**
+ * @file Preferences.h
+ * @brief Host stand-in for the ESP32 Preferences (NVS) library
+ *
+ * @details Namespaces and keys live in process memory, so values survive
+ * re-initialising OTAManager (as NVS survives a reboot) for the lifetime of the
+ * test binary. Only the blob accessors the library uses are provided.
+ */
+#pragma once
+
+#include "Arduino.h"
+
+#include <string>
+
+class Preferences {
+   public:
+    ~Preferences() { end(); }
+
+    bool begin(const char* name, bool readOnly = false);
+    void end();
+
+    bool clear();
+    bool remove(const char* key);
+    bool isKey(const char* key);
+
+    size_t putBytes(const char* key, const void* value, size_t len);
+    size_t getBytesLength(const char* key);
+    size_t getBytes(const char* key, void* buf, size_t maxLen);
+
+    // Host-only: number of putBytes()/remove()/clear() calls that reached storage
+    static uint32_t getWriteCount();
+
+   private:
+    std::string space;
+    bool opened = false;
+    bool readOnly = true;
+};
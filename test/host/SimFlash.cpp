@@ -0,0 +1,100 @@
+// SimFlash.cpp - simulated NOR flash partition
+#include "SimFlash.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+SimFlashClass SimFlash;
+
+bool SimFlashClass::begin(size_t partitionSize, const char* backingFile) {
+    end();
+    size_t sectors = (partitionSize + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    storage.assign(sectors * SECTOR_SIZE, 0xFF);
+    if (backingFile) {
+        backingFd = open(backingFile, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (backingFd < 0) {
+            return false;
+        }
+        if (pwrite(backingFd, storage.data(), storage.size(), 0) != (ssize_t)storage.size()) {
+            end();
+            return false;
+        }
+    }
+    resetStats();
+    return true;
+}
+
+void SimFlashClass::setRunningImage(const uint8_t* image, size_t len) {
+    running.assign(DEFAULT_PARTITION_SIZE > len ? DEFAULT_PARTITION_SIZE : len, 0xFF);
+    memcpy(running.data(), image, len);
+}
+
+void SimFlashClass::end() {
+    if (backingFd >= 0) {
+        fsync(backingFd);
+        close(backingFd);
+        backingFd = -1;
+    }
+}
+
+void SimFlashClass::setTiming(uint32_t eraseUsPerSector, uint32_t programUsPerKiB) {
+    eraseUs = eraseUsPerSector;
+    programUsPerKB = programUsPerKiB;
+}
+
+void SimFlashClass::resetStats() {
+    eraseCount = 0;
+    bytesProgrammed = 0;
+    busyMicros = 0;
+}
+
+void SimFlashClass::simulateLatency(uint64_t us) {
+    if (us > 0) {
+        usleep((useconds_t)us);
+        busyMicros += us;
+    }
+}
+
+bool SimFlashClass::eraseSector(size_t sector) {
+    size_t offset = sector * SECTOR_SIZE;
+    if (offset + SECTOR_SIZE > storage.size()) {
+        return false;
+    }
+    memset(storage.data() + offset, 0xFF, SECTOR_SIZE);
+    if (backingFd >= 0) {
+        pwrite(backingFd, storage.data() + offset, SECTOR_SIZE, offset);
+    }
+    eraseCount++;
+    simulateLatency(eraseUs);
+    return true;
+}
+
+bool SimFlashClass::write(size_t offset, const uint8_t* data, size_t len) {
+    if (offset + len > storage.size()) {
+        return false;
+    }
+    // NOR programming can only clear bits; unerased regions corrupt like real flash
+    uint8_t* dst = storage.data() + offset;
+    for (size_t i = 0; i < len; i++) {
+        dst[i] &= data[i];
+    }
+    if (backingFd >= 0) {
+        pwrite(backingFd, dst, len, offset);
+    }
+    bytesProgrammed += len;
+    simulateLatency((uint64_t)programUsPerKB * len / 1024);
+    return true;
+}
+
+bool SimFlashClass::read(size_t offset, uint8_t* data, size_t len) const {
+    if (readFailures > 0) {
+        readFailures--;
+        return false;
+    }
+    if (offset + len > storage.size()) {
+        return false;
+    }
+    memcpy(data, storage.data() + offset, len);
+    return true;
+}
@@ -0,0 +1,80 @@
+/**
+ * @file SimFlash.h
+ * @brief Simulated SPI NOR flash partition for the host build
+ *
+ * @details Models the properties of the ESP32 app partition that matter to OTA:
+ * 4 KB erase sectors, erase-before-write (programming can only clear bits) and
+ * configurable erase/program latency so benchmarks see realistic flash stalls.
+ * Contents live in RAM and are optionally mirrored to a backing file.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+class SimFlashClass {
+   public:
+    static constexpr size_t SECTOR_SIZE = 4096;
+    static constexpr size_t DEFAULT_PARTITION_SIZE = 0x1E0000;  // 1.875 MB app slot
+
+    /**
+     * @brief (Re)create the partition, erased to 0xFF
+     *
+     * @param partitionSize Partition size in bytes (rounded up to a sector)
+     * @param backingFile Optional path; when set every program/erase is mirrored to it
+     * @return true on success
+     */
+    bool begin(size_t partitionSize = DEFAULT_PARTITION_SIZE, const char* backingFile = nullptr);
+    void end();
+
+    /**
+     * @brief Set simulated latencies (0 = as fast as the host can go)
+     *
+     * @param eraseUsPerSector Time to erase one 4 KB sector
+     * @param programUsPerKB Time to program 1 KB
+     */
+    void setTiming(uint32_t eraseUsPerSector, uint32_t programUsPerKB);
+
+    bool eraseSector(size_t sector);
+    bool write(size_t offset, const uint8_t* data, size_t len);
+    bool read(size_t offset, uint8_t* data, size_t len) const;
+
+    /**
+     * @brief Fault injection: the next count reads fail
+     */
+    void failReads(uint32_t count) { readFailures = count; }
+
+    size_t size() const { return storage.size(); }
+    const uint8_t* data() const { return storage.data(); }
+
+    /**
+     * @brief Contents of the running app partition (the base for delta updates)
+     *
+     * Kept separately from the update partition and not affected by begin().
+     */
+    void setRunningImage(const uint8_t* image, size_t len);
+    const std::vector<uint8_t>& runningPartition() const { return running; }
+
+    // Statistics since begin()/resetStats()
+    uint32_t getEraseCount() const { return eraseCount; }
+    uint64_t getBytesProgrammed() const { return bytesProgrammed; }
+    uint64_t getBusyMicros() const { return busyMicros; }
+    void resetStats();
+
+   private:
+    void simulateLatency(uint64_t us);
+
+    std::vector<uint8_t> storage;
+    std::vector<uint8_t> running;
+    int backingFd = -1;
+    uint32_t eraseUs = 0;
+    uint32_t programUsPerKB = 0;
+    uint32_t eraseCount = 0;
+    uint64_t bytesProgrammed = 0;
+    uint64_t busyMicros = 0;
+    mutable uint32_t readFailures = 0;
+};
+
+extern SimFlashClass SimFlash;
@@ -0,0 +1,249 @@
+// TraceDecoder.cpp - timelines from OTATrace dumps
+#include "TraceDecoder.h"
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "OTATrace.h"
+
+static uint32_t getLE32(const uint8_t* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+bool decodeOtaTrace(const uint8_t* dump, size_t len, OtaTrace* out) {
+    if (len < OTATrace::HEADER_SIZE || memcmp(dump, "OTR", 3) != 0 || dump[3] != OTATrace::VERSION ||
+        (len - OTATrace::HEADER_SIZE) % OTATrace::RECORD_SIZE != 0) {
+        return false;
+    }
+    out->recorded = getLE32(dump + 4);
+    out->events.clear();
+    // Timestamps wrap every 71 minutes; events are close enough to unroll by deltas.
+    // Erase starts are recorded late with their own time, so deltas can be negative.
+    uint64_t base = (uint64_t)1 << 40;
+    uint32_t previous = 0;
+    for (size_t off = OTATrace::HEADER_SIZE; off < len; off += OTATrace::RECORD_SIZE) {
+        uint32_t raw = getLE32(dump + off);
+        uint32_t word = getLE32(dump + off + 4);
+        if (!out->events.empty()) {
+            base += (int64_t)(int32_t)(raw - previous);
+        }
+        previous = raw;
+        out->events.push_back({base, (uint8_t)(word >> 24), word & OTATrace::ARG_MAX});
+    }
+    if (!out->events.empty()) {
+        uint64_t first = out->events[0].timeUs;
+        for (const OtaTraceEvent& e : out->events) {
+            first = std::min(first, e.timeUs);
+        }
+        for (OtaTraceEvent& e : out->events) {
+            e.timeUs -= first;
+        }
+    }
+    return true;
+}
+
+bool parseOtaTraceLog(const std::string& text, std::vector<uint8_t>* dump) {
+    dump->clear();
+    size_t at = 0;
+    while ((at = text.find("Trace ", at)) != std::string::npos) {
+        at += 6;
+        char* end = nullptr;
+        unsigned long offset = strtoul(text.c_str() + at, &end, 16);
+        if (end == text.c_str() + at || *end != ':' || end[1] != ' ') {
+            continue;  // The summary line, or "Trace" in other text
+        }
+        const char* hex = end + 2;
+        std::vector<uint8_t> bytes;
+        while (isxdigit((unsigned char)hex[0]) && isxdigit((unsigned char)hex[1])) {
+            char pair[3] = {hex[0], hex[1], 0};
+            bytes.push_back((uint8_t)strtoul(pair, nullptr, 16));
+            hex += 2;
+        }
+        if (offset != dump->size()) {
+            if (offset == 0) {
+                dump->clear();  // A later dump in the same capture replaces the earlier one
+            } else {
+                return false;   // A line is missing
+            }
+        }
+        dump->insert(dump->end(), bytes.begin(), bytes.end());
+    }
+    return !dump->empty();
+}
+
+const char* otaTraceEventName(uint8_t event) {
+    switch (event) {
+        case OTA_TRACE_INVITE:
+            return "INVITE";
+        case OTA_TRACE_AUTH_OK:
+            return "AUTH_OK";
+        case OTA_TRACE_CONNECTED:
+            return "CONNECTED";
+        case OTA_TRACE_START:
+            return "START";
+        case OTA_TRACE_FIRST_BYTE:
+            return "FIRST_BYTE";
+        case OTA_TRACE_CHUNK:
+            return "CHUNK";
+        case OTA_TRACE_ERASE_START:
+            return "ERASE_START";
+        case OTA_TRACE_ERASE_END:
+            return "ERASE_END";
+        case OTA_TRACE_STALL:
+            return "STALL";
+        case OTA_TRACE_END:
+            return "END";
+        case OTA_TRACE_ERROR:
+            return "ERROR";
+        default:
+            return "?";
+    }
+}
+
+std::vector<OtaTraceSession> splitOtaTraceSessions(const OtaTrace& trace) {
+    std::vector<OtaTraceSession> sessions;
+    bool started = false;  // The current session has its START
+    bool closed = false;   // ... or has ended or failed
+    for (const OtaTraceEvent& e : trace.events) {
+        bool begins = e.event == OTA_TRACE_INVITE ||
+                      (e.event == OTA_TRACE_START && (sessions.empty() || started || closed));
+        if (begins || sessions.empty()) {
+            sessions.push_back({{}, !begins});
+            started = false;
+            closed = false;
+        }
+        started |= e.event == OTA_TRACE_START;
+        closed |= e.event == OTA_TRACE_END || e.event == OTA_TRACE_ERROR;
+        sessions.back().events.push_back(e);
+    }
+    for (OtaTraceSession& s : sessions) {
+        std::stable_sort(s.events.begin(), s.events.end(),
+                         [](const OtaTraceEvent& a, const OtaTraceEvent& b) { return a.timeUs < b.timeUs; });
+    }
+    return sessions;
+}
+
+static std::string describe(const OtaTraceEvent& e) {
+    static const char* const errors[] = {"auth", "begin", "connect", "receive", "end"};
+    char buf[64];
+    switch (e.event) {
+        case OTA_TRACE_INVITE:
+            snprintf(buf, sizeof(buf), "%u byte image", e.arg);
+            break;
+        case OTA_TRACE_AUTH_OK:
+        case OTA_TRACE_CONNECTED:
+            snprintf(buf, sizeof(buf), "from offset %u", e.arg);
+            break;
+        case OTA_TRACE_START:
+            snprintf(buf, sizeof(buf), "session %u", e.arg);
+            break;
+        case OTA_TRACE_ERASE_START:
+        case OTA_TRACE_ERASE_END:
+            snprintf(buf, sizeof(buf), "sector 0x%06x", e.arg);
+            break;
+        case OTA_TRACE_STALL:
+            snprintf(buf, sizeof(buf), "%u ms", e.arg);
+            break;
+        case OTA_TRACE_ERROR:
+            snprintf(buf, sizeof(buf), "%s (%u)", e.arg < 5 ? errors[e.arg] : "unknown", e.arg);
+            break;
+        default:
+            snprintf(buf, sizeof(buf), "%u bytes", e.arg);
+            break;
+    }
+    return buf;
+}
+
+static void appendf(std::string* out, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+static void appendf(std::string* out, const char* fmt, ...) {
+    char buf[256];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    *out += buf;
+}
+
+std::string formatOtaTrace(const OtaTrace& trace, size_t largestGaps) {
+    std::string out;
+    size_t lost = trace.recorded > trace.events.size() ? trace.recorded - trace.events.size() : 0;
+    appendf(&out, "%zu events, %zu older ones overwritten\n", trace.events.size(), lost);
+
+    std::vector<OtaTraceSession> sessions = splitOtaTraceSessions(trace);
+    for (size_t n = 0; n < sessions.size(); n++) {
+        const std::vector<OtaTraceEvent>& events = sessions[n].events;
+        uint64_t t0 = events.front().timeUs;
+        appendf(&out, "\nSession %zu%s: %zu events over %.3f ms\n", n + 1,
+                sessions[n].partial ? " (start not in the trace)" : "", events.size(),
+                (events.back().timeUs - t0) / 1000.0);
+
+        std::vector<std::pair<uint64_t, size_t>> gaps;  // Gap before event i
+        for (size_t i = 0; i < events.size(); i++) {
+            uint64_t gap = i ? events[i].timeUs - events[i - 1].timeUs : 0;
+            if (i) {
+                gaps.push_back({gap, i});
+            }
+            appendf(&out, "  %12.3f ms  %+11.3f  %-11s %s\n", (events[i].timeUs - t0) / 1000.0,
+                    gap / 1000.0, otaTraceEventName(events[i].event), describe(events[i]).c_str());
+        }
+
+        std::stable_sort(gaps.begin(), gaps.end(),
+                         [](const std::pair<uint64_t, size_t>& a, const std::pair<uint64_t, size_t>& b) {
+                             return a.first > b.first;
+                         });
+        if (gaps.size() > largestGaps) {
+            gaps.resize(largestGaps);
+        }
+        if (!gaps.empty()) {
+            out += "  Largest gaps:";
+            for (const auto& g : gaps) {
+                const OtaTraceEvent& e = events[g.second];
+                appendf(&out, " %.3f ms before %s at %.3f ms;", g.first / 1000.0, otaTraceEventName(e.event),
+                        (e.timeUs - t0) / 1000.0);
+            }
+            out.back() = '\n';
+        }
+    }
+    return out;
+}
+
+#ifdef TRACE_DECODER_MAIN
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <dump.bin | serial log>\n", argv[0]);
+        return 2;
+    }
+    FILE* f = fopen(argv[1], "rb");
+    if (!f) {
+        fprintf(stderr, "cannot read %s\n", argv[1]);
+        return 1;
+    }
+    std::vector<uint8_t> data;
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        data.insert(data.end(), buf, buf + n);
+    }
+    fclose(f);
+
+    std::vector<uint8_t> dump;
+    if (data.size() >= 3 && memcmp(data.data(), "OTR", 3) == 0) {
+        dump = data;
+    } else if (!parseOtaTraceLog(std::string(data.begin(), data.end()), &dump)) {
+        fprintf(stderr, "no trace lines in %s\n", argv[1]);
+        return 1;
+    }
+    OtaTrace trace;
+    if (!decodeOtaTrace(dump.data(), dump.size(), &trace)) {
+        fprintf(stderr, "not an OTA trace (or truncated)\n");
+        return 1;
+    }
+    fputs(formatOtaTrace(trace).c_str(), stdout);
+    return 0;
+}
+#endif
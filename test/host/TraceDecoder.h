@@ -0,0 +1,48 @@
+/**
+ * @file TraceDecoder.h
+ * @brief Host-side decoder for OTATrace dumps
+ *
+ * @details Reads a dump (binary, or the hex lines logTrace() writes, picked out
+ * of a serial capture), splits it into sessions and prints each as a timeline
+ * with the gap before every event and the largest gaps. Used by the native
+ * tests, and buildable as a command line tool:
+ *
+ *     g++ -O2 -DTRACE_DECODER_MAIN -Isrc -Itest/host test/host/TraceDecoder.cpp \
+ *         -o otatrace
+ *     ./otatrace serial.log        # or a binary dump from OTAManager::getTrace()
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+struct OtaTraceEvent {
+    uint64_t timeUs;  // Since the first event in the dump, 32-bit wraps unrolled
+    uint8_t event;    // OTATraceEvent
+    uint32_t arg;
+};
+
+struct OtaTraceSession {
+    std::vector<OtaTraceEvent> events;  // In time order
+    bool partial;                       // Its start was overwritten or cleared
+};
+
+struct OtaTrace {
+    uint32_t recorded;  // Events recorded on the device, including overwritten ones
+    std::vector<OtaTraceEvent> events;
+};
+
+bool decodeOtaTrace(const uint8_t* dump, size_t len, OtaTrace* out);
+
+// Collects "Trace <offset>: <hex>" lines from log text into a binary dump
+bool parseOtaTraceLog(const std::string& text, std::vector<uint8_t>* dump);
+
+// A session begins at an invite, or at a start that no invite led up to
+std::vector<OtaTraceSession> splitOtaTraceSessions(const OtaTrace& trace);
+
+const char* otaTraceEventName(uint8_t event);
+
+std::string formatOtaTrace(const OtaTrace& trace, size_t largestGaps = 3);
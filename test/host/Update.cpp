@@ -0,0 +1,143 @@
+// Update.cpp - host UpdateClass writing into SimFlash
+#include "Update.h"
+
+#include "SimFlash.h"
+
+UpdateClass Update;
+
+bool UpdateClass::begin(size_t size, int command) {
+    if (running) {
+        return false;
+    }
+    error = UPDATE_ERROR_OK;
+    if (command != U_FLASH) {
+        // Only the app partition is simulated
+        error = UPDATE_ERROR_SPACE;
+        return false;
+    }
+    if (size == UPDATE_SIZE_UNKNOWN) {
+        size = SimFlash.size();  // As the core: the whole partition, trimmed by end(true)
+    }
+    if (size == 0 || size > SimFlash.size()) {
+        error = UPDATE_ERROR_SIZE;
+        return false;
+    }
+    totalSize = size;
+    progressBytes = 0;
+    flashOffset = 0;
+    bufferLen = 0;
+    expectedMD5[0] = '\0';
+    md5.begin();
+    running = true;
+    return true;
+}
+
+bool UpdateClass::setMD5(const char* expected) {
+    if (!expected || strlen(expected) != 32) {
+        return false;
+    }
+    memcpy(expectedMD5, expected, 33);
+    return true;
+}
+
+bool UpdateClass::flushBuffer() {
+    if (bufferLen == 0) {
+        return true;
+    }
+    if (!SimFlash.eraseSector(flashOffset / SimFlashClass::SECTOR_SIZE)) {
+        error = UPDATE_ERROR_ERASE;
+        return false;
+    }
+    // As the core, the start of the image reaches flash only once it has been
+    // verified, so an interrupted update never leaves a bootable partition
+    size_t skip = flashOffset == 0 ? (bufferLen < HEADER_HOLDBACK ? bufferLen : HEADER_HOLDBACK) : 0;
+    memcpy(heldHeader, buffer, skip);
+    if (!SimFlash.write(flashOffset + skip, buffer + skip, bufferLen - skip)) {
+        error = UPDATE_ERROR_WRITE;
+        return false;
+    }
+    md5.add(buffer, bufferLen);
+    flashOffset += bufferLen;
+    bufferLen = 0;
+    return true;
+}
+
+size_t UpdateClass::write(uint8_t* data, size_t len) {
+    if (!running || hasError()) {
+        return 0;
+    }
+    if (len > remaining()) {
+        error = UPDATE_ERROR_SPACE;
+        return 0;
+    }
+    size_t written = 0;
+    while (written < len) {
+        size_t take = sizeof(buffer) - bufferLen;
+        if (take > len - written) {
+            take = len - written;
+        }
+        memcpy(buffer + bufferLen, data + written, take);
+        bufferLen += take;
+        written += take;
+        progressBytes += take;
+        if (bufferLen == sizeof(buffer) || progressBytes == totalSize) {
+            if (!flushBuffer()) {
+                return written - take;
+            }
+        }
+    }
+    return written;
+}
+
+bool UpdateClass::end(bool evenIfRemaining) {
+    if (!running || hasError()) {
+        running = false;
+        return false;
+    }
+    if (!isFinished() && !evenIfRemaining) {
+        error = UPDATE_ERROR_ABORT;
+        running = false;
+        return false;
+    }
+    if (!flushBuffer()) {
+        running = false;
+        return false;
+    }
+    totalSize = progressBytes;
+    running = false;
+    md5.calculate();
+    if (expectedMD5[0]) {
+        char actual[33];
+        md5.getChars(actual);
+        if (strcmp(actual, expectedMD5) != 0) {
+            error = UPDATE_ERROR_MD5;
+            return false;
+        }
+    }
+    size_t held = totalSize < HEADER_HOLDBACK ? totalSize : HEADER_HOLDBACK;
+    if (!SimFlash.write(0, heldHeader, held)) {
+        error = UPDATE_ERROR_WRITE;
+        return false;
+    }
+    return true;
+}
+
+void UpdateClass::abort() {
+    running = false;
+    bufferLen = 0;
+    error = UPDATE_ERROR_ABORT;
+}
+
+const char* UpdateClass::errorString() const {
+    switch (error) {
+        case UPDATE_ERROR_OK: return "No Error";
+        case UPDATE_ERROR_WRITE: return "Flash Write Failed";
+        case UPDATE_ERROR_ERASE: return "Flash Erase Failed";
+        case UPDATE_ERROR_SPACE: return "Not Enough Space";
+        case UPDATE_ERROR_SIZE: return "Bad Size Given";
+        case UPDATE_ERROR_STREAM: return "Stream Read Timeout";
+        case UPDATE_ERROR_MD5: return "MD5 Check Failed";
+        case UPDATE_ERROR_ABORT: return "Update Aborted";
+        default: return "UNKNOWN";
+    }
+}
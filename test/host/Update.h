@@ -0,0 +1,63 @@
+/**
+ * @file Update.h
+ * @brief Host stand-in for the ESP32 core UpdateClass, backed by SimFlash
+ *
+ * @details Mirrors the device behaviour: data is staged in a 4 KB buffer and each
+ * full sector is erased then programmed; end() verifies the optional MD5 and only
+ * then writes the first 16 bytes of the image, which are held back until then.
+ */
+#pragma once
+
+#include "Arduino.h"
+#include "MD5Builder.h"
+
+#define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
+
+#define U_FLASH 0
+#define U_SPIFFS 100
+#define U_AUTH 200
+
+#define UPDATE_ERROR_OK (0)
+#define UPDATE_ERROR_WRITE (1)
+#define UPDATE_ERROR_ERASE (2)
+#define UPDATE_ERROR_SPACE (4)
+#define UPDATE_ERROR_SIZE (5)
+#define UPDATE_ERROR_STREAM (6)
+#define UPDATE_ERROR_MD5 (7)
+#define UPDATE_ERROR_ABORT (10)
+
+class UpdateClass {
+   public:
+    bool begin(size_t size = UPDATE_SIZE_UNKNOWN, int command = U_FLASH);
+    size_t write(uint8_t* data, size_t len);
+    bool end(bool evenIfRemaining = false);
+    void abort();
+    bool setMD5(const char* expectedMD5);
+
+    bool isRunning() const { return running; }
+    bool isFinished() const { return running && progressBytes == totalSize; }
+    bool hasError() const { return error != UPDATE_ERROR_OK; }
+    uint8_t getError() const { return error; }
+    const char* errorString() const;
+    size_t size() const { return totalSize; }
+    size_t progress() const { return progressBytes; }
+    size_t remaining() const { return totalSize - progressBytes; }
+
+   private:
+    bool flushBuffer();
+
+    static const size_t HEADER_HOLDBACK = 16;  // ENCRYPTED_BLOCK_SIZE in the core
+
+    bool running = false;
+    uint8_t error = UPDATE_ERROR_OK;
+    size_t totalSize = 0;
+    size_t progressBytes = 0;
+    size_t flashOffset = 0;
+    uint8_t buffer[4096];
+    uint8_t heldHeader[HEADER_HOLDBACK];
+    size_t bufferLen = 0;
+    MD5Builder md5;
+    char expectedMD5[33] = {0};
+};
+
+extern UpdateClass Update;
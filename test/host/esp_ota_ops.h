@@ -0,0 +1,16 @@
+/**
+ * @file esp_ota_ops.h
+ * @brief Host stand-in for the ESP-IDF OTA partition queries
+ *
+ * @details The running partition is backed by SimFlash.setRunningImage(), the
+ * update partition by the SimFlash storage that Update writes. Setting the boot
+ * partition only checks for an app image header and records the choice.
+ */
+#pragma once
+
+#include "esp_partition.h"
+
+const esp_partition_t* esp_ota_get_running_partition(void);
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start_from);
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition);
+const esp_partition_t* esp_ota_get_boot_partition(void);
@@ -0,0 +1,74 @@
+// esp_partition.cpp - running and update app partitions backed by SimFlash
+#include "esp_ota_ops.h"
+
+#include <string.h>
+
+#include "SimFlash.h"
+
+static esp_partition_t runningPartition = {0x10000, 0, "app0"};
+static esp_partition_t updatePartition = {0x1F0000, 0, "app1"};
+static const esp_partition_t* bootPartition = nullptr;
+
+const esp_partition_t* esp_ota_get_running_partition(void) {
+    runningPartition.size = SimFlash.runningPartition().size();
+    return &runningPartition;
+}
+
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start_from) {
+    (void)start_from;
+    updatePartition.size = SimFlash.size();
+    return &updatePartition;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t src_offset, void* dst,
+                             size_t size) {
+    if (partition == &updatePartition && dst) {
+        return SimFlash.read(src_offset, (uint8_t*)dst, size) ? ESP_OK : ESP_ERR_INVALID_SIZE;
+    }
+    if (partition != &runningPartition || !dst) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const std::vector<uint8_t>& data = SimFlash.runningPartition();
+    if (src_offset > data.size() || size > data.size() - src_offset) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(dst, data.data() + src_offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t dst_offset, const void* src,
+                              size_t size) {
+    if (partition != &updatePartition || !src) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return SimFlash.write(dst_offset, (const uint8_t*)src, size) ? ESP_OK : ESP_ERR_INVALID_SIZE;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size) {
+    if (partition != &updatePartition || offset % SimFlashClass::SECTOR_SIZE != 0 ||
+        size % SimFlashClass::SECTOR_SIZE != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t off = offset; off < offset + size; off += SimFlashClass::SECTOR_SIZE) {
+        if (!SimFlash.eraseSector(off / SimFlashClass::SECTOR_SIZE)) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition) {
+    if (partition != &updatePartition && partition != &runningPartition) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint8_t magic = 0;
+    if (esp_partition_read(partition, 0, &magic, 1) != ESP_OK || magic != 0xE9) {
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    bootPartition = partition;
+    return ESP_OK;
+}
+
+const esp_partition_t* esp_ota_get_boot_partition(void) {
+    return bootPartition ? bootPartition : esp_ota_get_running_partition();
+}
@@ -0,0 +1,405 @@
+// FreeRTOS.cpp - pthread-backed implementation of the host FreeRTOS stand-in
+#include "FreeRTOS.h"
+#include "queue.h"
+#include "semphr.h"
+#include "task.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#include <vector>
+
+struct HostTask {
+    TaskFunction_t fn;
+    void* params;
+    char name[16];
+    UBaseType_t priority;
+    BaseType_t coreId;
+    UBaseType_t coreMask;
+    pthread_t thread;
+    pid_t tid;        // Kernel thread id, for setpriority()
+    bool niceManaged; // Created through xTaskCreate, so its nice value follows the priority
+};
+
+struct HostSemaphore {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    UBaseType_t count;
+    UBaseType_t maxCount;
+};
+
+static thread_local HostTask* currentTask = nullptr;
+static thread_local uint32_t semaphoreTakes = 0;
+static std::atomic<bool> prioritiesEnforced{false};
+
+static void applyPriority(HostTask* task) {
+    if (!prioritiesEnforced || !task->niceManaged || task->tid == 0) {
+        return;
+    }
+    int nice = 19 - 4 * (int)task->priority;
+    setpriority(PRIO_PROCESS, task->tid, nice > 0 ? nice : 0);
+}
+
+static UBaseType_t maskOf(BaseType_t coreId) {
+    return coreId == tskNO_AFFINITY ? (1u << portNUM_PROCESSORS) - 1 : 1u << coreId;
+}
+
+static void* taskTrampoline(void* arg) {
+    HostTask* task = static_cast<HostTask*>(arg);
+    currentTask = task;
+    task->tid = (pid_t)syscall(SYS_gettid);
+    task->niceManaged = true;
+    applyPriority(task);
+    task->fn(task->params);
+    // FreeRTOS tasks must not return; treat it like vTaskDelete(NULL)
+    return nullptr;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stackDepth,
+                                   void* params, UBaseType_t priority, TaskHandle_t* handle,
+                                   BaseType_t coreId) {
+    HostTask* task = new HostTask();
+    task->fn = fn;
+    task->params = params;
+    snprintf(task->name, sizeof(task->name), "%s", name ? name : "");
+    task->priority = priority;
+    task->coreId = coreId;
+    task->coreMask = maskOf(coreId);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    // Host stacks are far larger than the requested words; honour a sane minimum
+    size_t stackBytes = (size_t)stackDepth * 4;
+    if (stackBytes < 256 * 1024) {
+        stackBytes = 256 * 1024;
+    }
+    pthread_attr_setstacksize(&attr, stackBytes);
+
+    int rc = pthread_create(&task->thread, &attr, taskTrampoline, task);
+    pthread_attr_destroy(&attr);
+    if (rc != 0) {
+        delete task;
+        return pdFAIL;
+    }
+    if (handle) {
+        *handle = task;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char* name, uint32_t stackDepth, void* params,
+                       UBaseType_t priority, TaskHandle_t* handle) {
+    return xTaskCreatePinnedToCore(fn, name, stackDepth, params, priority, handle, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task == nullptr || task == currentTask) {
+        // The HostTask record is intentionally leaked; handles may still be held by callers
+        pthread_exit(nullptr);
+    }
+    // Deleting another task is not supported on the host; it keeps running to completion
+}
+
+void vTaskDelay(TickType_t ticks) {
+    if (ticks == 0) {
+        sched_yield();
+        return;
+    }
+    usleep((useconds_t)ticks * 1000);
+}
+
+TickType_t xTaskGetTickCount() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (TickType_t)((uint64_t)ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    if (!currentTask) {
+        // Adopt threads that were not created through xTaskCreate (e.g. main)
+        currentTask = new HostTask();
+        currentTask->thread = pthread_self();
+        currentTask->priority = 1;
+        currentTask->coreId = tskNO_AFFINITY;
+        currentTask->coreMask = maskOf(tskNO_AFFINITY);
+        currentTask->tid = (pid_t)syscall(SYS_gettid);
+        snprintf(currentTask->name, sizeof(currentTask->name), "main");
+    }
+    return currentTask;
+}
+
+char* pcTaskGetName(TaskHandle_t task) {
+    return (task ? task : xTaskGetCurrentTaskHandle())->name;
+}
+
+void taskYIELD() {
+    sched_yield();
+}
+
+BaseType_t xPortGetCoreID() {
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    return self->coreId == tskNO_AFFINITY ? 0 : self->coreId;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task) {
+    return (task ? task : xTaskGetCurrentTaskHandle())->priority;
+}
+
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority) {
+    HostTask* t = task ? task : xTaskGetCurrentTaskHandle();
+    t->priority = priority < configMAX_PRIORITIES ? priority : configMAX_PRIORITIES - 1;
+    applyPriority(t);
+}
+
+void vTaskCoreAffinitySet(TaskHandle_t task, UBaseType_t coreMask) {
+    HostTask* t = task ? task : xTaskGetCurrentTaskHandle();
+    t->coreMask = coreMask;
+    t->coreId = tskNO_AFFINITY;
+    if (coreMask != maskOf(tskNO_AFFINITY)) {
+        for (BaseType_t core = 0; core < portNUM_PROCESSORS; core++) {
+            if (coreMask & (1u << core)) {
+                t->coreId = core;
+                break;
+            }
+        }
+    }
+}
+
+UBaseType_t vTaskCoreAffinityGet(TaskHandle_t task) {
+    return (task ? task : xTaskGetCurrentTaskHandle())->coreMask;
+}
+
+static void* probeNice(void* arg) {
+    pid_t tid = (pid_t)syscall(SYS_gettid);
+    *static_cast<bool*>(arg) = setpriority(PRIO_PROCESS, tid, 10) == 0 && setpriority(PRIO_PROCESS, tid, 0) == 0;
+    return nullptr;
+}
+
+bool hostEnforcePriorities(bool enable) {
+    if (enable) {
+        // Try on a throwaway thread: lowering a nice value again needs privilege
+        bool allowed = false;
+        pthread_t probe;
+        if (pthread_create(&probe, nullptr, probeNice, &allowed) != 0) {
+            return false;
+        }
+        pthread_join(probe, nullptr);
+        if (!allowed) {
+            return false;
+        }
+    }
+    prioritiesEnforced = enable;
+    return true;
+}
+
+// Compute an absolute CLOCK_MONOTONIC deadline `ticks` milliseconds from now
+static struct timespec deadlineAfter(TickType_t ticks) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += ticks / 1000;
+    deadline.tv_nsec += (long)(ticks % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    return deadline;
+}
+
+// Wait on `cond` until `ready()` or the tick timeout expires; lock must be held
+template <typename Pred>
+static bool waitUntil(pthread_cond_t* cond, pthread_mutex_t* lock, TickType_t ticks, Pred ready) {
+    if (ticks == portMAX_DELAY) {
+        while (!ready()) {
+            pthread_cond_wait(cond, lock);
+        }
+        return true;
+    }
+    struct timespec deadline = deadlineAfter(ticks);
+    while (!ready()) {
+        if (pthread_cond_timedwait(cond, lock, &deadline) == ETIMEDOUT) {
+            return ready();
+        }
+    }
+    return true;
+}
+
+// === Semaphores ===
+
+static SemaphoreHandle_t createSemaphore(UBaseType_t maxCount, UBaseType_t initialCount) {
+    HostSemaphore* sem = new HostSemaphore();
+    pthread_mutex_init(&sem->lock, nullptr);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&sem->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    sem->count = initialCount;
+    sem->maxCount = maxCount;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    return createSemaphore(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+    return createSemaphore(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount) {
+    return createSemaphore(maxCount, initialCount);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+    if (!sem) {
+        return pdFALSE;
+    }
+    semaphoreTakes++;
+    pthread_mutex_lock(&sem->lock);
+    waitUntil(&sem->cond, &sem->lock, ticks, [sem]() { return sem->count > 0; });
+    BaseType_t taken = pdFALSE;
+    if (sem->count > 0) {
+        sem->count--;
+        taken = pdTRUE;
+    }
+    pthread_mutex_unlock(&sem->lock);
+    return taken;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    if (!sem) {
+        return pdFALSE;
+    }
+    pthread_mutex_lock(&sem->lock);
+    BaseType_t given = pdFALSE;
+    if (sem->count < sem->maxCount) {
+        sem->count++;
+        given = pdTRUE;
+        pthread_cond_signal(&sem->cond);
+    }
+    pthread_mutex_unlock(&sem->lock);
+    return given;
+}
+
+uint32_t hostSemaphoreTakes() {
+    return semaphoreTakes;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) {
+    if (!sem) {
+        return;
+    }
+    pthread_cond_destroy(&sem->cond);
+    pthread_mutex_destroy(&sem->lock);
+    delete sem;
+}
+
+// === Queues ===
+
+struct HostQueue {
+    pthread_mutex_t lock;
+    pthread_cond_t notEmpty;
+    pthread_cond_t notFull;
+    UBaseType_t length;
+    UBaseType_t itemSize;
+    UBaseType_t head;
+    UBaseType_t count;
+    std::vector<uint8_t> storage;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    if (length == 0) {
+        return nullptr;
+    }
+    HostQueue* queue = new HostQueue();
+    pthread_mutex_init(&queue->lock, nullptr);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&queue->notEmpty, &attr);
+    pthread_cond_init(&queue->notFull, &attr);
+    pthread_condattr_destroy(&attr);
+    queue->length = length;
+    queue->itemSize = itemSize;
+    queue->head = 0;
+    queue->count = 0;
+    queue->storage.resize((size_t)length * itemSize);
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks) {
+    if (!queue) {
+        return pdFALSE;
+    }
+    pthread_mutex_lock(&queue->lock);
+    if (!waitUntil(&queue->notFull, &queue->lock, ticks,
+                   [queue]() { return queue->count < queue->length; })) {
+        pthread_mutex_unlock(&queue->lock);
+        return pdFALSE;
+    }
+    UBaseType_t tail = (queue->head + queue->count) % queue->length;
+    memcpy(&queue->storage[(size_t)tail * queue->itemSize], item, queue->itemSize);
+    queue->count++;
+    pthread_cond_signal(&queue->notEmpty);
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void* item) {
+    if (!queue || queue->length != 1) {
+        return pdFALSE;
+    }
+    pthread_mutex_lock(&queue->lock);
+    memcpy(&queue->storage[(size_t)queue->head * queue->itemSize], item, queue->itemSize);
+    queue->count = 1;
+    pthread_cond_signal(&queue->notEmpty);
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks) {
+    if (!queue) {
+        return pdFALSE;
+    }
+    pthread_mutex_lock(&queue->lock);
+    if (!waitUntil(&queue->notEmpty, &queue->lock, ticks, [queue]() { return queue->count > 0; })) {
+        pthread_mutex_unlock(&queue->lock);
+        return pdFALSE;
+    }
+    memcpy(item, &queue->storage[(size_t)queue->head * queue->itemSize], queue->itemSize);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    pthread_cond_signal(&queue->notFull);
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    if (!queue) {
+        return 0;
+    }
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    if (!queue) {
+        return;
+    }
+    pthread_cond_destroy(&queue->notEmpty);
+    pthread_cond_destroy(&queue->notFull);
+    pthread_mutex_destroy(&queue->lock);
+    delete queue;
+}
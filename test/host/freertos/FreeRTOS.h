@@ -0,0 +1,34 @@
+/**
+ * @file FreeRTOS.h
+ * @brief Host (pthread) stand-in for the FreeRTOS kernel API used by OTAManager
+ *
+ * @details Ticks are milliseconds (configTICK_RATE_HZ = 1000). Tasks map to
+ * detached pthreads. Priorities and core affinity are recorded but not enforced,
+ * unless hostEnforcePriorities() maps priorities onto thread nice values.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS 1
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFFUL)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+
+#define tskNO_AFFINITY 0x7FFFFFFF
+#define portNUM_PROCESSORS 2
+#define configMAX_PRIORITIES 25
+// As in the SMP kernel: vTaskCoreAffinitySet()/vTaskCoreAffinityGet()
+#define configUSE_CORE_AFFINITY 1
+
+#include "task.h"
@@ -0,0 +1,33 @@
+// task.h - host stand-in for FreeRTOS task API
+#pragma once
+
+#include "FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void*);
+typedef struct HostTask* TaskHandle_t;
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char* name, uint32_t stackDepth, void* params,
+                       UBaseType_t priority, TaskHandle_t* handle);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stackDepth,
+                                   void* params, UBaseType_t priority, TaskHandle_t* handle,
+                                   BaseType_t coreId);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount();
+TaskHandle_t xTaskGetCurrentTaskHandle();
+// NULL queries the calling task
+char* pcTaskGetName(TaskHandle_t task);
+void taskYIELD();
+BaseType_t xPortGetCoreID();
+// NULL means the calling task
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task);
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority);
+// Bit n allows core n; xPortGetCoreID() reports the lowest allowed core
+void vTaskCoreAffinitySet(TaskHandle_t task, UBaseType_t coreMask);
+UBaseType_t vTaskCoreAffinityGet(TaskHandle_t task);
+
+// Host only: from now on give tasks the nice value max(0, 19 - 4 * priority), so a
+// higher priority wins most of the CPU from lower ones (threads not created through
+// xTaskCreate keep theirs). Returns false, and stays off, if the process may not
+// lower a nice value again (needs CAP_SYS_NICE or RLIMIT_NICE)
+bool hostEnforcePriorities(bool enable);
@@ -49,6 +49,16 @@ if ! run_test "esp32-stress-tests" "Stress Tests"; then
     ((FAILED++))
 fi
 
+# Run microbenchmarks against the stored baselines
+if ! run_test "esp32-bench-tests" "Benchmarks"; then
+    ((FAILED++))
+fi
+
+# Run host (Linux) loopback tests - no board required
+if ! run_test "native" "Host Loopback Tests"; then
+    ((FAILED++))
+fi
+
 # Summary
 echo -e "\n==================================="
 echo "Test Summary"
@@ -0,0 +1,36 @@
+/**
+ * @file test_bench.cpp
+ * @brief OTAManager microbenchmarks on the device
+ *
+ * Runs the cases in bench/OTAManagerBench.h from 1 and 4 tasks spread over
+ * both cores and checks them against the ESP32 baselines in
+ * bench/OTABenchBaselines.h. Run with the esp32-bench-tests environment; the
+ * same cases run on the host in test_native_bench.cpp.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <OTAManager.h>
+
+#include "bench/OTAManagerBench.h"
+
+void setUp() {}
+
+void tearDown() {}
+
+#ifdef UNIT_TEST
+void setup() {
+    delay(2000); // Wait for serial
+
+    Serial.begin(115200);
+    Serial.println("\n=== OTAManager Benchmarks ===\n");
+
+    UNITY_BEGIN();
+    runOTAManagerBenchmarks();
+    UNITY_END();
+}
+
+void loop() {
+    // Nothing to do
+}
+#endif
@@ -0,0 +1,29 @@
+/**
+ * @file test_native_bench.cpp
+ * @brief OTAManager microbenchmarks on the host build
+ *
+ * Runs the cases in bench/OTAManagerBench.h from 1 and 4 threads against the
+ * host baselines in bench/OTABenchBaselines.h. The same cases run on the
+ * device in test_bench.cpp.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <OTAManager.h>
+
+#define HOST_TEST_PORT 13250
+#define OTA_BENCH_PORT HOST_TEST_PORT
+
+#include "bench/OTAManagerBench.h"
+
+void setUp() {}
+
+void tearDown() {}
+
+int main() {
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    UNITY_BEGIN();
+    runOTAManagerBenchmarks();
+    return UNITY_END();
+}
@@ -0,0 +1,241 @@
+/**
+ * @file test_native_boost.cpp
+ * @brief Priority and core of the session task (OTAManager::setSessionBoost())
+ *
+ * A subscriber samples the priority and core of the task it runs on at session
+ * start, during progress, and at the end or error, which OTAManager reports
+ * after restoring them. Sessions run in listener and polling mode, with a
+ * boost, without one, for a task already above the boost, and for a transfer
+ * that fails halfway. Last, a 1 MB update is timed with three busy tasks at
+ * the listener's priority, with and without the boost; the host stand-in then
+ * maps priorities onto nice values, so that needs permission to raise one.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <OTAManager.h>
+#include <EspotaClient.h>
+#include <SimFlash.h>
+
+#include <atomic>
+#include <vector>
+
+#define HOST_TEST_PORT 13253
+#define BOOST_IMAGE_SIZE (256 * 1024)
+#define LOAD_IMAGE_SIZE (1024 * 1024)
+#define LOAD_TASKS 3
+
+// Boost the tests opt into; OTA_SESSION_PRIORITY defaults to none
+#define BOOST_PRIORITY 5
+
+struct TaskSample {
+    std::atomic<int> starts{0};
+    std::atomic<int> ends{0};
+    std::atomic<int> errors{0};
+    UBaseType_t startPriority = 0;
+    UBaseType_t progressPriority = 0;
+    BaseType_t progressCore = -1;
+    UBaseType_t finalPriority = 0;  // At the end or error
+    BaseType_t finalCore = -1;
+};
+
+static TaskSample sample;
+static volatile bool pollerRunning = false;
+static volatile bool loadRunning = false;
+static std::atomic<int> loadTasks{0};
+
+static void onStart(void*) {
+    sample.startPriority = uxTaskPriorityGet(NULL);
+    sample.starts++;
+}
+
+static void onProgress(unsigned int, unsigned int, void*) {
+    sample.progressPriority = uxTaskPriorityGet(NULL);
+    sample.progressCore = xPortGetCoreID();
+}
+
+static void onEnd(void*) {
+    sample.finalPriority = uxTaskPriorityGet(NULL);
+    sample.finalCore = xPortGetCoreID();
+    sample.ends++;
+}
+
+static void onError(ota_error_t, void*) {
+    sample.finalPriority = uxTaskPriorityGet(NULL);
+    sample.finalCore = xPortGetCoreID();
+    sample.errors++;
+}
+
+static bool hostNetworkReady() {
+    return true;
+}
+
+static void pollerTask(void* pvParameters) {
+    (void)pvParameters;
+    while (pollerRunning) {
+        OTAManager::handleUpdates();
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    vTaskDelete(NULL);
+}
+
+// Application work that never blocks
+static void loadTask(void* pvParameters) {
+    (void)pvParameters;
+    loadTasks++;
+    volatile uint32_t spin = 0;
+    while (loadRunning) {
+        spin++;
+    }
+    loadTasks--;
+    vTaskDelete(NULL);
+}
+
+static std::vector<uint8_t> makeImage(size_t size) {
+    std::vector<uint8_t> image(size);
+    for (size_t i = 0; i < size; i++) {
+        image[i] = (uint8_t)(i * 37 + 11);
+    }
+    return image;
+}
+
+static bool upload(const std::vector<uint8_t>& image, EspotaResult* result, size_t cutAfter = 0) {
+    EspotaClient client("127.0.0.1", HOST_TEST_PORT);
+    client.setPassword("secret");
+    client.setTimeoutMs(10000);
+    client.setCutAfter(cutAfter);
+    return client.upload(image.data(), image.size(), result);
+}
+
+static void waitFor(std::atomic<int>& counter, int value) {
+    for (int i = 0; i < 10000 && counter < value; i++) {
+        delay(1);
+    }
+    TEST_ASSERT_EQUAL(value, counter.load());
+}
+
+void setUp() {
+    TEST_ASSERT_TRUE(SimFlash.begin());
+}
+
+void tearDown() {}
+
+void test_policy() {
+    OTAManager::initialize("host-boost", "secret", HOST_TEST_PORT, hostNetworkReady);
+    OTAManager::subscribe({onStart, onProgress, onEnd, onError, nullptr, 0, 0});
+
+    // Cores that do not exist are refused; the priority is kept below the kernel's limit
+    TEST_ASSERT_FALSE(OTAManager::setSessionBoost(5, portNUM_PROCESSORS));
+    TEST_ASSERT_FALSE(OTAManager::setSessionBoost(5, -2));
+    TEST_ASSERT_TRUE(OTAManager::setSessionBoost(100));
+    TEST_ASSERT_TRUE(OTAManager::setSessionBoost(BOOST_PRIORITY, 1));
+    TEST_ASSERT_TRUE(OTAManager::setSessionBoost(OTA_SESSION_PRIORITY, OTA_SESSION_CORE));
+}
+
+void test_listener_session() {
+    std::vector<uint8_t> image = makeImage(BOOST_IMAGE_SIZE);
+    EspotaResult result;
+    TEST_ASSERT_TRUE(OTAManager::setSessionBoost(6, 1));
+    TEST_ASSERT_TRUE(OTAManager::startListener(2));
+
+    // Raised and moved from start to end, then back
+    TEST_ASSERT_TRUE(upload(image, &result));
+    waitFor(sample.ends, 1);
+    TEST_ASSERT_EQUAL(6, sample.startPriority);
+    TEST_ASSERT_EQUAL(6, sample.progressPriority);
+    TEST_ASSERT_EQUAL(1, sample.progressCore);
+    TEST_ASSERT_EQUAL(2, sample.finalPriority);
+    TEST_ASSERT_EQUAL(0, sample.finalCore);
+
+    // Restored on a failed transfer too
+    sample.finalPriority = 0;
+    TEST_ASSERT_FALSE(upload(image, &result, BOOST_IMAGE_SIZE / 2));
+    waitFor(sample.errors, 1);
+    TEST_ASSERT_EQUAL(6, sample.progressPriority);
+    TEST_ASSERT_EQUAL(2, sample.finalPriority);
+    TEST_ASSERT_EQUAL(0, sample.finalCore);
+
+    // No boost
+    TEST_ASSERT_TRUE(OTAManager::setSessionBoost(0));
+    TEST_ASSERT_TRUE(upload(image, &result));
+    waitFor(sample.ends, 2);
+    TEST_ASSERT_EQUAL(2, sample.progressPriority);
+    TEST_ASSERT_EQUAL(0, sample.progressCore);
+    OTAManager::stopListener();
+
+    // A task already above the boost is not lowered
+    TEST_ASSERT_TRUE(OTAManager::setSessionBoost(BOOST_PRIORITY));
+    TEST_ASSERT_TRUE(OTAManager::startListener(BOOST_PRIORITY + 3));
+    TEST_ASSERT_TRUE(upload(image, &result));
+    waitFor(sample.ends, 3);
+    TEST_ASSERT_EQUAL(BOOST_PRIORITY + 3, sample.progressPriority);
+    TEST_ASSERT_EQUAL(BOOST_PRIORITY + 3, sample.finalPriority);
+    OTAManager::stopListener();
+}
+
+void test_polling_session() {
+    std::vector<uint8_t> image = makeImage(BOOST_IMAGE_SIZE);
+    EspotaResult result;
+    int ends = sample.ends + 1;
+    TEST_ASSERT_TRUE(OTAManager::setSessionBoost(BOOST_PRIORITY));
+    pollerRunning = true;
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(pollerTask, "OTAPoll", 4096, NULL, 1, NULL));
+    TEST_ASSERT_TRUE(upload(image, &result));
+    waitFor(sample.ends, ends);
+    pollerRunning = false;
+    delay(20);
+    TEST_ASSERT_EQUAL(BOOST_PRIORITY, sample.startPriority);
+    TEST_ASSERT_EQUAL(BOOST_PRIORITY, sample.progressPriority);
+    TEST_ASSERT_EQUAL(1, sample.finalPriority);
+}
+
+// Transfer time of a listener update at priority 2 with LOAD_TASKS busy tasks at 2
+static double timedUnderLoad(UBaseType_t boost, int load) {
+    std::vector<uint8_t> image = makeImage(LOAD_IMAGE_SIZE);
+    OTAManager::setSessionBoost(boost);
+    loadRunning = true;
+    for (int i = 0; i < load; i++) {
+        TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(loadTask, "AppLoad", 2048, NULL, 2, NULL));
+    }
+    TEST_ASSERT_TRUE(OTAManager::startListener(2));
+    int ends = sample.ends + 1;
+    EspotaResult result;
+    TEST_ASSERT_TRUE(upload(image, &result));
+    waitFor(sample.ends, ends);
+    OTAManager::stopListener();
+    loadRunning = false;
+    while (loadTasks > 0) {
+        delay(1);
+    }
+    return result.transferUs / 1000.0;
+}
+
+void test_throughput_under_load() {
+    if (!hostEnforcePriorities(true)) {
+        TEST_IGNORE_MESSAGE("priorities need CAP_SYS_NICE or RLIMIT_NICE on the host");
+    }
+    double idle = timedUnderLoad(0, 0);
+    double loaded = timedUnderLoad(0, LOAD_TASKS);
+    double boosted = timedUnderLoad(BOOST_PRIORITY, LOAD_TASKS);
+    hostEnforcePriorities(false);
+    OTAManager::setSessionBoost(OTA_SESSION_PRIORITY);
+
+    printf("1 MB, listener at priority 2, %d busy tasks at priority 2:\n", LOAD_TASKS);
+    printf("  no load              %8.1f ms  %6.2f MB/s\n", idle, 1000.0 / idle);
+    printf("  loaded, no boost     %8.1f ms  %6.2f MB/s\n", loaded, 1000.0 / loaded);
+    printf("  loaded, boosted to %d %8.1f ms  %6.2f MB/s\n", BOOST_PRIORITY, boosted, 1000.0 / boosted);
+
+    // The boosted session keeps most of its unloaded speed
+    TEST_ASSERT_TRUE(boosted < loaded * 0.75);
+}
+
+int main() {
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_policy);
+    RUN_TEST(test_listener_session);
+    RUN_TEST(test_polling_session);
+    RUN_TEST(test_throughput_under_load);
+    return UNITY_END();
+}
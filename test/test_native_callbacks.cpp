@@ -0,0 +1,409 @@
+/**
+ * @file test_native_callbacks.cpp
+ * @brief Application callbacks on the callback task (OTAManager::startCallbackTask())
+ *
+ * The queue is checked on its own first: event order, progress coalescing, a
+ * full queue. Then updates are pushed in polling and listener mode with the
+ * callbacks inline and on the callback task, to check where they run and in
+ * which order, and to time a transfer whose progress callback takes 5 ms.
+ * Last, the plain handlers (function and context) are set without allocating
+ * and called with their context, inline and on the callback task.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <OTAManager.h>
+#include <EspotaClient.h>
+#include <SimFlash.h>
+#include <HeapTracker.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define HOST_TEST_PORT 13251
+#define CALLBACK_IMAGE_SIZE (256 * 1024)
+#define SLOW_PROGRESS_MS 5
+
+struct CallbackRecord {
+    char event;  // 'S'tart, 'P'rogress, 'E'nd, e'R'ror
+    uint32_t arg;
+    std::string task;
+    uint32_t restarts;
+};
+
+static std::mutex recordsLock;
+static std::vector<CallbackRecord> records;
+static std::atomic<int> endCount{0};
+static std::atomic<int> errorCount{0};
+static std::atomic<uint32_t> progressCalls{0};
+static volatile uint32_t progressDelayMs = 0;
+static volatile bool pollerRunning = false;
+
+static bool hostNetworkReady() {
+    return true;
+}
+
+static void record(char event, uint32_t arg) {
+    std::lock_guard<std::mutex> lock(recordsLock);
+    records.push_back({event, arg, pcTaskGetName(NULL), ESP.getRestartCount()});
+}
+
+static void setCallbacks() {
+    OTAManager::setStartCallback([]() { record('S', 0); });
+    OTAManager::setProgressCallback([](unsigned int progress, unsigned int) {
+        progressCalls++;
+        if (progressDelayMs) {
+            delay(progressDelayMs);
+        }
+        record('P', progress);
+    });
+    OTAManager::setEndCallback([]() {
+        record('E', 0);
+        endCount++;
+    });
+    OTAManager::setErrorCallback([](ota_error_t error) {
+        record('R', error);
+        errorCount++;
+    });
+}
+
+static void pollerTask(void* pvParameters) {
+    (void)pvParameters;
+    while (pollerRunning) {
+        OTAManager::handleUpdates();
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    vTaskDelete(NULL);
+}
+
+static std::vector<uint8_t> makeImage(size_t size) {
+    std::vector<uint8_t> image(size);
+    for (size_t i = 0; i < size; i++) {
+        image[i] = (uint8_t)(i * 13 + 5);
+    }
+    return image;
+}
+
+static bool upload(const std::vector<uint8_t>& image, EspotaResult* result, const char* password = "secret") {
+    EspotaClient client("127.0.0.1", HOST_TEST_PORT);
+    client.setPassword(password);
+    client.setTimeoutMs(5000);
+    return client.upload(image.data(), image.size(), result);
+}
+
+static void waitFor(std::atomic<int>& counter, int value) {
+    for (int i = 0; i < 5000 && counter < value; i++) {
+        delay(1);
+    }
+    TEST_ASSERT_EQUAL(value, counter.load());
+}
+
+static std::vector<CallbackRecord> takeRecords() {
+    std::lock_guard<std::mutex> lock(recordsLock);
+    std::vector<CallbackRecord> taken;
+    taken.swap(records);
+    return taken;
+}
+
+void setUp() {
+    TEST_ASSERT_TRUE(SimFlash.begin());
+    takeRecords();
+    progressCalls = 0;
+    progressDelayMs = 0;
+}
+
+void tearDown() {}
+
+void test_queue_order_and_coalescing() {
+    OTACallbackQueue queue;
+    TEST_ASSERT_TRUE(queue.begin(4));
+
+    uint32_t start = queue.post(OTA_CALLBACK_START);
+    for (uint32_t i = 0; i <= 1000; i++) {
+        queue.postProgress(i * 100, 100000);
+    }
+    uint32_t end = queue.post(OTA_CALLBACK_END);
+    TEST_ASSERT_EQUAL(1, start);
+    TEST_ASSERT_EQUAL(2, end);
+
+    // A thousand reports are one entry, resolved to the last report
+    OTACallbackMessage m;
+    TEST_ASSERT_TRUE(queue.receive(&m, 0));
+    TEST_ASSERT_EQUAL(OTA_CALLBACK_START, m.event);
+    TEST_ASSERT_TRUE(queue.receive(&m, 0));
+    TEST_ASSERT_EQUAL(OTA_CALLBACK_PROGRESS, m.event);
+    TEST_ASSERT_EQUAL(100000, m.arg);
+    TEST_ASSERT_EQUAL(100000, m.total);
+    TEST_ASSERT_TRUE(queue.receive(&m, 0));
+    TEST_ASSERT_EQUAL(OTA_CALLBACK_END, m.event);
+    TEST_ASSERT_EQUAL(2, m.seq);
+    TEST_ASSERT_FALSE(queue.receive(&m, 0));
+
+    // A report that lands after its token was taken queues a new token; a token
+    // whose report was already delivered resolves to nothing
+    queue.postProgress(1, 10);
+    TEST_ASSERT_TRUE(queue.receive(&m, 0));
+    TEST_ASSERT_EQUAL(1, m.arg);
+    queue.postProgress(2, 10);
+    TEST_ASSERT_TRUE(queue.receive(&m, 0));
+    TEST_ASSERT_EQUAL(2, m.arg);
+
+    // Full: events are dropped and counted, progress tries again with the next report
+    for (int i = 0; i < 4; i++) {
+        TEST_ASSERT_NOT_EQUAL(0, queue.post(OTA_CALLBACK_ERROR, i));
+    }
+    TEST_ASSERT_EQUAL(0, queue.post(OTA_CALLBACK_END));
+    queue.postProgress(3, 10);
+    TEST_ASSERT_TRUE(queue.receive(&m, 0));
+    TEST_ASSERT_EQUAL(OTA_CALLBACK_ERROR, m.event);
+    TEST_ASSERT_EQUAL(0, m.arg);
+    queue.postProgress(4, 10);
+    for (int i = 1; i < 4; i++) {
+        TEST_ASSERT_TRUE(queue.receive(&m, 0));
+        TEST_ASSERT_EQUAL(OTA_CALLBACK_ERROR, m.event);
+    }
+    TEST_ASSERT_TRUE(queue.receive(&m, 0));
+    TEST_ASSERT_EQUAL(OTA_CALLBACK_PROGRESS, m.event);
+    TEST_ASSERT_EQUAL(4, m.arg);
+
+    OTACallbackStats stats = queue.getStats();
+    TEST_ASSERT_EQUAL(6, stats.eventsQueued);
+    TEST_ASSERT_EQUAL(1, stats.eventsDropped);
+    TEST_ASSERT_EQUAL(1005, stats.progressReports);
+    TEST_ASSERT_EQUAL(4, stats.progressDelivered);
+
+    // Handled sequence numbers
+    queue.handled(6);
+    TEST_ASSERT_TRUE(queue.waitHandled(6, 0));
+    TEST_ASSERT_TRUE(queue.waitHandled(5, 0));
+    TEST_ASSERT_FALSE(queue.waitHandled(7, 5));
+}
+
+// Checks one session's records: start, rising progress ending at the image size,
+// end before the restart; all on the expected task
+static void checkSession(const std::vector<CallbackRecord>& recs, const char* task, uint32_t restartsBefore) {
+    TEST_ASSERT_TRUE(recs.size() >= 3);
+    TEST_ASSERT_EQUAL('S', recs.front().event);
+    TEST_ASSERT_EQUAL('E', recs.back().event);
+    TEST_ASSERT_EQUAL(restartsBefore, recs.back().restarts);
+    uint32_t last = 0;
+    for (size_t i = 0; i < recs.size(); i++) {
+        TEST_ASSERT_EQUAL_STRING(task, recs[i].task.c_str());
+        if (i > 0 && i + 1 < recs.size()) {
+            TEST_ASSERT_EQUAL('P', recs[i].event);
+            TEST_ASSERT_TRUE(recs[i].arg >= last);
+            last = recs[i].arg;
+        }
+    }
+    TEST_ASSERT_EQUAL(CALLBACK_IMAGE_SIZE, last);
+}
+
+void test_callbacks_run_on_the_callback_task() {
+    std::vector<uint8_t> image = makeImage(CALLBACK_IMAGE_SIZE);
+    OTAManager::initialize("host-callbacks", "secret", HOST_TEST_PORT, hostNetworkReady);
+    setCallbacks();
+    TEST_ASSERT_FALSE(OTAManager::isCallbackTaskRunning());
+    TEST_ASSERT_TRUE(OTAManager::startCallbackTask());
+    TEST_ASSERT_TRUE(OTAManager::isCallbackTaskRunning());
+    EspotaResult result;
+
+    // Listener mode
+    TEST_ASSERT_TRUE(OTAManager::startListener());
+    uint32_t restarts = ESP.getRestartCount();
+    TEST_ASSERT_TRUE(upload(image, &result));
+    waitFor(endCount, 1);
+    checkSession(takeRecords(), "OTACallbacks", restarts);
+    // The session restarts once the end callback has returned
+    for (int i = 0; i < 1000 && ESP.getRestartCount() == restarts; i++) {
+        delay(1);
+    }
+    TEST_ASSERT_EQUAL(restarts + 1, ESP.getRestartCount());
+
+    // A failed login reaches the error callback there as well
+    TEST_ASSERT_FALSE(upload(image, &result, "wrong"));
+    waitFor(errorCount, 1);
+    std::vector<CallbackRecord> recs = takeRecords();
+    TEST_ASSERT_EQUAL(1, recs.size());
+    TEST_ASSERT_EQUAL('R', recs[0].event);
+    TEST_ASSERT_EQUAL(OTA_AUTH_ERROR, recs[0].arg);
+    TEST_ASSERT_EQUAL_STRING("OTACallbacks", recs[0].task.c_str());
+    OTAManager::stopListener();
+
+    // Polling mode
+    pollerRunning = true;
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(pollerTask, "OTAPoll", 4096, NULL, 1, NULL));
+    restarts = ESP.getRestartCount();
+    TEST_ASSERT_TRUE(upload(image, &result));
+    waitFor(endCount, 2);
+    pollerRunning = false;
+    delay(20);
+    checkSession(takeRecords(), "OTACallbacks", restarts);
+
+    OTACallbackStats stats = OTAManager::getCallbackStats();
+    printf("Callback task: %u events, %u progress reports, %u delivered, %u dropped\n",
+           (unsigned)stats.eventsQueued, (unsigned)stats.progressReports,
+           (unsigned)stats.progressDelivered, (unsigned)stats.eventsDropped);
+    TEST_ASSERT_EQUAL(5, stats.eventsQueued);
+    TEST_ASSERT_EQUAL(0, stats.eventsDropped);
+    TEST_ASSERT_TRUE(stats.progressDelivered <= stats.progressReports);
+
+    // Stopped: inline again, on the task that runs the session
+    OTAManager::stopCallbackTask();
+    TEST_ASSERT_FALSE(OTAManager::isCallbackTaskRunning());
+    TEST_ASSERT_TRUE(OTAManager::startListener());
+    restarts = ESP.getRestartCount();
+    TEST_ASSERT_TRUE(upload(image, &result));
+    waitFor(endCount, 3);
+    OTAManager::stopListener();
+    checkSession(takeRecords(), "OTAListener", restarts);
+}
+
+// Transfer time with the progress callback taking SLOW_PROGRESS_MS per call
+static double timedUpload(bool listener, bool onTask, uint32_t* calls) {
+    std::vector<uint8_t> image = makeImage(CALLBACK_IMAGE_SIZE);
+    if (onTask) {
+        TEST_ASSERT_TRUE(OTAManager::startCallbackTask());
+    }
+    if (listener) {
+        TEST_ASSERT_TRUE(OTAManager::startListener());
+    } else {
+        pollerRunning = true;
+        TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(pollerTask, "OTAPoll", 4096, NULL, 1, NULL));
+    }
+    int ends = endCount + 1;
+    progressCalls = 0;
+    EspotaResult result;
+    TEST_ASSERT_TRUE(upload(image, &result));
+    waitFor(endCount, ends);
+    if (listener) {
+        OTAManager::stopListener();
+    } else {
+        pollerRunning = false;
+        delay(20);
+    }
+    OTAManager::stopCallbackTask();
+    *calls = progressCalls;
+    takeRecords();
+    return result.transferUs / 1000.0;
+}
+
+void test_slow_progress_callback() {
+    struct Mode {
+        const char* name;
+        bool listener;
+    };
+    const Mode modes[] = {{"polling", false}, {"listener", true}};
+
+    printf("%-9s %14s %14s %14s %9s\n", "mode", "fast callback", "slow inline", "slow on task",
+           "calls");
+    for (const Mode& mode : modes) {
+        uint32_t fastCalls, inlineCalls, taskCalls;
+        progressDelayMs = 0;
+        double fast = timedUpload(mode.listener, false, &fastCalls);
+        progressDelayMs = SLOW_PROGRESS_MS;
+        double slowInline = timedUpload(mode.listener, false, &inlineCalls);
+        double slowTask = timedUpload(mode.listener, true, &taskCalls);
+        progressDelayMs = 0;
+        printf("%-9s %11.1f ms %11.1f ms %11.1f ms %4u/%-4u\n", mode.name, fast, slowInline, slowTask,
+               (unsigned)taskCalls, (unsigned)inlineCalls);
+
+        // Inline, every report costs the transfer the callback's time
+        TEST_ASSERT_TRUE(slowInline >= fast + 0.8 * inlineCalls * SLOW_PROGRESS_MS);
+        // On the task the transfer hardly notices, and the reports are coalesced
+        TEST_ASSERT_TRUE(slowTask < fast + 0.25 * (slowInline - fast));
+        TEST_ASSERT_TRUE(taskCalls < inlineCalls);
+    }
+}
+
+struct HandlerCounts {
+    std::atomic<int> starts{0};
+    std::atomic<int> ends{0};
+    std::atomic<int> errors{0};
+    std::atomic<uint32_t> lastProgress{0};
+    std::string progressTask;
+};
+
+static void onPlainStart(void* context) {
+    static_cast<HandlerCounts*>(context)->starts++;
+}
+
+static void onPlainEnd(void* context) {
+    static_cast<HandlerCounts*>(context)->ends++;
+}
+
+static void onPlainProgress(unsigned int progress, unsigned int, void* context) {
+    HandlerCounts* counts = static_cast<HandlerCounts*>(context);
+    counts->lastProgress = progress;
+    counts->progressTask = pcTaskGetName(NULL);
+}
+
+static void onPlainError(ota_error_t, void* context) {
+    static_cast<HandlerCounts*>(context)->errors++;
+}
+
+void test_plain_handlers() {
+    std::vector<uint8_t> image = makeImage(CALLBACK_IMAGE_SIZE);
+    HandlerCounts counts;
+    uintptr_t a = 1, b = 2, c = 3, d = 4;
+
+    // A lambda capturing four words does not fit std::function's inline buffer
+    HeapTracker::resetPeak();
+    OTAManager::setProgressCallback([a, b, c, d](unsigned int, unsigned int) { (void)(a + b + c + d); });
+    uint64_t functionAllocations = HeapTracker::allocations();
+
+    HeapTracker::resetPeak();
+    OTAManager::setStartCallback(onPlainStart, &counts);
+    OTAManager::setEndCallback(onPlainEnd, &counts);
+    OTAManager::setProgressCallback(onPlainProgress, &counts);
+    OTAManager::setErrorCallback(onPlainError, &counts);
+    uint64_t handlerAllocations = HeapTracker::allocations();
+    printf("Allocations: capturing std::function %u, four plain handlers %u\n",
+           (unsigned)functionAllocations, (unsigned)handlerAllocations);
+    TEST_ASSERT_TRUE(functionAllocations > 0);
+    TEST_ASSERT_EQUAL(0, handlerAllocations);
+
+    // Inline, on the listener
+    EspotaResult result;
+    TEST_ASSERT_TRUE(OTAManager::startListener());
+    TEST_ASSERT_TRUE(upload(image, &result));
+    waitFor(counts.ends, 1);
+    TEST_ASSERT_EQUAL(1, counts.starts.load());
+    TEST_ASSERT_EQUAL(CALLBACK_IMAGE_SIZE, counts.lastProgress.load());
+    TEST_ASSERT_EQUAL_STRING("OTAListener", counts.progressTask.c_str());
+
+    // On the callback task
+    TEST_ASSERT_TRUE(OTAManager::startCallbackTask());
+    counts.lastProgress = 0;
+    TEST_ASSERT_TRUE(upload(image, &result));
+    waitFor(counts.ends, 2);
+    TEST_ASSERT_FALSE(upload(image, &result, "wrong"));
+    waitFor(counts.errors, 1);
+    OTAManager::stopCallbackTask();
+    OTAManager::stopListener();
+    TEST_ASSERT_EQUAL(2, counts.starts.load());
+    TEST_ASSERT_EQUAL(CALLBACK_IMAGE_SIZE, counts.lastProgress.load());
+    TEST_ASSERT_EQUAL_STRING("OTACallbacks", counts.progressTask.c_str());
+
+    // The std::function setters take over again
+    OTAManager::setEndCallback([]() { endCount++; });
+    int ends = endCount;
+    TEST_ASSERT_TRUE(OTAManager::startListener());
+    TEST_ASSERT_TRUE(upload(image, &result));
+    waitFor(endCount, ends + 1);
+    OTAManager::stopListener();
+    TEST_ASSERT_EQUAL(2, counts.ends.load());
+    TEST_ASSERT_EQUAL(3, counts.starts.load());
+}
+
+int main() {
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_queue_order_and_coalescing);
+    RUN_TEST(test_callbacks_run_on_the_callback_task);
+    RUN_TEST(test_slow_progress_callback);
+    RUN_TEST(test_plain_handlers);
+    return UNITY_END();
+}
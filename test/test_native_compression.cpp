@@ -0,0 +1,251 @@
+/**
+ * @file test_native_compression.cpp
+ * @brief Streaming decompression of gzip/zlib images
+ *
+ * The decoder is checked against zlib for every deflate block type and for
+ * arbitrary piece sizes (down to one byte), then compressed images are pushed
+ * through the listener. The benchmark sends the same image raw and gzip
+ * compressed over a slow link with ESP32-like flash timing and compares wire
+ * bytes and wall time.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <OTAManager.h>
+#include <OTAInflater.h>
+#include <EspotaClient.h>
+#include <SimFlash.h>
+
+#include <zlib.h>
+
+#include <chrono>
+#include <vector>
+
+#define HOST_TEST_PORT 13236
+
+#ifndef BENCH_IMAGE_SIZE
+#define BENCH_IMAGE_SIZE (512 * 1024)
+#endif
+#ifndef BENCH_ERASE_US
+#define BENCH_ERASE_US 6000
+#endif
+#ifndef BENCH_PROGRAM_US_PER_KB
+#define BENCH_PROGRAM_US_PER_KB 2500
+#endif
+// A congested 2.4 GHz site
+#ifndef BENCH_LINK_KBPS
+#define BENCH_LINK_KBPS 160
+#endif
+
+static volatile int lastError = -1;
+
+static bool hostNetworkReady() {
+    return true;
+}
+
+// Firmware-like content: mostly instructions from a small vocabulary, some literals
+static std::vector<uint8_t> makeFirmwareImage(size_t size) {
+    std::vector<uint8_t> image(size);
+    uint32_t x = 12345;
+    auto next = [&x]() {
+        x = x * 1103515245u + 12345u;
+        return x >> 8;
+    };
+    uint32_t vocabulary[256];
+    for (uint32_t& word : vocabulary) {
+        word = next() * 2654435761u;
+    }
+    image[0] = 0xE9;  // ESP32 image magic
+    for (size_t i = 4; i + 4 <= size; i += 4) {
+        uint32_t r = next();
+        uint32_t word = (r & 0xff) < 190 ? vocabulary[(r >> 8) & 0xff] : next() ^ (next() << 16);
+        memcpy(&image[i], &word, 4);
+    }
+    return image;
+}
+
+// windowBits 15 = zlib container, 31 = gzip
+static std::vector<uint8_t> compress(const std::vector<uint8_t>& data, int level, int windowBits,
+                                     int strategy = Z_DEFAULT_STRATEGY) {
+    z_stream zs = {};
+    TEST_ASSERT_EQUAL(Z_OK, deflateInit2(&zs, level, Z_DEFLATED, windowBits, 8, strategy));
+    std::vector<uint8_t> out(deflateBound(&zs, data.size()) + 64);
+    zs.next_in = const_cast<uint8_t*>(data.data());
+    zs.avail_in = data.size();
+    zs.next_out = out.data();
+    zs.avail_out = out.size();
+    TEST_ASSERT_EQUAL(Z_STREAM_END, deflate(&zs, Z_FINISH));
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return out;
+}
+
+static bool collect(void* context, uint8_t* data, size_t len) {
+    std::vector<uint8_t>* out = static_cast<std::vector<uint8_t>*>(context);
+    out->insert(out->end(), data, data + len);
+    return true;
+}
+
+static bool inflateInPieces(const std::vector<uint8_t>& compressed, size_t piece,
+                            std::vector<uint8_t>* out) {
+    OTAInflater inflater;
+    out->clear();
+    TEST_ASSERT_TRUE(inflater.begin(collect, out));
+    bool ok = true;
+    for (size_t off = 0; off < compressed.size() && ok; off += piece) {
+        size_t n = compressed.size() - off < piece ? compressed.size() - off : piece;
+        ok = inflater.write(compressed.data() + off, n);
+    }
+    return ok && inflater.isFinished();
+}
+
+static double timedUpload(const std::vector<uint8_t>& payload, const std::vector<uint8_t>& image) {
+    TEST_ASSERT_TRUE(SimFlash.begin());
+    SimFlash.setTiming(BENCH_ERASE_US, BENCH_PROGRAM_US_PER_KB);
+    EspotaClient client("127.0.0.1", HOST_TEST_PORT);
+    client.setRateLimitKBps(BENCH_LINK_KBPS);
+    EspotaResult result;
+    TEST_ASSERT_TRUE_MESSAGE(client.upload(payload.data(), payload.size(), &result), result.error);
+    SimFlash.setTiming(0, 0);
+    TEST_ASSERT_EQUAL_MEMORY(image.data(), SimFlash.data(), image.size());
+    return result.transferUs / 1000.0;
+}
+
+void setUp() {
+    lastError = -1;
+}
+
+void tearDown() {
+    SimFlash.setTiming(0, 0);
+}
+
+void test_inflate_matches_zlib_in_any_piece_size() {
+    std::vector<uint8_t> image = makeFirmwareImage(200 * 1024 + 3);
+    struct {
+        const char* name;
+        int level;
+        int windowBits;
+        int strategy;
+    } formats[] = {
+        {"gzip -9", 9, 31, Z_DEFAULT_STRATEGY},  {"zlib -6", 6, 15, Z_DEFAULT_STRATEGY},
+        {"stored", 0, 15, Z_DEFAULT_STRATEGY},   {"fixed Huffman", 6, 31, Z_FIXED},
+        {"Huffman only", 6, 15, Z_HUFFMAN_ONLY}, {"RLE", 6, 31, Z_RLE},
+    };
+    static const size_t pieces[] = {1, 7, 1460, 1 << 20};
+
+    std::vector<uint8_t> out;
+    for (const auto& f : formats) {
+        std::vector<uint8_t> compressed = compress(image, f.level, f.windowBits, f.strategy);
+        for (size_t piece : pieces) {
+            TEST_ASSERT_TRUE_MESSAGE(inflateInPieces(compressed, piece, &out), f.name);
+            TEST_ASSERT_EQUAL(image.size(), out.size());
+            TEST_ASSERT_EQUAL_MEMORY(image.data(), out.data(), image.size());
+        }
+    }
+
+    std::vector<uint8_t> gz = compress(image, 9, 31);
+    auto start = std::chrono::steady_clock::now();
+    TEST_ASSERT_TRUE(inflateInPieces(gz, 4096, &out));
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+                    .count();
+    printf("Inflate: %zu -> %zu bytes (%.0f%%) in %.1f ms, %.1f MB/s output, %u bytes of heap\n",
+           gz.size(), image.size(), 100.0 * gz.size() / image.size(), ms,
+           image.size() / ms / 1000.0, (unsigned)OTAInflater::memoryRequired());
+}
+
+void test_inflate_rejects_damaged_streams() {
+    std::vector<uint8_t> image = makeFirmwareImage(64 * 1024);
+    std::vector<uint8_t> gz = compress(image, 9, 31);
+    std::vector<uint8_t> out;
+
+    std::vector<uint8_t> truncated(gz.begin(), gz.end() - 5);
+    TEST_ASSERT_FALSE(inflateInPieces(truncated, 1460, &out));
+
+    std::vector<uint8_t> flipped = gz;
+    flipped[flipped.size() / 2] ^= 0x10;
+    TEST_ASSERT_FALSE(inflateInPieces(flipped, 1460, &out));
+
+    std::vector<uint8_t> badCrc = gz;
+    badCrc[badCrc.size() - 8] ^= 0x01;
+    TEST_ASSERT_FALSE(inflateInPieces(badCrc, 1460, &out));
+
+    const uint8_t raw[] = {0xE9, 0x03, 0x02, 0x20};
+    TEST_ASSERT_FALSE(OTAInflater::isCompressed(raw, sizeof(raw)));
+    TEST_ASSERT_TRUE(OTAInflater::isCompressed(gz.data(), gz.size()));
+}
+
+void test_compressed_update_over_listener() {
+    OTAManager::initialize("host-compress", "", HOST_TEST_PORT, hostNetworkReady);
+    OTAManager::setEndCallback([]() {});
+    OTAManager::setErrorCallback([](ota_error_t error) { lastError = error; });
+    TEST_ASSERT_TRUE(OTAManager::startListener());
+
+    std::vector<uint8_t> image = makeFirmwareImage(300 * 1024 + 11);
+    const int windowBits[] = {31, 15};  // gzip, zlib
+    for (int wb : windowBits) {
+        std::vector<uint8_t> payload = compress(image, 9, wb);
+        TEST_ASSERT_TRUE(SimFlash.begin());
+        uint32_t restarts = ESP.getRestartCount();
+        EspotaClient client("127.0.0.1", HOST_TEST_PORT);
+        EspotaResult result;
+        TEST_ASSERT_TRUE_MESSAGE(client.upload(payload.data(), payload.size(), &result),
+                                 result.error);
+        TEST_ASSERT_EQUAL_MEMORY(image.data(), SimFlash.data(), image.size());
+        TEST_ASSERT_EQUAL(-1, lastError);
+        for (int i = 0; i < 100 && ESP.getRestartCount() == restarts; i++) {
+            delay(1);
+        }
+        TEST_ASSERT_EQUAL(restarts + 1, ESP.getRestartCount());
+    }
+}
+
+void test_damaged_compressed_update_rejected() {
+    std::vector<uint8_t> image = makeFirmwareImage(128 * 1024);
+    std::vector<uint8_t> payload = compress(image, 9, 31);
+    payload[payload.size() - 8] ^= 0x01;  // CRC-32 of the decoded image
+
+    TEST_ASSERT_TRUE(SimFlash.begin());
+    uint32_t restarts = ESP.getRestartCount();
+    EspotaClient client("127.0.0.1", HOST_TEST_PORT);
+    client.setTimeoutMs(2000);
+    EspotaResult result;
+    TEST_ASSERT_FALSE(client.upload(payload.data(), payload.size(), &result));
+    for (int i = 0; i < 100 && lastError == -1; i++) {
+        delay(1);
+    }
+    TEST_ASSERT_EQUAL(OTA_END_ERROR, lastError);
+    TEST_ASSERT_EQUAL(restarts, ESP.getRestartCount());
+}
+
+void test_compressed_vs_raw_transfer() {
+    std::vector<uint8_t> image = makeFirmwareImage(BENCH_IMAGE_SIZE);
+    std::vector<uint8_t> gz = compress(image, 9, 31);
+
+    double rawMs = timedUpload(image, image);
+    double gzMs = timedUpload(gz, image);
+
+    printf("Compression benchmark: link %d KB/s, flash %d us/erase + %d us/KB\n", BENCH_LINK_KBPS,
+           BENCH_ERASE_US, BENCH_PROGRAM_US_PER_KB);
+    printf("  raw  : %8zu wire bytes, %8.1f ms\n", image.size(), rawMs);
+    printf("  gzip : %8zu wire bytes, %8.1f ms (%.0f%% of the bytes, %.0f%% faster)\n", gz.size(),
+           gzMs, 100.0 * gz.size() / image.size(), 100.0 * (1.0 - gzMs / rawMs));
+
+    TEST_ASSERT_LESS_THAN(image.size() * 3 / 4, gz.size());
+    TEST_ASSERT_LESS_THAN(rawMs * 0.85, gzMs);
+    OTAManager::stopListener();
+}
+
+// Main test runner
+int main() {
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    UNITY_BEGIN();
+
+    RUN_TEST(test_inflate_matches_zlib_in_any_piece_size);
+    RUN_TEST(test_inflate_rejects_damaged_streams);
+    RUN_TEST(test_compressed_update_over_listener);
+    RUN_TEST(test_damaged_compressed_update_rejected);
+    RUN_TEST(test_compressed_vs_raw_transfer);
+
+    return UNITY_END();
+}
@@ -0,0 +1,129 @@
+/**
+ * @file test_native_contention.cpp
+ * @brief Cost of handleUpdates() when several tasks call it at once
+ *
+ * Counts the lock acquisitions of a single call on each path: none while there
+ * is nothing to poll (before initialize(), in listener mode, or while only signed
+ * updates are accepted) and one while polling ArduinoOTA. The benchmark runs 1 to
+ * 8 FreeRTOS tasks (pthreads on the host) calling handleUpdates() in a loop and
+ * reports calls per second on the idle and the polling path.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <OTAManager.h>
+
+#include <atomic>
+
+#define HOST_TEST_PORT 13243
+
+#ifndef CONTENTION_MEASURE_MS
+#define CONTENTION_MEASURE_MS 300
+#endif
+
+static std::atomic<uint32_t> networkChecks{0};
+static std::atomic<bool> hammerRunning{false};
+static std::atomic<uint64_t> hammerCalls{0};
+static std::atomic<int> hammersDone{0};
+
+static bool countingNetworkReady() {
+    networkChecks++;
+    return true;
+}
+
+static void hammerTask(void* pvParameters) {
+    (void)pvParameters;
+    uint64_t calls = 0;
+    while (hammerRunning.load(std::memory_order_relaxed)) {
+        OTAManager::handleUpdates();
+        calls++;
+    }
+    hammerCalls += calls;
+    hammersDone++;
+    vTaskDelete(NULL);
+}
+
+// Calls per second with `tasks` tasks calling handleUpdates() back to back
+static double measureCallsPerSecond(int tasks) {
+    hammerCalls = 0;
+    hammersDone = 0;
+    hammerRunning = true;
+    for (int i = 0; i < tasks; i++) {
+        TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(hammerTask, "OTAHammer", 4096, NULL, 1, NULL));
+    }
+    delay(CONTENTION_MEASURE_MS);
+    hammerRunning = false;
+    while (hammersDone < tasks) {
+        delay(1);
+    }
+    return hammerCalls * 1000.0 / CONTENTION_MEASURE_MS;
+}
+
+// Lock acquisitions made by one handleUpdates() call on this thread
+static uint32_t locksPerCall() {
+    uint32_t before = hostSemaphoreTakes();
+    OTAManager::handleUpdates();
+    return hostSemaphoreTakes() - before;
+}
+
+void setUp() {
+    networkChecks = 0;
+}
+
+void tearDown() {}
+
+void test_handle_updates_lock_count() {
+    // Not initialized yet: nothing to do, nothing locked
+    TEST_ASSERT_EQUAL(0, locksPerCall());
+
+    OTAManager::initialize("host-contention", "", HOST_TEST_PORT, countingNetworkReady);
+    TEST_ASSERT_TRUE(OTAManager::isInitialized());
+
+    // Polling: one acquisition covers the network check and ArduinoOTA.handle()
+    TEST_ASSERT_EQUAL(1, locksPerCall());
+    TEST_ASSERT_EQUAL(1, networkChecks.load());
+
+    // Listener mode: the listener task serves updates
+    TEST_ASSERT_TRUE(OTAManager::startListener());
+    networkChecks = 0;
+    TEST_ASSERT_EQUAL(0, locksPerCall());
+    TEST_ASSERT_EQUAL(0, networkChecks.load());
+    OTAManager::stopListener();
+    TEST_ASSERT_EQUAL(1, locksPerCall());
+
+    // Only signed updates: ArduinoOTA is not polled
+    uint8_t publicKey[32] = {1};
+    OTAManager::setSigningKey(publicKey);
+    TEST_ASSERT_EQUAL(0, locksPerCall());
+    OTAManager::setSigningKey(nullptr);
+    TEST_ASSERT_EQUAL(1, locksPerCall());
+}
+
+void test_handle_updates_contention() {
+    const int taskCounts[] = {1, 2, 4, 8};
+
+    printf("handleUpdates() contention, %d ms per run\n", CONTENTION_MEASURE_MS);
+    printf("  tasks   idle (listener) calls/s   polling calls/s\n");
+    for (int tasks : taskCounts) {
+        TEST_ASSERT_TRUE(OTAManager::startListener());
+        double idle = measureCallsPerSecond(tasks);
+        OTAManager::stopListener();
+        double polling = measureCallsPerSecond(tasks);
+        printf("  %5d   %23.0f   %15.0f\n", tasks, idle, polling);
+
+        // The idle check never waits for the lock, so it stays far ahead of polling
+        TEST_ASSERT_TRUE(idle > polling * 10);
+    }
+}
+
+// Main test runner
+int main() {
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    UNITY_BEGIN();
+
+    RUN_TEST(test_handle_updates_lock_count);
+    RUN_TEST(test_handle_updates_contention);
+
+    return UNITY_END();
+}
@@ -0,0 +1,354 @@
+/**
+ * @file test_native_delta.cpp
+ * @brief Delta updates applied against the running partition
+ *
+ * Images are rendered from a small "program" model so that a release can insert
+ * code and have every absolute address after it relocated, which is what makes
+ * real firmware diffs large for naive tools. Patches are produced by the host
+ * generator, applied in arbitrary pieces, and pushed through the listener. The
+ * benchmark reports patch sizes, generation and apply time, and a full versus
+ * delta update over a slow link with ESP32-like flash timing.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <OTAManager.h>
+#include <OTAPatcher.h>
+#include <EspotaClient.h>
+#include <PatchGenerator.h>
+#include <SimFlash.h>
+
+#include <zlib.h>
+
+#include <chrono>
+#include <vector>
+
+#define HOST_TEST_PORT 13237
+
+#ifndef BENCH_IMAGE_SIZE
+#define BENCH_IMAGE_SIZE (256 * 1024)
+#endif
+#ifndef BENCH_ERASE_US
+#define BENCH_ERASE_US 6000
+#endif
+#ifndef BENCH_PROGRAM_US_PER_KB
+#define BENCH_PROGRAM_US_PER_KB 2500
+#endif
+// A weak link at the edge of coverage
+#ifndef BENCH_LINK_KBPS
+#define BENCH_LINK_KBPS 64
+#endif
+
+#define IMAGE_BASE_ADDRESS 0x400D0000u
+
+static volatile int lastError = -1;
+
+static bool hostNetworkReady() {
+    return true;
+}
+
+// One 32-bit word of the program: an instruction from a small vocabulary, a
+// literal, or a pointer to another word (rendered as an absolute address)
+struct Word {
+    uint8_t kind;
+    uint32_t value;
+};
+
+struct Program {
+    std::vector<Word> words;
+    uint32_t seed;
+
+    uint32_t next() {
+        seed = seed * 1103515245u + 12345u;
+        return seed >> 8;
+    }
+
+    Word randomWord(size_t at) {
+        uint32_t r = next() & 0xff;
+        if (r < 170) {
+            return {0, next() & 0xff};
+        }
+        if (r < 215) {
+            // Mostly near references, as in real code
+            int32_t target = (int32_t)at + (int32_t)(next() % 2048) - 1024;
+            return {2, (uint32_t)(target < 0 ? 0 : target)};
+        }
+        return {1, next() ^ (next() << 16)};
+    }
+
+    static Program generate(size_t bytes) {
+        Program p = {{}, 99};
+        p.words.reserve(bytes / 4);
+        for (size_t i = 0; i < bytes / 4; i++) {
+            p.words.push_back(p.randomWord(i));
+        }
+        return p;
+    }
+
+    // Insert new words at index, relocating every pointer past it
+    void insert(size_t at, size_t count) {
+        for (Word& w : words) {
+            if (w.kind == 2 && w.value >= at) {
+                w.value += count;
+            }
+        }
+        std::vector<Word> added;
+        for (size_t i = 0; i < count; i++) {
+            added.push_back(randomWord(at + i));
+        }
+        words.insert(words.begin() + at, added.begin(), added.end());
+    }
+
+    void edit(size_t at, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            words[at + i] = randomWord(at + i);
+        }
+    }
+
+    std::vector<uint8_t> render() const {
+        static uint32_t vocabulary[256];
+        static bool ready = false;
+        if (!ready) {
+            uint32_t x = 7;
+            for (uint32_t& v : vocabulary) {
+                x = x * 1103515245u + 12345u;
+                v = x * 2654435761u;
+            }
+            ready = true;
+        }
+        std::vector<uint8_t> image(words.size() * 4);
+        for (size_t i = 0; i < words.size(); i++) {
+            const Word& w = words[i];
+            uint32_t v = w.kind == 0 ? vocabulary[w.value]
+                                     : w.kind == 2 ? IMAGE_BASE_ADDRESS + 4 * w.value : w.value;
+            memcpy(&image[4 * i], &v, 4);
+        }
+        image[0] = 0xE9;
+        return image;
+    }
+};
+
+static std::vector<uint8_t> gzip(const std::vector<uint8_t>& data) {
+    z_stream zs = {};
+    TEST_ASSERT_EQUAL(Z_OK, deflateInit2(&zs, 9, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY));
+    std::vector<uint8_t> out(deflateBound(&zs, data.size()) + 64);
+    zs.next_in = const_cast<uint8_t*>(data.data());
+    zs.avail_in = data.size();
+    zs.next_out = out.data();
+    zs.avail_out = out.size();
+    TEST_ASSERT_EQUAL(Z_STREAM_END, deflate(&zs, Z_FINISH));
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return out;
+}
+
+static const std::vector<uint8_t>* memoryBase = nullptr;
+
+static bool readMemoryBase(void* context, uint32_t offset, uint8_t* dst, size_t len) {
+    (void)context;
+    if (offset + len > memoryBase->size()) {
+        return false;
+    }
+    memcpy(dst, memoryBase->data() + offset, len);
+    return true;
+}
+
+static bool collect(void* context, uint8_t* data, size_t len) {
+    std::vector<uint8_t>* out = static_cast<std::vector<uint8_t>*>(context);
+    out->insert(out->end(), data, data + len);
+    return true;
+}
+
+static bool applyInPieces(const std::vector<uint8_t>& base, std::vector<uint8_t> patch,
+                          size_t piece, std::vector<uint8_t>* out) {
+    memoryBase = &base;
+    OTAPatcher patcher;
+    out->clear();
+    TEST_ASSERT_TRUE(patcher.begin(readMemoryBase, collect, out));
+    bool ok = true;
+    for (size_t off = 0; off < patch.size() && ok; off += piece) {
+        size_t n = patch.size() - off < piece ? patch.size() - off : piece;
+        ok = patcher.write(patch.data() + off, n);
+    }
+    return ok && patcher.isFinished();
+}
+
+static bool upload(const std::vector<uint8_t>& payload, EspotaResult* result,
+                   uint32_t linkKBps = 0) {
+    EspotaClient client("127.0.0.1", HOST_TEST_PORT);
+    client.setRateLimitKBps(linkKBps);
+    client.setTimeoutMs(3000);
+    return client.upload(payload.data(), payload.size(), result);
+}
+
+static double elapsedMs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+void setUp() {
+    lastError = -1;
+}
+
+void tearDown() {
+    SimFlash.setTiming(0, 0);
+}
+
+void test_patch_applies_in_any_piece_size() {
+    Program program = Program::generate(96 * 1024);
+    std::vector<uint8_t> base = program.render();
+    program.insert(9000, 300);
+    program.edit(20000, 40);
+    std::vector<uint8_t> target = program.render();
+    target.push_back(0x42);  // Not a word multiple
+
+    std::vector<uint8_t> patch = makeOtaPatch(base.data(), base.size(), target.data(), target.size());
+    static const size_t pieces[] = {1, 13, 1460, 1 << 20};
+    std::vector<uint8_t> out;
+    for (size_t piece : pieces) {
+        TEST_ASSERT_TRUE(applyInPieces(base, patch, piece, &out));
+        TEST_ASSERT_EQUAL(target.size(), out.size());
+        TEST_ASSERT_EQUAL_MEMORY(target.data(), out.data(), target.size());
+    }
+
+    // Identical and completely unrelated images are valid patches too
+    std::vector<uint8_t> same = makeOtaPatch(base.data(), base.size(), base.data(), base.size());
+    TEST_ASSERT_TRUE(applyInPieces(base, same, 1460, &out));
+    TEST_ASSERT_EQUAL_MEMORY(base.data(), out.data(), base.size());
+    std::vector<uint8_t> other = Program::generate(8 * 1024).render();
+    other[100] ^= 0x55;
+    std::vector<uint8_t> unrelated = makeOtaPatch(base.data(), 4096, other.data(), other.size());
+    std::vector<uint8_t> shortBase(base.begin(), base.begin() + 4096);
+    TEST_ASSERT_TRUE(applyInPieces(shortBase, unrelated, 1460, &out));
+    TEST_ASSERT_EQUAL_MEMORY(other.data(), out.data(), other.size());
+}
+
+void test_patch_rejects_wrong_base_and_damage() {
+    Program program = Program::generate(32 * 1024);
+    std::vector<uint8_t> base = program.render();
+    program.edit(1000, 10);
+    std::vector<uint8_t> target = program.render();
+    std::vector<uint8_t> patch = makeOtaPatch(base.data(), base.size(), target.data(), target.size());
+    std::vector<uint8_t> out;
+
+    std::vector<uint8_t> otherBase = base;
+    otherBase[5000] ^= 1;
+    TEST_ASSERT_FALSE(applyInPieces(otherBase, patch, 1460, &out));
+    TEST_ASSERT_EQUAL(0, out.size());  // Nothing produced before the base is verified
+
+    std::vector<uint8_t> truncated(patch.begin(), patch.end() - 10);
+    TEST_ASSERT_FALSE(applyInPieces(base, truncated, 1460, &out));
+
+    std::vector<uint8_t> badMagic = patch;
+    badMagic[4] = 9;  // Version
+    TEST_ASSERT_FALSE(applyInPieces(base, badMagic, 1460, &out));
+}
+
+void test_delta_update_over_listener() {
+    OTAManager::initialize("host-delta", "", HOST_TEST_PORT, hostNetworkReady);
+    OTAManager::setEndCallback([]() {});
+    OTAManager::setErrorCallback([](ota_error_t error) { lastError = error; });
+    TEST_ASSERT_TRUE(OTAManager::startListener());
+
+    Program program = Program::generate(200 * 1024);
+    std::vector<uint8_t> running = program.render();
+    program.insert(20000, 512);
+    std::vector<uint8_t> target = program.render();
+    std::vector<uint8_t> patch =
+        makeOtaPatch(running.data(), running.size(), target.data(), target.size());
+    SimFlash.setRunningImage(running.data(), running.size());
+
+    // Plain and gzip compressed patch
+    const std::vector<uint8_t> payloads[] = {patch, gzip(patch)};
+    for (const std::vector<uint8_t>& payload : payloads) {
+        TEST_ASSERT_TRUE(SimFlash.begin());
+        uint32_t restarts = ESP.getRestartCount();
+        EspotaResult result;
+        TEST_ASSERT_TRUE_MESSAGE(upload(payload, &result), result.error);
+        TEST_ASSERT_EQUAL_MEMORY(target.data(), SimFlash.data(), target.size());
+        TEST_ASSERT_EQUAL(-1, lastError);
+        for (int i = 0; i < 100 && ESP.getRestartCount() == restarts; i++) {
+            delay(1);
+        }
+        TEST_ASSERT_EQUAL(restarts + 1, ESP.getRestartCount());
+    }
+
+    // A device running something else must refuse the patch
+    std::vector<uint8_t> otherRunning = running;
+    otherRunning[1234] ^= 0xff;
+    SimFlash.setRunningImage(otherRunning.data(), otherRunning.size());
+    TEST_ASSERT_TRUE(SimFlash.begin());
+    uint32_t restarts = ESP.getRestartCount();
+    EspotaResult result;
+    TEST_ASSERT_FALSE(upload(patch, &result));
+    for (int i = 0; i < 100 && lastError == -1; i++) {
+        delay(1);
+    }
+    TEST_ASSERT_EQUAL(OTA_END_ERROR, lastError);
+    TEST_ASSERT_EQUAL(restarts, ESP.getRestartCount());
+}
+
+static void benchRelease(const char* name, const std::vector<uint8_t>& running,
+                         const std::vector<uint8_t>& target) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<uint8_t> patch =
+        makeOtaPatch(running.data(), running.size(), target.data(), target.size());
+    double generateMs = elapsedMs(start);
+    std::vector<uint8_t> patchGz = gzip(patch);
+    std::vector<uint8_t> fullGz = gzip(target);
+
+    std::vector<uint8_t> out;
+    start = std::chrono::steady_clock::now();
+    TEST_ASSERT_TRUE(applyInPieces(running, patch, 1460, &out));
+    double applyMs = elapsedMs(start);
+
+    SimFlash.setRunningImage(running.data(), running.size());
+    EspotaResult full, delta;
+    TEST_ASSERT_TRUE(SimFlash.begin());
+    SimFlash.setTiming(BENCH_ERASE_US, BENCH_PROGRAM_US_PER_KB);
+    TEST_ASSERT_TRUE_MESSAGE(upload(fullGz, &full, BENCH_LINK_KBPS), full.error);
+    TEST_ASSERT_TRUE(SimFlash.begin());
+    TEST_ASSERT_TRUE_MESSAGE(upload(patchGz, &delta, BENCH_LINK_KBPS), delta.error);
+    SimFlash.setTiming(0, 0);
+    TEST_ASSERT_EQUAL_MEMORY(target.data(), SimFlash.data(), target.size());
+
+    printf("  %-24s %8zu %8zu %8zu %8zu %9.0f %7.1f %9.0f %9.0f\n", name, target.size(),
+           fullGz.size(), patch.size(), patchGz.size(), generateMs, applyMs,
+           full.transferUs / 1000.0, delta.transferUs / 1000.0);
+
+    TEST_ASSERT_LESS_THAN(fullGz.size() / 4, patchGz.size());
+    TEST_ASSERT_LESS_THAN(full.transferUs, delta.transferUs);
+}
+
+void test_delta_vs_full_update() {
+    Program program = Program::generate(BENCH_IMAGE_SIZE);
+    std::vector<uint8_t> v1 = program.render();
+    program.edit(program.words.size() / 3, 20);
+    program.edit(program.words.size() / 2, 8);
+    std::vector<uint8_t> v2 = program.render();
+    program.insert(program.words.size() / 4, 1024);  // 4 KB of new code, everything relocated
+    program.edit(program.words.size() / 2, 64);
+    std::vector<uint8_t> v3 = program.render();
+
+    printf("Delta benchmark: link %d KB/s, flash %d us/erase + %d us/KB (bytes, ms)\n",
+           BENCH_LINK_KBPS, BENCH_ERASE_US, BENCH_PROGRAM_US_PER_KB);
+    printf("  %-24s %8s %8s %8s %8s %9s %7s %9s %9s\n", "release", "image", "full.gz", "patch",
+           "patch.gz", "generate", "apply", "full upd", "delta upd");
+    benchRelease("small fix", v1, v2);
+    benchRelease("feature + relocation", v2, v3);
+    OTAManager::stopListener();
+}
+
+// Main test runner
+int main() {
+    esp_log_level_set("*", ESP_LOG_ERROR);
+
+    UNITY_BEGIN();
+
+    RUN_TEST(test_patch_applies_in_any_piece_size);
+    RUN_TEST(test_patch_rejects_wrong_base_and_damage);
+    RUN_TEST(test_delta_update_over_listener);
+    RUN_TEST(test_delta_vs_full_update);
+
+    return UNITY_END();
+}
@@ -0,0 +1,264 @@
+/**
+ * @file test_native_events.cpp
+ * @brief Session event subscribers (OTAManager::subscribe())
+ *
+ * The subscriber table is checked on its own first: capacity, ids, and which
+ * progress reports each rate filter lets through, on a simulated clock. Then
+ * updates are pushed with several subscribers next to the application's
+ * callbacks, inline and with the callback task, to check that every subscriber
+ * sees the session and none replaces another or the callbacks.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <OTAManager.h>
+#include <EspotaClient.h>
+#include <SimFlash.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#define HOST_TEST_PORT 13252
+#define EVENTS_IMAGE_SIZE (256 * 1024)
+#define CHUNK 1460
+
+struct SubscriberLog {
+    std::atomic<int> starts{0};
+    std::atomic<int> ends{0};
+    std::atomic<int> errors{0};
+    std::vector<uint32_t> progress;  // Reports received
+    std::vector<uint32_t> times;     // ... and the clock at each (bus test only)
+    uint32_t endRestarts = 0;        // ESP.getRestartCount() in onEnd
+    std::string task;
+    uint32_t* clock = nullptr;
+};
+
+static void onStart(void* context) {
+    static_cast<SubscriberLog*>(context)->starts++;
+}
+
+static void onProgress(unsigned int progress, unsigned int, void* context) {
+    SubscriberLog* log = static_cast<SubscriberLog*>(context);
+    log->progress.push_back(progress);
+    log->times.push_back(log->clock ? *log->clock : 0);
+    log->task = pcTaskGetName(NULL);
+}
+
+static void onEnd(void* context) {
+    SubscriberLog* log = static_cast<SubscriberLog*>(context);
+    log->endRestarts = ESP.getRestartCount();
+    log->ends++;
+}
+
+static void onError(ota_error_t, void* context) {
+    static_cast<SubscriberLog*>(context)->errors++;
+}
+
+static OTASubscriber makeSubscriber(SubscriberLog* log, uint32_t minBytes, uint32_t minMs) {
+    return {onStart, onProgress, onEnd, onError, log, minBytes, minMs};
+}
+
+static bool hostNetworkReady() {
+    return true;
+}
+
+static std::vector<uint8_t> makeImage(size_t size) {
+    std::vector<uint8_t> image(size);
+    for (size_t i = 0; i < size; i++) {
+        image[i] = (uint8_t)(i * 29 + 3);
+    }
+    return image;
+}
+
+static bool upload(const std::vector<uint8_t>& image, EspotaResult* result, const char* password = "secret") {
+    EspotaClient client("127.0.0.1", HOST_TEST_PORT);
+    client.setPassword(password);
+    client.setTimeoutMs(5000);
+    return client.upload(image.data(), image.size(), result);
+}
+
+static void waitFor(std::atomic<int>& counter, int value) {
+    for (int i = 0; i < 5000 && counter < value; i++) {
+        delay(1);
+    }
+    TEST_ASSERT_EQUAL(value, counter.load());
+}
+
+// Every report after the first and before the last is at least minBytes and
+// minMs after the one before it
+static void checkSpacing(const SubscriberLog& log, uint32_t minBytes, uint32_t minMs, uint32_t total) {
+    TEST_ASSERT_TRUE(log.progress.size() >= 2);
+    TEST_ASSERT_EQUAL(0, log.progress.front());
+    TEST_ASSERT_EQUAL(total, log.progress.back());
+    for (size_t i = 1; i + 1 < log.progress.size(); i++) {
+        TEST_ASSERT_TRUE(log.progress[i] - log.progress[i - 1] >= minBytes);
+        TEST_ASSERT_TRUE(log.times[i] - log.times[i - 1] >= minMs);
+    }
+}
+
+void setUp() {
+    TEST_ASSERT_TRUE(SimFlash.begin());
+}
+
+void tearDown() {}
+
+void test_subscribe_needs_initialize() {
+    SubscriberLog log;
+    TEST_ASSERT_EQUAL(-1, OTAManager::subscribe(makeSubscriber(&log, 0, 0)));
+    TEST_ASSERT_FALSE(OTAManager::unsubscribe(0));
+}
+
+void test_table_capacity() {
+    OTAEventBus bus;
+    SubscriberLog log;
+    for (int i = 0; i < OTAEventBus::CAPACITY; i++) {
+        TEST_ASSERT_EQUAL(i, bus.subscribe(makeSubscriber(&log, 0, 0)));
+    }
+    TEST_ASSERT_EQUAL(-1, bus.subscribe(makeSubscriber(&log, 0, 0)));
+    TEST_ASSERT_EQUAL(OTAEventBus::CAPACITY, bus.count());
+
+    // A freed slot is taken by the next subscriber
+    TEST_ASSERT_TRUE(bus.unsubscribe(2));
+    TEST_ASSERT_FALSE(bus.unsubscribe(2));
+    TEST_ASSERT_FALSE(bus.unsubscribe(-1));
+    TEST_ASSERT_FALSE(bus.unsubscribe(OTAEventBus::CAPACITY));
+    TEST_ASSERT_EQUAL(2, bus.subscribe(makeSubscriber(&log, 0, 0)));
+
+    bus.start();
+    bus.error(OTA_RECEIVE_ERROR);
+    bus.end();
+    TEST_ASSERT_EQUAL(OTAEventBus::CAPACITY, log.starts.load());
+    TEST_ASSERT_EQUAL(OTAEventBus::CAPACITY, log.errors.load());
+    TEST_ASSERT_EQUAL(OTAEventBus::CAPACITY, log.ends.load());
+}
+
+void test_rate_filters() {
+    const uint32_t total = 1024 * 1024;
+    OTAEventBus bus;
+    uint32_t clock = 1000;
+    SubscriberLog all, bytes, time, both, startOnly;
+    all.clock = bytes.clock = time.clock = both.clock = &clock;
+    bus.subscribe(makeSubscriber(&all, 0, 0));
+    bus.subscribe(makeSubscriber(&bytes, 64 * 1024, 0));
+    bus.subscribe(makeSubscriber(&time, 0, 50));
+    bus.subscribe(makeSubscriber(&both, 16 * 1024, 100));
+    OTASubscriber noProgress = {onStart, nullptr, nullptr, nullptr, &startOnly, 0, 0};
+    bus.subscribe(noProgress);
+
+    // A chunk a millisecond, and the last report at the total
+    uint32_t reports = 0;
+    bus.start();
+    for (uint32_t p = 0;; p += CHUNK) {
+        uint32_t progress = p < total ? p : total;
+        bus.progress(progress, total, clock);
+        reports++;
+        clock++;
+        if (progress == total) {
+            break;
+        }
+    }
+    bus.end();
+    printf("%u reports: all %u, 64 KB %u, 50 ms %u, 16 KB and 100 ms %u\n", (unsigned)reports,
+           (unsigned)all.progress.size(), (unsigned)bytes.progress.size(), (unsigned)time.progress.size(),
+           (unsigned)both.progress.size());
+
+    TEST_ASSERT_EQUAL(reports, all.progress.size());
+    checkSpacing(all, 0, 0, total);
+    checkSpacing(bytes, 64 * 1024, 0, total);
+    checkSpacing(time, 0, 50, total);
+    checkSpacing(both, 16 * 1024, 100, total);
+    // Each filter lets through about one report per interval, not fewer
+    TEST_ASSERT_UINT32_WITHIN(2, total / (64 * 1024) + 1, bytes.progress.size());
+    TEST_ASSERT_UINT32_WITHIN(2, reports / 50 + 1, time.progress.size());
+    TEST_ASSERT_UINT32_WITHIN(2, reports / 100 + 1, both.progress.size());
+    TEST_ASSERT_EQUAL(all.progress.size() + bytes.progress.size() + time.progress.size() + both.progress.size(),
+                      bus.progressCalls());
+    TEST_ASSERT_EQUAL(1, startOnly.starts.load());
+
+    // The next session starts the filters over
+    bus.start();
+    bus.progress(0, total, clock);
+    TEST_ASSERT_EQUAL(0, bytes.progress.back());
+    TEST_ASSERT_EQUAL(0, both.progress.back());
+
+    // So does a subscriber added during a session, and the others' filters hold
+    SubscriberLog late;
+    late.clock = &clock;
+    size_t bytesBefore = bytes.progress.size();
+    bus.subscribe(makeSubscriber(&late, 64 * 1024, 0));
+    bus.progress(CHUNK, total, clock);
+    TEST_ASSERT_EQUAL(1, late.progress.size());
+    TEST_ASSERT_EQUAL(bytesBefore, bytes.progress.size());
+}
+
+void test_subscribers_in_a_session() {
+    std::vector<uint8_t> image = makeImage(EVENTS_IMAGE_SIZE);
+    OTAManager::initialize("host-events", "secret", HOST_TEST_PORT, hostNetworkReady);
+
+    SubscriberLog led, telemetry;
+    int ledId = OTAManager::subscribe(makeSubscriber(&led, 0, 0));
+    int telemetryId = OTAManager::subscribe(makeSubscriber(&telemetry, 32 * 1024, 0));
+    TEST_ASSERT_TRUE(ledId >= 0);
+    TEST_ASSERT_TRUE(telemetryId >= 0 && telemetryId != ledId);
+
+    // The application's callback is set next to them, not instead of them
+    static std::atomic<int> callbackEnds{0};
+    static std::atomic<uint32_t> callbackProgress{0};
+    OTAManager::setProgressCallback([](unsigned int progress, unsigned int) { callbackProgress = progress; });
+    OTAManager::setEndCallback([]() { callbackEnds++; });
+
+    // Inline, on the listener
+    EspotaResult result;
+    TEST_ASSERT_TRUE(OTAManager::startListener());
+    uint32_t restarts = ESP.getRestartCount();
+    TEST_ASSERT_TRUE(upload(image, &result));
+    waitFor(callbackEnds, 1);
+    TEST_ASSERT_EQUAL(1, led.starts.load());
+    TEST_ASSERT_EQUAL(1, led.ends.load());
+    TEST_ASSERT_EQUAL(1, telemetry.ends.load());
+    TEST_ASSERT_EQUAL(restarts, led.endRestarts);  // Before the restart
+    TEST_ASSERT_EQUAL(EVENTS_IMAGE_SIZE, led.progress.back());
+    TEST_ASSERT_EQUAL(EVENTS_IMAGE_SIZE, telemetry.progress.back());
+    TEST_ASSERT_EQUAL(EVENTS_IMAGE_SIZE, callbackProgress.load());
+    TEST_ASSERT_TRUE(telemetry.progress.size() <= EVENTS_IMAGE_SIZE / (32 * 1024) + 2);
+    TEST_ASSERT_TRUE(telemetry.progress.size() < led.progress.size());
+    TEST_ASSERT_EQUAL_STRING("OTAListener", led.task.c_str());
+
+    // With the callback task the subscribers still run in the session
+    TEST_ASSERT_TRUE(OTAManager::startCallbackTask());
+    TEST_ASSERT_FALSE(upload(image, &result, "wrong"));
+    for (int i = 0; i < 5000 && led.errors < 1; i++) {
+        delay(1);
+    }
+    TEST_ASSERT_EQUAL(1, led.errors.load());
+    TEST_ASSERT_EQUAL(1, telemetry.errors.load());
+    led.progress.clear();
+    TEST_ASSERT_TRUE(upload(image, &result));
+    waitFor(callbackEnds, 2);
+    OTAManager::stopCallbackTask();
+    TEST_ASSERT_EQUAL(2, led.ends.load());
+    TEST_ASSERT_EQUAL(EVENTS_IMAGE_SIZE, led.progress.back());
+    TEST_ASSERT_EQUAL_STRING("OTAListener", led.task.c_str());
+
+    // Unsubscribed: no more events
+    TEST_ASSERT_TRUE(OTAManager::unsubscribe(ledId));
+    TEST_ASSERT_FALSE(OTAManager::unsubscribe(ledId));
+    TEST_ASSERT_TRUE(upload(image, &result));
+    waitFor(callbackEnds, 3);
+    OTAManager::stopListener();
+    TEST_ASSERT_EQUAL(2, led.ends.load());
+    TEST_ASSERT_EQUAL(3, telemetry.ends.load());
+    TEST_ASSERT_TRUE(OTAManager::unsubscribe(telemetryId));
+}
+
+int main() {
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_subscribe_needs_initialize);
+    RUN_TEST(test_table_capacity);
+    RUN_TEST(test_rate_filters);
+    RUN_TEST(test_subscribers_in_a_session);
+    return UNITY_END();
+}
@@ -0,0 +1,122 @@
+/**
+ * @file test_native_idle.cpp
+ * @brief The handleUpdates() idle path never touches the heap
+ *
+ * One million calls on each path must make no allocation: before initialize(),
+ * while polling with the network up (the status log comes due and the address
+ * changes along the way), while the network is down (the error log comes due),
+ * and in listener mode, where the listener task idles at the same time. The
+ * host clock is moved forward so the log intervals elapse during the run.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <OTAManager.h>
+#include <HeapTracker.h>
+
+#include <chrono>
+
+#define HOST_TEST_PORT 13245
+
+#ifndef IDLE_CALLS
+#define IDLE_CALLS 1000000
+#endif
+
+// Clock advances per run, so every log interval elapses several times
+#define IDLE_CLOCK_STEPS 10
+
+struct IdleRun {
+    uint64_t allocations;
+    double nsPerCall;
+};
+
+// IDLE_CALLS handleUpdates() calls, moving the clock by stepMs every so often
+// and running between() halfway through
+static IdleRun runIdle(unsigned long stepMs, void (*between)() = nullptr) {
+    OTAManager::handleUpdates();  // Anything done once on the first call is not counted
+
+    uint64_t before = HeapTracker::allocations();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < IDLE_CALLS; i++) {
+        if (stepMs && i % (IDLE_CALLS / IDLE_CLOCK_STEPS) == 0) {
+            hostAdvanceMillis(stepMs);
+        }
+        if (between && i == IDLE_CALLS / 2) {
+            between();
+        }
+        OTAManager::handleUpdates();
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    IdleRun run;
+    run.allocations = HeapTracker::allocations() - before;
+    run.nsPerCall = ns / IDLE_CALLS;
+    return run;
+}
+
+static void report(const char* path, const IdleRun& run) {
+    printf("  %-24s %6.1f ns/call, %llu allocations\n", path, run.nsPerCall,
+           (unsigned long long)run.allocations);
+}
+
+static void changeAddress() {
+    OTAManager::notifyNetworkUp(IPAddress(10, 9, 8, 2));
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_not_initialized_is_heap_free() {
+    TEST_ASSERT_FALSE(OTAManager::isInitialized());
+    IdleRun run = runIdle(0);
+    report("not initialized", run);
+    TEST_ASSERT_EQUAL(0, run.allocations);
+}
+
+void test_polling_is_heap_free() {
+    OTAManager::initialize("host-idle", "", HOST_TEST_PORT, nullptr);
+    OTAManager::notifyNetworkUp(IPAddress(10, 9, 8, 1));
+    TEST_ASSERT_TRUE(OTAManager::isNetworkReady());
+
+    IdleRun run = runIdle(OTA_LOG_INTERVAL_MS, changeAddress);
+    report("polling", run);
+    TEST_ASSERT_EQUAL(0, run.allocations);
+    TEST_ASSERT_TRUE(OTAManager::getNetworkAddress() == IPAddress(10, 9, 8, 2));
+}
+
+void test_network_down_is_heap_free() {
+    OTAManager::notifyNetworkDown();
+    TEST_ASSERT_FALSE(OTAManager::isNetworkReady());
+
+    IdleRun run = runIdle(OTA_ERROR_LOG_INTERVAL_MS);
+    report("network down", run);
+    TEST_ASSERT_EQUAL(0, run.allocations);
+}
+
+void test_listener_is_heap_free() {
+    OTAManager::notifyNetworkUp(IPAddress(10, 9, 8, 1));
+    TEST_ASSERT_TRUE(OTAManager::startListener());
+
+    // Counts cover every thread, so the idling listener task is included
+    IdleRun run = runIdle(OTA_LOG_INTERVAL_MS);
+    report("listener", run);
+    OTAManager::stopListener();
+    TEST_ASSERT_EQUAL(0, run.allocations);
+}
+
+// Main test runner
+int main() {
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    printf("handleUpdates() idle path, %d calls per run\n", IDLE_CALLS);
+
+    UNITY_BEGIN();
+
+    RUN_TEST(test_not_initialized_is_heap_free);
+    RUN_TEST(test_polling_is_heap_free);
+    RUN_TEST(test_network_down_is_heap_free);
+    RUN_TEST(test_listener_is_heap_free);
+
+    return UNITY_END();
+}
@@ -0,0 +1,180 @@
+/**
+ * @file test_native_latency.cpp
+ * @brief Log2 latency histograms (OTAHistogram, getLatencyHistogram())
+ *
+ * Checks the bucket bounds, percentiles and the fixed size, counts exactly under
+ * concurrent recording, then pushes an update onto simulated flash with slow
+ * sector erases: the flash write histogram must show the erase stalls while the
+ * socket read histogram stays fast.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <OTAManager.h>
+#include <EspotaClient.h>
+#include <SimFlash.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#define HOST_TEST_PORT 13248
+#define LATENCY_IMAGE_SIZE (256 * 1024)
+#define ERASE_US 20000
+
+static std::atomic<int> endCount{0};
+
+static bool hostNetworkReady() {
+    return true;
+}
+
+static void printHistogram(const char* name, const OTAHistogramSnapshot& h) {
+    printf("%s: %u samples, p50 <= %u us, p99 <= %u us, max %u us\n", name, h.count,
+           h.percentileUs(0.5f), h.percentileUs(0.99f), h.maxUs);
+    for (int b = 0; b < OTA_LATENCY_BUCKETS; b++) {
+        if (h.buckets[b]) {
+            printf("  %8u us+: %u\n", OTAHistogramSnapshot::bucketLowUs(b), h.buckets[b]);
+        }
+    }
+}
+
+void setUp() {
+    TEST_ASSERT_TRUE(SimFlash.begin());
+}
+
+void tearDown() {}
+
+void test_buckets_and_percentiles() {
+    TEST_ASSERT_EQUAL(0, OTAHistogram::bucketOf(0));
+    TEST_ASSERT_EQUAL(0, OTAHistogram::bucketOf(1));
+    TEST_ASSERT_EQUAL(1, OTAHistogram::bucketOf(2));
+    TEST_ASSERT_EQUAL(1, OTAHistogram::bucketOf(3));
+    TEST_ASSERT_EQUAL(9, OTAHistogram::bucketOf(1023));
+    TEST_ASSERT_EQUAL(10, OTAHistogram::bucketOf(1024));
+    TEST_ASSERT_EQUAL(OTA_LATENCY_BUCKETS - 1, OTAHistogram::bucketOf(0xFFFFFFFF));
+
+    // The size is known at compile time: the buckets, a count and the maximum
+    TEST_ASSERT_EQUAL((OTA_LATENCY_BUCKETS + 2) * sizeof(uint32_t), sizeof(OTAHistogram));
+
+    OTAHistogram h;
+    TEST_ASSERT_EQUAL(0, h.snapshot().percentileUs(0.5f));
+    for (int i = 0; i < 98; i++) {
+        h.record(100);  // Bucket 6: 64..127 us
+    }
+    h.record(5000);     // Bucket 12: 4096..8191 us
+    h.record(70000);
+    OTAHistogramSnapshot s = h.snapshot();
+    TEST_ASSERT_EQUAL(100, s.count);
+    TEST_ASSERT_EQUAL(98, s.buckets[6]);
+    TEST_ASSERT_EQUAL(1, s.buckets[12]);
+    TEST_ASSERT_EQUAL(1, s.buckets[16]);
+    TEST_ASSERT_EQUAL(70000, s.maxUs);
+    TEST_ASSERT_EQUAL(127, s.percentileUs(0.5f));
+    TEST_ASSERT_EQUAL(8191, s.percentileUs(0.99f));
+    TEST_ASSERT_EQUAL(70000, s.percentileUs(1.0f));
+
+    h.reset();
+    s = h.snapshot();
+    TEST_ASSERT_EQUAL(0, s.count);
+    TEST_ASSERT_EQUAL(0, s.maxUs);
+    TEST_ASSERT_EQUAL(0, s.buckets[6]);
+}
+
+void test_concurrent_recording() {
+    OTAHistogram h;
+    const int threads = 4;
+    const int perThread = 100000;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&h, t]() {
+            for (int i = 0; i < perThread; i++) {
+                h.record((uint32_t)(i % 4096) + t);
+            }
+        });
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+    OTAHistogramSnapshot s = h.snapshot();
+    uint32_t sum = 0;
+    for (int b = 0; b < OTA_LATENCY_BUCKETS; b++) {
+        sum += s.buckets[b];
+    }
+    TEST_ASSERT_EQUAL(threads * perThread, s.count);
+    TEST_ASSERT_EQUAL(threads * perThread, sum);
+    TEST_ASSERT_EQUAL(4095 + threads - 1, s.maxUs);
+}
+
+void test_flash_erase_stalls_are_visible() {
+    OTAManager::initialize("host-latency", "secret", HOST_TEST_PORT, hostNetworkReady);
+    OTAManager::setEndCallback([]() { endCount++; });
+    TEST_ASSERT_TRUE(OTAManager::startListener());
+    OTAManager::resetLatencyHistograms();
+
+    SimFlash.setTiming(ERASE_US, 0);
+    std::vector<uint8_t> image(LATENCY_IMAGE_SIZE);
+    for (size_t i = 0; i < image.size(); i++) {
+        image[i] = (uint8_t)(i * 7 + 3);
+    }
+    EspotaClient client("127.0.0.1", HOST_TEST_PORT);
+    client.setPassword("secret");
+    EspotaResult result;
+    TEST_ASSERT_TRUE_MESSAGE(client.upload(image.data(), image.size(), &result), result.error);
+    for (int i = 0; i < 1000 && endCount == 0; i++) {
+        delay(1);
+    }
+    OTAManager::stopListener();
+    SimFlash.setTiming(0, 0);
+    TEST_ASSERT_EQUAL(1, endCount.load());
+
+    OTAHistogramSnapshot reads = OTAManager::getLatencyHistogram(OTA_LATENCY_SOCKET_READ);
+    OTAHistogramSnapshot writes = OTAManager::getLatencyHistogram(OTA_LATENCY_FLASH_WRITE);
+    printHistogram("Socket read", reads);
+    printHistogram("Flash write", writes);
+    TEST_ASSERT_TRUE(reads.count > 0);
+
+    // The pipeline hands over whole sectors, so every write pays for an erase, while
+    // the socket reads keep running on their own and stay fast
+    uint32_t sectors = LATENCY_IMAGE_SIZE / SimFlashClass::SECTOR_SIZE;
+    uint32_t stalls = 0;
+    for (int b = OTAHistogram::bucketOf(ERASE_US); b < OTA_LATENCY_BUCKETS; b++) {
+        stalls += writes.buckets[b];
+    }
+    TEST_ASSERT_EQUAL(sectors, writes.count);
+    TEST_ASSERT_EQUAL(sectors, stalls);
+    TEST_ASSERT_TRUE(reads.percentileUs(0.5f) < ERASE_US / 4);
+    TEST_ASSERT_TRUE(writes.maxUs >= ERASE_US);
+}
+
+void test_handle_updates_histogram() {
+    OTAManager::resetLatencyHistograms();
+    for (int i = 0; i < 10000; i++) {
+        OTAManager::handleUpdates();
+    }
+    OTAHistogramSnapshot h = OTAManager::getLatencyHistogram(OTA_LATENCY_HANDLE_UPDATES);
+    printHistogram("handleUpdates()", h);
+    TEST_ASSERT_EQUAL(10000, h.count);
+    TEST_ASSERT_EQUAL(0, OTAManager::getLatencyHistogram(OTA_LATENCY_FLASH_WRITE).count);
+
+    // In listener mode calls return before anything is timed
+    TEST_ASSERT_TRUE(OTAManager::startListener());
+    for (int i = 0; i < 10000; i++) {
+        OTAManager::handleUpdates();
+    }
+    OTAManager::stopListener();
+    TEST_ASSERT_EQUAL(10000, OTAManager::getLatencyHistogram(OTA_LATENCY_HANDLE_UPDATES).count);
+}
+
+// Main test runner
+int main() {
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    UNITY_BEGIN();
+
+    RUN_TEST(test_buckets_and_percentiles);
+    RUN_TEST(test_concurrent_recording);
+    RUN_TEST(test_flash_erase_stalls_are_visible);
+    RUN_TEST(test_handle_updates_histogram);
+
+    return UNITY_END();
+}
@@ -0,0 +1,176 @@
+/**
+ * @file test_native_listener.cpp
+ * @brief Host tests and measurements for the event-driven listener mode
+ *
+ * Compares the polling model (a task calling handleUpdates() on a fixed
+ * interval) with OTAManager::startListener() on two axes: CPU consumed while
+ * idle and latency from the UDP invite to the device connecting back.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <OTAManager.h>
+#include <EspotaClient.h>
+#include <SimFlash.h>
+
+#include <sys/resource.h>
+
+#include <vector>
+
+#define HOST_TEST_PORT 13233
+#define IDLE_MEASURE_MS 2000
+#define LATENCY_IMAGE_SIZE (64 * 1024)
+
+// Poll cadences used by the examples: ThreadSafeOTA (10 ms) and the library default
+#define FAST_POLL_MS 10
+
+static volatile bool pollerRunning = false;
+static volatile uint32_t pollIntervalMs = FAST_POLL_MS;
+static volatile int endCount = 0;
+
+static bool hostNetworkReady() {
+    return true;
+}
+
+static void pollerTask(void* pvParameters) {
+    (void)pvParameters;
+    while (pollerRunning) {
+        OTAManager::handleUpdates();
+        vTaskDelay(pdMS_TO_TICKS(pollIntervalMs));
+    }
+    vTaskDelete(NULL);
+}
+
+static void startPoller(uint32_t intervalMs) {
+    pollIntervalMs = intervalMs;
+    pollerRunning = true;
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(pollerTask, "OTAPoll", 4096, NULL, 1, NULL));
+}
+
+static void stopPoller() {
+    pollerRunning = false;
+    vTaskDelay(pdMS_TO_TICKS(pollIntervalMs + 20));
+}
+
+// Process CPU time (all threads) in microseconds
+static uint64_t processCpuUs() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000ULL +
+           usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static uint64_t measureIdleCpuUs() {
+    uint64_t before = processCpuUs();
+    delay(IDLE_MEASURE_MS);
+    return processCpuUs() - before;
+}
+
+static std::vector<uint8_t> makeImage(size_t size) {
+    std::vector<uint8_t> image(size);
+    for (size_t i = 0; i < size; i++) {
+        image[i] = (uint8_t)(i * 31 + 7);
+    }
+    return image;
+}
+
+static uint64_t measureInviteLatencyUs(const std::vector<uint8_t>& image) {
+    EspotaClient client("127.0.0.1", HOST_TEST_PORT);
+    client.setPassword("secret");
+    EspotaResult result;
+    bool ok = client.upload(image.data(), image.size(), &result);
+    TEST_ASSERT_TRUE_MESSAGE(ok, result.error);
+    TEST_ASSERT_EQUAL_MEMORY(image.data(), SimFlash.data(), image.size());
+    return result.inviteToConnectUs;
+}
+
+void setUp() {
+    TEST_ASSERT_TRUE(SimFlash.begin());
+}
+
+void tearDown() {}
+
+void test_listener_requires_initialization() {
+    TEST_ASSERT_FALSE(OTAManager::startListener());
+    TEST_ASSERT_FALSE(OTAManager::isListenerRunning());
+}
+
+void test_listener_full_update() {
+    OTAManager::initialize("host-listener", "secret", HOST_TEST_PORT, hostNetworkReady);
+    OTAManager::setEndCallback([]() { endCount++; });
+
+    TEST_ASSERT_TRUE(OTAManager::startListener());
+    TEST_ASSERT_TRUE(OTAManager::isListenerRunning());
+
+    std::vector<uint8_t> image = makeImage(512 * 1024);
+    EspotaClient client("127.0.0.1", HOST_TEST_PORT);
+    client.setPassword("secret");
+    EspotaResult result;
+    bool ok = client.upload(image.data(), image.size(), &result);
+
+    TEST_ASSERT_TRUE_MESSAGE(ok, result.error);
+    // The uploader sees "OK" just before the end callback runs
+    for (int i = 0; i < 100 && endCount == 0; i++) {
+        delay(1);
+    }
+    TEST_ASSERT_EQUAL(1, endCount);
+    TEST_ASSERT_EQUAL_MEMORY(image.data(), SimFlash.data(), image.size());
+
+    OTAManager::stopListener();
+    TEST_ASSERT_FALSE(OTAManager::isListenerRunning());
+}
+
+void test_polling_vs_listener_idle_and_latency() {
+    std::vector<uint8_t> image = makeImage(LATENCY_IMAGE_SIZE);
+
+    // Polling, fast cadence: low latency but CPU burned continuously
+    startPoller(FAST_POLL_MS);
+    uint64_t fastPollCpu = measureIdleCpuUs();
+    uint64_t fastPollLatency = measureInviteLatencyUs(image);
+    stopPoller();
+
+    // Polling, library default cadence: cheap but slow to react
+    startPoller(OTA_CHECK_INTERVAL_MS);
+    uint64_t slowPollCpu = measureIdleCpuUs();
+    uint64_t slowPollLatency = measureInviteLatencyUs(image);
+    stopPoller();
+
+    // Listener: blocks in select()
+    TEST_ASSERT_TRUE(OTAManager::startListener());
+    uint64_t listenerCpu = measureIdleCpuUs();
+    uint64_t listenerLatency = measureInviteLatencyUs(image);
+    OTAManager::stopListener();
+
+    printf("Idle CPU over %d ms / invite->connect latency:\n", IDLE_MEASURE_MS);
+    printf("  poll every %3d ms: %6llu us CPU, %8.2f ms\n", FAST_POLL_MS,
+           (unsigned long long)fastPollCpu, fastPollLatency / 1000.0);
+    printf("  poll every %3d ms: %6llu us CPU, %8.2f ms\n", OTA_CHECK_INTERVAL_MS,
+           (unsigned long long)slowPollCpu, slowPollLatency / 1000.0);
+    printf("  listener         : %6llu us CPU, %8.2f ms\n", (unsigned long long)listenerCpu,
+           listenerLatency / 1000.0);
+
+    // The listener must beat the cheap cadence on latency and the fast cadence on CPU
+    TEST_ASSERT_LESS_THAN(slowPollLatency, listenerLatency);
+    TEST_ASSERT_LESS_THAN(fastPollCpu, listenerCpu);
+}
+
+void test_polling_resumes_after_listener_stops() {
+    std::vector<uint8_t> image = makeImage(LATENCY_IMAGE_SIZE);
+    startPoller(FAST_POLL_MS);
+    measureInviteLatencyUs(image);
+    stopPoller();
+}
+
+// Main test runner
+int main() {
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    UNITY_BEGIN();
+
+    RUN_TEST(test_listener_requires_initialization);
+    RUN_TEST(test_listener_full_update);
+    RUN_TEST(test_polling_vs_listener_idle_and_latency);
+    RUN_TEST(test_polling_resumes_after_listener_stops);
+
+    return UNITY_END();
+}
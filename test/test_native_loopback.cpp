@@ -0,0 +1,154 @@
+/**
+ * @file test_native_loopback.cpp
+ * @brief Host (Linux) end-to-end OTA tests over loopback
+ *
+ * These tests run the real OTAManager sources against the POSIX stand-ins in
+ * test/host: an espota-style uploader pushes an image over 127.0.0.1 while a
+ * task polls OTAManager::handleUpdates(), and the result is compared byte for
+ * byte with the simulated flash partition. Throughput is reported and gated.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <OTAManager.h>
+#include <EspotaClient.h>
+#include <SimFlash.h>
+
+#include <vector>
+
+// Loopback test configuration
+#define HOST_TEST_PORT 13232
+#define HOST_TEST_IMAGE_SIZE (1536 * 1024)
+
+// Minimum acceptable loopback throughput; raise per CI machine to gate regressions
+#ifndef OTA_HOST_MIN_KBPS
+#define OTA_HOST_MIN_KBPS 2000
+#endif
+
+static volatile bool pollerRunning = false;
+static volatile int endCount = 0;
+static volatile int lastError = -1;
+
+static bool hostNetworkReady() {
+    return true;
+}
+
+/**
+ * @brief Emulates the usual OTA task: poll handleUpdates() every tick
+ */
+static void pollerTask(void* pvParameters) {
+    (void)pvParameters;
+    while (pollerRunning) {
+        OTAManager::handleUpdates();
+        vTaskDelay(1);
+    }
+    vTaskDelete(NULL);
+}
+
+static std::vector<uint8_t> makeImage(size_t size, uint32_t seed) {
+    std::vector<uint8_t> image(size);
+    uint32_t x = seed;
+    for (size_t i = 0; i < size; i++) {
+        x = x * 1664525u + 1013904223u;
+        image[i] = (uint8_t)(x >> 24);
+    }
+    return image;
+}
+
+static void startPoller() {
+    pollerRunning = true;
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(pollerTask, "OTAPoll", 4096, NULL, 1, NULL));
+}
+
+static void stopPoller() {
+    pollerRunning = false;
+    vTaskDelay(pdMS_TO_TICKS(20));
+}
+
+void setUp() {
+    endCount = 0;
+    lastError = -1;
+    TEST_ASSERT_TRUE(SimFlash.begin());
+}
+
+void tearDown() {}
+
+void test_full_update_over_loopback() {
+    OTAManager::initialize("host-ota", "", HOST_TEST_PORT, hostNetworkReady);
+    TEST_ASSERT_TRUE(OTAManager::isInitialized());
+    OTAManager::setEndCallback([]() { endCount++; });
+    OTAManager::setErrorCallback([](ota_error_t error) { lastError = error; });
+
+    std::vector<uint8_t> image = makeImage(HOST_TEST_IMAGE_SIZE, 1);
+    uint32_t restartsBefore = ESP.getRestartCount();
+
+    startPoller();
+    EspotaClient client("127.0.0.1", HOST_TEST_PORT);
+    EspotaResult result;
+    bool ok = client.upload(image.data(), image.size(), &result);
+    stopPoller();
+
+    TEST_ASSERT_TRUE_MESSAGE(ok, result.error);
+    TEST_ASSERT_EQUAL(1, endCount);
+    TEST_ASSERT_EQUAL(-1, lastError);
+    TEST_ASSERT_EQUAL(restartsBefore + 1, ESP.getRestartCount());
+    TEST_ASSERT_EQUAL_MEMORY(image.data(), SimFlash.data(), image.size());
+}
+
+void test_password_protected_update() {
+    OTAManager::initialize("host-ota", "secret", HOST_TEST_PORT, hostNetworkReady);
+    OTAManager::setEndCallback([]() { endCount++; });
+    OTAManager::setErrorCallback([](ota_error_t error) { lastError = error; });
+
+    std::vector<uint8_t> image = makeImage(64 * 1024, 2);
+    startPoller();
+
+    // Wrong password is rejected before any data is transferred
+    EspotaClient intruder("127.0.0.1", HOST_TEST_PORT);
+    intruder.setPassword("wrong");
+    intruder.setTimeoutMs(2000);
+    EspotaResult result;
+    TEST_ASSERT_FALSE(intruder.upload(image.data(), image.size(), &result));
+    TEST_ASSERT_EQUAL(OTA_AUTH_ERROR, lastError);
+    TEST_ASSERT_EQUAL(0, SimFlash.getBytesProgrammed());
+
+    EspotaClient client("127.0.0.1", HOST_TEST_PORT);
+    client.setPassword("secret");
+    bool ok = client.upload(image.data(), image.size(), &result);
+    stopPoller();
+
+    TEST_ASSERT_TRUE_MESSAGE(ok, result.error);
+    TEST_ASSERT_EQUAL(1, endCount);
+    TEST_ASSERT_EQUAL_MEMORY(image.data(), SimFlash.data(), image.size());
+}
+
+void test_loopback_throughput_gate() {
+    OTAManager::setEndCallback([]() { endCount++; });
+    std::vector<uint8_t> image = makeImage(HOST_TEST_IMAGE_SIZE, 3);
+
+    startPoller();
+    EspotaClient client("127.0.0.1", HOST_TEST_PORT);
+    client.setPassword("secret");
+    EspotaResult result;
+    bool ok = client.upload(image.data(), image.size(), &result);
+    stopPoller();
+    TEST_ASSERT_TRUE_MESSAGE(ok, result.error);
+
+    double kbps = (double)result.bytesSent / 1024.0 / (result.transferUs / 1e6);
+    printf("Loopback: %zu bytes, invite->connect %.2f ms, transfer %.1f ms, %.0f KB/s\n",
+           result.bytesSent, result.inviteToConnectUs / 1000.0, result.transferUs / 1000.0, kbps);
+    TEST_ASSERT_GREATER_OR_EQUAL(OTA_HOST_MIN_KBPS, (int)kbps);
+}
+
+// Main test runner
+int main() {
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    UNITY_BEGIN();
+
+    RUN_TEST(test_full_update_over_loopback);
+    RUN_TEST(test_password_protected_update);
+    RUN_TEST(test_loopback_throughput_gate);
+
+    return UNITY_END();
+}
@@ -0,0 +1,345 @@
+/**
+ * @file test_native_multicast.cpp
+ * @brief Multicast updates: one stream, Reed-Solomon parity and unicast repair
+ *
+ * The erasure code is checked on its own (any k of the k + p blocks rebuild a
+ * group). A loopback sender then streams images to the listener through a
+ * multicast group with packets dropped on the way: the device rebuilds what
+ * parity covers, repairs the rest over TCP, verifies the staged image and makes
+ * it the boot partition. Sessions the device cannot or must not take are
+ * refused before anything is written. The benchmark streams one image to a
+ * fleet of in-process receivers with independent loss and compares the time
+ * with updating the same fleet one device at a time over espota.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <OTAManager.h>
+#include <OTAFec.h>
+#include <OTAMulticast.h>
+#include <OTASignature.h>
+#include <AppImage.h>
+#include <Ed25519Signer.h>
+#include <EspotaClient.h>
+#include <MulticastSender.h>
+#include <SimFlash.h>
+#include <esp_ota_ops.h>
+
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#define HOST_TEST_PORT 13242
+#define MULTICAST_TEST_GROUP "239.255.32.42"
+#define MULTICAST_TEST_PORT (HOST_TEST_PORT + 1000)
+
+#ifndef BENCH_IMAGE_SIZE
+#define BENCH_IMAGE_SIZE (1024 * 1024)
+#endif
+#ifndef BENCH_LINK_KBPS
+#define BENCH_LINK_KBPS 4096
+#endif
+
+static volatile int lastError = -1;
+
+static const char* signingSeedHex = "4ccd089b28ff96da9db6c346ec114e0f5b8a319f35aba624da8cf6ed4fb8a6fb";
+
+static uint8_t signingSeed[32];
+static uint8_t signingPublicKey[32];
+
+static bool hostNetworkReady() {
+    return true;
+}
+
+static std::vector<uint8_t> makePayload(size_t size, uint32_t seed) {
+    std::vector<uint8_t> payload(size);
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1103515245u + 12345u;
+        payload[i] = (uint8_t)(seed >> 16);
+    }
+    return payload;
+}
+
+// Wait until the device restarts or reports an error
+static void waitForOutcome(uint32_t restarts) {
+    for (int i = 0; i < 10000 && lastError == -1 && ESP.getRestartCount() == restarts; i++) {
+        delay(1);
+    }
+}
+
+static bool writeToBuffer(void* context, uint32_t offset, const uint8_t* data, size_t len) {
+    std::vector<uint8_t>* buffer = static_cast<std::vector<uint8_t>*>(context);
+    if (offset + len > buffer->size()) {
+        return false;
+    }
+    memcpy(buffer->data() + offset, data, len);
+    return true;
+}
+
+static void signImage(MulticastSender& sender, const std::vector<uint8_t>& image, uint8_t signature[64]) {
+    ed25519Sign(signingSeed, image.data(), image.size(), signature);
+    sender.setSignature(signature);
+}
+
+void setUp() {
+    lastError = -1;
+}
+
+void tearDown() {}
+
+void test_fec_rebuilds_any_k_of_n() {
+    const uint8_t k = 12;
+    const uint8_t p = 4;
+    const size_t len = 200;
+    std::vector<uint8_t> original = makePayload(k * len, 1);
+    std::vector<std::vector<uint8_t>> parity(p, std::vector<uint8_t>(len));
+    const uint8_t* blocks[k];
+    for (uint8_t j = 0; j < k; j++) {
+        blocks[j] = original.data() + j * len;
+    }
+    for (uint8_t r = 0; r < p; r++) {
+        OTAFec::encode(blocks, k, r, parity[r].data(), len);
+    }
+
+    uint32_t seed = 7;
+    for (int trial = 0; trial < 200; trial++) {
+        // Lose 1..p data blocks and as many parity rows as can be spared
+        std::vector<uint8_t> received = original;
+        bool present[k];
+        memset(present, 1, sizeof(present));
+        seed = seed * 1103515245u + 12345u;
+        uint8_t lost = 1 + (seed >> 16) % p;
+        for (uint8_t n = 0; n < lost;) {
+            seed = seed * 1103515245u + 12345u;
+            uint8_t j = (seed >> 16) % k;
+            if (present[j]) {
+                present[j] = false;
+                memset(received.data() + j * len, 0xA5, len);
+                n++;
+            }
+        }
+        std::vector<std::vector<uint8_t>> scratch;
+        uint8_t rows[OTAFec::MAX_PARITY];
+        uint8_t first = (seed >> 20) % (p - lost + 1);
+        for (uint8_t i = 0; i < lost; i++) {
+            rows[i] = first + i;
+            scratch.push_back(parity[rows[i]]);
+        }
+        uint8_t* data[k];
+        uint8_t* parityPtrs[OTAFec::MAX_PARITY];
+        for (uint8_t j = 0; j < k; j++) {
+            data[j] = received.data() + j * len;
+        }
+        for (uint8_t i = 0; i < lost; i++) {
+            parityPtrs[i] = scratch[i].data();
+        }
+        TEST_ASSERT_TRUE(OTAFec::decode(data, present, k, parityPtrs, rows, lost, len));
+        TEST_ASSERT_EQUAL_MEMORY(original.data(), received.data(), original.size());
+
+        // One parity block short of the losses cannot work
+        if (lost > 1) {
+            memset(present, 1, sizeof(present));
+            present[0] = present[1] = false;
+            TEST_ASSERT_FALSE(OTAFec::decode(data, present, k, parityPtrs, rows, 1, len));
+        }
+    }
+}
+
+void test_listener_receives_multicast_session() {
+    OTAManager::initialize("host-multicast", "", HOST_TEST_PORT, hostNetworkReady);
+    OTAManager::setEndCallback([]() {});
+    OTAManager::setErrorCallback([](ota_error_t error) { lastError = error; });
+
+    // Sessions are served by the listener task, and only with a key to check them
+    TEST_ASSERT_FALSE(OTAManager::joinMulticast(MULTICAST_TEST_GROUP, MULTICAST_TEST_PORT, "127.0.0.1"));
+    TEST_ASSERT_TRUE(OTAManager::startListener());
+    TEST_ASSERT_FALSE(OTAManager::joinMulticast(MULTICAST_TEST_GROUP, MULTICAST_TEST_PORT, "127.0.0.1"));
+    TEST_ASSERT_TRUE(OTASignature::fromHex(signingSeedHex, signingSeed, sizeof(signingSeed)));
+    ed25519PublicKey(signingSeed, signingPublicKey);
+    OTAManager::setSigningKey(signingPublicKey);
+    TEST_ASSERT_FALSE(OTAManager::joinMulticast("10.0.0.1", MULTICAST_TEST_PORT, "127.0.0.1"));
+    TEST_ASSERT_TRUE(OTAManager::joinMulticast(MULTICAST_TEST_GROUP, MULTICAST_TEST_PORT, "127.0.0.1"));
+
+    MulticastSender sender;
+    TEST_ASSERT_TRUE(sender.begin(MULTICAST_TEST_GROUP, MULTICAST_TEST_PORT));
+    sender.setFec(1024, 16, 2);
+    sender.setLoss(8);
+    sender.setRateLimitKBps(8192);
+
+    std::vector<uint8_t> image = makeAppImage(makePayload(300 * 1024 + 11, 2));
+    uint8_t signature[64];
+    signImage(sender, image, signature);
+    TEST_ASSERT_TRUE(SimFlash.begin());
+    uint32_t restarts = ESP.getRestartCount();
+    TEST_ASSERT_TRUE(sender.send(image.data(), image.size()));
+    waitForOutcome(restarts);
+    TEST_ASSERT_EQUAL(-1, lastError);
+    TEST_ASSERT_EQUAL(restarts + 1, ESP.getRestartCount());
+    TEST_ASSERT_EQUAL_MEMORY(image.data(), SimFlash.data(), image.size());
+    TEST_ASSERT_TRUE(esp_ota_get_boot_partition() == esp_ota_get_next_update_partition(nullptr));
+
+    // Parity rebuilt most losses; the groups that lost more than p went to repair
+    OTAMulticastStats stats = OTAManager::getMulticastStats();
+    TEST_ASSERT_EQUAL(sender.sessionId(), stats.session);
+    TEST_ASSERT_EQUAL((image.size() + 1023) / 1024, stats.blocks);
+    TEST_ASSERT_GREATER_THAN(0, stats.recovered);
+    TEST_ASSERT_GREATER_THAN(0, stats.repaired);
+    TEST_ASSERT_EQUAL(1, sender.repairRequests());
+
+    // Every check runs on the staged image: a wrong SHA-256 keeps the old boot partition
+    uint8_t wrong[32] = {0};
+    sender.setSha256(wrong);
+    sender.setLoss(0);
+    TEST_ASSERT_TRUE(SimFlash.begin());
+    restarts = ESP.getRestartCount();
+    TEST_ASSERT_TRUE(sender.send(image.data(), image.size()));
+    waitForOutcome(restarts);
+    TEST_ASSERT_EQUAL(OTA_END_ERROR, lastError);
+    TEST_ASSERT_EQUAL(restarts, ESP.getRestartCount());
+    sender.setSha256(nullptr);
+
+    sender.end();
+}
+
+void test_listener_refuses_sessions() {
+    MulticastSender sender;
+    TEST_ASSERT_TRUE(sender.begin(MULTICAST_TEST_GROUP, MULTICAST_TEST_PORT));
+    sender.setRateLimitKBps(8192);
+    std::vector<uint8_t> image = makeAppImage(makePayload(64 * 1024, 3));
+    uint32_t restarts = ESP.getRestartCount();
+
+    // A group larger than OTA_MULTICAST_GROUP_MAX
+    sender.setFec(1400, 16, 2);
+    TEST_ASSERT_TRUE(SimFlash.begin());
+    TEST_ASSERT_TRUE(sender.send(image.data(), image.size()));
+    waitForOutcome(restarts);
+    TEST_ASSERT_EQUAL(OTA_BEGIN_ERROR, lastError);
+    TEST_ASSERT_EQUAL(0xFF, SimFlash.data()[0]);
+
+    // Unsigned sessions: anyone on the LAN can announce one
+    sender.setFec(1024, 16, 2);
+    lastError = -1;
+    TEST_ASSERT_TRUE(sender.send(image.data(), image.size()));
+    waitForOutcome(restarts);
+    TEST_ASSERT_EQUAL(OTA_AUTH_ERROR, lastError);
+    TEST_ASSERT_EQUAL(0xFF, SimFlash.data()[0]);
+
+    // Signed by another key
+    uint8_t signature[64];
+    uint8_t otherSeed[32];
+    memcpy(otherSeed, signingSeed, sizeof(otherSeed));
+    otherSeed[0] ^= 1;
+    ed25519Sign(otherSeed, image.data(), image.size(), signature);
+    sender.setSignature(signature);
+    lastError = -1;
+    TEST_ASSERT_TRUE(sender.send(image.data(), image.size()));
+    waitForOutcome(restarts);
+    TEST_ASSERT_NOT_EQUAL(-1, lastError);
+    TEST_ASSERT_EQUAL(restarts, ESP.getRestartCount());
+
+    // Signed sessions once the key is gone: nothing left to check them against
+    signImage(sender, image, signature);
+    OTAManager::setSigningKey(nullptr);
+    TEST_ASSERT_TRUE(SimFlash.begin());
+    lastError = -1;
+    TEST_ASSERT_TRUE(sender.send(image.data(), image.size()));
+    waitForOutcome(restarts);
+    TEST_ASSERT_EQUAL(OTA_AUTH_ERROR, lastError);
+    TEST_ASSERT_EQUAL(0xFF, SimFlash.data()[0]);
+
+    // The same session with the key back is installed
+    OTAManager::setSigningKey(signingPublicKey);
+    lastError = -1;
+    TEST_ASSERT_TRUE(sender.send(image.data(), image.size()));
+    waitForOutcome(restarts);
+    TEST_ASSERT_EQUAL(-1, lastError);
+    TEST_ASSERT_EQUAL(restarts + 1, ESP.getRestartCount());
+    TEST_ASSERT_EQUAL_MEMORY(image.data(), SimFlash.data(), image.size());
+
+    OTAManager::setSigningKey(nullptr);
+    sender.end();
+}
+
+void test_fleet_update_time() {
+    std::vector<uint8_t> image = makeAppImage(makePayload(BENCH_IMAGE_SIZE, 4));
+
+    // Unicast: the fleet is updated one device at a time over the same link
+    TEST_ASSERT_TRUE(SimFlash.begin());
+    EspotaClient client("127.0.0.1", HOST_TEST_PORT);
+    client.setLockstep(false);
+    client.setRateLimitKBps(BENCH_LINK_KBPS);
+    EspotaResult result;
+    TEST_ASSERT_TRUE_MESSAGE(client.upload(image.data(), image.size(), &result), result.error);
+    double unicastMs = result.totalUs / 1000.0;
+    OTAManager::stopListener();
+
+    MulticastSender sender;
+    TEST_ASSERT_TRUE(sender.begin(MULTICAST_TEST_GROUP, MULTICAST_TEST_PORT));
+    sender.setFec(1024, 16, 3);
+    sender.setRateLimitKBps(BENCH_LINK_KBPS);
+    sender.setLeadMs(200);
+
+    printf("Fleet benchmark: %zu byte image, %d KB/s link, groups of 16+3 x 1024 bytes\n", image.size(),
+           BENCH_LINK_KBPS);
+    printf("  unicast: %.1f ms per device\n", unicastMs);
+    const int fleets[] = {1, 8, 32};
+    const uint8_t losses[] = {0, 2, 5};
+    for (int devices : fleets) {
+        for (uint8_t loss : losses) {
+            std::vector<std::unique_ptr<OTAMulticast>> receivers;
+            std::vector<std::vector<uint8_t>> flash(devices, std::vector<uint8_t>(image.size()));
+            std::vector<std::thread> threads;
+            std::vector<char> done(devices, 0);
+            for (int i = 0; i < devices; i++) {
+                receivers.emplace_back(new OTAMulticast());
+                TEST_ASSERT_TRUE(receivers[i]->begin(MULTICAST_TEST_GROUP, MULTICAST_TEST_PORT, "127.0.0.1"));
+                receivers[i]->setSimulatedLoss(loss, i + 1);
+            }
+            for (int i = 0; i < devices; i++) {
+                threads.emplace_back([&, i]() {
+                    done[i] = receivers[i]->waitForSession(3000) &&
+                              receivers[i]->receive(writeToBuffer, nullptr, &flash[i]);
+                });
+            }
+            auto start = std::chrono::steady_clock::now();
+            TEST_ASSERT_TRUE(sender.send(image.data(), image.size()));
+            for (auto& t : threads) {
+                t.join();
+            }
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+                            .count() - 200;
+
+            uint32_t recovered = 0;
+            uint32_t repaired = 0;
+            for (int i = 0; i < devices; i++) {
+                TEST_ASSERT_TRUE(done[i]);
+                TEST_ASSERT_EQUAL_MEMORY(image.data(), flash[i].data(), image.size());
+                recovered += receivers[i]->getStats().recovered;
+                repaired += receivers[i]->getStats().repaired;
+            }
+            printf("  multicast to %2d devices, %u%% loss: %7.1f ms (unicast %8.1f ms, %4.1fx), "
+                   "%u blocks rebuilt, %u repaired\n",
+                   devices, loss, ms, unicastMs * devices, unicastMs * devices / ms, (unsigned)recovered,
+                   (unsigned)repaired);
+            if (devices == 32) {
+                TEST_ASSERT_TRUE(ms < unicastMs * devices / 4);
+            }
+        }
+    }
+    sender.end();
+}
+
+// Main test runner
+int main() {
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    UNITY_BEGIN();
+
+    RUN_TEST(test_fec_rebuilds_any_k_of_n);
+    RUN_TEST(test_listener_receives_multicast_session);
+    RUN_TEST(test_listener_refuses_sessions);
+    RUN_TEST(test_fleet_update_time);
+
+    return UNITY_END();
+}
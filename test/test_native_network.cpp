@@ -0,0 +1,158 @@
+/**
+ * @file test_native_network.cpp
+ * @brief Event-driven network readiness
+ *
+ * OTANetworkState is driven through up/down events for several interfaces,
+ * including address changes. OTAManager follows reported events without
+ * querying anything, still polls a custom NetworkCheckCallback, and answers a
+ * readiness check from the cached state without allocating; the benchmark
+ * reports the cost per check on both paths.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <OTAManager.h>
+#include <OTANetworkState.h>
+#include <HeapTracker.h>
+
+#include <chrono>
+#include <thread>
+
+#define HOST_TEST_PORT 13244
+
+#ifndef NETWORK_BENCH_CALLS
+#define NETWORK_BENCH_CALLS 1000000
+#endif
+
+static volatile bool callbackReady = true;
+static volatile uint32_t callbackCalls = 0;
+
+static bool countingNetworkReady() {
+    callbackCalls = callbackCalls + 1;
+    return callbackReady;
+}
+
+// Nanoseconds per isNetworkReady() call, and the allocations made by all of them
+static double measureCheckNs(uint64_t* allocations) {
+    uint64_t before = HeapTracker::allocations();
+    auto start = std::chrono::steady_clock::now();
+    uint32_t ready = 0;
+    for (int i = 0; i < NETWORK_BENCH_CALLS; i++) {
+        ready += OTAManager::isNetworkReady();
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    *allocations = HeapTracker::allocations() - before;
+    TEST_ASSERT_EQUAL(NETWORK_BENCH_CALLS, ready);
+    return ns / NETWORK_BENCH_CALLS;
+}
+
+void setUp() {
+    callbackReady = true;
+    callbackCalls = 0;
+}
+
+void tearDown() {}
+
+void test_state_follows_interface_events() {
+    OTANetworkState state;
+    char text[16];
+    TEST_ASSERT_FALSE(state.isReady());
+    TEST_ASSERT_EQUAL(0, state.address());
+    state.formatAddress(text, sizeof(text));
+    TEST_ASSERT_EQUAL_STRING("unknown", text);
+
+    state.up(OTANetworkState::ETHERNET, IPAddress(192, 168, 1, 20));
+    TEST_ASSERT_TRUE(state.isReady());
+    state.formatAddress(text, sizeof(text));
+    TEST_ASSERT_EQUAL_STRING("192.168.1.20", text);
+
+    // WiFi is preferred for the address while both are up
+    state.up(OTANetworkState::WIFI, IPAddress(10, 0, 0, 5));
+    TEST_ASSERT_EQUAL((uint32_t)IPAddress(10, 0, 0, 5), state.address());
+    state.down(OTANetworkState::WIFI);
+    TEST_ASSERT_TRUE(state.isReady());
+    TEST_ASSERT_EQUAL((uint32_t)IPAddress(192, 168, 1, 20), state.address());
+
+    // A new address on an interface that is up counts as a change; a repeat does not
+    uint32_t changes = state.changes();
+    state.up(OTANetworkState::ETHERNET, IPAddress(192, 168, 1, 21));
+    state.up(OTANetworkState::ETHERNET, IPAddress(192, 168, 1, 21));
+    TEST_ASSERT_EQUAL(changes + 1, state.changes());
+    TEST_ASSERT_EQUAL((uint32_t)IPAddress(192, 168, 1, 21), state.address());
+
+    state.down(OTANetworkState::ETHERNET);
+    state.down(OTANetworkState::ETHERNET);
+    TEST_ASSERT_FALSE(state.isReady());
+    TEST_ASSERT_EQUAL(0, state.address());
+    TEST_ASSERT_EQUAL(changes + 2, state.changes());
+}
+
+void test_manager_follows_notified_network() {
+    OTAManager::initialize("host-network", "", HOST_TEST_PORT, nullptr);
+
+    // The host has no interfaces of its own and nothing has been reported
+    TEST_ASSERT_FALSE(OTAManager::isNetworkReady());
+
+    OTAManager::notifyNetworkUp(IPAddress(10, 1, 2, 3));
+    TEST_ASSERT_TRUE(OTAManager::isNetworkReady());
+    TEST_ASSERT_TRUE(OTAManager::getNetworkAddress() == IPAddress(10, 1, 2, 3));
+
+    OTAManager::notifyNetworkDown();
+    TEST_ASSERT_FALSE(OTAManager::isNetworkReady());
+    TEST_ASSERT_TRUE(OTAManager::getNetworkAddress() == IPAddress(0, 0, 0, 0));
+
+    // Events from another task are seen by the next check
+    std::thread([]() { OTAManager::notifyNetworkUp(IPAddress(10, 1, 2, 4)); }).join();
+    TEST_ASSERT_TRUE(OTAManager::isNetworkReady());
+}
+
+void test_custom_callback_is_polled() {
+    OTAManager::initialize("host-network", "", HOST_TEST_PORT, countingNetworkReady);
+
+    // The callback decides, whatever the events say
+    TEST_ASSERT_TRUE(OTAManager::isNetworkReady());
+    callbackReady = false;
+    TEST_ASSERT_FALSE(OTAManager::isNetworkReady());
+    TEST_ASSERT_EQUAL(2, callbackCalls);
+
+    OTAManager::handleUpdates();
+    TEST_ASSERT_EQUAL(3, callbackCalls);
+}
+
+void test_readiness_check_cost() {
+    uint64_t callbackAllocations;
+    OTAManager::initialize("host-network", "", HOST_TEST_PORT, countingNetworkReady);
+    double callbackNs = measureCheckNs(&callbackAllocations);
+
+    uint64_t eventAllocations;
+    OTAManager::initialize("host-network", "", HOST_TEST_PORT, nullptr);
+    OTAManager::notifyNetworkUp(IPAddress(10, 1, 2, 5));
+    double eventNs = measureCheckNs(&eventAllocations);
+
+    printf("isNetworkReady(), %d calls\n", NETWORK_BENCH_CALLS);
+    printf("  events:          %6.1f ns/call, %llu allocations\n", eventNs,
+           (unsigned long long)eventAllocations);
+    printf("  custom callback: %6.1f ns/call, %llu allocations\n", callbackNs,
+           (unsigned long long)callbackAllocations);
+    TEST_ASSERT_EQUAL(0, eventAllocations);
+
+    uint64_t before = HeapTracker::allocations();
+    for (int i = 0; i < 1000; i++) {
+        TEST_ASSERT_TRUE(OTAManager::getNetworkAddress() == IPAddress(10, 1, 2, 5));
+    }
+    TEST_ASSERT_EQUAL(before, HeapTracker::allocations());
+}
+
+// Main test runner
+int main() {
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    UNITY_BEGIN();
+
+    RUN_TEST(test_state_follows_interface_events);
+    RUN_TEST(test_manager_follows_notified_network);
+    RUN_TEST(test_custom_callback_is_polled);
+    RUN_TEST(test_readiness_check_cost);
+
+    return UNITY_END();
+}
@@ -0,0 +1,300 @@
+/**
+ * @file test_native_poll.cpp
+ * @brief Poll delay recommended by handleUpdates() and the poll task
+ *
+ * OTAPollCadence is checked on its own first: the idle back-off, no delay after
+ * a call that found a datagram waiting or saw a session event, and the
+ * network-down delay. Then OTAUdpProbe on ArduinoOTA's socket, handleUpdates()
+ * itself, and a network-up event waking the poll task early. Last, idle CPU and
+ * invite latency of the poll task are measured against the fixed cadences of
+ * the examples (10 ms) and the library default (OTA_CHECK_INTERVAL_MS). With a password ArduinoOTA takes one
+ * poll for the invite, one for the login and one to start the transfer, so a
+ * fixed cadence pays its interval up to three times.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <OTAManager.h>
+#include <OTAUdpProbe.h>
+#include <EspotaClient.h>
+#include <SimFlash.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <vector>
+
+#define HOST_TEST_PORT 13255
+#define IDLE_MEASURE_MS 3000
+#define INVITES 3
+#define INVITE_IMAGE_SIZE (16 * 1024)
+
+// Long enough for the poll task to back off to OTA_POLL_IDLE_MAX_MS
+#define BACKOFF_MS (OTA_POLL_IDLE_MAX_MS + 2000)
+#define SETTLE_MS 1500
+
+#define FAST_POLL_MS 10
+
+static volatile bool pollerRunning = false;
+static volatile uint32_t pollIntervalMs = FAST_POLL_MS;
+static std::atomic<int> ends{0};
+
+static void fixedPollerTask(void* pvParameters) {
+    (void)pvParameters;
+    while (pollerRunning) {
+        OTAManager::handleUpdates();
+        vTaskDelay(pdMS_TO_TICKS(pollIntervalMs));
+    }
+    vTaskDelete(NULL);
+}
+
+// Process CPU time (all threads) in microseconds
+static uint64_t processCpuUs() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000ULL +
+           usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static std::vector<uint8_t> makeImage(size_t size) {
+    std::vector<uint8_t> image(size);
+    for (size_t i = 0; i < size; i++) {
+        image[i] = (uint8_t)(i * 43 + 5);
+    }
+    return image;
+}
+
+struct PollFigures {
+    uint64_t idleCpuUs;
+    uint64_t meanLatencyUs;
+    uint64_t maxLatencyUs;
+};
+
+// Idle CPU over IDLE_MEASURE_MS, then INVITES updates that each follow an idle spell
+static PollFigures measure(const std::vector<uint8_t>& image) {
+    PollFigures figures = {0, 0, 0};
+    delay(BACKOFF_MS);
+    uint64_t before = processCpuUs();
+    delay(IDLE_MEASURE_MS);
+    figures.idleCpuUs = processCpuUs() - before;
+
+    for (int i = 0; i < INVITES; i++) {
+        delay(SETTLE_MS);
+        int ended = ends + 1;
+        EspotaClient client("127.0.0.1", HOST_TEST_PORT);
+        client.setPassword("secret");
+        client.setTimeoutMs(5000);
+        EspotaResult result;
+        TEST_ASSERT_TRUE_MESSAGE(client.upload(image.data(), image.size(), &result), result.error);
+        for (int j = 0; j < 1000 && ends < ended; j++) {
+            delay(1);
+        }
+        TEST_ASSERT_EQUAL(ended, ends.load());
+        figures.meanLatencyUs += result.inviteToConnectUs / INVITES;
+        if (result.inviteToConnectUs > figures.maxLatencyUs) {
+            figures.maxLatencyUs = result.inviteToConnectUs;
+        }
+    }
+    return figures;
+}
+
+static PollFigures measureFixed(const std::vector<uint8_t>& image, uint32_t intervalMs) {
+    pollIntervalMs = intervalMs;
+    pollerRunning = true;
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(fixedPollerTask, "FixedPoll", 4096, NULL, 1, NULL));
+    PollFigures figures = measure(image);
+    pollerRunning = false;
+    delay(intervalMs + 20);
+    return figures;
+}
+
+void setUp() {
+    TEST_ASSERT_TRUE(SimFlash.begin());
+}
+
+void tearDown() {}
+
+// Quiet calls from OTA_POLL_MIN_MS up to maxMs
+static void checkBackoff(OTAPollCadence& cadence, int calls, bool watched = true) {
+    uint32_t maxMs = watched ? OTA_POLL_IDLE_MAX_MS : OTA_CHECK_INTERVAL_MS;
+    uint32_t expected = OTA_POLL_MIN_MS;
+    for (int i = 0; i < calls; i++) {
+        TEST_ASSERT_EQUAL(expected, cadence.next(false, watched));
+        expected = expected * 2 < maxMs ? expected * 2 : maxMs;
+    }
+}
+
+void test_cadence() {
+    OTAPollCadence cadence;
+    TEST_ASSERT_TRUE(OTA_POLL_IDLE_MAX_MS >= 1000);
+    checkBackoff(cadence, 12);
+    TEST_ASSERT_EQUAL(OTA_POLL_IDLE_MAX_MS, cadence.next(false, true));
+
+    // A datagram was waiting: no delay, then the back-off starts over
+    TEST_ASSERT_EQUAL(0, cadence.next(true, true));
+    TEST_ASSERT_EQUAL(0, cadence.next(true, true));
+    checkBackoff(cadence, 4);
+
+    // A session event counts once
+    cadence.activity();
+    TEST_ASSERT_EQUAL(0, cadence.next(false, true));
+    checkBackoff(cadence, 3);
+
+    // Network down restarts the back-off and drops a pending event
+    cadence.activity();
+    TEST_ASSERT_EQUAL(OTA_POLL_NETWORK_DOWN_MS, cadence.networkDown());
+    checkBackoff(cadence, 2);
+
+    // Nothing shows an invite coming without the socket: the fixed interval at most,
+    // and the back-off goes on from there once the socket is found again
+    TEST_ASSERT_EQUAL(0, cadence.next(true, true));
+    checkBackoff(cadence, 12);
+    TEST_ASSERT_EQUAL(OTA_CHECK_INTERVAL_MS, cadence.next(false, false));
+    TEST_ASSERT_EQUAL(OTA_CHECK_INTERVAL_MS, cadence.next(false, false));
+    TEST_ASSERT_EQUAL(OTA_CHECK_INTERVAL_MS, cadence.next(false, true));
+    TEST_ASSERT_EQUAL(OTA_CHECK_INTERVAL_MS * 2, cadence.next(false, true));
+    TEST_ASSERT_EQUAL(0, cadence.next(true, false));
+    checkBackoff(cadence, 12, false);
+}
+
+void test_udp_probe() {
+    OTAUdpProbe probe;
+    TEST_ASSERT_FALSE(probe.pending());
+    TEST_ASSERT_FALSE(probe.attach(HOST_TEST_PORT));  // ArduinoOTA not started yet
+
+    ArduinoOTA.setPort(HOST_TEST_PORT);
+    ArduinoOTA.begin();
+    TEST_ASSERT_TRUE(probe.attach(HOST_TEST_PORT));
+    TEST_ASSERT_FALSE(probe.pending());
+
+    // A datagram stays queued for handle() after the probe saw it
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in to = {};
+    to.sin_family = AF_INET;
+    to.sin_port = htons(HOST_TEST_PORT);
+    to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    TEST_ASSERT_EQUAL(4, sendto(sock, "ping", 4, 0, (struct sockaddr*)&to, sizeof(to)));
+    for (int i = 0; i < 100 && !probe.pending(); i++) {
+        delay(1);
+    }
+    TEST_ASSERT_TRUE(probe.pending());
+    TEST_ASSERT_TRUE(probe.pending());
+    ArduinoOTA.handle();
+    TEST_ASSERT_FALSE(probe.pending());
+
+    // Closed, and the number reused by a socket on another port: detached, not misread
+    ArduinoOTA.end();
+    int other = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in any = {};
+    any.sin_family = AF_INET;
+    any.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    TEST_ASSERT_EQUAL(0, bind(other, (struct sockaddr*)&any, sizeof(any)));
+    struct sockaddr_in bound = {};
+    socklen_t boundLen = sizeof(bound);
+    getsockname(other, (struct sockaddr*)&bound, &boundLen);
+    to.sin_port = bound.sin_port;
+    TEST_ASSERT_EQUAL(4, sendto(sock, "ping", 4, 0, (struct sockaddr*)&to, sizeof(to)));
+    delay(5);
+    TEST_ASSERT_TRUE(probe.attached());
+    TEST_ASSERT_FALSE(probe.pending());
+    TEST_ASSERT_FALSE(probe.attached());
+    close(other);
+    close(sock);
+}
+
+void test_handle_updates_delay() {
+    // Nothing to poll yet
+    TEST_ASSERT_EQUAL(OTA_POLL_IDLE_MAX_MS, OTAManager::handleUpdates());
+    TEST_ASSERT_FALSE(OTAManager::startPollTask());
+
+    OTAManager::initialize("host-poll", "secret", HOST_TEST_PORT, nullptr);
+    OTAManager::setEndCallback([]() { ends++; });
+    OTAManager::notifyNetworkDown();
+    TEST_ASSERT_EQUAL(OTA_POLL_NETWORK_DOWN_MS, OTAManager::handleUpdates());
+
+    OTAManager::notifyNetworkUp(IPAddress(127, 0, 0, 1));
+    TEST_ASSERT_EQUAL(OTA_POLL_MIN_MS, OTAManager::handleUpdates());
+
+    // ArduinoOTA's socket closed behind OTAManager's back: the fixed interval at
+    // most until a socket is on the port again, then the long idle delay
+    ArduinoOTA.end();
+    for (int i = 0; i < 12; i++) {
+        TEST_ASSERT_TRUE(OTAManager::handleUpdates() <= OTA_CHECK_INTERVAL_MS);
+    }
+    ArduinoOTA.begin();
+    delay(OTA_CHECK_INTERVAL_MS + 10);
+    uint32_t delayMs = 0;
+    for (int i = 0; i < 12; i++) {
+        delayMs = OTAManager::handleUpdates();
+    }
+    TEST_ASSERT_EQUAL(OTA_POLL_IDLE_MAX_MS, delayMs);
+
+    // The listener serves updates itself
+    TEST_ASSERT_TRUE(OTAManager::startListener());
+    TEST_ASSERT_EQUAL(OTA_POLL_IDLE_MAX_MS, OTAManager::handleUpdates());
+    OTAManager::stopListener();
+    TEST_ASSERT_TRUE(OTAManager::handleUpdates() < OTA_POLL_IDLE_MAX_MS);
+}
+
+void test_network_up_wakes_poll_task() {
+    OTAManager::notifyNetworkDown();
+    TEST_ASSERT_TRUE(OTAManager::startPollTask());
+    TEST_ASSERT_TRUE(OTAManager::startPollTask());
+    TEST_ASSERT_TRUE(OTAManager::isPollTaskRunning());
+    delay(50);
+
+    // Waiting OTA_POLL_NETWORK_DOWN_MS: an event ends the wait
+    uint32_t calls = OTAManager::getStats().handleUpdatesPolls;
+    delay(50);
+    TEST_ASSERT_EQUAL(calls, OTAManager::getStats().handleUpdatesPolls);
+    OTAManager::notifyNetworkUp(IPAddress(127, 0, 0, 1));
+    delay(20);
+    TEST_ASSERT_TRUE(OTAManager::getStats().handleUpdatesPolls > calls);
+
+    OTAManager::stopPollTask();
+    TEST_ASSERT_FALSE(OTAManager::isPollTaskRunning());
+    OTAManager::stopPollTask();
+}
+
+void test_idle_cpu_and_invite_latency() {
+    std::vector<uint8_t> image = makeImage(INVITE_IMAGE_SIZE);
+    PollFigures fast = measureFixed(image, FAST_POLL_MS);
+    PollFigures slow = measureFixed(image, OTA_CHECK_INTERVAL_MS);
+
+    TEST_ASSERT_TRUE(OTAManager::startPollTask());
+    PollFigures adaptive = measure(image);
+    OTAManager::stopPollTask();
+
+    printf("Idle CPU over %d ms / invite->connect latency after %d ms idle (mean, max of %d):\n",
+           IDLE_MEASURE_MS, SETTLE_MS, INVITES);
+    printf("  poll every %3d ms : %6llu us CPU, %8.2f ms, %8.2f ms\n", FAST_POLL_MS,
+           (unsigned long long)fast.idleCpuUs, fast.meanLatencyUs / 1000.0, fast.maxLatencyUs / 1000.0);
+    printf("  poll every %3d ms : %6llu us CPU, %8.2f ms, %8.2f ms\n", OTA_CHECK_INTERVAL_MS,
+           (unsigned long long)slow.idleCpuUs, slow.meanLatencyUs / 1000.0, slow.maxLatencyUs / 1000.0);
+    printf("  poll task         : %6llu us CPU, %8.2f ms, %8.2f ms\n", (unsigned long long)adaptive.idleCpuUs,
+           adaptive.meanLatencyUs / 1000.0, adaptive.maxLatencyUs / 1000.0);
+
+    // Idle, the poll task costs less than even OTA_CHECK_INTERVAL_MS polling.
+    // The invite ends its wait, and the login and the transfer follow within a
+    // few OTA_POLL_MIN_MS, so it connects sooner too
+    TEST_ASSERT_LESS_THAN(slow.idleCpuUs, adaptive.idleCpuUs);
+    TEST_ASSERT_LESS_THAN(slow.meanLatencyUs, adaptive.meanLatencyUs);
+    TEST_ASSERT_LESS_THAN(slow.maxLatencyUs, adaptive.maxLatencyUs);
+    TEST_ASSERT_TRUE(adaptive.maxLatencyUs < OTA_CHECK_INTERVAL_MS * 1000ULL);
+}
+
+int main() {
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_cadence);
+    RUN_TEST(test_udp_probe);
+    RUN_TEST(test_handle_updates_delay);
+    RUN_TEST(test_network_up_wakes_poll_task);
+    RUN_TEST(test_idle_cpu_and_invite_latency);
+    return UNITY_END();
+}
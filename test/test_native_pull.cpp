@@ -0,0 +1,309 @@
+/**
+ * @file test_native_pull.cpp
+ * @brief Pull-mode updates: the device downloads the image over HTTP
+ *
+ * Images are served by a local HTTP server and installed with
+ * OTAManager::pullUpdate(): plain, gzip compressed and behind a redirect;
+ * downloads cut partway continue with Range requests (or by skipping, when the
+ * server ignores Range); error statuses, damaged images and unsigned images are
+ * refused. The benchmark reports throughput and the peak heap each download
+ * needs, with ESP32-like flash timing.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <OTAManager.h>
+#include <OTASignature.h>
+#include <AppImage.h>
+#include <Ed25519Signer.h>
+#include <HeapTracker.h>
+#include <HttpTestServer.h>
+#include <MD5Builder.h>
+#include <SimFlash.h>
+
+#include <zlib.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#define HOST_TEST_PORT 13241
+
+#ifndef BENCH_IMAGE_SIZE
+#define BENCH_IMAGE_SIZE (1024 * 1024)
+#endif
+#ifndef BENCH_ERASE_US
+#define BENCH_ERASE_US 6000
+#endif
+#ifndef BENCH_PROGRAM_US_PER_KB
+#define BENCH_PROGRAM_US_PER_KB 2500
+#endif
+
+static volatile int lastError = -1;
+static HttpTestServer server;
+
+static const char* signingSeedHex = "4ccd089b28ff96da9db6c346ec114e0f5b8a319f35aba624da8cf6ed4fb8a6fb";
+
+static bool hostNetworkReady() {
+    return true;
+}
+
+static std::vector<uint8_t> makePayload(size_t size, uint32_t seed) {
+    std::vector<uint8_t> payload(size);
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1103515245u + 12345u;
+        // Skewed bytes so the image compresses like firmware does
+        payload[i] = (seed >> 16) & 0x3 ? (uint8_t)(seed >> 28) : (uint8_t)(seed >> 16);
+    }
+    return payload;
+}
+
+static std::vector<uint8_t> gzip(const std::vector<uint8_t>& data) {
+    z_stream zs = {};
+    TEST_ASSERT_EQUAL(Z_OK, deflateInit2(&zs, 9, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY));
+    std::vector<uint8_t> out(deflateBound(&zs, data.size()) + 64);
+    zs.next_in = const_cast<uint8_t*>(data.data());
+    zs.avail_in = data.size();
+    zs.next_out = out.data();
+    zs.avail_out = out.size();
+    TEST_ASSERT_EQUAL(Z_STREAM_END, deflate(&zs, Z_FINISH));
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return out;
+}
+
+static std::string md5Hex(const std::vector<uint8_t>& data) {
+    MD5Builder md5;
+    md5.begin();
+    md5.add(data.data(), data.size());
+    md5.calculate();
+    char hex[33];
+    md5.getChars(hex);
+    return hex;
+}
+
+static std::string toHex(const uint8_t* data, size_t len) {
+    std::string hex;
+    char byte[3];
+    for (size_t i = 0; i < len; i++) {
+        snprintf(byte, sizeof(byte), "%02x", data[i]);
+        hex += byte;
+    }
+    return hex;
+}
+
+static std::string url(const char* path) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "http://127.0.0.1:%u%s", server.port(), path);
+    return buf;
+}
+
+// Pull `file` (which installs as `image`) and check the flash and the restart
+static OTAPullStats pullAndCheck(const std::vector<uint8_t>& file, const std::vector<uint8_t>& image,
+                                 const char* path = "/firmware.bin") {
+    server.setFile(file.data(), file.size());
+    TEST_ASSERT_TRUE(SimFlash.begin());
+    uint32_t restarts = ESP.getRestartCount();
+    std::string md5 = md5Hex(file);
+    OTAPullOptions options;
+    options.md5 = md5.c_str();
+    TEST_ASSERT_TRUE(OTAManager::pullUpdate(url(path).c_str(), options));
+    TEST_ASSERT_EQUAL(-1, lastError);
+    TEST_ASSERT_EQUAL(restarts + 1, ESP.getRestartCount());
+    TEST_ASSERT_EQUAL_MEMORY(image.data(), SimFlash.data(), image.size());
+    OTAPullStats stats = OTAManager::getPullStats();
+    TEST_ASSERT_EQUAL(file.size(), stats.imageSize);
+    return stats;
+}
+
+void setUp() {
+    lastError = -1;
+    server.setRangeSupport(true);
+    server.setCutAfter(0, 0);
+    server.setRedirect(nullptr, nullptr);
+    server.setStatus(0);
+    server.setRateLimitKBps(0);
+}
+
+void tearDown() {
+    SimFlash.setTiming(0, 0);
+    OTAManager::setPipelineEnabled(true);
+}
+
+void test_pull_plain_image() {
+    TEST_ASSERT_TRUE(server.begin());
+    OTAManager::initialize("host-pull", "", HOST_TEST_PORT, hostNetworkReady);
+    OTAManager::setEndCallback([]() {});
+    OTAManager::setErrorCallback([](ota_error_t error) { lastError = error; });
+
+    std::vector<uint8_t> image = makeAppImage(makePayload(300 * 1024 + 7, 1));
+    OTAPullStats stats = pullAndCheck(image, image);
+    TEST_ASSERT_EQUAL(200, stats.httpStatus);
+    TEST_ASSERT_EQUAL(image.size(), stats.bytes);
+    TEST_ASSERT_EQUAL(0, stats.reconnects);
+    TEST_ASSERT_EQUAL(1, server.requestCount());
+
+    // Without the pipeline the body goes through the direct-write chunk instead
+    OTAManager::setPipelineEnabled(false);
+    pullAndCheck(image, image);
+}
+
+void test_pull_compressed_image_behind_redirect() {
+    std::vector<uint8_t> image = makeAppImage(makePayload(256 * 1024, 2));
+    std::vector<uint8_t> gz = gzip(image);
+    server.setRedirect("/latest", "/firmware.bin.gz");
+    OTAPullStats stats = pullAndCheck(gz, image, "/latest");
+    TEST_ASSERT_EQUAL(gz.size(), stats.bytes);
+
+    // Absolute Location headers are followed too
+    std::string absolute = url("/firmware.bin.gz");
+    server.setRedirect("/latest", absolute.c_str());
+    pullAndCheck(gz, image, "/latest");
+}
+
+void test_pull_continues_after_dropped_connection() {
+    std::vector<uint8_t> image = makeAppImage(makePayload(400 * 1024, 3));
+
+    // Range requests pick up at the last byte received
+    server.setCutAfter(100 * 1024, 2);
+    OTAPullStats stats = pullAndCheck(image, image);
+    TEST_ASSERT_EQUAL(2, stats.reconnects);
+    TEST_ASSERT_EQUAL(206, stats.httpStatus);
+    TEST_ASSERT_EQUAL(image.size(), stats.bytes);
+    TEST_ASSERT_GREATER_THAN(0, server.lastRangeStart());
+
+    // A server that ignores Range resends from byte zero; the received part is skipped
+    server.setRangeSupport(false);
+    server.setCutAfter(150 * 1024, 1);
+    stats = pullAndCheck(image, image);
+    TEST_ASSERT_EQUAL(1, stats.reconnects);
+    TEST_ASSERT_EQUAL(200, stats.httpStatus);
+}
+
+void test_pull_failures_are_reported() {
+    std::vector<uint8_t> image = makeAppImage(makePayload(128 * 1024, 4));
+    server.setFile(image.data(), image.size());
+    uint32_t restarts = ESP.getRestartCount();
+
+    server.setStatus(404);
+    TEST_ASSERT_FALSE(OTAManager::pullUpdate(url("/missing.bin").c_str()));
+    TEST_ASSERT_EQUAL(OTA_CONNECT_ERROR, lastError);
+    TEST_ASSERT_EQUAL(404, OTAManager::getPullStats().httpStatus);
+    server.setStatus(0);
+
+    lastError = -1;
+    TEST_ASSERT_FALSE(OTAManager::pullUpdate("https://127.0.0.1/firmware.bin"));
+    TEST_ASSERT_EQUAL(OTA_CONNECT_ERROR, lastError);
+
+    // More drops than OTA_PULL_RETRIES
+    lastError = -1;
+    server.setCutAfter(16 * 1024, OTA_PULL_RETRIES + 1);
+    TEST_ASSERT_FALSE(OTAManager::pullUpdate(url("/firmware.bin").c_str()));
+    TEST_ASSERT_EQUAL(OTA_RECEIVE_ERROR, lastError);
+    TEST_ASSERT_EQUAL(OTA_PULL_RETRIES, OTAManager::getPullStats().reconnects);
+    server.setCutAfter(0, 0);
+
+    // Wrong digests
+    lastError = -1;
+    OTAPullOptions options;
+    options.md5 = "00112233445566778899aabbccddeeff";
+    TEST_ASSERT_FALSE(OTAManager::pullUpdate(url("/firmware.bin").c_str(), options));
+    TEST_ASSERT_EQUAL(OTA_END_ERROR, lastError);
+
+    lastError = -1;
+    options.md5 = nullptr;
+    options.sha256 = "0000000000000000000000000000000000000000000000000000000000000000";
+    TEST_ASSERT_FALSE(OTAManager::pullUpdate(url("/firmware.bin").c_str(), options));
+    TEST_ASSERT_EQUAL(OTA_END_ERROR, lastError);
+
+    TEST_ASSERT_EQUAL(restarts, ESP.getRestartCount());
+}
+
+void test_pull_signature_required() {
+    uint8_t seed[32];
+    uint8_t publicKey[32];
+    TEST_ASSERT_TRUE(OTASignature::fromHex(signingSeedHex, seed, sizeof(seed)));
+    ed25519PublicKey(seed, publicKey);
+    OTAManager::setSigningKey(publicKey);
+
+    std::vector<uint8_t> image = makeAppImage(makePayload(96 * 1024, 5));
+    server.setFile(image.data(), image.size());
+    int requests = server.requestCount();
+    TEST_ASSERT_FALSE(OTAManager::pullUpdate(url("/firmware.bin").c_str()));
+    TEST_ASSERT_EQUAL(OTA_AUTH_ERROR, lastError);
+    TEST_ASSERT_EQUAL(requests, server.requestCount());  // Refused before downloading
+
+    uint8_t sig[64];
+    ed25519Sign(seed, image.data(), image.size(), sig);
+    std::string sigHex = toHex(sig, sizeof(sig));
+    TEST_ASSERT_TRUE(SimFlash.begin());
+    lastError = -1;
+    OTAPullOptions options;
+    options.signature = sigHex.c_str();
+    TEST_ASSERT_TRUE(OTAManager::pullUpdate(url("/firmware.bin").c_str(), options));
+    TEST_ASSERT_EQUAL_MEMORY(image.data(), SimFlash.data(), image.size());
+
+    // A signature for other content is rejected
+    image[image.size() / 2] ^= 1;
+    lastError = -1;
+    TEST_ASSERT_FALSE(OTAManager::pullUpdate(url("/firmware.bin").c_str(), options));
+    TEST_ASSERT_EQUAL(OTA_END_ERROR, lastError);
+
+    OTAManager::setSigningKey(nullptr);
+}
+
+void test_pull_throughput_and_heap() {
+    std::vector<uint8_t> image = makeAppImage(makePayload(BENCH_IMAGE_SIZE, 6));
+    std::vector<uint8_t> gz = gzip(image);
+    struct {
+        const char* name;
+        const std::vector<uint8_t>* file;
+        bool pipeline;
+    } runs[] = {
+        {"plain, pipeline", &image, true},
+        {"plain, direct  ", &image, false},
+        {"gzip, pipeline ", &gz, true},
+    };
+
+    printf("Pull benchmark: %zu byte image, flash %d us/erase + %d us/KB\n", image.size(),
+           BENCH_ERASE_US, BENCH_PROGRAM_US_PER_KB);
+    for (const auto& run : runs) {
+        OTAManager::setPipelineEnabled(run.pipeline);
+        server.setFile(run.file->data(), run.file->size());
+        TEST_ASSERT_TRUE(SimFlash.begin());
+        SimFlash.setTiming(BENCH_ERASE_US, BENCH_PROGRAM_US_PER_KB);
+
+        HeapTracker::resetPeak();
+        size_t before = HeapTracker::inUse();
+        TEST_ASSERT_TRUE(OTAManager::pullUpdate(url("/firmware.bin").c_str()));
+        size_t peak = HeapTracker::peak() - before;
+        SimFlash.setTiming(0, 0);
+        TEST_ASSERT_EQUAL_MEMORY(image.data(), SimFlash.data(), image.size());
+
+        OTAPullStats stats = OTAManager::getPullStats();
+        double ms = stats.transferUs / 1000.0;
+        printf("  %s: %8u bytes in %7.1f ms, %6.1f KB/s, peak heap %6zu bytes, %llu allocations\n",
+               run.name, (unsigned)stats.bytes, ms, stats.bytes / ms * 1000.0 / 1024.0, peak,
+               (unsigned long long)HeapTracker::allocations());
+
+        // The image is never held in memory: the peak stays far below its size
+        TEST_ASSERT_LESS_THAN(run.file->size() / 4, peak);
+    }
+    server.end();
+}
+
+// Main test runner
+int main() {
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    UNITY_BEGIN();
+
+    RUN_TEST(test_pull_plain_image);
+    RUN_TEST(test_pull_compressed_image_behind_redirect);
+    RUN_TEST(test_pull_continues_after_dropped_connection);
+    RUN_TEST(test_pull_failures_are_reported);
+    RUN_TEST(test_pull_signature_required);
+    RUN_TEST(test_pull_throughput_and_heap);
+
+    return UNITY_END();
+}
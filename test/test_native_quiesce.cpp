@@ -0,0 +1,307 @@
+/**
+ * @file test_native_quiesce.cpp
+ * @brief Application parts paused during update sessions (OTAManager::addQuiesceParticipant())
+ *
+ * The participant table is checked on its own first: capacity, handlers
+ * acknowledging on return and from another task, the time budget, resume
+ * order, and removing a paused participant. Then a simulated sensor task,
+ * which acknowledges from its own loop, is paused for listener updates: it
+ * makes no bus transaction from the first progress report to the last, and is
+ * resumed after completed, cut and refused sessions alike.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <OTAManager.h>
+#include <EspotaClient.h>
+#include <SimFlash.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#define HOST_TEST_PORT 13254
+#define QUIESCE_IMAGE_SIZE (256 * 1024)
+#define ACK_DELAY_MS 20
+
+// Records the order of handler calls as "p<name>" and "r<name>"
+static std::string calls;
+
+struct Part {
+    const char* name;
+    bool pausesAtOnce;
+    int id;
+};
+
+static bool partPause(void* context) {
+    Part* part = static_cast<Part*>(context);
+    calls += std::string("p") + part->name;
+    return part->pausesAtOnce;
+}
+
+static void partResume(void* context) {
+    calls += std::string("r") + static_cast<Part*>(context)->name;
+}
+
+static OTAParticipant participantFor(Part* part) {
+    return {part->name, partPause, partResume, part};
+}
+
+// Acknowledges for the OTAQuiesce under test after ACK_DELAY_MS
+static OTAQuiesce* ackQuiesce = nullptr;
+
+static void ackTask(void* pvParameters) {
+    delay(ACK_DELAY_MS);
+    ackQuiesce->acknowledge((int)(intptr_t)pvParameters);
+    vTaskDelete(NULL);
+}
+
+// A sensor task polling a bus; it pauses between transactions when asked
+struct SensorTask {
+    int id = -1;
+    std::atomic<bool> pauseRequested{false};
+    std::atomic<bool> paused{false};
+    std::atomic<uint32_t> transactions{0};
+    std::atomic<bool> running{true};
+};
+
+static SensorTask sensor;
+
+static void sensorLoop(void* pvParameters) {
+    (void)pvParameters;
+    while (sensor.running) {
+        if (sensor.pauseRequested) {
+            if (!sensor.paused) {
+                sensor.paused = true;
+                OTAManager::acknowledgeQuiesce(sensor.id);
+            }
+            delay(1);
+            continue;
+        }
+        sensor.paused = false;
+        sensor.transactions++;
+        delay(1);
+    }
+    vTaskDelete(NULL);
+}
+
+static bool sensorPause(void*) {
+    sensor.pauseRequested = true;
+    return false;  // Acknowledged from the sensor's loop
+}
+
+static void sensorResume(void*) {
+    sensor.pauseRequested = false;
+}
+
+static std::atomic<int> ends{0};
+static std::atomic<int> errors{0};
+static std::atomic<uint32_t> firstProgressTransactions{0};
+static std::atomic<uint32_t> lastProgressTransactions{0};
+static std::atomic<bool> pausedAtStart{false};
+static bool firstReport = true;
+
+static void onStart(void*) {
+    pausedAtStart = sensor.paused.load();
+    firstReport = true;
+}
+
+static void onProgress(unsigned int, unsigned int, void*) {
+    if (firstReport) {
+        firstProgressTransactions = sensor.transactions.load();
+        firstReport = false;
+    }
+    lastProgressTransactions = sensor.transactions.load();
+}
+
+static void onEnd(void*) {
+    ends++;
+}
+
+static void onError(ota_error_t, void*) {
+    errors++;
+}
+
+static bool hostNetworkReady() {
+    return true;
+}
+
+static std::vector<uint8_t> makeImage(size_t size) {
+    std::vector<uint8_t> image(size);
+    for (size_t i = 0; i < size; i++) {
+        image[i] = (uint8_t)(i * 41 + 7);
+    }
+    return image;
+}
+
+static bool upload(const std::vector<uint8_t>& image, EspotaResult* result, const char* password = "secret",
+                   size_t cutAfter = 0) {
+    EspotaClient client("127.0.0.1", HOST_TEST_PORT);
+    client.setPassword(password);
+    client.setTimeoutMs(5000);
+    client.setCutAfter(cutAfter);
+    return client.upload(image.data(), image.size(), result);
+}
+
+static void waitFor(std::atomic<int>& counter, int value) {
+    for (int i = 0; i < 5000 && counter < value; i++) {
+        delay(1);
+    }
+    TEST_ASSERT_EQUAL(value, counter.load());
+}
+
+// The sensor makes transactions again
+static void checkResumed() {
+    uint32_t before = sensor.transactions;
+    for (int i = 0; i < 1000 && sensor.transactions < before + 5; i++) {
+        delay(1);
+    }
+    TEST_ASSERT_FALSE(sensor.pauseRequested.load());
+    TEST_ASSERT_TRUE(sensor.transactions >= before + 5);
+}
+
+void setUp() {
+    TEST_ASSERT_TRUE(SimFlash.begin());
+    calls.clear();
+}
+
+void tearDown() {}
+
+void test_table() {
+    OTAQuiesce q;
+    Part a = {"A", true, 0};
+    TEST_ASSERT_EQUAL(-1, q.add({"none", nullptr, partResume, &a}));
+    for (int i = 0; i < OTAQuiesce::CAPACITY; i++) {
+        TEST_ASSERT_EQUAL(i, q.add(participantFor(&a)));
+    }
+    TEST_ASSERT_EQUAL(-1, q.add(participantFor(&a)));
+    TEST_ASSERT_TRUE(q.remove(3));
+    TEST_ASSERT_FALSE(q.remove(3));
+    TEST_ASSERT_FALSE(q.remove(OTAQuiesce::CAPACITY));
+    TEST_ASSERT_EQUAL(3, q.add(participantFor(&a)));
+}
+
+void test_pause_and_resume() {
+    OTAQuiesce q;
+    Part a = {"A", true, 0}, b = {"B", false, 0}, c = {"C", true, 0};
+    a.id = q.add(participantFor(&a));
+    b.id = q.add(participantFor(&b));
+    c.id = q.add(participantFor(&c));
+
+    // B acknowledges from another task; the pause waits for it, not for the budget
+    ackQuiesce = &q;
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(ackTask, "Ack", 2048, (void*)(intptr_t)b.id, 1, NULL));
+    TEST_ASSERT_TRUE(q.pause(1000));
+    OTAQuiesceStats stats = q.getStats();
+    printf("Acknowledged after %u us\n", (unsigned)stats.lastWaitUs);
+    TEST_ASSERT_TRUE(stats.lastWaitUs >= (ACK_DELAY_MS - 2) * 1000);
+    TEST_ASSERT_TRUE(stats.lastWaitUs < 500 * 1000);
+    TEST_ASSERT_EQUAL(0, stats.lastLateMask);
+    TEST_ASSERT_TRUE(q.isPaused());
+
+    // Resumed last paused first, once
+    q.resume();
+    q.resume();
+    TEST_ASSERT_EQUAL_STRING("pApBpCrCrBrA", calls.c_str());
+    TEST_ASSERT_FALSE(q.isPaused());
+
+    // Nobody acknowledges for B: the budget runs out and B is reported late,
+    // then resumed with the others
+    calls.clear();
+    uint32_t start = millis();
+    TEST_ASSERT_FALSE(q.pause(50));
+    uint32_t waited = millis() - start;
+    stats = q.getStats();
+    TEST_ASSERT_TRUE(waited >= 49 && waited < 500);
+    TEST_ASSERT_EQUAL(1u << b.id, stats.lastLateMask);
+    TEST_ASSERT_EQUAL(2, stats.pauses);
+    TEST_ASSERT_EQUAL(1, stats.timeouts);
+
+    // Removing a paused participant resumes it; an acknowledgement after the
+    // session is ignored
+    TEST_ASSERT_TRUE(q.remove(c.id));
+    q.acknowledge(b.id);
+    q.resume();
+    TEST_ASSERT_EQUAL_STRING("pApBpCrCrBrA", calls.c_str());
+
+    // A pause left without its end is ended by the next one
+    calls.clear();
+    q.pause(0);
+    q.pause(0);
+    q.resume();
+    TEST_ASSERT_EQUAL_STRING("pApBrBrApApBrBrA", calls.c_str());
+}
+
+void test_sensor_paused_for_sessions() {
+    std::vector<uint8_t> image = makeImage(QUIESCE_IMAGE_SIZE);
+    EspotaResult result;
+    OTAManager::initialize("host-quiesce", "secret", HOST_TEST_PORT, hostNetworkReady);
+    OTAManager::subscribe({onStart, onProgress, onEnd, onError, nullptr, 0, 0});
+    sensor.id = OTAManager::addQuiesceParticipant({"SensorTask", sensorPause, sensorResume, nullptr});
+    TEST_ASSERT_TRUE(sensor.id >= 0);
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(sensorLoop, "SensorTask", 4096, NULL, 1, NULL));
+    delay(20);
+    TEST_ASSERT_TRUE(sensor.transactions > 0);
+
+    // Paused before the start callbacks and for the whole transfer
+    TEST_ASSERT_TRUE(OTAManager::startListener());
+    TEST_ASSERT_TRUE(upload(image, &result));
+    waitFor(ends, 1);
+    TEST_ASSERT_TRUE(pausedAtStart.load());
+    TEST_ASSERT_EQUAL(firstProgressTransactions.load(), lastProgressTransactions.load());
+    OTAQuiesceStats stats = OTAManager::getQuiesceStats();
+    printf("Sensor acknowledged after %u us\n", (unsigned)stats.lastWaitUs);
+    TEST_ASSERT_EQUAL(1, stats.pauses);
+    TEST_ASSERT_EQUAL(0, stats.timeouts);
+    TEST_ASSERT_TRUE(stats.lastWaitUs < OTA_QUIESCE_BUDGET_MS * 1000);
+    checkResumed();
+
+    // A transfer cut halfway resumes it too
+    TEST_ASSERT_FALSE(upload(image, &result, "secret", QUIESCE_IMAGE_SIZE / 2));
+    waitFor(errors, 1);
+    TEST_ASSERT_EQUAL(2, OTAManager::getQuiesceStats().pauses);
+    checkResumed();
+
+    // A refused login never starts a session, so nothing is paused
+    TEST_ASSERT_FALSE(upload(image, &result, "wrong"));
+    waitFor(errors, 2);
+    TEST_ASSERT_EQUAL(2, OTAManager::getQuiesceStats().pauses);
+    checkResumed();
+}
+
+void test_late_participant() {
+    std::vector<uint8_t> image = makeImage(QUIESCE_IMAGE_SIZE);
+    EspotaResult result;
+
+    // Never acknowledges: the session waits for the budget, then goes ahead
+    Part late = {"Late", false, 0};
+    late.id = OTAManager::addQuiesceParticipant(participantFor(&late));
+    TEST_ASSERT_TRUE(late.id >= 0);
+    int before = ends;
+    TEST_ASSERT_TRUE(upload(image, &result));
+    waitFor(ends, before + 1);
+    OTAQuiesceStats stats = OTAManager::getQuiesceStats();
+    TEST_ASSERT_EQUAL(1, stats.timeouts);
+    TEST_ASSERT_EQUAL(1u << late.id, stats.lastLateMask);
+    TEST_ASSERT_TRUE(stats.lastWaitUs >= (OTA_QUIESCE_BUDGET_MS - 2) * 1000);
+    TEST_ASSERT_EQUAL_STRING("pLaterLate", calls.c_str());
+    checkResumed();
+
+    TEST_ASSERT_TRUE(OTAManager::removeQuiesceParticipant(late.id));
+    TEST_ASSERT_TRUE(OTAManager::removeQuiesceParticipant(sensor.id));
+    TEST_ASSERT_FALSE(OTAManager::removeQuiesceParticipant(sensor.id));
+    OTAManager::stopListener();
+    sensor.running = false;
+    delay(10);
+}
+
+int main() {
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_table);
+    RUN_TEST(test_pause_and_resume);
+    RUN_TEST(test_sensor_paused_for_sessions);
+    RUN_TEST(test_late_participant);
+    return UNITY_END();
+}
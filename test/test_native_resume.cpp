@@ -0,0 +1,291 @@
+/**
+ * @file test_native_resume.cpp
+ * @brief Resuming interrupted transfers from the committed offset
+ *
+ * The uploader cuts the stream (connection reset, or a silent stall the device
+ * has to time out on) and retries with a resume request until the image is
+ * complete; the result must be bit-identical to the image. Records are checked
+ * to survive a re-initialisation, to be refused for another image and to be
+ * dropped when the committed data turns out to be bad or cannot be read back. The benchmark compares
+ * a transfer cut at 90% and retried with and without resume.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <OTAManager.h>
+#include <AppImage.h>
+#include <EspotaClient.h>
+#include <Preferences.h>
+#include <SimFlash.h>
+
+#include <vector>
+
+#define HOST_TEST_PORT 13238
+
+#ifndef BENCH_IMAGE_SIZE
+#define BENCH_IMAGE_SIZE (512 * 1024)
+#endif
+#ifndef BENCH_ERASE_US
+#define BENCH_ERASE_US 6000
+#endif
+#ifndef BENCH_PROGRAM_US_PER_KB
+#define BENCH_PROGRAM_US_PER_KB 2500
+#endif
+// A flaky site at the edge of coverage
+#ifndef BENCH_LINK_KBPS
+#define BENCH_LINK_KBPS 64
+#endif
+
+static volatile int lastError = -1;
+
+static bool hostNetworkReady() {
+    return true;
+}
+
+// App image with an appended SHA-256, so the replayed prefix is verified as well
+static std::vector<uint8_t> makeImage(size_t size, uint32_t seed) {
+    std::vector<uint8_t> payload(size);
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1103515245u + 12345u;
+        payload[i] = (uint8_t)(seed >> 16);
+    }
+    return makeAppImage(payload);
+}
+
+static void startDevice(bool pipeline) {
+    OTATuning tuning;
+    tuning.receiveTimeoutMs = 200;  // Detect a stalled uploader quickly
+    OTAManager::initialize("host-resume", "", HOST_TEST_PORT, hostNetworkReady, tuning);
+    OTAManager::setEndCallback([]() {});
+    OTAManager::setErrorCallback([](ota_error_t error) { lastError = error; });
+    OTAManager::setPipelineEnabled(pipeline);
+    TEST_ASSERT_TRUE(OTAManager::startListener());
+}
+
+static void waitForError() {
+    for (int i = 0; i < 3000 && lastError == -1; i++) {
+        delay(1);
+    }
+}
+
+// One attempt; returns true when the image was accepted
+static bool attempt(const std::vector<uint8_t>& image, EspotaResult* result, size_t cutAfter = 0,
+                    bool stall = false, bool resume = true, uint32_t linkKBps = 0) {
+    EspotaClient client("127.0.0.1", HOST_TEST_PORT);
+    client.setResume(resume);
+    client.setCutAfter(cutAfter, stall);
+    client.setRateLimitKBps(linkKBps);
+    client.setTimeoutMs(3000);
+    lastError = -1;
+    bool ok = client.upload(image.data(), image.size(), result);
+    if (!ok && strcmp(result->error, "cut by fault injection") == 0) {
+        waitForError();  // Let the device wind the session down before the next invite
+    }
+    return ok;
+}
+
+static void waitForRestart(uint32_t restarts) {
+    for (int i = 0; i < 100 && ESP.getRestartCount() == restarts; i++) {
+        delay(1);
+    }
+    TEST_ASSERT_EQUAL(restarts + 1, ESP.getRestartCount());
+}
+
+void setUp() {
+    lastError = -1;
+    Preferences prefs;
+    prefs.begin(OTA_RESUME_NVS_NAMESPACE);
+    prefs.clear();
+    prefs.end();
+    TEST_ASSERT_TRUE(SimFlash.begin());
+}
+
+void tearDown() {
+    SimFlash.setTiming(0, 0);
+    OTAManager::stopListener();
+}
+
+void test_resume_after_cut_and_reinitialize() {
+    startDevice(true);
+    std::vector<uint8_t> image = makeImage(300 * 1024 + 123, 1);
+    uint32_t restarts = ESP.getRestartCount();
+
+    EspotaResult result;
+    TEST_ASSERT_FALSE(attempt(image, &result, 100000));
+    TEST_ASSERT_EQUAL(OTA_END_ERROR, lastError);  // The device saw a short image
+    TEST_ASSERT_EQUAL(restarts, ESP.getRestartCount());
+
+    // The record lives in NVS, so it outlasts the OTAManager instance (a reboot)
+    OTAManager::stopListener();
+    startDevice(true);
+
+    TEST_ASSERT_TRUE_MESSAGE(attempt(image, &result), result.error);
+    TEST_ASSERT_EQUAL(0, result.resumedFrom % SimFlashClass::SECTOR_SIZE);
+    TEST_ASSERT_GREATER_THAN(64 * 1024, result.resumedFrom);
+    TEST_ASSERT_LESS_OR_EQUAL(100000, result.resumedFrom);
+    TEST_ASSERT_EQUAL(image.size(), result.bytesSent);
+    TEST_ASSERT_EQUAL_MEMORY(image.data(), SimFlash.data(), image.size());
+    waitForRestart(restarts);
+
+    // Completed: the next transfer of the same image starts from zero
+    TEST_ASSERT_TRUE(SimFlash.begin());
+    TEST_ASSERT_TRUE_MESSAGE(attempt(image, &result), result.error);
+    TEST_ASSERT_EQUAL(0, result.resumedFrom);
+}
+
+void test_random_cuts_give_identical_image() {
+    uint32_t seed = 2024;
+    auto next = [&seed]() {
+        seed = seed * 1103515245u + 12345u;
+        return seed >> 8;
+    };
+
+    for (int round = 0; round < 4; round++) {
+        bool pipeline = round % 2 == 0;
+        startDevice(pipeline);
+        TEST_ASSERT_TRUE(SimFlash.begin());
+        std::vector<uint8_t> image = makeImage(200 * 1024 + next() % 4096, 100 + round);
+        uint32_t restarts = ESP.getRestartCount();
+
+        EspotaResult result;
+        size_t wireBytes = 0;
+        size_t lastResume = 0;
+        int attempts = 0;
+        bool done = false;
+        while (!done) {
+            TEST_ASSERT_LESS_THAN(40, attempts++);  // Every attempt must make progress
+            // Cut somewhere in the first 48 KB of what is left, by reset or by stall
+            size_t cut = 1 + next() % (48 * 1024);
+            bool stall = next() % 4 == 0;
+            done = attempt(image, &result, cut, stall);
+            TEST_ASSERT_GREATER_OR_EQUAL(lastResume, result.resumedFrom);  // Never goes backwards
+            lastResume = result.resumedFrom;
+            wireBytes += result.bytesSent - result.resumedFrom;
+        }
+        TEST_ASSERT_EQUAL_MEMORY(image.data(), SimFlash.data(), image.size());
+        waitForRestart(restarts);
+        // Only partial sectors are sent twice
+        TEST_ASSERT_LESS_THAN(image.size() + attempts * SimFlashClass::SECTOR_SIZE, wireBytes);
+        printf("Round %d (%s): %zu bytes in %d attempts, %zu bytes on the wire\n", round,
+               pipeline ? "pipelined" : "direct", image.size(), attempts, wireBytes);
+        OTAManager::stopListener();
+    }
+}
+
+void test_resume_refused_for_other_image() {
+    startDevice(true);
+    std::vector<uint8_t> imageA = makeImage(128 * 1024, 7);
+    std::vector<uint8_t> imageB = makeImage(128 * 1024, 8);
+
+    EspotaResult result;
+    TEST_ASSERT_FALSE(attempt(imageA, &result, 70000));
+    TEST_ASSERT_TRUE_MESSAGE(attempt(imageB, &result), result.error);
+    TEST_ASSERT_EQUAL(0, result.resumedFrom);
+    TEST_ASSERT_EQUAL_MEMORY(imageB.data(), SimFlash.data(), imageB.size());
+
+    // B overwrote the partition, so A's record is gone as well
+    TEST_ASSERT_FALSE(attempt(imageA, &result, 70000));
+    TEST_ASSERT_EQUAL(0, result.resumedFrom);
+
+    // An uploader that does not ask for resume gets the whole image accepted from zero
+    TEST_ASSERT_TRUE(attempt(imageA, &result, 0, false, false));
+    TEST_ASSERT_EQUAL(0, result.resumedFrom);
+    TEST_ASSERT_EQUAL_MEMORY(imageA.data(), SimFlash.data(), imageA.size());
+    TEST_ASSERT_TRUE(SimFlash.begin());
+    TEST_ASSERT_TRUE_MESSAGE(attempt(imageA, &result), result.error);
+    TEST_ASSERT_EQUAL(0, result.resumedFrom);
+}
+
+void test_damaged_prefix_starts_over() {
+    startDevice(false);
+    std::vector<uint8_t> image = makeImage(160 * 1024, 9);
+    uint32_t restarts = ESP.getRestartCount();
+
+    EspotaResult result;
+    TEST_ASSERT_FALSE(attempt(image, &result, 90000));
+    // A bit flips in the committed part while the device waits for the retry
+    const uint8_t zero = 0;
+    size_t victim = 40000;
+    TEST_ASSERT_NOT_EQUAL(0, image[victim]);
+    TEST_ASSERT_TRUE(SimFlash.write(victim, &zero, 1));
+
+    TEST_ASSERT_FALSE(attempt(image, &result));  // Resumed, but the image fails its MD5
+    TEST_ASSERT_GREATER_THAN(0, result.resumedFrom);
+    waitForError();
+    TEST_ASSERT_EQUAL(OTA_END_ERROR, lastError);
+    TEST_ASSERT_EQUAL(restarts, ESP.getRestartCount());
+
+    TEST_ASSERT_TRUE_MESSAGE(attempt(image, &result), result.error);
+    TEST_ASSERT_EQUAL(0, result.resumedFrom);
+    TEST_ASSERT_EQUAL_MEMORY(image.data(), SimFlash.data(), image.size());
+    waitForRestart(restarts);
+}
+
+void test_unrestorable_prefix_sends_whole_image() {
+    startDevice(true);
+    std::vector<uint8_t> image = makeImage(160 * 1024, 10);
+    uint32_t restarts = ESP.getRestartCount();
+
+    EspotaResult result;
+    TEST_ASSERT_FALSE(attempt(image, &result, 90000));
+    // The committed part cannot be read back: the uploader is told "OK", not an
+    // offset, and the session takes the whole image without an error
+    SimFlash.failReads(1);
+    TEST_ASSERT_TRUE_MESSAGE(attempt(image, &result), result.error);
+    TEST_ASSERT_EQUAL(0, result.resumedFrom);
+    TEST_ASSERT_EQUAL(-1, lastError);
+    TEST_ASSERT_EQUAL_MEMORY(image.data(), SimFlash.data(), image.size());
+    waitForRestart(restarts);
+}
+
+static double timedRecovery(const std::vector<uint8_t>& image, bool resume, uint32_t* nvsWrites) {
+    TEST_ASSERT_TRUE(SimFlash.begin());
+    SimFlash.setTiming(BENCH_ERASE_US, BENCH_PROGRAM_US_PER_KB);
+    uint32_t writesBefore = Preferences::getWriteCount();
+    unsigned long start = millis();
+    EspotaResult result;
+    TEST_ASSERT_FALSE(attempt(image, &result, image.size() * 9 / 10, false, resume, BENCH_LINK_KBPS));
+    TEST_ASSERT_TRUE_MESSAGE(attempt(image, &result, 0, false, resume, BENCH_LINK_KBPS), result.error);
+    double ms = millis() - start;
+    SimFlash.setTiming(0, 0);
+    TEST_ASSERT_EQUAL_MEMORY(image.data(), SimFlash.data(), image.size());
+    TEST_ASSERT_EQUAL(resume ? image.size() * 9 / 10 / SimFlashClass::SECTOR_SIZE * SimFlashClass::SECTOR_SIZE : 0,
+                      result.resumedFrom);
+    *nvsWrites = Preferences::getWriteCount() - writesBefore;
+    return ms;
+}
+
+void test_resumed_vs_restarted_transfer() {
+    startDevice(true);
+    std::vector<uint8_t> image = makeImage(BENCH_IMAGE_SIZE, 11);
+
+    uint32_t restartWrites, resumeWrites;
+    double restartMs = timedRecovery(image, false, &restartWrites);
+    double resumeMs = timedRecovery(image, true, &resumeWrites);
+
+    printf("Resume benchmark: %zu byte image cut at 90%%, link %d KB/s, flash %d us/erase + %d us/KB\n",
+           image.size(), BENCH_LINK_KBPS, BENCH_ERASE_US, BENCH_PROGRAM_US_PER_KB);
+    printf("  restart from zero : %8.0f ms\n", restartMs);
+    printf("  resume            : %8.0f ms (%.0f%% less, %u NVS writes)\n", resumeMs,
+           100.0 * (1.0 - resumeMs / restartMs), (unsigned)resumeWrites);
+
+    TEST_ASSERT_LESS_THAN(restartMs * 0.75, resumeMs);
+    // Checkpoints are bounded by OTA_RESUME_CHECKPOINT_BYTES
+    TEST_ASSERT_LESS_OR_EQUAL(BENCH_IMAGE_SIZE / OTA_RESUME_CHECKPOINT_BYTES + 3, resumeWrites);
+}
+
+// Main test runner
+int main() {
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    UNITY_BEGIN();
+
+    RUN_TEST(test_resume_after_cut_and_reinitialize);
+    RUN_TEST(test_random_cuts_give_identical_image);
+    RUN_TEST(test_resume_refused_for_other_image);
+    RUN_TEST(test_damaged_prefix_starts_over);
+    RUN_TEST(test_unrestorable_prefix_sends_whole_image);
+    RUN_TEST(test_resumed_vs_restarted_transfer);
+
+    return UNITY_END();
+}
@@ -0,0 +1,319 @@
+/**
+ * @file test_native_sha256.cpp
+ * @brief Streaming SHA-256 verification of received images
+ *
+ * The hash backend is checked against the FIPS 180-2 vectors in arbitrary
+ * pieces, the verifier against well-formed, corrupted and truncated app images,
+ * and the listener end to end, including a corruption that the uploader's MD5
+ * cannot see. The benchmark reports hashing cost per MB next to the time a
+ * session spends per MB.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <OTAManager.h>
+#include <OTASha256.h>
+#include <OTAVerifier.h>
+#include <AppImage.h>
+#include <EspotaClient.h>
+#include <SimFlash.h>
+
+#include <zlib.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#define HOST_TEST_PORT 13239
+
+#ifndef BENCH_IMAGE_SIZE
+#define BENCH_IMAGE_SIZE (1024 * 1024)
+#endif
+#ifndef BENCH_ERASE_US
+#define BENCH_ERASE_US 6000
+#endif
+#ifndef BENCH_PROGRAM_US_PER_KB
+#define BENCH_PROGRAM_US_PER_KB 2500
+#endif
+
+static volatile int lastError = -1;
+
+static bool hostNetworkReady() {
+    return true;
+}
+
+static std::vector<uint8_t> makePayload(size_t size, uint32_t seed) {
+    std::vector<uint8_t> payload(size);
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1103515245u + 12345u;
+        payload[i] = (uint8_t)(seed >> 16);
+    }
+    return payload;
+}
+
+static std::string shaHex(const uint8_t* data, size_t len, size_t piece) {
+    OTASha256 sha;
+    sha.begin();
+    for (size_t off = 0; off < len; off += piece) {
+        sha.update(data + off, len - off < piece ? len - off : piece);
+    }
+    uint8_t digest[OTASha256::DIGEST_SIZE];
+    sha.finish(digest);
+    char hex[65];
+    for (size_t i = 0; i < sizeof(digest); i++) {
+        snprintf(hex + 2 * i, 3, "%02x", digest[i]);
+    }
+    return hex;
+}
+
+// Feeds the image in pieces; returns the offset at which the verifier gave up, or size
+static size_t verifyInPieces(const std::vector<uint8_t>& image, size_t piece, bool* finished) {
+    OTAVerifier verifier;
+    verifier.begin(true);
+    for (size_t off = 0; off < image.size(); off += piece) {
+        size_t n = image.size() - off < piece ? image.size() - off : piece;
+        if (!verifier.write(image.data() + off, n)) {
+            *finished = false;
+            return off;
+        }
+    }
+    *finished = verifier.finish(nullptr) && verifier.isAppDigestVerified();
+    return image.size();
+}
+
+static bool upload(const std::vector<uint8_t>& payload, EspotaResult* result,
+                   const char* sha256 = nullptr) {
+    EspotaClient client("127.0.0.1", HOST_TEST_PORT);
+    client.setTimeoutMs(3000);
+    client.setSha256(sha256);
+    lastError = -1;
+    return client.upload(payload.data(), payload.size(), result);
+}
+
+static void expectRejected(const std::vector<uint8_t>& payload, const char* sha256 = nullptr) {
+    TEST_ASSERT_TRUE(SimFlash.begin());
+    uint32_t restarts = ESP.getRestartCount();
+    EspotaResult result;
+    TEST_ASSERT_FALSE(upload(payload, &result, sha256));
+    for (int i = 0; i < 3000 && lastError == -1; i++) {
+        delay(1);
+    }
+    TEST_ASSERT_EQUAL(OTA_END_ERROR, lastError);
+    TEST_ASSERT_EQUAL(restarts, ESP.getRestartCount());
+}
+
+static void expectAccepted(const std::vector<uint8_t>& image, const std::vector<uint8_t>& payload,
+                           const char* sha256 = nullptr) {
+    TEST_ASSERT_TRUE(SimFlash.begin());
+    uint32_t restarts = ESP.getRestartCount();
+    EspotaResult result;
+    TEST_ASSERT_TRUE_MESSAGE(upload(payload, &result, sha256), result.error);
+    TEST_ASSERT_EQUAL_MEMORY(image.data(), SimFlash.data(), image.size());
+    TEST_ASSERT_EQUAL(-1, lastError);
+    for (int i = 0; i < 100 && ESP.getRestartCount() == restarts; i++) {
+        delay(1);
+    }
+    TEST_ASSERT_EQUAL(restarts + 1, ESP.getRestartCount());
+}
+
+static std::vector<uint8_t> gzip(const std::vector<uint8_t>& data) {
+    z_stream zs = {};
+    TEST_ASSERT_EQUAL(Z_OK, deflateInit2(&zs, 9, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY));
+    std::vector<uint8_t> out(deflateBound(&zs, data.size()) + 64);
+    zs.next_in = const_cast<uint8_t*>(data.data());
+    zs.avail_in = data.size();
+    zs.next_out = out.data();
+    zs.avail_out = out.size();
+    TEST_ASSERT_EQUAL(Z_STREAM_END, deflate(&zs, Z_FINISH));
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return out;
+}
+
+void setUp() {
+    lastError = -1;
+}
+
+void tearDown() {
+    SimFlash.setTiming(0, 0);
+}
+
+void test_sha256_known_answers() {
+    const char* abc = "abc";
+    const char* twoBlocks = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    std::string million(1000000, 'a');
+    static const size_t pieces[] = {1, 3, 63, 64, 65, 1460, 1 << 20};
+
+    for (size_t piece : pieces) {
+        TEST_ASSERT_EQUAL_STRING(
+            "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+            shaHex(nullptr, 0, piece).c_str());
+        TEST_ASSERT_EQUAL_STRING(
+            "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+            shaHex((const uint8_t*)abc, 3, piece).c_str());
+        TEST_ASSERT_EQUAL_STRING(
+            "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1",
+            shaHex((const uint8_t*)twoBlocks, strlen(twoBlocks), piece).c_str());
+        TEST_ASSERT_EQUAL_STRING(
+            "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0",
+            shaHex((const uint8_t*)million.data(), million.size(), piece).c_str());
+    }
+
+    // peek() leaves the running hash untouched
+    OTASha256 sha;
+    sha.begin();
+    sha.update((const uint8_t*)"ab", 2);
+    uint8_t partial[32], full[32], expected[32];
+    sha.peek(partial);
+    sha.update((const uint8_t*)"c", 1);
+    sha.finish(full);
+    TEST_ASSERT_TRUE(OTASha256::fromHex(
+        "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", expected));
+    TEST_ASSERT_EQUAL_MEMORY(expected, full, 32);
+    TEST_ASSERT_NOT_EQUAL(0, memcmp(partial, full, 32));
+    TEST_ASSERT_FALSE(OTASha256::fromHex("xyz", expected));
+}
+
+void test_verifier_checks_app_images() {
+    std::vector<uint8_t> image = makeAppImage(makePayload(100 * 1024 + 5, 1), 4);
+    static const size_t pieces[] = {1, 7, 1460, 4096, 1 << 20};
+    bool finished;
+    for (size_t piece : pieces) {
+        TEST_ASSERT_EQUAL(image.size(), verifyInPieces(image, piece, &finished));
+        TEST_ASSERT_TRUE(finished);
+    }
+
+    // Bytes after the digest (a signature block) are allowed and not covered
+    std::vector<uint8_t> signedImage = image;
+    signedImage.resize(image.size() + 4096, 0x5A);
+    TEST_ASSERT_EQUAL(signedImage.size(), verifyInPieces(signedImage, 1460, &finished));
+    TEST_ASSERT_TRUE(finished);
+
+    // A corrupted body fails as soon as the digest arrives, not at the end of the stream
+    signedImage[50000] ^= 0x04;
+    size_t failedAt = verifyInPieces(signedImage, 1460, &finished);
+    TEST_ASSERT_FALSE(finished);
+    TEST_ASSERT_LESS_THAN(signedImage.size() - 2048, failedAt);
+    TEST_ASSERT_GREATER_OR_EQUAL(appImageBodySize(image) - 1460, failedAt);
+
+    // A bad header fails at once
+    std::vector<uint8_t> badHeader = image;
+    badHeader[1] = 0;  // No segments
+    TEST_ASSERT_EQUAL(0, verifyInPieces(badHeader, 1460, &finished));
+    badHeader = image;
+    badHeader[24 + 7] = 0x7F;  // First segment longer than any flash
+    TEST_ASSERT_EQUAL(0, verifyInPieces(badHeader, 1460, &finished));
+
+    // Truncated before the digest
+    std::vector<uint8_t> truncated(image.begin(), image.end() - 10);
+    TEST_ASSERT_EQUAL(truncated.size(), verifyInPieces(truncated, 1460, &finished));
+    TEST_ASSERT_FALSE(finished);
+
+    // No appended digest: nothing to check, nothing rejected
+    std::vector<uint8_t> plain = image;
+    plain[23] = 0;
+    OTAVerifier verifier;
+    verifier.begin(true);
+    TEST_ASSERT_TRUE(verifier.write(plain.data(), plain.size()));
+    TEST_ASSERT_TRUE(verifier.finish(nullptr));
+    TEST_ASSERT_FALSE(verifier.isAppDigestVerified());
+}
+
+void test_listener_verifies_sha256() {
+    OTAManager::initialize("host-sha256", "", HOST_TEST_PORT, hostNetworkReady);
+    OTAManager::setEndCallback([]() {});
+    OTAManager::setErrorCallback([](ota_error_t error) { lastError = error; });
+    TEST_ASSERT_TRUE(OTAManager::startListener());
+
+    std::vector<uint8_t> image = makeAppImage(makePayload(256 * 1024, 2));
+    expectAccepted(image, image);
+
+    // Corrupted before the uploader computed its MD5 (e.g. a bad build artefact or a
+    // damaged cache): only the embedded SHA-256 catches it
+    std::vector<uint8_t> corrupt = image;
+    corrupt[120000] ^= 0x80;
+    expectRejected(corrupt);
+
+    // Header damage stops the transfer early
+    std::vector<uint8_t> badHeader = image;
+    badHeader[1] = 0;
+    TEST_ASSERT_TRUE(SimFlash.begin());
+    EspotaResult result;
+    TEST_ASSERT_FALSE(upload(badHeader, &result));
+    TEST_ASSERT_LESS_THAN(image.size() / 2, result.bytesSent);
+
+    // Digest from the uploader, for the plain image and for the file as sent
+    std::string digest = shaHex(image.data(), image.size(), 4096);
+    expectAccepted(image, image, digest.c_str());
+    std::vector<uint8_t> gz = gzip(image);
+    std::string gzDigest = shaHex(gz.data(), gz.size(), 4096);
+    expectAccepted(image, gz, gzDigest.c_str());
+    expectRejected(gz, digest.c_str());
+
+    OTAManager::stopListener();
+}
+
+void test_sha256_overhead_per_mb() {
+    std::vector<uint8_t> payload = makePayload(BENCH_IMAGE_SIZE, 3);
+    std::vector<uint8_t> image = makeAppImage(payload);
+    double mb = image.size() / (1024.0 * 1024.0);
+
+    auto start = std::chrono::steady_clock::now();
+    const int rounds = 8;
+    for (int i = 0; i < rounds; i++) {
+        OTAVerifier verifier;
+        verifier.begin(true);
+        for (size_t off = 0; off < image.size(); off += 4096) {
+            size_t n = image.size() - off < 4096 ? image.size() - off : 4096;
+            TEST_ASSERT_TRUE(verifier.write(image.data() + off, n));
+        }
+        TEST_ASSERT_TRUE(verifier.finish(nullptr));
+    }
+    double hashMsPerMb =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() /
+        rounds / mb;
+
+    OTAManager::initialize("host-sha256", "", HOST_TEST_PORT, hostNetworkReady);
+    OTAManager::setEndCallback([]() {});
+    TEST_ASSERT_TRUE(OTAManager::startListener());
+
+    // Loopback without flash latency: the fastest the session can go on this host
+    TEST_ASSERT_TRUE(SimFlash.begin());
+    EspotaClient client("127.0.0.1", HOST_TEST_PORT);
+    client.setLockstep(false);
+    EspotaResult fast;
+    TEST_ASSERT_TRUE_MESSAGE(client.upload(image.data(), image.size(), &fast), fast.error);
+    double fastMsPerMb = fast.transferUs / 1000.0 / mb;
+
+    // ESP32-like flash timing: the flash writer, which also does the hashing, is the bottleneck
+    TEST_ASSERT_TRUE(SimFlash.begin());
+    SimFlash.setTiming(BENCH_ERASE_US, BENCH_PROGRAM_US_PER_KB);
+    EspotaResult flash;
+    TEST_ASSERT_TRUE_MESSAGE(client.upload(image.data(), image.size(), &flash), flash.error);
+    SimFlash.setTiming(0, 0);
+    double flashMsPerMb = flash.transferUs / 1000.0 / mb;
+    OTAManager::stopListener();
+
+    printf("SHA-256 (%s backend): %.2f ms/MB (%.0f MB/s)\n", OTASha256::backendName(), hashMsPerMb,
+           1000.0 / hashMsPerMb);
+    printf("  session, no flash latency : %8.2f ms/MB, hashing %.1f%% of it\n", fastMsPerMb,
+           100.0 * hashMsPerMb / fastMsPerMb);
+    printf("  session, ESP32 flash      : %8.2f ms/MB, hashing %.2f%% of it\n", flashMsPerMb,
+           100.0 * hashMsPerMb / flashMsPerMb);
+
+    TEST_ASSERT_LESS_THAN(flashMsPerMb * 0.02, hashMsPerMb);
+}
+
+// Main test runner
+int main() {
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    UNITY_BEGIN();
+
+    RUN_TEST(test_sha256_known_answers);
+    RUN_TEST(test_verifier_checks_app_images);
+    RUN_TEST(test_listener_verifies_sha256);
+    RUN_TEST(test_sha256_overhead_per_mb);
+
+    return UNITY_END();
+}
@@ -0,0 +1,433 @@
+/**
+ * @file test_native_signature.cpp
+ * @brief Streaming Ed25519 signature checks on received images
+ *
+ * SHA-512 is checked against the FIPS 180-2 vectors, the verifier against the
+ * RFC 8032 vectors (fed in arbitrary pieces) and against malformed keys and
+ * signatures, and the listener end to end: signed images are written, unsigned
+ * ones are refused at the invite, and images that do not match their signature
+ * are rejected even when their MD5 and appended SHA-256 are consistent. The
+ * benchmark times the parts of a check and what is left after the last byte.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <OTAManager.h>
+#include <OTASha512.h>
+#include <OTASignature.h>
+#include <AppImage.h>
+#include <Ed25519Signer.h>
+#include <EspotaClient.h>
+#include <SimFlash.h>
+
+#include <zlib.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#define HOST_TEST_PORT 13240
+
+#ifndef BENCH_IMAGE_SIZE
+#define BENCH_IMAGE_SIZE (1024 * 1024)
+#endif
+#ifndef BENCH_ERASE_US
+#define BENCH_ERASE_US 6000
+#endif
+#ifndef BENCH_PROGRAM_US_PER_KB
+#define BENCH_PROGRAM_US_PER_KB 2500
+#endif
+
+static volatile int lastError = -1;
+
+static const char* signingSeedHex = "4ccd089b28ff96da9db6c346ec114e0f5b8a319f35aba624da8cf6ed4fb8a6fb";
+
+static bool hostNetworkReady() {
+    return true;
+}
+
+static std::vector<uint8_t> makePayload(size_t size, uint32_t seed) {
+    std::vector<uint8_t> payload(size);
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1103515245u + 12345u;
+        payload[i] = (uint8_t)(seed >> 16);
+    }
+    return payload;
+}
+
+static std::vector<uint8_t> fromHex(const char* hex) {
+    std::vector<uint8_t> out(strlen(hex) / 2);
+    TEST_ASSERT_TRUE(OTASignature::fromHex(hex, out.data(), out.size()));
+    return out;
+}
+
+static std::string toHex(const uint8_t* data, size_t len) {
+    std::string hex;
+    char byte[3];
+    for (size_t i = 0; i < len; i++) {
+        snprintf(byte, sizeof(byte), "%02x", data[i]);
+        hex += byte;
+    }
+    return hex;
+}
+
+static std::string sha512Hex(const uint8_t* data, size_t len, size_t piece) {
+    OTASha512 sha;
+    sha.begin();
+    for (size_t off = 0; off < len; off += piece) {
+        sha.update(data + off, len - off < piece ? len - off : piece);
+    }
+    uint8_t digest[OTASha512::DIGEST_SIZE];
+    sha.finish(digest);
+    return toHex(digest, sizeof(digest));
+}
+
+static bool verifyInPieces(const uint8_t* publicKey, const uint8_t* signature,
+                           const std::vector<uint8_t>& message, size_t piece) {
+    OTASignature check;
+    if (!check.begin(publicKey, signature)) {
+        return false;
+    }
+    for (size_t off = 0; off < message.size(); off += piece) {
+        check.update(message.data() + off,
+                     message.size() - off < piece ? message.size() - off : piece);
+    }
+    return check.finish();
+}
+
+static std::string signHex(const std::vector<uint8_t>& file) {
+    std::vector<uint8_t> seed = fromHex(signingSeedHex);
+    uint8_t signature[OTASignature::SIGNATURE_SIZE];
+    ed25519Sign(seed.data(), file.data(), file.size(), signature);
+    return toHex(signature, sizeof(signature));
+}
+
+static bool upload(const std::vector<uint8_t>& file, EspotaResult* result,
+                   const char* signature) {
+    EspotaClient client("127.0.0.1", HOST_TEST_PORT);
+    client.setTimeoutMs(3000);
+    client.setSignature(signature);
+    lastError = -1;
+    return client.upload(file.data(), file.size(), result);
+}
+
+static void waitForError() {
+    for (int i = 0; i < 3000 && lastError == -1; i++) {
+        delay(1);
+    }
+}
+
+static void expectAccepted(const std::vector<uint8_t>& image, const std::vector<uint8_t>& file,
+                           const char* signature) {
+    TEST_ASSERT_TRUE(SimFlash.begin());
+    uint32_t restarts = ESP.getRestartCount();
+    EspotaResult result;
+    TEST_ASSERT_TRUE_MESSAGE(upload(file, &result, signature), result.error);
+    TEST_ASSERT_EQUAL_MEMORY(image.data(), SimFlash.data(), image.size());
+    TEST_ASSERT_EQUAL(-1, lastError);
+    for (int i = 0; i < 100 && ESP.getRestartCount() == restarts; i++) {
+        delay(1);
+    }
+    TEST_ASSERT_EQUAL(restarts + 1, ESP.getRestartCount());
+}
+
+static void expectRejected(const std::vector<uint8_t>& file, const char* signature) {
+    TEST_ASSERT_TRUE(SimFlash.begin());
+    uint32_t restarts = ESP.getRestartCount();
+    EspotaResult result;
+    TEST_ASSERT_FALSE(upload(file, &result, signature));
+    waitForError();
+    TEST_ASSERT_EQUAL(OTA_END_ERROR, lastError);
+    TEST_ASSERT_EQUAL(restarts, ESP.getRestartCount());
+}
+
+static std::vector<uint8_t> gzip(const std::vector<uint8_t>& data) {
+    z_stream zs = {};
+    TEST_ASSERT_EQUAL(Z_OK, deflateInit2(&zs, 9, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY));
+    std::vector<uint8_t> out(deflateBound(&zs, data.size()) + 64);
+    zs.next_in = const_cast<uint8_t*>(data.data());
+    zs.avail_in = data.size();
+    zs.next_out = out.data();
+    zs.avail_out = out.size();
+    TEST_ASSERT_EQUAL(Z_STREAM_END, deflate(&zs, Z_FINISH));
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return out;
+}
+
+void setUp() {
+    lastError = -1;
+}
+
+void tearDown() {
+    OTAManager::setSigningKey(nullptr);
+    SimFlash.setTiming(0, 0);
+}
+
+void test_sha512_known_answers() {
+    const char* abc = "abc";
+    const char* twoBlocks =
+        "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqr"
+        "lmnopqrsmnopqrstnopqrstu";
+    std::string million(1000000, 'a');
+    static const size_t pieces[] = {1, 3, 111, 112, 127, 128, 129, 1460, 1 << 20};
+
+    for (size_t piece : pieces) {
+        TEST_ASSERT_EQUAL_STRING(
+            "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
+            "47d0d13c5d85f2b0ff8318d2877eec2f63b931bd47417a81a538327af927da3e",
+            sha512Hex(nullptr, 0, piece).c_str());
+        TEST_ASSERT_EQUAL_STRING(
+            "ddaf35a193617abacc417349ae20413112e6fa4e89a97ea20a9eeee64b55d39a"
+            "2192992a274fc1a836ba3c23a3feebbd454d4423643ce80e2a9ac94fa54ca49f",
+            sha512Hex((const uint8_t*)abc, 3, piece).c_str());
+        TEST_ASSERT_EQUAL_STRING(
+            "8e959b75dae313da8cf4f72814fc143f8f7779c6eb9f7fa17299aeadb6889018"
+            "501d289e4900f7e4331b99dec4b5433ac7d329eeb6dd26545e96e55b874be909",
+            sha512Hex((const uint8_t*)twoBlocks, strlen(twoBlocks), piece).c_str());
+        TEST_ASSERT_EQUAL_STRING(
+            "e718483d0ce769644e2e42c7bc15b4638e1f98b13b2044285632a803afa973eb"
+            "de0ff244877ea60a4cb0432ce577c31beb009c5c2c49aa2e4eadb217ad8cc09b",
+            sha512Hex((const uint8_t*)million.data(), million.size(), piece).c_str());
+    }
+}
+
+void test_rfc8032_vectors() {
+    // RFC 8032 section 7.1, tests 1 to 3
+    static const struct {
+        const char* seed;
+        const char* publicKey;
+        const char* message;
+        const char* signature;
+    } vectors[] = {
+        {"9d61b19deffd5a60ba844af492ec2cc44449c5697b326919703bac031cae7f60",
+         "d75a980182b10ab7d54bfed3c964073a0ee172f3daa62325af021a68f707511a", "",
+         "e5564300c360ac729086e2cc806e828a84877f1eb8e5d974d873e06522490155"
+         "5fb8821590a33bacc61e39701cf9b46bd25bf5f0595bbe24655141438e7a100b"},
+        {"4ccd089b28ff96da9db6c346ec114e0f5b8a319f35aba624da8cf6ed4fb8a6fb",
+         "3d4017c3e843895a92b70aa74d1b7ebc9c982ccf2ec4968cc0cd55f12af4660c", "72",
+         "92a009a9f0d4cab8720e820b5f642540a2b27b5416503f8fb3762223ebdb69da"
+         "085ac1e43e15996e458f3613d0f11d8c387b2eaeb4302aeeb00d291612bb0c00"},
+        {"c5aa8df43f9f837bedb7442f31dcb7b166d38535076f094b85ce3a2e0b4458f7",
+         "fc51cd8e6218a1a38da47ed00230f0580816ed13ba3303ac5deb911548908025", "af82",
+         "6291d657deec24024827e69c3abe01a30ce548a284743a445e3680d7db5ac3ac"
+         "18ff9b538d16f290ae67f760984dc6594a7c15e9716ed28dc027beceea1ec40a"},
+    };
+    for (const auto& v : vectors) {
+        std::vector<uint8_t> seed = fromHex(v.seed);
+        std::vector<uint8_t> publicKey = fromHex(v.publicKey);
+        std::vector<uint8_t> message = fromHex(v.message);
+        std::vector<uint8_t> signature = fromHex(v.signature);
+
+        // The host signer agrees with the RFC, so the listener tests sign correctly
+        uint8_t derived[32], signed64[64];
+        ed25519PublicKey(seed.data(), derived);
+        ed25519Sign(seed.data(), message.data(), message.size(), signed64);
+        TEST_ASSERT_EQUAL_MEMORY(publicKey.data(), derived, 32);
+        TEST_ASSERT_EQUAL_MEMORY(signature.data(), signed64, 64);
+
+        TEST_ASSERT_TRUE(OTASignature::verify(publicKey.data(), signature.data(), message.data(),
+                                              message.size()));
+        for (size_t bit = 0; bit < 512; bit += 37) {
+            signature[bit / 8] ^= 1 << (bit % 8);
+            TEST_ASSERT_FALSE(OTASignature::verify(publicKey.data(), signature.data(),
+                                                   message.data(), message.size()));
+            signature[bit / 8] ^= 1 << (bit % 8);
+        }
+    }
+
+    // A long message in arbitrary pieces; any changed byte fails
+    std::vector<uint8_t> seed = fromHex(signingSeedHex);
+    uint8_t publicKey[32], signature[64];
+    ed25519PublicKey(seed.data(), publicKey);
+    std::vector<uint8_t> message = makePayload(70000, 1);
+    ed25519Sign(seed.data(), message.data(), message.size(), signature);
+    static const size_t pieces[] = {1, 127, 128, 1460, 4096, 1 << 20};
+    for (size_t piece : pieces) {
+        TEST_ASSERT_TRUE(verifyInPieces(publicKey, signature, message, piece));
+    }
+    message[69999] ^= 1;
+    TEST_ASSERT_FALSE(verifyInPieces(publicKey, signature, message, 1460));
+    message.pop_back();
+    TEST_ASSERT_FALSE(verifyInPieces(publicKey, signature, message, 1460));
+}
+
+void test_malformed_keys_and_signatures() {
+    std::vector<uint8_t> seed = fromHex(signingSeedHex);
+    uint8_t publicKey[32], signature[64];
+    ed25519PublicKey(seed.data(), publicKey);
+    std::vector<uint8_t> message = makePayload(1000, 2);
+    ed25519Sign(seed.data(), message.data(), message.size(), signature);
+    OTASignature check;
+
+    // S + L verifies mathematically but is refused (RFC 8032 malleability check)
+    static const uint8_t order[32] = {0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58,
+                                      0xd6, 0x9c, 0xf7, 0xa2, 0xde, 0xf9, 0xde, 0x14,
+                                      0,    0,    0,    0,    0,    0,    0,    0,
+                                      0,    0,    0,    0,    0,    0,    0,    0x10};
+    uint8_t malleable[64];
+    memcpy(malleable, signature, 64);
+    int carry = 0;
+    for (int i = 0; i < 32; i++) {
+        int sum = malleable[32 + i] + order[i] + carry;
+        malleable[32 + i] = (uint8_t)sum;
+        carry = sum >> 8;
+    }
+    TEST_ASSERT_FALSE(check.begin(publicKey, malleable));
+    TEST_ASSERT_EQUAL_STRING("malformed signature", check.errorString());
+
+    // y = 2 is not on the curve; y = p is a non-canonical encoding of y = 0
+    uint8_t offCurve[32] = {2};
+    TEST_ASSERT_FALSE(check.begin(offCurve, signature));
+    TEST_ASSERT_EQUAL_STRING("invalid public key", check.errorString());
+    uint8_t nonCanonical[32];
+    memset(nonCanonical, 0xff, 32);
+    nonCanonical[0] = 0xed;
+    nonCanonical[31] = 0x7f;
+    TEST_ASSERT_FALSE(check.begin(nonCanonical, signature));
+
+    // Another key
+    uint8_t otherKey[32];
+    std::vector<uint8_t> otherSeed = makePayload(32, 3);
+    ed25519PublicKey(otherSeed.data(), otherKey);
+    TEST_ASSERT_FALSE(OTASignature::verify(otherKey, signature, message.data(), message.size()));
+    TEST_ASSERT_TRUE(OTASignature::verify(publicKey, signature, message.data(), message.size()));
+
+    // finish() without a successful begin() never passes
+    TEST_ASSERT_FALSE(check.finish());
+    TEST_ASSERT_FALSE(OTASignature::fromHex("abc", signature, 2));
+}
+
+void test_listener_checks_signatures() {
+    OTAManager::initialize("host-signature", "", HOST_TEST_PORT, hostNetworkReady);
+    OTAManager::setEndCallback([]() {});
+    OTAManager::setErrorCallback([](ota_error_t error) { lastError = error; });
+    TEST_ASSERT_TRUE(OTAManager::startListener());
+
+    std::vector<uint8_t> seed = fromHex(signingSeedHex);
+    uint8_t publicKey[32];
+    ed25519PublicKey(seed.data(), publicKey);
+    OTAManager::setSigningKey(publicKey);
+
+    std::vector<uint8_t> image = makeAppImage(makePayload(256 * 1024, 4));
+    std::string signature = signHex(image);
+    expectAccepted(image, image, signature.c_str());
+
+    // No signature: refused at the invite, before any data is sent
+    TEST_ASSERT_TRUE(SimFlash.begin());
+    EspotaResult result;
+    TEST_ASSERT_FALSE(upload(image, &result, nullptr));
+    TEST_ASSERT_EQUAL_STRING("Signature Required", result.error);
+    waitForError();
+    TEST_ASSERT_EQUAL(OTA_AUTH_ERROR, lastError);
+    TEST_ASSERT_EQUAL(0, result.bytesSent);
+
+    // A non-reduced signature cannot be valid for any image
+    std::string garbage(128, 'f');
+    TEST_ASSERT_FALSE(upload(image, &result, garbage.c_str()));
+    TEST_ASSERT_EQUAL_STRING("Signature Invalid", result.error);
+
+    // A well-formed image (consistent MD5 and appended SHA-256) that was not signed
+    std::vector<uint8_t> other = makeAppImage(makePayload(256 * 1024, 5));
+    expectRejected(other, signature.c_str());
+
+    // The signature covers the file as sent
+    std::vector<uint8_t> gz = gzip(image);
+    std::string gzSignature = signHex(gz);
+    expectAccepted(image, gz, gzSignature.c_str());
+    expectRejected(gz, signature.c_str());
+
+    // Without a key, signatures are optional again
+    OTAManager::setSigningKey(nullptr);
+    expectAccepted(image, image, nullptr);
+
+    OTAManager::stopListener();
+}
+
+void test_signature_verify_time() {
+    std::vector<uint8_t> image = makeAppImage(makePayload(BENCH_IMAGE_SIZE, 6));
+    double mb = image.size() / (1024.0 * 1024.0);
+    std::vector<uint8_t> seed = fromHex(signingSeedHex);
+    uint8_t publicKey[32], signature[64];
+    ed25519PublicKey(seed.data(), publicKey);
+    ed25519Sign(seed.data(), image.data(), image.size(), signature);
+
+    // Split into the work before the first byte, per byte, and after the last byte
+    const int rounds = 20;
+    double beginUs = 0, hashUs = 0, finishUs = 0;
+    for (int i = 0; i < rounds; i++) {
+        OTASignature check;
+        auto t0 = std::chrono::steady_clock::now();
+        TEST_ASSERT_TRUE(check.begin(publicKey, signature));
+        auto t1 = std::chrono::steady_clock::now();
+        for (size_t off = 0; off < image.size(); off += 4096) {
+            check.update(image.data() + off, image.size() - off < 4096 ? image.size() - off : 4096);
+        }
+        auto t2 = std::chrono::steady_clock::now();
+        TEST_ASSERT_TRUE(check.finish());
+        auto t3 = std::chrono::steady_clock::now();
+        beginUs += std::chrono::duration<double, std::micro>(t1 - t0).count();
+        hashUs += std::chrono::duration<double, std::micro>(t2 - t1).count();
+        finishUs += std::chrono::duration<double, std::micro>(t3 - t2).count();
+    }
+    beginUs /= rounds;
+    hashUs /= rounds;
+    finishUs /= rounds;
+    double hashMsPerMb = hashUs / 1000.0 / mb;
+
+    // A check that only starts once the image is complete: a second pass over the image
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        TEST_ASSERT_TRUE(OTASignature::verify(publicKey, signature, image.data(), image.size()));
+    }
+    double afterTheFactUs =
+        std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count() /
+        rounds;
+
+    // Sessions with ESP32-like flash timing, unsigned and signed
+    OTAManager::initialize("host-signature", "", HOST_TEST_PORT, hostNetworkReady);
+    OTAManager::setEndCallback([]() {});
+    TEST_ASSERT_TRUE(OTAManager::startListener());
+    EspotaClient client("127.0.0.1", HOST_TEST_PORT);
+    client.setLockstep(false);
+    EspotaResult plain, signedRun;
+    TEST_ASSERT_TRUE(SimFlash.begin());
+    SimFlash.setTiming(BENCH_ERASE_US, BENCH_PROGRAM_US_PER_KB);
+    TEST_ASSERT_TRUE_MESSAGE(client.upload(image.data(), image.size(), &plain), plain.error);
+    OTAManager::setSigningKey(publicKey);
+    std::string sigHex = toHex(signature, sizeof(signature));
+    client.setSignature(sigHex.c_str());
+    TEST_ASSERT_TRUE(SimFlash.begin());
+    TEST_ASSERT_TRUE_MESSAGE(client.upload(image.data(), image.size(), &signedRun),
+                             signedRun.error);
+    SimFlash.setTiming(0, 0);
+    OTAManager::stopListener();
+
+    printf("Ed25519 over a %.2f MB image (SHA-512 %s backend):\n", mb, OTASha512::backendName());
+    printf("  begin ([S]B, before any data)  : %8.1f us\n", beginUs);
+    printf("  SHA-512 while streaming        : %8.2f ms/MB (%.0f MB/s)\n", hashMsPerMb,
+           1000.0 / hashMsPerMb);
+    printf("  finish (after the last byte)   : %8.1f us\n", finishUs);
+    printf("  one-shot check after the image : %8.1f us\n", afterTheFactUs);
+    printf("  session, ESP32 flash           : %8.1f ms unsigned, %8.1f ms signed\n",
+           plain.totalUs / 1000.0, signedRun.totalUs / 1000.0);
+
+    // What is left at the end is a fixed cost, independent of the image size
+    TEST_ASSERT_LESS_THAN(afterTheFactUs, finishUs + hashUs / 2);
+    TEST_ASSERT_LESS_THAN(plain.totalUs / 1000.0 / mb * 0.05, hashMsPerMb);
+}
+
+// Main test runner
+int main() {
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    UNITY_BEGIN();
+
+    RUN_TEST(test_sha512_known_answers);
+    RUN_TEST(test_rfc8032_vectors);
+    RUN_TEST(test_malformed_keys_and_signatures);
+    RUN_TEST(test_listener_checks_signatures);
+    RUN_TEST(test_signature_verify_time);
+
+    return UNITY_END();
+}
@@ -0,0 +1,228 @@
+/**
+ * @file test_native_stats.cpp
+ * @brief Session and handleUpdates() statistics (OTAManager::getStats())
+ *
+ * Updates are pushed in polling and listener mode, compressed, cut off and with a
+ * wrong password, and the counters are compared before and after each. A
+ * monitoring thread takes snapshots while a slow transfer holds the OTA mutex to
+ * show that reading the statistics never waits for the update.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <OTAManager.h>
+#include <EspotaClient.h>
+#include <SimFlash.h>
+
+#include <zlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#define HOST_TEST_PORT 13246
+#define STATS_IMAGE_SIZE (128 * 1024)
+
+static std::atomic<int> endCount{0};
+static std::atomic<int> errorCount{0};
+static volatile bool pollerRunning = false;
+
+static bool hostNetworkReady() {
+    return true;
+}
+
+static void pollerTask(void* pvParameters) {
+    (void)pvParameters;
+    while (pollerRunning) {
+        OTAManager::handleUpdates();
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    vTaskDelete(NULL);
+}
+
+static std::vector<uint8_t> makeImage(size_t size) {
+    std::vector<uint8_t> image(size);
+    for (size_t i = 0; i < size; i++) {
+        image[i] = (uint8_t)(i * 31 + 7);
+    }
+    return image;
+}
+
+static bool upload(const std::vector<uint8_t>& image, const char* password = "secret",
+                   size_t cutAfter = 0, uint32_t rateLimitKBps = 0) {
+    EspotaClient client("127.0.0.1", HOST_TEST_PORT);
+    client.setPassword(password);
+    client.setCutAfter(cutAfter);
+    client.setRateLimitKBps(rateLimitKBps);
+    client.setTimeoutMs(3000);
+    EspotaResult result;
+    return client.upload(image.data(), image.size(), &result);
+}
+
+// The uploader sees "OK" (or gives up) just before the callbacks run
+static void waitFor(std::atomic<int>& counter, int value) {
+    for (int i = 0; i < 2000 && counter < value; i++) {
+        delay(1);
+    }
+    TEST_ASSERT_EQUAL(value, counter.load());
+}
+
+void setUp() {
+    TEST_ASSERT_TRUE(SimFlash.begin());
+}
+
+void tearDown() {}
+
+void test_handle_updates_counters() {
+    OTAStats before = OTAManager::getStats();
+    for (int i = 0; i < 1000; i++) {
+        OTAManager::handleUpdates();
+    }
+    OTAStats idle = OTAManager::getStats();
+    TEST_ASSERT_EQUAL(before.handleUpdatesPolls, idle.handleUpdatesPolls);
+    TEST_ASSERT_EQUAL(before.handleUpdatesLockedUs, idle.handleUpdatesLockedUs);
+
+    OTAManager::initialize("host-stats", "secret", HOST_TEST_PORT, hostNetworkReady);
+    OTAManager::setEndCallback([]() { endCount++; });
+    OTAManager::setErrorCallback([](ota_error_t) { errorCount++; });
+    for (int i = 0; i < 100000; i++) {
+        OTAManager::handleUpdates();
+    }
+    OTAStats polling = OTAManager::getStats();
+    TEST_ASSERT_EQUAL(100000, polling.handleUpdatesPolls - idle.handleUpdatesPolls);
+    TEST_ASSERT_TRUE(polling.handleUpdatesLockedUs > idle.handleUpdatesLockedUs);
+    TEST_ASSERT_EQUAL(0, polling.sessionsStarted);
+    TEST_ASSERT_FALSE(polling.sessionActive);
+}
+
+void test_sessions_in_both_modes() {
+    std::vector<uint8_t> image = makeImage(STATS_IMAGE_SIZE);
+    OTAStats before = OTAManager::getStats();
+
+    // Polling mode: ArduinoOTA serves the update
+    pollerRunning = true;
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(pollerTask, "OTAPoll", 4096, NULL, 1, NULL));
+    TEST_ASSERT_TRUE(upload(image));
+    waitFor(endCount, 1);
+    pollerRunning = false;
+    delay(20);
+    OTAStats polled = OTAManager::getStats();
+
+    // Listener mode: the built-in receiver serves it
+    TEST_ASSERT_TRUE(OTAManager::startListener());
+    TEST_ASSERT_TRUE(upload(image));
+    waitFor(endCount, 2);
+    OTAManager::stopListener();
+    OTAStats after = OTAManager::getStats();
+
+    printf("Throughput: polling %u B/s, listener %u B/s, peak %u B/s\n", polled.lastThroughput,
+           after.lastThroughput, after.peakThroughput);
+    TEST_ASSERT_EQUAL(2, after.sessionsStarted - before.sessionsStarted);
+    TEST_ASSERT_EQUAL(2, after.sessionsCompleted - before.sessionsCompleted);
+    TEST_ASSERT_EQUAL(0, after.sessionsFailed - before.sessionsFailed);
+    TEST_ASSERT_EQUAL(STATS_IMAGE_SIZE, polled.bytesReceived - before.bytesReceived);
+    TEST_ASSERT_EQUAL(2 * STATS_IMAGE_SIZE, after.bytesReceived - before.bytesReceived);
+    TEST_ASSERT_EQUAL(2 * STATS_IMAGE_SIZE, after.bytesWritten - before.bytesWritten);
+    TEST_ASSERT_TRUE(polled.lastThroughput > 0);
+    TEST_ASSERT_TRUE(after.lastThroughput > 0);
+    TEST_ASSERT_TRUE(after.peakThroughput >= polled.lastThroughput);
+    TEST_ASSERT_TRUE(after.peakThroughput >= after.lastThroughput);
+    TEST_ASSERT_FALSE(after.sessionActive);
+}
+
+void test_failures_by_error() {
+    std::vector<uint8_t> image = makeImage(STATS_IMAGE_SIZE);
+    TEST_ASSERT_TRUE(OTAManager::startListener());
+    OTAStats before = OTAManager::getStats();
+
+    // A failed login is an error, but no session
+    TEST_ASSERT_FALSE(upload(image, "wrong"));
+    waitFor(errorCount, 1);
+    OTAStats refused = OTAManager::getStats();
+    TEST_ASSERT_EQUAL(1, refused.errors[OTA_AUTH_ERROR] - before.errors[OTA_AUTH_ERROR]);
+    TEST_ASSERT_EQUAL(0, refused.sessionsStarted - before.sessionsStarted);
+    TEST_ASSERT_EQUAL(0, refused.sessionsFailed - before.sessionsFailed);
+
+    // An upload cut off halfway fails the session that started: the image is short
+    TEST_ASSERT_FALSE(upload(image, "secret", STATS_IMAGE_SIZE / 2));
+    waitFor(errorCount, 2);
+    OTAStats cut = OTAManager::getStats();
+    OTAManager::stopListener();
+
+    TEST_ASSERT_EQUAL(1, cut.sessionsStarted - refused.sessionsStarted);
+    TEST_ASSERT_EQUAL(0, cut.sessionsCompleted - refused.sessionsCompleted);
+    TEST_ASSERT_EQUAL(1, cut.sessionsFailed - refused.sessionsFailed);
+    TEST_ASSERT_EQUAL(1, cut.errors[OTA_END_ERROR] - refused.errors[OTA_END_ERROR]);
+    TEST_ASSERT_TRUE(cut.bytesReceived - refused.bytesReceived <= STATS_IMAGE_SIZE / 2);
+    TEST_ASSERT_FALSE(cut.sessionActive);
+}
+
+void test_compressed_session_bytes() {
+    std::vector<uint8_t> image = makeImage(STATS_IMAGE_SIZE);
+    uLongf packedLen = compressBound(image.size());
+    std::vector<uint8_t> packed(packedLen);
+    TEST_ASSERT_EQUAL(Z_OK, compress2(packed.data(), &packedLen, image.data(), image.size(), 9));
+    packed.resize(packedLen);
+
+    TEST_ASSERT_TRUE(OTAManager::startListener());
+    OTAStats before = OTAManager::getStats();
+    int ends = endCount;
+    TEST_ASSERT_TRUE(upload(packed));
+    waitFor(endCount, ends + 1);
+    OTAStats after = OTAManager::getStats();
+    OTAManager::stopListener();
+
+    // The wire carries the compressed file, flash gets the image
+    TEST_ASSERT_EQUAL(packed.size(), after.bytesReceived - before.bytesReceived);
+    TEST_ASSERT_EQUAL(STATS_IMAGE_SIZE, after.bytesWritten - before.bytesWritten);
+    TEST_ASSERT_EQUAL_MEMORY(image.data(), SimFlash.data(), image.size());
+}
+
+void test_snapshot_during_session() {
+    std::vector<uint8_t> image = makeImage(STATS_IMAGE_SIZE);
+    TEST_ASSERT_TRUE(OTAManager::startListener());
+    OTAStats before = OTAManager::getStats();
+    int ends = endCount;
+
+    // About half a second at 256 KB/s; the listener holds the OTA mutex throughout
+    std::thread uploader([&image]() { TEST_ASSERT_TRUE(upload(image, "secret", 0, 256)); });
+
+    bool sawActive = false;
+    uint32_t lastBytes = before.bytesReceived;
+    uint32_t snapshots = 0;
+    double slowestUs = 0;
+    while (endCount == ends) {
+        auto start = std::chrono::steady_clock::now();
+        OTAStats s = OTAManager::getStats();
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        slowestUs = us > slowestUs ? us : slowestUs;
+        snapshots++;
+        sawActive |= s.sessionActive;
+        TEST_ASSERT_TRUE(s.bytesReceived - lastBytes <= image.size());  // Never back, even across a wrap
+        lastBytes = s.bytesReceived;
+        delay(1);
+    }
+    uploader.join();
+    OTAManager::stopListener();
+
+    printf("%u snapshots during the session, slowest %.1f us\n", snapshots, slowestUs);
+    TEST_ASSERT_TRUE(sawActive);
+    TEST_ASSERT_TRUE(snapshots > 100);
+    TEST_ASSERT_TRUE(slowestUs < 10000);
+}
+
+// Main test runner
+int main() {
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    UNITY_BEGIN();
+
+    RUN_TEST(test_handle_updates_counters);
+    RUN_TEST(test_sessions_in_both_modes);
+    RUN_TEST(test_failures_by_error);
+    RUN_TEST(test_compressed_session_bytes);
+    RUN_TEST(test_snapshot_during_session);
+
+    return UNITY_END();
+}
@@ -0,0 +1,226 @@
+/**
+ * @file test_native_throughput.cpp
+ * @brief Transfer rate and ETA estimate (OTAThroughput)
+ *
+ * The estimator is driven by a fake microsecond clock: steady transfers, bursty
+ * reports as TCP reads produce them, a drop in link speed, a resumed session and
+ * a clock that wraps. The last tests push a rate-limited update and read the
+ * estimate through getStats() from the progress callback, in both forms.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <OTAManager.h>
+#include <OTAThroughput.h>
+#include <EspotaClient.h>
+#include <SimFlash.h>
+
+#include <atomic>
+#include <vector>
+
+#define HOST_TEST_PORT 13247
+#define CHUNK 1460
+
+// Drives an estimator with a fake clock, one CHUNK per report at bytesPerSecond
+struct FakeTransfer {
+    OTAThroughput& estimator;
+    uint64_t nowUs;
+    uint32_t bytes;
+
+    void run(uint32_t bytesPerSecond, uint32_t durationMs) {
+        uint64_t endUs = nowUs + (uint64_t)durationMs * 1000;
+        while (nowUs < endUs) {
+            bytes += CHUNK;
+            nowUs += (uint64_t)CHUNK * 1000000 / bytesPerSecond;
+            estimator.update((uint32_t)nowUs, bytes);
+        }
+    }
+};
+
+static void assertWithin(uint32_t expected, uint32_t actual, float tolerance) {
+    float delta = expected * tolerance;
+    TEST_ASSERT_FLOAT_WITHIN(delta, (float)expected, (float)actual);
+}
+
+static std::atomic<int> endCount{0};
+static std::atomic<int> progressReports{0};
+static std::atomic<uint32_t> lastEtaSeen{0};
+static std::atomic<bool> etaRose{false};
+static std::atomic<uint32_t> rateSeen{0};
+
+static bool hostNetworkReady() {
+    return true;
+}
+
+// Reads the estimate from inside the callback, where the OTA mutex is held
+static void onProgress(unsigned int progress, unsigned int total) {
+    OTAStats s = OTAManager::getStats();
+    TEST_ASSERT_EQUAL(progress, s.sessionBytes);
+    if (progress > total / 4 && s.etaMs != OTAThroughput::ETA_UNKNOWN) {
+        if (lastEtaSeen && s.etaMs > lastEtaSeen + 500) {
+            etaRose = true;
+        }
+        lastEtaSeen = s.etaMs;
+        rateSeen = s.currentRate;
+    }
+    progressReports++;
+}
+
+// The plain handler form reads the same estimate
+static void onProgressPlain(unsigned int progress, unsigned int total, void* context) {
+    (*(std::atomic<int>*)context)++;
+    onProgress(progress, total);
+}
+
+void setUp() {
+    TEST_ASSERT_TRUE(SimFlash.begin());
+}
+
+void tearDown() {}
+
+void test_steady_rate() {
+    OTAThroughput estimator(2000);
+    estimator.begin(0, 0, 1024 * 1024);
+    TEST_ASSERT_EQUAL(0, estimator.rate());
+    TEST_ASSERT_EQUAL(OTAThroughput::ETA_UNKNOWN, estimator.etaMs());
+
+    FakeTransfer t = {estimator, 0, 0};
+    t.run(100 * 1024, 3000);
+    assertWithin(100 * 1024, estimator.rate(), 0.01f);
+    assertWithin(100 * 1024, estimator.averageRate(), 0.01f);
+    uint32_t expectedEta = (uint64_t)(1024 * 1024 - t.bytes) * 1000 / (100 * 1024);
+    assertWithin(expectedEta, estimator.etaMs(), 0.02f);
+
+    t.run(100 * 1024, 20000);
+    TEST_ASSERT_TRUE(t.bytes >= 1024 * 1024);
+    TEST_ASSERT_EQUAL(0, estimator.etaMs());
+}
+
+void test_bursty_reports() {
+    // Four chunks back to back, then a pause: 200 KB/s on average
+    OTAThroughput estimator(2000);
+    estimator.begin(0, 0, 8 * 1024 * 1024);
+    uint64_t nowUs = 0;
+    uint32_t bytes = 0;
+    for (int burst = 0; burst < 400; burst++) {
+        for (int i = 0; i < 4; i++) {
+            bytes += CHUNK;
+            nowUs += 5;
+            estimator.update((uint32_t)nowUs, bytes);
+        }
+        nowUs += (uint64_t)4 * CHUNK * 1000000 / (200 * 1024) - 20;
+        estimator.update((uint32_t)nowUs, bytes);
+    }
+    // Weighting by time, not by report, keeps the fast reports from dominating
+    assertWithin(200 * 1024, estimator.rate(), 0.05f);
+    assertWithin(200 * 1024, estimator.averageRate(), 0.01f);
+}
+
+void test_follows_rate_change() {
+    OTAThroughput estimator(2000);
+    estimator.begin(0, 0, 64 * 1024 * 1024);
+    FakeTransfer t = {estimator, 0, 0};
+    t.run(400 * 1024, 10000);
+    assertWithin(400 * 1024, estimator.rate(), 0.01f);
+
+    // One time constant after the link slows to 100 KB/s, ~63% of the step is in
+    t.run(100 * 1024, 2000);
+    float expected = 400 * 1024 - 0.632f * 300 * 1024;
+    assertWithin((uint32_t)expected, estimator.rate(), 0.05f);
+
+    // Six time constants: settled, while the session average still lags far behind
+    t.run(100 * 1024, 10000);
+    assertWithin(100 * 1024, estimator.rate(), 0.02f);
+    TEST_ASSERT_TRUE(estimator.averageRate() > 200 * 1024);
+    uint32_t expectedEta = (uint64_t)(64 * 1024 * 1024 - t.bytes) * 1000 / (100 * 1024);
+    assertWithin(expectedEta, estimator.etaMs(), 0.02f);
+}
+
+void test_resumed_session_and_clock_wrap() {
+    // Starts 2 s before the 32-bit microsecond clock wraps, 512 KB already done
+    OTAThroughput estimator(2000);
+    uint64_t startUs = 0xFFFFFFFFULL - 2000000;
+    estimator.begin((uint32_t)startUs, 512 * 1024, 1024 * 1024);
+    FakeTransfer t = {estimator, startUs, 512 * 1024};
+    t.run(50 * 1024, 4000);
+
+    // Only the bytes of this session count towards the average
+    assertWithin(50 * 1024, estimator.averageRate(), 0.01f);
+    assertWithin(50 * 1024, estimator.rate(), 0.01f);
+    TEST_ASSERT_EQUAL(t.bytes, estimator.bytes());
+
+    // Progress going back restarts the measurement instead of reading as a huge rate
+    estimator.update((uint32_t)(t.nowUs + 1000), 0);
+    t.bytes = 0;
+    t.nowUs += 1000;
+    t.run(50 * 1024, 1000);
+    TEST_ASSERT_TRUE(estimator.rate() < 60 * 1024);
+}
+
+// Pushes a 192 KB image over a 256 KB/s link to the listener and checks the
+// estimate the progress callback read through getStats()
+static void uploadRateLimited() {
+    endCount = 0;
+    progressReports = 0;
+    lastEtaSeen = 0;
+    etaRose = false;
+    rateSeen = 0;
+    TEST_ASSERT_TRUE(OTAManager::startListener());
+
+    std::vector<uint8_t> image(192 * 1024);
+    for (size_t i = 0; i < image.size(); i++) {
+        image[i] = (uint8_t)(i * 13 + 1);
+    }
+    EspotaClient client("127.0.0.1", HOST_TEST_PORT);
+    client.setPassword("secret");
+    client.setRateLimitKBps(256);
+    EspotaResult result;
+    TEST_ASSERT_TRUE_MESSAGE(client.upload(image.data(), image.size(), &result), result.error);
+    for (int i = 0; i < 1000 && endCount == 0; i++) {
+        delay(1);
+    }
+    OTAManager::stopListener();
+    OTAStats s = OTAManager::getStats();
+
+    printf("256 KB/s link: recent %u B/s, average %u B/s, last session %u B/s, %d reports\n",
+           rateSeen.load(), s.averageRate, s.lastThroughput, progressReports.load());
+    TEST_ASSERT_EQUAL(1, endCount.load());
+    TEST_ASSERT_TRUE(progressReports > 10);
+    assertWithin(256 * 1024, rateSeen, 0.3f);
+    assertWithin(256 * 1024, s.averageRate, 0.3f);
+    TEST_ASSERT_FALSE(etaRose);
+    TEST_ASSERT_EQUAL(0, s.etaMs);
+    TEST_ASSERT_EQUAL(image.size(), s.sessionTotal);
+}
+
+void test_estimate_in_progress_callback() {
+    OTAManager::initialize("host-throughput", "secret", HOST_TEST_PORT, hostNetworkReady);
+    OTAManager::setEndCallback([]() { endCount++; });
+    OTAManager::setProgressCallback(onProgress);
+    uploadRateLimited();
+}
+
+void test_estimate_in_plain_progress_handler() {
+    static std::atomic<int> plainReports{0};
+    OTAManager::initialize("host-throughput", "secret", HOST_TEST_PORT, hostNetworkReady);
+    OTAManager::setEndCallback([]() { endCount++; });
+    OTAManager::setProgressCallback(onProgressPlain, &plainReports);
+    uploadRateLimited();
+    TEST_ASSERT_EQUAL(progressReports.load(), plainReports.load());
+}
+
+// Main test runner
+int main() {
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    UNITY_BEGIN();
+
+    RUN_TEST(test_steady_rate);
+    RUN_TEST(test_bursty_reports);
+    RUN_TEST(test_follows_rate_change);
+    RUN_TEST(test_resumed_session_and_clock_wrap);
+    RUN_TEST(test_estimate_in_progress_callback);
+    RUN_TEST(test_estimate_in_plain_progress_handler);
+
+    return UNITY_END();
+}
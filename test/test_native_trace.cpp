@@ -0,0 +1,312 @@
+/**
+ * @file test_native_trace.cpp
+ * @brief Session event trace (OTATrace, getTrace()) and its host decoder
+ *
+ * Checks the ring and the dump format, decodes a hand-made trace across a clock
+ * wrap, then traces real sessions: a listener update, an uploader that stalls
+ * onto slow flash until the device gives up, and a polling-mode update. Each
+ * trace is decoded and printed the way otatrace prints it.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <OTAManager.h>
+#include <EspotaClient.h>
+#include <SimFlash.h>
+#include <TraceDecoder.h>
+
+#include <atomic>
+#include <vector>
+
+#define HOST_TEST_PORT 13249
+#define TRACE_IMAGE_SIZE (128 * 1024)
+
+static std::atomic<int> endCount{0};
+static std::atomic<int> errorCount{0};
+static volatile bool pollerRunning = false;
+
+static bool hostNetworkReady() {
+    return true;
+}
+
+static void pollerTask(void* pvParameters) {
+    (void)pvParameters;
+    while (pollerRunning) {
+        OTAManager::handleUpdates();
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    vTaskDelete(NULL);
+}
+
+static std::vector<uint8_t> makeImage(size_t size) {
+    std::vector<uint8_t> image(size);
+    for (size_t i = 0; i < size; i++) {
+        image[i] = (uint8_t)(i * 17 + 5);
+    }
+    return image;
+}
+
+static void waitFor(std::atomic<int>& counter, int value) {
+    for (int i = 0; i < 3000 && counter < value; i++) {
+        delay(1);
+    }
+    TEST_ASSERT_EQUAL(value, counter.load());
+}
+
+static OtaTrace takeTrace() {
+    std::vector<uint8_t> dump(OTATrace::DUMP_SIZE);
+    size_t n = OTAManager::getTrace(dump.data(), dump.size());
+    OtaTrace trace;
+    TEST_ASSERT_TRUE(decodeOtaTrace(dump.data(), n, &trace));
+    printf("%s", formatOtaTrace(trace).c_str());
+    return trace;
+}
+
+static std::vector<uint8_t> eventsOf(const OtaTrace& trace, bool skipErases = false) {
+    std::vector<uint8_t> events;
+    for (const OtaTraceEvent& e : trace.events) {
+        if (!skipErases || (e.event != OTA_TRACE_ERASE_START && e.event != OTA_TRACE_ERASE_END)) {
+            events.push_back(e.event);
+        }
+    }
+    return events;
+}
+
+static size_t countOf(const OtaTrace& trace, uint8_t event) {
+    size_t n = 0;
+    for (const OtaTraceEvent& e : trace.events) {
+        n += e.event == event;
+    }
+    return n;
+}
+
+void setUp() {
+    TEST_ASSERT_TRUE(SimFlash.begin());
+}
+
+void tearDown() {}
+
+void test_ring_and_dump_format() {
+    TEST_ASSERT_EQUAL(8, OTATrace::RECORD_SIZE);
+    TEST_ASSERT_EQUAL(2 * OTA_TRACE_EVENTS * sizeof(uint32_t) + sizeof(uint32_t), sizeof(OTATrace));
+
+    static OTATrace ring;
+    std::vector<uint8_t> dump(OTATrace::DUMP_SIZE);
+    TEST_ASSERT_EQUAL(OTATrace::HEADER_SIZE, ring.dump(dump.data(), dump.size()));
+
+    ring.record(OTA_TRACE_INVITE, 1000, 10);
+    ring.record(OTA_TRACE_STALL, 0x12345678, 20);  // Clamped to 24 bits
+    size_t n = ring.dump(dump.data(), dump.size());
+    TEST_ASSERT_EQUAL(OTATrace::HEADER_SIZE + 2 * OTATrace::RECORD_SIZE, n);
+    const uint8_t expected[] = {'O', 'T', 'R', OTATrace::VERSION, 2, 0, 0, 0,
+                                10, 0, 0, 0, 0xE8, 0x03, 0x00, OTA_TRACE_INVITE,
+                                20, 0, 0, 0, 0xFF, 0xFF, 0xFF, OTA_TRACE_STALL};
+    TEST_ASSERT_EQUAL_MEMORY(expected, dump.data(), sizeof(expected));
+
+    // Past the capacity the oldest events go; the header still counts them
+    for (uint32_t i = 0; i < OTA_TRACE_EVENTS + 8; i++) {
+        ring.record(OTA_TRACE_CHUNK, i, 100 + i);
+    }
+    n = ring.dump(dump.data(), dump.size());
+    TEST_ASSERT_EQUAL(OTATrace::DUMP_SIZE, n);
+    TEST_ASSERT_EQUAL(n, ring.dumpSize());
+    OtaTrace trace;
+    TEST_ASSERT_TRUE(decodeOtaTrace(dump.data(), n, &trace));
+    TEST_ASSERT_EQUAL(OTA_TRACE_EVENTS + 10, trace.recorded);
+    TEST_ASSERT_EQUAL(OTA_TRACE_EVENTS, trace.events.size());
+    TEST_ASSERT_EQUAL(8, trace.events.front().arg);
+    TEST_ASSERT_EQUAL(OTA_TRACE_EVENTS + 7, trace.events.back().arg);
+
+    // Taken in odd-sized pieces, the dump is the same
+    std::vector<uint8_t> pieces;
+    uint8_t piece[7];
+    size_t got;
+    while ((got = ring.dump(piece, sizeof(piece), pieces.size())) > 0) {
+        pieces.insert(pieces.end(), piece, piece + got);
+    }
+    TEST_ASSERT_EQUAL(n, pieces.size());
+    TEST_ASSERT_EQUAL_MEMORY(dump.data(), pieces.data(), n);
+
+    ring.clear();
+    TEST_ASSERT_EQUAL(0, ring.recorded());
+    TEST_ASSERT_EQUAL(OTATrace::HEADER_SIZE, ring.dump(dump.data(), dump.size()));
+}
+
+void test_decoder_timelines() {
+    // Two sessions across the 32-bit micros() wrap; the first one stalls for 500 ms
+    static OTATrace ring;
+    uint32_t t = 0xFFFFFFFF - 300000;
+    ring.record(OTA_TRACE_INVITE, 4096, t);
+    ring.record(OTA_TRACE_AUTH_OK, 0, t + 2000);
+    ring.record(OTA_TRACE_CONNECTED, 0, t + 3000);
+    ring.record(OTA_TRACE_START, 1, t + 5000);
+    ring.record(OTA_TRACE_FIRST_BYTE, 1460, t + 6000);
+    ring.record(OTA_TRACE_ERASE_END, 0, t + 30000);
+    ring.record(OTA_TRACE_ERASE_START, 0, t + 10000);  // Recorded after the write, with its start time
+    ring.record(OTA_TRACE_STALL, 500, t + 530000);
+    ring.record(OTA_TRACE_ERROR, OTA_RECEIVE_ERROR, t + 531000);
+    ring.record(OTA_TRACE_START, 2, t + 900000);
+    ring.record(OTA_TRACE_END, 4096, t + 950000);
+
+    // As logTrace() writes it, inside log prefixes and other lines
+    std::string log = "[  1234][I][OTAManager.cpp:420] Trace: 11 events recorded, 96 bytes\n";
+    uint8_t bytes[32];
+    size_t n;
+    for (size_t offset = 0; (n = ring.dump(bytes, sizeof(bytes), offset)) > 0; offset += n) {
+        char line[128];
+        int len = snprintf(line, sizeof(line), "[  1234][I][OTAManager.cpp:436] Trace %04x: ", (unsigned)offset);
+        for (size_t i = 0; i < n; i++) {
+            len += snprintf(line + len, sizeof(line) - len, "%02x", bytes[i]);
+        }
+        log += line;
+        log += "\r\nunrelated line\n";
+    }
+    std::vector<uint8_t> dump;
+    TEST_ASSERT_TRUE(parseOtaTraceLog(log, &dump));
+    TEST_ASSERT_EQUAL(ring.dumpSize(), dump.size());
+
+    OtaTrace trace;
+    TEST_ASSERT_TRUE(decodeOtaTrace(dump.data(), dump.size(), &trace));
+    std::vector<OtaTraceSession> sessions = splitOtaTraceSessions(trace);
+    TEST_ASSERT_EQUAL(2, sessions.size());
+    TEST_ASSERT_FALSE(sessions[0].partial);
+    TEST_ASSERT_EQUAL(9, sessions[0].events.size());
+    TEST_ASSERT_EQUAL(2, sessions[1].events.size());
+
+    // Time order within a session, clock wrap unrolled
+    const std::vector<OtaTraceEvent>& first = sessions[0].events;
+    TEST_ASSERT_EQUAL(OTA_TRACE_ERASE_START, first[5].event);
+    TEST_ASSERT_EQUAL(OTA_TRACE_ERASE_END, first[6].event);
+    TEST_ASSERT_EQUAL(530000, first[7].timeUs - first[0].timeUs);
+    TEST_ASSERT_EQUAL(900000, sessions[1].events[0].timeUs - first[0].timeUs);
+
+    std::string text = formatOtaTrace(trace);
+    printf("%s", text.c_str());
+    TEST_ASSERT_TRUE(text.find("Largest gaps: 500.000 ms before STALL") != std::string::npos);
+    TEST_ASSERT_TRUE(text.find("receive (3)") != std::string::npos);
+
+    // A missing line is reported instead of decoding garbage
+    size_t second = log.find("Trace 0020");
+    std::string broken = log.substr(0, second) + log.substr(log.find('\n', second) + 1);
+    TEST_ASSERT_FALSE(parseOtaTraceLog(broken, &dump));
+}
+
+void test_listener_session() {
+    OTAManager::initialize("host-trace", "secret", HOST_TEST_PORT, hostNetworkReady);
+    OTAManager::setEndCallback([]() { endCount++; });
+    OTAManager::setErrorCallback([](ota_error_t) { errorCount++; });
+    TEST_ASSERT_TRUE(OTAManager::startListener());
+    OTAManager::clearTrace();
+
+    std::vector<uint8_t> image = makeImage(TRACE_IMAGE_SIZE);
+    EspotaClient client("127.0.0.1", HOST_TEST_PORT);
+    client.setPassword("secret");
+    EspotaResult result;
+    TEST_ASSERT_TRUE_MESSAGE(client.upload(image.data(), image.size(), &result), result.error);
+    waitFor(endCount, 1);
+    OTAManager::stopListener();
+
+    OtaTrace trace = takeTrace();
+    std::vector<uint8_t> events = eventsOf(trace, true);
+    const uint8_t opening[] = {OTA_TRACE_INVITE, OTA_TRACE_AUTH_OK, OTA_TRACE_CONNECTED, OTA_TRACE_START,
+                               OTA_TRACE_FIRST_BYTE};
+    TEST_ASSERT_TRUE(events.size() > sizeof(opening));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(opening, events.data(), sizeof(opening));
+    TEST_ASSERT_EQUAL(OTA_TRACE_END, events.back());
+    TEST_ASSERT_EQUAL(TRACE_IMAGE_SIZE, trace.events.back().arg);
+    TEST_ASSERT_EQUAL(TRACE_IMAGE_SIZE, trace.events.front().arg);
+
+    // One report per 1460-byte chunk after the first; every OTA_TRACE_CHUNK_INTERVAL-th is kept
+    size_t reports = (TRACE_IMAGE_SIZE + 1459) / 1460;
+    TEST_ASSERT_EQUAL(reports / OTA_TRACE_CHUNK_INTERVAL, countOf(trace, OTA_TRACE_CHUNK));
+
+    // Every OTA_TRACE_SECTOR_INTERVAL-th sector write, as a start and end pair
+    size_t sectors = TRACE_IMAGE_SIZE / SimFlashClass::SECTOR_SIZE;
+    size_t traced = (sectors + OTA_TRACE_SECTOR_INTERVAL - 1) / OTA_TRACE_SECTOR_INTERVAL;
+    TEST_ASSERT_EQUAL(traced, countOf(trace, OTA_TRACE_ERASE_START));
+    TEST_ASSERT_EQUAL(traced, countOf(trace, OTA_TRACE_ERASE_END));
+    TEST_ASSERT_EQUAL(0, countOf(trace, OTA_TRACE_STALL));
+    TEST_ASSERT_EQUAL(1, splitOtaTraceSessions(trace).size());
+}
+
+void test_stall_and_slow_flash() {
+    OTATuning tuning;
+    tuning.receiveTimeoutMs = 200;  // Give up on the stalled uploader quickly
+    OTAManager::initialize("host-trace", "secret", HOST_TEST_PORT, hostNetworkReady, tuning);
+    TEST_ASSERT_TRUE(OTAManager::startListener());
+    OTAManager::clearTrace();
+
+    // Every sector write is slow enough to be traced, whatever the interval
+    SimFlash.setTiming(OTA_TRACE_STALL_MS * 1000 + 20000, 0);
+    std::vector<uint8_t> image = makeImage(TRACE_IMAGE_SIZE);
+    EspotaClient client("127.0.0.1", HOST_TEST_PORT);
+    client.setPassword("secret");
+    client.setTimeoutMs(5000);
+    client.setCutAfter(6 * SimFlashClass::SECTOR_SIZE, true);
+    EspotaResult result;
+    TEST_ASSERT_FALSE(client.upload(image.data(), image.size(), &result));
+    waitFor(errorCount, 1);
+    OTAManager::stopListener();
+    SimFlash.setTiming(0, 0);
+
+    // The log lines carry the same dump
+    OTAManager::logTrace();
+    OtaTrace trace = takeTrace();
+    TEST_ASSERT_TRUE(countOf(trace, OTA_TRACE_ERASE_START) >= 5);
+    TEST_ASSERT_EQUAL(countOf(trace, OTA_TRACE_ERASE_START), countOf(trace, OTA_TRACE_ERASE_END));
+
+    // The receiver re-acknowledges three times before it gives up
+    TEST_ASSERT_EQUAL(4, countOf(trace, OTA_TRACE_STALL));
+    uint32_t lastStall = 0;
+    for (const OtaTraceEvent& e : trace.events) {
+        if (e.event == OTA_TRACE_STALL) {
+            TEST_ASSERT_TRUE(e.arg >= lastStall + 190);
+            lastStall = e.arg;
+        }
+    }
+    TEST_ASSERT_EQUAL(OTA_TRACE_ERROR, trace.events.back().event);
+    TEST_ASSERT_EQUAL(OTA_RECEIVE_ERROR, trace.events.back().arg);
+    TEST_ASSERT_EQUAL(0, countOf(trace, OTA_TRACE_END));
+}
+
+void test_polling_session() {
+    OTAManager::clearTrace();
+    pollerRunning = true;
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(pollerTask, "OTAPoll", 4096, NULL, 1, NULL));
+    std::vector<uint8_t> image = makeImage(TRACE_IMAGE_SIZE);
+    EspotaClient client("127.0.0.1", HOST_TEST_PORT);
+    client.setPassword("secret");
+    EspotaResult result;
+    int ends = endCount;
+    TEST_ASSERT_TRUE_MESSAGE(client.upload(image.data(), image.size(), &result), result.error);
+    waitFor(endCount, ends + 1);
+    pollerRunning = false;
+    delay(20);
+
+    // ArduinoOTA only exposes the session callbacks
+    OtaTrace trace = takeTrace();
+    std::vector<uint8_t> events = eventsOf(trace);
+    TEST_ASSERT_TRUE(events.size() >= 3);
+    TEST_ASSERT_EQUAL(OTA_TRACE_START, events[0]);
+    TEST_ASSERT_EQUAL(OTA_TRACE_FIRST_BYTE, events[1]);
+    TEST_ASSERT_EQUAL(OTA_TRACE_END, events.back());
+    TEST_ASSERT_EQUAL(0, countOf(trace, OTA_TRACE_INVITE));
+    TEST_ASSERT_EQUAL(0, countOf(trace, OTA_TRACE_ERASE_START));
+    TEST_ASSERT_EQUAL(1, splitOtaTraceSessions(trace).size());
+    TEST_ASSERT_FALSE(splitOtaTraceSessions(trace)[0].partial);
+}
+
+// Main test runner
+int main() {
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    UNITY_BEGIN();
+
+    RUN_TEST(test_ring_and_dump_format);
+    RUN_TEST(test_decoder_timelines);
+    RUN_TEST(test_listener_session);
+    RUN_TEST(test_stall_and_slow_flash);
+    RUN_TEST(test_polling_session);
+
+    return UNITY_END();
+}
@@ -0,0 +1,160 @@
+/**
+ * @file test_native_tuning.cpp
+ * @brief Data path tuning: validation against heap and a chunk size sweep
+ *
+ * The sweep pushes the same image through the listener with different receive
+ * chunk sizes, once with flash latency disabled (network/CPU-bound) and once with
+ * ESP32-like erase/program times. The printed table is meant for choosing
+ * per-board defaults; override the BENCH_* macros to model other flash parts or
+ * links.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <OTAManager.h>
+#include <EspotaClient.h>
+#include <SimFlash.h>
+
+#include <vector>
+
+#define HOST_TEST_PORT 13235
+
+#ifndef BENCH_IMAGE_SIZE
+#define BENCH_IMAGE_SIZE (192 * 1024)
+#endif
+#ifndef BENCH_ERASE_US
+#define BENCH_ERASE_US 6000
+#endif
+#ifndef BENCH_PROGRAM_US_PER_KB
+#define BENCH_PROGRAM_US_PER_KB 2500
+#endif
+// 100 Mbit/s Ethernet (LAN8720)
+#ifndef BENCH_LINK_KBPS
+#define BENCH_LINK_KBPS 12000
+#endif
+
+static bool hostNetworkReady() {
+    return true;
+}
+
+static std::vector<uint8_t> makeImage(size_t size) {
+    std::vector<uint8_t> image(size);
+    uint32_t x = 7;
+    for (size_t i = 0; i < size; i++) {
+        x = x * 1103515245u + 12345u;
+        image[i] = (uint8_t)(x >> 16);
+    }
+    return image;
+}
+
+static void initWith(const OTATuning& tuning) {
+    OTAManager::initialize("host-tuning", "", HOST_TEST_PORT, hostNetworkReady, tuning);
+}
+
+void setUp() {
+    ESP.setHeapForTest(200 * 1024, 110 * 1024);
+}
+
+void tearDown() {
+    SimFlash.setTiming(0, 0);
+    ESP.setHeapForTest(200 * 1024, 110 * 1024);
+}
+
+void test_tuning_defaults_from_config() {
+    initWith(OTATuning());
+    OTATuning t = OTAManager::getTuning();
+    TEST_ASSERT_EQUAL(OTA_RECEIVE_CHUNK_SIZE, t.chunkSize);
+    TEST_ASSERT_EQUAL(OTA_SOCKET_RX_BUFFER, t.socketRxBuffer);
+    TEST_ASSERT_EQUAL(OTA_PIPELINE_BUFFER_SIZE, t.pipelineBufferSize);
+    TEST_ASSERT_EQUAL(OTA_PIPELINE_BUFFERS, t.pipelineBuffers);
+    TEST_ASSERT_EQUAL(OTA_RECEIVE_TIMEOUT_MS, t.receiveTimeoutMs);
+}
+
+void test_tuning_clamped_to_bounds() {
+    ESP.setHeapForTest(4 * 1024 * 1024, 4 * 1024 * 1024);
+    OTATuning req;
+    req.chunkSize = 16;
+    req.socketRxBuffer = 1024 * 1024;
+    req.pipelineBufferSize = 1024 * 1024;
+    req.pipelineBuffers = 1;
+    initWith(req);
+
+    OTATuning t = OTAManager::getTuning();
+    TEST_ASSERT_EQUAL(OTA_RECEIVE_CHUNK_MIN, t.chunkSize);
+    TEST_ASSERT_EQUAL(OTA_SOCKET_RX_BUFFER_MAX, t.socketRxBuffer);
+    TEST_ASSERT_EQUAL(OTA_PIPELINE_BUFFER_MAX, t.pipelineBufferSize);
+    TEST_ASSERT_EQUAL(2, t.pipelineBuffers);
+}
+
+void test_tuning_fits_available_heap() {
+    const uint32_t freeHeap = 96 * 1024;
+    const uint32_t maxAlloc = 40 * 1024;
+    ESP.setHeapForTest(freeHeap, maxAlloc);
+    OTATuning req;
+    req.chunkSize = 8192;
+    req.socketRxBuffer = 32768;
+    req.pipelineBufferSize = 16384;
+    req.pipelineBuffers = 8;
+    initWith(req);
+
+    OTATuning t = OTAManager::getTuning();
+    TEST_ASSERT_TRUE(t.sessionHeapBytes() <= freeHeap - OTA_TUNING_HEAP_RESERVE);
+    TEST_ASSERT_TRUE(t.pipelineBufferSize * t.pipelineBuffers <= maxAlloc);
+    TEST_ASSERT_GREATER_OR_EQUAL(2, t.pipelineBuffers);
+    // Pipeline memory is given up before the receive chunk
+    TEST_ASSERT_EQUAL(8192, t.chunkSize);
+}
+
+static double sweepOnce(const std::vector<uint8_t>& image, uint32_t chunk, bool flashLatency) {
+    OTATuning tuning;
+    tuning.chunkSize = chunk;
+    initWith(tuning);
+    TEST_ASSERT_EQUAL(chunk, OTAManager::getTuning().chunkSize);
+
+    TEST_ASSERT_TRUE(SimFlash.begin());
+    if (flashLatency) {
+        SimFlash.setTiming(BENCH_ERASE_US, BENCH_PROGRAM_US_PER_KB);
+    }
+    EspotaClient client("127.0.0.1", HOST_TEST_PORT);
+    client.setLockstep(false);
+    client.setRateLimitKBps(BENCH_LINK_KBPS);
+    EspotaResult result;
+    TEST_ASSERT_TRUE_MESSAGE(client.upload(image.data(), image.size(), &result), result.error);
+    TEST_ASSERT_EQUAL_MEMORY(image.data(), SimFlash.data(), image.size());
+    SimFlash.setTiming(0, 0);
+    return image.size() / 1024.0 / (result.transferUs / 1e6);
+}
+
+void test_chunk_size_sweep() {
+    static const uint32_t chunks[] = {512, 1460, 2920, 5840, 11680};
+    std::vector<uint8_t> image = makeImage(BENCH_IMAGE_SIZE);
+
+    OTAManager::initialize("host-tuning", "", HOST_TEST_PORT, hostNetworkReady);
+    OTAManager::setEndCallback([]() {});
+    TEST_ASSERT_TRUE(OTAManager::startListener());
+
+    printf("Chunk size sweep: %d KB image, link %d KB/s, flash %d us/erase + %d us/KB\n",
+           BENCH_IMAGE_SIZE / 1024, BENCH_LINK_KBPS, BENCH_ERASE_US, BENCH_PROGRAM_US_PER_KB);
+    printf("  %8s %16s %16s\n", "chunk", "no flash KB/s", "sim flash KB/s");
+    for (uint32_t chunk : chunks) {
+        double fast = sweepOnce(image, chunk, false);
+        double slow = sweepOnce(image, chunk, true);
+        printf("  %8u %16.0f %16.0f\n", (unsigned)chunk, fast, slow);
+    }
+
+    OTAManager::stopListener();
+}
+
+// Main test runner
+int main() {
+    esp_log_level_set("*", ESP_LOG_ERROR);
+
+    UNITY_BEGIN();
+
+    RUN_TEST(test_tuning_defaults_from_config);
+    RUN_TEST(test_tuning_clamped_to_bounds);
+    RUN_TEST(test_tuning_fits_available_heap);
+    RUN_TEST(test_chunk_size_sweep);
+
+    return UNITY_END();
+}